@@ -4,7 +4,6 @@
 
 #include <ratr0/ratr0.h>
 #include <clib/graphics_protos.h>
-#include "default_copper.h"
 #include "inv_main_stage.h"
 
 static Ratr0Engine *engine;
@@ -48,9 +47,7 @@ void main_stage_update(struct Ratr0Stage *this_stage,
     }
 
     // TEST: blit
-    OwnBlitter();
     ratr0_blit_rect_1plane(&backbuffer->surface, &bobs2_sheet, 0, 0, 0, 0);
-    DisownBlitter();
 }
 
 void copy_sprite(UINT16 *dst, UINT16 *src, UINT16 spr_height)
@@ -65,7 +62,6 @@ void copy_sprite(UINT16 *dst, UINT16 *src, UINT16 spr_height)
 }
 
 
-extern struct Ratr0CopperListInfo DEFAULT_COPPER_INFO;
 /**
  * We need to copy the alien sheet to a long strip of aliens
  */
@@ -110,9 +106,8 @@ void copy_spritesheet_to_sprite()
     for (int i = 0; i < 3; i++) {
         ratr0_sprites_set_pos(new_sprite[i], sprite_pos[i][0], sprite_pos[i][1], sprite_pos[i][1] + spr_height);
     }
-    // TODO: Point to default copper list
-    ratr0_display_set_sprite(default_copper, DEFAULT_COPPER_SIZE_WORDS,
-                             &DEFAULT_COPPER_INFO,
+    ratr0_display_set_sprite(current_coplist, current_coplist_size,
+                             current_copper_info,
                              0, new_sprite[0]);
 }
 
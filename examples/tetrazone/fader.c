@@ -1,21 +0,0 @@
-#include "fader.h"
-
-#ifdef DEBUG
-#include <stdio.h>
-extern FILE *debug_fp;
-#endif
-
-/*
-UINT16 fader_data[5][3] = {
-    { 0x0fff, 0xfff, 0xfff },
-    { 0x0fff, 0xfff, 0xfff },
-    { 0x0fff, 0xfff, 0xfff },
-    { 0x0fff, 0xfff, 0xfff },
-    { 0x0fff, 0xfff, 0xfff }
-};
-
-struct FaderData myfader = {
-    5, 5, fader_data
-};
-
-*/
@@ -84,14 +84,22 @@ UINT16 ghost_piece_colors[NUM_GHOST_PIECE_COLORS] = {
     0x707, 0xa0a, 0xf0f, 0xa0a
 };
 UINT8 current_ghost_piece_color = 0;
+// set by the timer interrupt, the copper list is only changed in the update
+volatile BOOL ghost_piece_color_changed = FALSE;
 
 void change_ghost_piece_color(void)
 {
-    // TODO: modify the palette color 17
+    ghost_piece_color_changed = TRUE;
+}
+
+void update_ghost_piece_color(void)
+{
+    if (!ghost_piece_color_changed) return;
+    ghost_piece_color_changed = FALSE;
     // default is f0f
     UINT16 color = ghost_piece_colors[current_ghost_piece_color++];
     current_ghost_piece_color %= NUM_GHOST_PIECE_COLORS;
-    current_coplist[current_copper_info->color00_index + 17 * 2] = color;
+    ratr0_display_set_palette(&color, 1, 17);
 }
 
 /**
@@ -459,6 +467,7 @@ void main_stage_update(struct Ratr0Stage *this_stage,
     if (move_cooldown > 0) move_cooldown--;
     if (rotate_cooldown > 0) rotate_cooldown--;
     if (quickdrop_cooldown > 0) quickdrop_cooldown--;
+    update_ghost_piece_color();
     if (toggle_music_cooldown > 0) toggle_music_cooldown--;
 
     // Input processing
@@ -876,9 +885,6 @@ void main_stage_on_exit(struct Ratr0Stage *this_stage)
 
     // clear all rendering related queues
     clear_render_queues();
-
-    // free the timer
-    ratr0_timers_free(outline_timer);
 }
 
 struct Ratr0Stage *setup_main_stage(Ratr0Engine *eng)
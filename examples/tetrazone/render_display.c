@@ -96,7 +96,6 @@ void process_blit_queues(struct Ratr0DisplayBuffer *backbuffer,
     struct RotationSpec *queued_spec;
     struct Ratr0Surface *backbuffer_surface = &backbuffer->surface;
     int cur_buffer = backbuffer->buffernum;
-    OwnBlitter();
     // 1. Clear queue to clean up pieces from the previous render pass
     while (clear_piece_queue_num_elems[cur_buffer] > 0) {
         RATR0_DEQUEUE_ARR(piece_queue_item, clear_piece_queue, cur_buffer);
@@ -129,7 +128,6 @@ void process_blit_queues(struct Ratr0DisplayBuffer *backbuffer,
     }
     render_preview_queues(backbuffer, preview_surface, cur_buffer);
     render_score_queues(backbuffer, digits16_surface, digits_surface, cur_buffer);
-    DisownBlitter();
 }
 
 void render_preview_queues(struct Ratr0DisplayBuffer *backbuffer,
@@ -209,12 +207,10 @@ void process_move_queue(struct Ratr0DisplayBuffer *backbuffer)
     struct MoveQueueItem item;
     struct Ratr0Surface *backbuffer_surface = &backbuffer->surface;
     int cur_buffer = backbuffer->buffernum;
-    OwnBlitter();
     while (move_queue_num_elems[cur_buffer] > 0) {
         RATR0_DEQUEUE_ARR(item, move_queue, cur_buffer);
         _move_board_rect(backbuffer_surface, item.from, item.to, item.num_rows);
     }
-    DisownBlitter();
 }
 
 void clear_render_queues(void)
@@ -11,6 +11,7 @@
 static Ratr0Engine *engine = NULL;
 extern struct Ratr0Stage *main_stage, *title_screen, *hiscore_screen;
 extern struct Ratr0CopperListInfo DEFAULT_COPPER_INFO;
+extern struct Ratr0FadeTable title_fade_in;
 
 extern RATR0_ACTION_ID action_quit, action_drop;
 
@@ -20,6 +21,7 @@ struct Ratr0TileSheet titlescreen_ts;
 static BOOL title_screen_first_update = FALSE;
 static UINT16 title_screen_timeout = 0;
 static UINT16 title_screen_space_cooldown = 0;
+static struct Ratr0Fader title_fader;
 #define TITLE_SCREEN_TIMEOUT (200)
 #define TITLE_SCREEN_SPACE_COOLDOWN (20)
 void title_screen_update(struct Ratr0Stage *this_stage,
@@ -29,6 +31,7 @@ void title_screen_update(struct Ratr0Stage *this_stage,
         title_screen_timeout = TITLE_SCREEN_TIMEOUT;
     }
     title_screen_timeout--;
+    ratr0_fader_update(&title_fader);
     if (title_screen_space_cooldown > 0) {
         title_screen_space_cooldown--;
     }
@@ -52,7 +55,8 @@ static void _load_resources(void)
     BOOL ts_read = ratr0_resources_read_tilesheet(TITLE_PATH_PAL, &titlescreen_ts);
     ratr0_resources_init_surface_from_tilesheet(&bg_surf, &titlescreen_ts);
     ratr0_display_blit_surface_to_buffers(&bg_surf, 0, 0, 0);
-    ratr0_display_set_palette(titlescreen_ts.palette, 32, 0);
+    // the palette fades in from black
+    ratr0_fader_start(&title_fader, &title_fade_in, 2, FALSE);
 
     // from here we don't need to the memory for the background
     // anymore, we can free the surface and tilesheet
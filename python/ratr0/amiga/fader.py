@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+
+"""
+ratr0-fader bakes the palettes of a fade into a C file, so a game can play
+the fade with a Ratr0Fader without computing anything.
+
+The start and end palettes are either RATR0 tile sheet files (.ts) or
+comma separated lists of RGB4 colors, e.g. 0x000,0xfff. A missing palette
+is black, so
+
+    ratr0-fader --to assets/title_screen.ts --name title_fade_in title_fade.c
+
+creates a fade in from black. The interpolation is linear per component
+and matches ratr0_fader_mix_color(), halves are rounded away from the start
+color.
+"""
+import argparse
+import struct
+
+DESCRIPTION = """ratr0-fader - generate fade tables
+"""
+
+# palette size and the palette in a tile sheet file
+TS_PALETTE_SIZE_OFFSET = 24
+TS_PALETTE_OFFSET = 32
+
+
+def read_palette(spec):
+    """reads a palette from a tile sheet or a color list"""
+    if spec.endswith(".ts"):
+        with open(spec, "rb") as infile:
+            data = infile.read()
+        size = struct.unpack_from(">H", data, TS_PALETTE_SIZE_OFFSET)[0]
+        return list(struct.unpack_from(">%dH" % size, data, TS_PALETTE_OFFSET))
+    return [int(color, 0) & 0xfff for color in spec.split(",")]
+
+
+def scale_rounded(n, last):
+    """n / last rounded to the nearest integer, halves away from 0"""
+    delta = (2 * abs(n) + last) // (2 * last)
+    return delta if n >= 0 else -delta
+
+
+def mix_color(start, end, step, num_steps):
+    last = num_steps - 1
+    if last <= 0:
+        return start
+    color = 0
+    for shift in (0, 4, 8):
+        c0 = (start >> shift) & 0xf
+        c1 = (end >> shift) & 0xf
+        color |= (c0 + scale_rounded((c1 - c0) * step, last)) << shift
+    return color
+
+
+def fade_table(start, end, num_steps):
+    return [[mix_color(c0, c1, step, num_steps) for c0, c1 in zip(start, end)]
+            for step in range(num_steps)]
+
+
+def write_table(outfile, name, first_color, steps):
+    outfile.write("/* generated by ratr0-fader, don't edit */\n")
+    outfile.write("#include <ratr0/fader.h>\n\n")
+    outfile.write("static UINT16 %s_colors[] = {\n" % name)
+    for colors in steps:
+        for i in range(0, len(colors), 8):
+            outfile.write("    %s,\n" % ", ".join(["0x%03x" % color for color in colors[i:i + 8]]))
+    outfile.write("};\n\n")
+    outfile.write("struct Ratr0FadeTable %s = {\n" % name)
+    outfile.write("    %d, %d, %d, %s_colors, -1\n" % (first_color, len(steps[0]),
+                                                      len(steps), name))
+    outfile.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     description=DESCRIPTION)
+    parser.add_argument("outfile", help="output C file")
+    parser.add_argument("--name", required=True, help="name of the Ratr0FadeTable")
+    parser.add_argument("--from", dest="start", help="start palette, default: black")
+    parser.add_argument("--to", dest="end", help="end palette, default: black")
+    parser.add_argument("--first", type=int, default=0,
+                        help="first color of the range in the palettes, default: 0")
+    parser.add_argument("--numcolors", type=int,
+                        help="number of colors in the range, default: the rest of the palette")
+    parser.add_argument("--numsteps", type=int, default=16,
+                        help="number of steps including start and end, default: 16")
+    args = parser.parse_args()
+
+    if args.start is None and args.end is None:
+        parser.error("at least one of --from and --to is needed")
+    if args.numsteps < 2:
+        parser.error("a fade has at least 2 steps")
+    start = read_palette(args.start) if args.start else None
+    end = read_palette(args.end) if args.end else None
+    palette_size = len(start if start is not None else end)
+    num_colors = args.numcolors if args.numcolors else palette_size - args.first
+    if start is None:
+        start = [0] * palette_size
+    if end is None:
+        end = [0] * palette_size
+    if args.first + num_colors > min(len(start), len(end)) or num_colors <= 0:
+        parser.error("the palettes don't have colors %d to %d" %
+                     (args.first, args.first + num_colors - 1))
+
+    colors = slice(args.first, args.first + num_colors)
+    with open(args.outfile, "w") as outfile:
+        write_table(outfile, args.name, args.first,
+                    fade_table(start[colors], end[colors], args.numsteps))
+
+
+if __name__ == "__main__":
+    main()
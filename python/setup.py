@@ -50,4 +50,7 @@ if __name__ == '__main__':
           classifiers=CLASSIFIERS,
           install_requires=INSTALL_REQUIRES,
           include_package_data=True, package_data=PACKAGE_DATA,
-          scripts=[])
+          scripts=[],
+          entry_points={
+              'console_scripts': ['ratr0-fader=ratr0.amiga.fader:main']
+          })
@@ -49,14 +49,14 @@ void ratr0_audio_play_sound(struct Ratr0AudioSample *sample, INT8 channel)
     mt_playfx(&custom, &sound_fx);
 }
 
-#define AUDIO_DEFAULT_MOD_SAMPLES (NULL)
 #define AUDIO_DEFAULT_MOD_START (0)
 
 void ratr0_audio_play_mod(struct Ratr0AudioProtrackerMod *mod)
 {
     void *mod_data = ratr0_memory_block_address(mod->h_data);
-    mt_init(&custom, mod_data, AUDIO_DEFAULT_MOD_SAMPLES,
-            AUDIO_DEFAULT_MOD_START);
+    // NULL tells the player that the samples follow the patterns
+    void *sample_data = mod->h_samples ? ratr0_memory_block_address(mod->h_samples) : NULL;
+    mt_init(&custom, mod_data, sample_data, AUDIO_DEFAULT_MOD_START);
     mt_Enable = 1;
 }
 
@@ -1,6 +1,13 @@
 /** @file blitter.c */
+#ifdef AMIGA
+#include <exec/interrupts.h>
 #include <hardware/custom.h>
+#include <hardware/intbits.h>
+#include <clib/exec_protos.h>
 #include <clib/graphics_protos.h>
+#else
+#include <ratr0/blitter_emu.h>
+#endif
 
 #include <ratr0/debug_utils.h>
 #include <ratr0/resources.h>
@@ -12,20 +19,190 @@
 extern struct Custom custom;
 static Ratr0Engine *engine;
 
+// Blit budget accounting
+static UINT32 frame_budget;
+static Ratr0BlitSite current_site;
+static struct Ratr0BlitFrameStats frame_stats;
+static struct Ratr0BlitProfile profile;
+
+/*
+ * Blit queue: a ring buffer of prepared blits. The main program appends at
+ * queue_tail, the blitter interrupt takes them from queue_head. Each index
+ * is only written by one side, queue_active is TRUE while the interrupt
+ * chains blits.
+ */
+#define BLIT_QUEUE_SIZE (128)
+static struct Ratr0BlitDescriptor blit_queue[BLIT_QUEUE_SIZE];
+static volatile UINT16 queue_head, queue_tail;
+static volatile BOOL queue_active;
+
+// nesting depth of ratr0_blitter_own()
+static UINT16 own_depth;
+
+#ifdef AMIGA
+static struct Interrupt blit_interrupt;
+static struct Interrupt *old_blit_interrupt;
+#endif
+
+/*
+ * Adds the estimated cost of a blit to the current frame. Only the channel
+ * enable bits of bltcon0 are needed.
+ */
+static void _count_blit(UINT16 bltcon0, UINT16 bltsize)
+{
+    UINT32 cycles = ratr0_blitter_blit_cycles(bltcon0, bltsize);
+    frame_stats.cycles += cycles;
+    frame_stats.num_blits++;
+    frame_stats.sites[current_site].cycles += cycles;
+    frame_stats.sites[current_site].num_blits++;
+}
+
+/*
+ * Starts a blit by writing BLTSIZE and counts its cost.
+ */
+static void _start_blit(UINT16 bltcon0, UINT16 bltsize)
+{
+    _count_blit(bltcon0, bltsize);
+    custom.bltsize = bltsize;
+}
+
+/*
+ * Waits until the blitter can be programmed directly, which is when the
+ * queue is empty and the last blit is finished.
+ */
+static void _wait_blitter(void)
+{
+    while (queue_active) WaitBlit();
+    WaitBlit();
+}
+
+static void _write_registers(struct Ratr0BlitDescriptor *desc)
+{
+    custom.bltcon0 = desc->bltcon0;
+    custom.bltcon1 = desc->bltcon1;
+    custom.bltafwm = desc->bltafwm;
+    custom.bltalwm = desc->bltalwm;
+    custom.bltamod = desc->bltamod;
+    custom.bltbmod = desc->bltbmod;
+    custom.bltcmod = desc->bltcmod;
+    custom.bltdmod = desc->bltdmod;
+    custom.bltapt = desc->bltapt;
+    custom.bltbpt = desc->bltbpt;
+    custom.bltcpt = desc->bltcpt;
+    custom.bltdpt = desc->bltdpt;
+    custom.bltadat = desc->bltadat;
+    custom.bltsize = desc->bltsize;
+}
+
+/* Runs a prepared blit right away */
+static void _run_blit(struct Ratr0BlitDescriptor *desc)
+{
+    _wait_blitter();
+    _count_blit(desc->bltcon0, desc->bltsize);
+    _write_registers(desc);
+}
+
+/*
+ * Blitter interrupt: the last blit is finished, start the next one from
+ * the queue.
+ */
+static void BlitterInterrupt(void)
+{
+    custom.intreq = INTF_BLIT;
+    if (queue_head != queue_tail) {
+        _write_registers(&blit_queue[queue_head]);
+        queue_head = (queue_head + 1) % BLIT_QUEUE_SIZE;
+    } else {
+        queue_active = FALSE;
+    }
+}
+
+void ratr0_blit_enqueue(struct Ratr0BlitDescriptor *desc)
+{
+    UINT16 next_tail = (queue_tail + 1) % BLIT_QUEUE_SIZE;
+    // queue is full: every finished blit frees an entry
+    while (next_tail == queue_head) WaitBlit();
+    _count_blit(desc->bltcon0, desc->bltsize);
+
+    // the interrupt must not look at the queue while we change it
+    custom.intena = INTF_BLIT;
+    if (queue_active) {
+        blit_queue[queue_tail] = *desc;
+        queue_tail = next_tail;
+    } else {
+        // start the chain, a direct blit might still be running and its
+        // interrupt request must not end the chain
+        WaitBlit();
+        custom.intreq = INTF_BLIT;
+        queue_active = TRUE;
+        _write_registers(desc);
+    }
+    custom.intena = INTF_SETCLR | INTF_BLIT;
+}
 
-void _blit_object_nonil(UINT32 dst_addr, UINT32 src_addr, UINT32 mask_addr,
+void ratr0_blitter_wait_queue(void)
+{
+    while (queue_active) WaitBlit();
+}
+
+void ratr0_blitter_own(void)
+{
+#ifdef AMIGA
+    if (own_depth == 0) OwnBlitter();
+#endif
+    own_depth++;
+}
+
+void ratr0_blitter_disown(void)
+{
+    if (--own_depth > 0) return;
+#ifdef AMIGA
+    DisownBlitter();
+#endif
+}
+
+
+void _blit_object_nonil(UINTPTR dst_addr, UINTPTR src_addr, UINTPTR mask_addr,
                         UINT16 dstmod, UINT16 srcmod,
                         UINT8 num_planes,
                         UINT16 dst_row_bytes, UINT16 src_plane_size,
                         INT8 dst_shift, UINT16 alwm, UINT16 bltsize);
 
-void _blit_object_il(UINT32 dst_addr, UINT32 src_addr, UINT32 mask_addr,
-                     UINT16 dstmod, UINT16 srcmod,
-                     INT8 dst_shift, UINT16 alwm, UINT16 bltsize);
 
 void ratr0_blitter_startup(Ratr0Engine *eng)
 {
     engine = eng;
+    frame_budget = 0;
+    current_site = RATR0_BLIT_SITE_OTHER;
+    ratr0_blitter_reset_profile();
+    ratr0_blitter_flush_cache();
+
+    queue_head = queue_tail = 0;
+    queue_active = FALSE;
+    own_depth = 0;
+#ifdef AMIGA
+    // The blitter interrupt is not a server chain, so we replace the
+    // handler and restore the system's at shutdown
+    blit_interrupt.is_Node.ln_Type = NT_INTERRUPT;
+    blit_interrupt.is_Node.ln_Pri = 0;
+    blit_interrupt.is_Node.ln_Name = "ratr0blit";
+    blit_interrupt.is_Data = (APTR) NULL;
+    blit_interrupt.is_Code = (void (*)()) BlitterInterrupt;
+    old_blit_interrupt = SetIntVector(INTB_BLIT, &blit_interrupt);
+#else
+    ratr0_blitter_emu_set_interrupt(BlitterInterrupt);
+#endif
+}
+
+void ratr0_blitter_shutdown(void)
+{
+    ratr0_blitter_wait_queue();
+    custom.intena = INTF_BLIT;
+#ifdef AMIGA
+    SetIntVector(INTB_BLIT, old_blit_interrupt);
+#else
+    ratr0_blitter_emu_set_interrupt(NULL);
+#endif
 }
 
 /**
@@ -38,30 +215,39 @@ void ratr0_blitter_startup(Ratr0Engine *eng)
  *   - dst is aligned on a 16 bit boundary and is larger than the blit width
  *   - both src and dst have the same depth
  */
-UINT16 _blit_rect_simple(UINT32 dst_addr, UINT32 src_addr, UINT16 dstmod,
-                         UINT16 srcmod,
-                         UINT16 bltsize,
-                         BOOL reversed)
+static void _describe_rect_simple(struct Ratr0BlitDescriptor *desc,
+                                  UINTPTR dst_addr, UINTPTR src_addr, UINT16 dstmod,
+                                  UINT16 srcmod, UINT16 bltsize, BOOL reversed)
 {
-    WaitBlit();
     // D = A => LF = 0xf0, channels A and D turned on => 0x09
-    custom.bltcon0 = 0x09f0;
+    desc->bltcon0 = 0x09f0;
     // copy direction
-    custom.bltcon1 = reversed ? 2 : 0;
-
-    custom.bltafwm = 0xffff;
-    custom.bltalwm = 0xffff;
-
-    custom.bltamod = srcmod;
-    custom.bltbmod = 0;
-    custom.bltcmod = 0;
-    custom.bltdmod = dstmod;
+    desc->bltcon1 = reversed ? 2 : 0;
+
+    desc->bltafwm = 0xffff;
+    desc->bltalwm = 0xffff;
+
+    desc->bltamod = srcmod;
+    desc->bltbmod = 0;
+    desc->bltcmod = 0;
+    desc->bltdmod = dstmod;
+
+    desc->bltapt = (UINT8 *) src_addr;
+    desc->bltbpt = 0;
+    desc->bltcpt = 0;
+    desc->bltdpt = (UINT8 *) dst_addr;
+    desc->bltadat = 0;
+    desc->bltsize = bltsize;
+}
 
-    custom.bltapt = (UINT8 *) src_addr;
-    custom.bltbpt = 0;
-    custom.bltcpt = 0;
-    custom.bltdpt = (UINT8 *) dst_addr;
-    custom.bltsize = bltsize;
+UINT16 _blit_rect_simple(UINTPTR dst_addr, UINTPTR src_addr, UINT16 dstmod,
+                         UINT16 srcmod,
+                         UINT16 bltsize,
+                         BOOL reversed)
+{
+    struct Ratr0BlitDescriptor desc;
+    _describe_rect_simple(&desc, dst_addr, src_addr, dstmod, srcmod, bltsize, reversed);
+    _run_blit(&desc);
     return bltsize;
 }
 
@@ -70,12 +256,38 @@ UINT16 _blit_rect_simple(UINT32 dst_addr, UINT32 src_addr, UINT16 dstmod,
  * destination. In this case we only have to specify the source and
  * and destination address and set the blit size only for starting the blit
  */
-void _blit_rect_simple2(UINT32 dst_addr, UINT32 src_addr, UINT16 bltsize)
+void _blit_rect_simple2(UINTPTR dst_addr, UINTPTR src_addr, UINT16 bltsize)
 {
-    WaitBlit();
+    _wait_blitter();
     custom.bltapt = (UINT8 *) src_addr;
     custom.bltdpt = (UINT8 *) dst_addr;
-    custom.bltsize = bltsize;
+    _start_blit(0x0900, bltsize);
+}
+
+void ratr0_blit_prepare_rect_simple(struct Ratr0BlitDescriptor *desc,
+                                    struct Ratr0Surface *dst,
+                                    struct Ratr0Surface *src,
+                                    UINT16 dstx, UINT16 dsty, UINT16 srcx, UINT16 srcy,
+                                    UINT16 blit_width_pixels, UINT16 blit_height_pixels)
+{
+    UINT16 blit_width_words = blit_width_pixels >> 4;
+    UINT16 src_width_bytes = src->width >> 3;
+    UINT16 dst_width_bytes = dst->width >> 3;
+    UINT16 srcmod = src_width_bytes - (blit_width_words << 1);
+    UINT16 dstmod = dst_width_bytes - (blit_width_words << 1);
+    UINTPTR src_addr = ((UINTPTR) src->buffer) + (src_width_bytes * srcy * src->depth) + (srcx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+
+    // see ratr0_blit_rect_simple() for the direction
+    BOOL reversed = dsty > srcy && dsty <= srcy + blit_height_pixels;
+    if (reversed) {
+        src_addr += blit_height_pixels * src_width_bytes * src->depth;
+        src_addr -= (srcmod + 2);
+        dst_addr += blit_height_pixels * dst_width_bytes * dst->depth;
+        dst_addr -= (dstmod + 2);
+    }
+    UINT16 bltsize = (UINT16) ((blit_height_pixels * src->depth) << 6) | blit_width_words;
+    _describe_rect_simple(desc, dst_addr, src_addr, dstmod, srcmod, bltsize, reversed);
 }
 
 UINT16 ratr0_blit_rect_simple(struct Ratr0Surface *dst,
@@ -89,8 +301,8 @@ UINT16 ratr0_blit_rect_simple(struct Ratr0Surface *dst,
     // modulos are in *bytes*
     UINT16 srcmod = src_width_bytes - (blit_width_words << 1);
     UINT16 dstmod = dst_width_bytes - (blit_width_words << 1);
-    UINT32 src_addr = ((UINT32) src->buffer) + (src_width_bytes * srcy * src->depth) + (srcx >> 3);
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+    UINTPTR src_addr = ((UINTPTR) src->buffer) + (src_width_bytes * srcy * src->depth) + (srcx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
 
     // determine blit direction. A blit is reverse if the source and
     // destination areas overlap and the destination starts after the source
@@ -145,8 +357,8 @@ void ratr0_blit_rect_simple2(struct Ratr0Surface *dst,
 {
     UINT16 src_width_bytes = src->width >> 3;
     UINT16 dst_width_bytes = dst->width >> 3;
-    UINT32 src_addr = ((UINT32) src->buffer) + (src_width_bytes * srcy * src->depth) + (srcx >> 3);
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+    UINTPTR src_addr = ((UINTPTR) src->buffer) + (src_width_bytes * srcy * src->depth) + (srcx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
     _blit_rect_simple2(dst_addr, src_addr, bltsize);
 }
 
@@ -200,7 +412,7 @@ void ratr0_blit_clear8(struct Ratr0Surface *dst,
            afwm, alwm);
     */
     // calculate start addresses in both source and destination
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
     int blit_height_total = height_pixels * dst->depth;
 
     // modulos are in *bytes*
@@ -208,7 +420,7 @@ void ratr0_blit_clear8(struct Ratr0Surface *dst,
     UINT16 bltsize = (UINT16) (blit_height_total << 6) | blit_width_words & 0x3f;
 
     // The actual blitter part
-    WaitBlit();
+    _wait_blitter();
     // D = ~AB => LF = 0x0f, channels B and D turned on => 0x5
     // By using negation, we can use the alwm and afwm masks to
     // to select the parts where the background shines through
@@ -229,12 +441,38 @@ void ratr0_blit_clear8(struct Ratr0Surface *dst,
     custom.bltdpt = (UINT8 *) dst_addr;
 
     custom.bltadat = 0xffff;  // clear data
-    custom.bltsize = bltsize;
+    _start_blit(0x0500, bltsize);
 }
 
 
 // A fast large blit that clears a rectangular region with a D <- 0 blit
 // and the width is a multiple of 16. Use for things like clear screen
+void ratr0_blit_prepare_clear16(struct Ratr0BlitDescriptor *desc,
+                                struct Ratr0Surface *dst,
+                                UINT16 dstx, UINT16 dsty,
+                                UINT16 width_pixels, UINT16 height_pixels)
+{
+    UINT16 dst_width_bytes = dst->width >> 3;
+    UINT16 blit_width_words = width_pixels >> 4;
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+
+    // D = 0 => LF = 0x00, channel D is the only active channel
+    desc->bltcon0 = 0x0100;
+    desc->bltcon1 = 0;
+    desc->bltafwm = 0xffff;
+    desc->bltalwm = 0xffff;
+    desc->bltamod = 0;
+    desc->bltbmod = 0;
+    desc->bltcmod = 0;
+    desc->bltdmod = dst_width_bytes - (blit_width_words << 1);
+    desc->bltapt = 0;
+    desc->bltbpt = 0;
+    desc->bltcpt = 0;
+    desc->bltdpt = (UINT8 *) dst_addr;
+    desc->bltadat = 0;
+    desc->bltsize = (UINT16) ((height_pixels * dst->depth) << 6) | (blit_width_words & 0x3f);
+}
+
 void ratr0_blit_clear16(struct Ratr0Surface *dst,
                         UINT16 dstx, UINT16 dsty,
                         UINT16 width_pixels,
@@ -243,7 +481,7 @@ void ratr0_blit_clear16(struct Ratr0Surface *dst,
     UINT16 dst_width_bytes = dst->width >> 3;
     UINT16 blit_width_words = width_pixels >> 4;
     // calculate start addresses in both source and destination
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_width_bytes * dsty * dst->depth) + (dstx >> 3);
     int blit_height_total = height_pixels * dst->depth;
 
     // modulos are in *bytes*
@@ -257,7 +495,7 @@ void ratr0_blit_clear16(struct Ratr0Surface *dst,
     UINT16 bltsize = (UINT16) (blit_height_total << 6) | blit_width_words & 0x3f;
 
     // Blit 1: up to 1024 lines
-    WaitBlit();
+    _wait_blitter();
     // D = 0 => LF = 0x00, channel D is the only active channel
     custom.bltcon0 = 0x0100;
     custom.bltcon1 = 0; // unused
@@ -276,14 +514,14 @@ void ratr0_blit_clear16(struct Ratr0Surface *dst,
     custom.bltdpt = (UINT8 *) dst_addr;
 
     custom.bltadat = 0;
-    custom.bltsize = bltsize;
+    _start_blit(0x0100, bltsize);
 
     // Blit 1: up to 1024 lines
     if (blit_height_rest > 0) {
         bltsize = (UINT16) (blit_height_rest << 6) | blit_width_words & 0x3f;
         dst_addr += dst_width_bytes * 1024;
-        WaitBlit();
-        custom.bltsize = bltsize;
+        _wait_blitter();
+        _start_blit(0x0100, bltsize);
     }
 }
 
@@ -306,8 +544,8 @@ void ratr0_blit_ad_d(struct Ratr0Surface *d_surface,
     UINT16 dst_width_bytes = d_surface->width >> 3;
 
     // calculate start addresses in both source and destination
-    UINT32 src_addr = ((UINT32) a_surface->buffer) + (src_width_bytes * srcy * a_surface->depth) + (srcx >> 3);
-    UINT32 dst_addr = ((UINT32) d_surface->buffer) + (dst_width_bytes * dsty * d_surface->depth) + (dstx >> 3);
+    UINTPTR src_addr = ((UINTPTR) a_surface->buffer) + (src_width_bytes * srcy * a_surface->depth) + (srcx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) d_surface->buffer) + (dst_width_bytes * dsty * d_surface->depth) + (dstx >> 3);
     int blit_height_total = blit_height_pixels * a_surface->depth;
 
     // modulos are in *bytes*
@@ -316,7 +554,7 @@ void ratr0_blit_ad_d(struct Ratr0Surface *d_surface,
     UINT16 bltsize = (UINT16) (blit_height_total << 6) | blit_width_words & 0x3f;
 
     // The actual blitter part
-    WaitBlit();
+    _wait_blitter();
     // D = A+B => LF = 0xfc, channels A, B and D turned on => 0x0d
     //custom.bltcon0 = 0x0dfc | (a_shift << 12);
     custom.bltcon0 = lf | 0x0d00 | (a_shift << 12);
@@ -335,7 +573,7 @@ void ratr0_blit_ad_d(struct Ratr0Surface *d_surface,
     custom.bltbpt = (UINT8 *) dst_addr;
     custom.bltcpt = 0;
     custom.bltdpt = (UINT8 *) dst_addr;
-    custom.bltsize = bltsize;
+    _start_blit(0x0d00, bltsize);
 }
 
 // *************************************************************
@@ -352,13 +590,13 @@ void ratr0_blit_ad_d(struct Ratr0Surface *d_surface,
  *   at least 16 pixels
  * - Each tile has the width of a multiple of 16 pixels
  */
-void _blit_object_nonil(UINT32 dst_addr, UINT32 src_addr, UINT32 mask_addr,
+void _blit_object_nonil(UINTPTR dst_addr, UINTPTR src_addr, UINTPTR mask_addr,
                         UINT16 dstmod, UINT16 srcmod,
                         UINT8 num_planes,
                         UINT16 dst_row_bytes, UINT16 src_plane_size,
                         INT8 dst_shift, UINT16 alwm, UINT16 bltsize)
 {
-    WaitBlit();
+    _wait_blitter();
 
     // channels A-D turned on => 0x09 LF => D = AB + ~AC => 0xca
     custom.bltcon0 = 0x0fca | (dst_shift << 12);
@@ -378,8 +616,8 @@ void _blit_object_nonil(UINT32 dst_addr, UINT32 src_addr, UINT32 mask_addr,
         custom.bltbpt = (UINT8 *) src_addr;
         custom.bltcpt = (UINT8 *) dst_addr;
         custom.bltdpt = (UINT8 *) dst_addr;
-        custom.bltsize = bltsize;
-        WaitBlit();
+        _start_blit(0x0f00, bltsize);
+        _wait_blitter();
         src_addr += src_plane_size;
         dst_addr += dst_row_bytes;
     }
@@ -390,54 +628,16 @@ void ratr0_blit_object_nonil(struct Ratr0Surface *dst,
                              int tilex, int tiley,
                              int dstx, int dsty)
 {
-    // Source variables
-    UINT16 src_blit_width_pixels = bobs->header.tile_width;
-    UINT16 src_blit_width = src_blit_width_pixels / 16;
-    if (bobs->header.tile_width & 0x0f != 0) {
-        // It's not evenly dividable by 16 -> add another word
-        src_blit_width++;
-    }
-
-    UINT16 blit_height_pixels = bobs->header.tile_height;
-    UINT16 srcx = tilex * bobs->header.tile_width;
-    UINT16 srcy = tiley * bobs->header.tile_height;
-
-    // Destination variables
-    // destination x relative to the containing word, this is also the
-    // the shift amount
+    struct Ratr0CompiledBlit *blit = ratr0_blit_compile_object(dst, bobs, tilex, tiley, FALSE);
     INT8 dst_shift = dstx & 0x0f;
-
-    UINT16 start_dst_word = dstx / 16;
-    UINT16 end_dst_word = (dstx + bobs->header.tile_width) / 16;
-    UINT16 dst_blit_width = end_dst_word - start_dst_word + 1;
-
-    UINT16 alwm = 0xffff;
-    UINT16 final_blit_width = src_blit_width;
-    if (dst_blit_width > src_blit_width) {
-        final_blit_width = dst_blit_width;
-        alwm = 0;
-    }
-    UINT16 dst_row_bytes = dst->width / 8;
-
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst->width / 8 * dsty * dst->depth) + dstx / 8;
-
-    int bobs_plane_size = bobs->header.width / 8 * bobs->header.height;
-    UINT8 *bobs_addr = ratr0_memory_block_address(bobs->h_imgdata);
-    // non-interleaved -> Offset within the first plane
-    UINT32 src_addr = ((UINT32) bobs_addr) + (bobs->header.width / 8 * srcy) + srcx / 8;
-
-    // it's the plane right after the actual image planes
-    // base address of the mask + offset of the tile
-    UINT32 mask_addr = (UINT32) bobs_addr + bobs_plane_size * bobs->header.bmdepth;
-    mask_addr += (bobs->header.width / 8 * srcy) + srcx / 8;
-
-    UINT16 dstmod = dst_row_bytes * dst->depth - (final_blit_width * 2);
-    UINT16 srcmod = bobs->header.width / 8 - (final_blit_width * 2);
-    UINT8 num_planes = bobs->header.bmdepth;
-    UINT16 src_plane_size = bobs->header.width / 8 * bobs->header.height;
-    UINT16 bltsize = (UINT16) (blit_height_pixels << 6) | (final_blit_width & 0x3f);
-    _blit_object_nonil(dst_addr, src_addr, mask_addr, dstmod, srcmod, num_planes,
-                       dst_row_bytes, src_plane_size, dst_shift, alwm, bltsize);
+    UINT16 wide = dst_shift >= blit->wide_shift;
+    UINTPTR bobs_addr = (UINTPTR) ratr0_memory_block_address(bobs->h_imgdata);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + blit->dst_line_bytes * dsty +
+        (dstx >> 3) + blit->dst_offset;
+    _blit_object_nonil(dst_addr, bobs_addr + blit->src_offset, bobs_addr + blit->mask_offset,
+                       blit->dstmod[wide], blit->srcmod[wide], bobs->header.bmdepth,
+                       blit->dst_row_bytes, blit->src_plane_size, dst_shift,
+                       wide ? 0 : 0xffff, blit->bltsize[wide]);
 }
 
 /**
@@ -453,85 +653,201 @@ void ratr0_blit_object_nonil(struct Ratr0Surface *dst,
  *   at least 16 pixels
  * - Each tile has the width of a multiple of 16 pixels
  */
-void _blit_object_il(UINT32 dst_addr, UINT32 src_addr, UINT32 mask_addr,
-                  UINT16 dstmod, UINT16 srcmod,
-                  INT8 dst_shift, UINT16 alwm, UINT16 bltsize)
+static void _describe_object_il(struct Ratr0BlitDescriptor *desc,
+                                UINTPTR dst_addr, UINTPTR src_addr, UINTPTR mask_addr,
+                                UINT16 dstmod, UINT16 srcmod,
+                                INT8 dst_shift, UINT16 alwm, UINT16 bltsize)
 {
-    WaitBlit();
     // channels A-D turned on => 0x09 LF => D = AB + ~AC => 0xca
-    custom.bltcon0 = 0x0fca | (dst_shift << 12);
+    desc->bltcon0 = 0x0fca | (dst_shift << 12);
     // used
-    custom.bltcon1 = dst_shift << 12;
-
-    custom.bltafwm = 0xffff;
-    custom.bltalwm = alwm;
+    desc->bltcon1 = dst_shift << 12;
+
+    desc->bltafwm = 0xffff;
+    desc->bltalwm = alwm;
+
+    desc->bltamod = srcmod;
+    desc->bltbmod = srcmod;
+    desc->bltcmod = dstmod;
+    desc->bltdmod = dstmod;
+
+    desc->bltapt = (UINT8 *) mask_addr;
+    desc->bltbpt = (UINT8 *) src_addr;
+    desc->bltcpt = (UINT8 *) dst_addr;
+    desc->bltdpt = (UINT8 *) dst_addr;
+    desc->bltadat = 0;
+    desc->bltsize = bltsize;
+}
 
-    custom.bltamod = srcmod;
-    custom.bltbmod = srcmod;
-    custom.bltcmod = dstmod;
-    custom.bltdmod = dstmod;
+/*
+ * Compiled blit cache. It is direct mapped: a key that maps to an occupied
+ * slot replaces its entry. That's good enough for the few tilesheets and
+ * display buffers a game uses at a time.
+ */
+#define BLIT_CACHE_SIZE (64)
+static struct Ratr0CompiledBlit blit_cache[BLIT_CACHE_SIZE];
 
-    custom.bltapt = (UINT8 *) mask_addr;
-    custom.bltbpt = (UINT8 *) src_addr;
-    custom.bltcpt = (UINT8 *) dst_addr;
-    custom.bltdpt = (UINT8 *) dst_addr;
-    custom.bltsize = bltsize;
+static UINT16 _blit_cache_index(struct Ratr0Surface *dst, struct Ratr0TileSheet *bobs,
+                                int tilex, int tiley)
+{
+    UINTPTR hash = (((UINTPTR) bobs) >> 4) ^ (((UINTPTR) dst) >> 3);
+    hash ^= tilex * 7 + tiley * 13;
+    return (UINT16) (hash & (BLIT_CACHE_SIZE - 1));
 }
 
+/*
+ * Finds the word columns of a tile that its mask covers. Only those need
+ * to be blitted, so transparent columns at the sides of a tile don't cost
+ * blitter cycles and a narrow BOB often fits without the extra word for
+ * the shift. A tile without any mask bits keeps its full width.
+ */
+static void _mask_columns(UINT8 *mask, UINT16 line_bytes, UINT16 height,
+                          UINT16 num_words, UINT16 *first_word, UINT16 *width_pixels)
+{
+    UINT16 first = num_words, last = 0, last_bits = 0;
+    for (int w = 0; w < num_words; w++) {
+        UINT16 bits = 0;
+        for (int y = 0; y < height; y++) {
+            UINT8 *word = mask + y * line_bytes + (w << 1);
+            bits |= (word[0] << 8) | word[1];
+        }
+        if (bits == 0) continue;
+        if (first == num_words) first = w;
+        last = w;
+        last_bits = bits;
+    }
+    if (first == num_words) {
+        *first_word = 0;
+        *width_pixels = num_words << 4;
+        return;
+    }
+    UINT16 last_pixels = 16;
+    for (; (last_bits & 1) == 0; last_bits >>= 1) last_pixels--;
+    *first_word = first;
+    *width_pixels = ((last - first) << 4) + last_pixels;
+}
 
-void ratr0_blit_object_il(struct Ratr0Surface *dst,
-                                struct Ratr0TileSheet *bobs,
-                                int tilex, int tiley,
-                                int dstx, int dsty)
+/*
+ * Computes everything that does not depend on the destination position.
+ * Whether a blit needs an extra word for the shifted pixels only depends
+ * on the shift, so both variants are stored.
+ */
+static void _compile_object(struct Ratr0CompiledBlit *blit,
+                            struct Ratr0Surface *dst, struct Ratr0TileSheet *bobs,
+                            int tilex, int tiley, BOOL interleaved)
 {
-    int bobs_row_bytes = bobs->header.width >> 3;
-    int bobs_plane_size = bobs_row_bytes * bobs->header.height;
-    // Source variables
-    UINT16 src_blit_width_pixels = bobs->header.tile_width;
-    UINT16 src_blit_width_words = src_blit_width_pixels >> 4;
+    UINT16 bobs_row_bytes = bobs->header.width >> 3;
+    UINT16 bobs_plane_size = bobs_row_bytes * bobs->header.height;
+    UINT16 depth = bobs->header.bmdepth;
+    UINT16 src_blit_width_words = bobs->header.tile_width >> 4;
     if ((bobs->header.tile_width & 0x0f) != 0) {
         // It's not evenly dividable by 16 -> add another word
         src_blit_width_words++;
     }
-
-    UINT16 blit_height_pixels = bobs->header.tile_height * bobs->header.bmdepth;
     UINT16 srcx = tilex * bobs->header.tile_width;
     UINT16 srcy = tiley * bobs->header.tile_height;
+    UINT16 blit_height_pixels = bobs->header.tile_height;
+    UINT16 dst_row_bytes = dst->width >> 3;
+    UINT16 dstmod = dst_row_bytes;
+    UINT16 mask_line_bytes = bobs_row_bytes;
+    UINT32 tile_offset;
+
+    if (interleaved) {
+        tile_offset = (bobs_row_bytes * srcy * depth) + (srcx >> 3);
+        blit_height_pixels *= depth;
+        mask_line_bytes *= depth;
+    } else {
+        // Offset within the first plane, every plane is a separate blit
+        tile_offset = (bobs_row_bytes * srcy) + (srcx >> 3);
+        dstmod *= dst->depth;
+    }
+    // it's the plane right after the actual image planes
+    UINT32 mask_offset = bobs_plane_size * depth + tile_offset;
+
+    // only the columns that the mask covers
+    UINT16 first_word, width_pixels;
+    _mask_columns((UINT8 *) ratr0_memory_block_address(bobs->h_imgdata) + mask_offset,
+                  mask_line_bytes, bobs->header.tile_height, src_blit_width_words,
+                  &first_word, &width_pixels);
+    if (width_pixels > bobs->header.tile_width - (first_word << 4)) {
+        width_pixels = bobs->header.tile_width - (first_word << 4);
+    }
+    src_blit_width_words = (width_pixels + 15) >> 4;
+
+    blit->bobs = bobs;
+    blit->dst = dst;
+    blit->tilex = tilex;
+    blit->tiley = tiley;
+    blit->interleaved = interleaved;
+    blit->src_offset = tile_offset + (first_word << 1);
+    blit->mask_offset = mask_offset + (first_word << 1);
+    blit->dst_offset = first_word << 1;
+    blit->dst_line_bytes = dst_row_bytes * dst->depth;
+    blit->dst_row_bytes = dst_row_bytes;
+    blit->src_plane_size = bobs_plane_size;
+    // The destination spans an extra word when the shifted pixels
+    // cross the last source word
+    blit->wide_shift = (src_blit_width_words << 4) - width_pixels + 1;
+
+    for (int wide = 0; wide < 2; wide++) {
+        UINT16 final_blit_width = src_blit_width_words + wide;
+        blit->dstmod[wide] = dstmod - (final_blit_width << 1);
+        blit->srcmod[wide] = bobs_row_bytes - (final_blit_width << 1);
+        blit->bltsize[wide] = (UINT16) (blit_height_pixels << 6) | (final_blit_width & 0x3f);
+    }
+}
 
-    // Destination variables
-    // destination x relative to the containing word, this is also the
-    // the shift amount
-    INT8 dst_shift = dstx & 0x0f;
-
-    // The destination blit width can be different from the source,
-    // depending on where the tile is offset, it can span extra words
-    UINT16 start_dst_word = dstx >> 4;
-    UINT16 end_dst_word = (dstx + bobs->header.tile_width) >> 4;
-    UINT16 dst_blit_width = end_dst_word - start_dst_word + 1;
-
-    UINT16 alwm = 0xffff;  // ALWM masks the shifted pixels
-    UINT16 final_blit_width = src_blit_width_words;
-    if (dst_blit_width > src_blit_width_words) {
-        final_blit_width = dst_blit_width;
-        alwm = 0;
+struct Ratr0CompiledBlit *ratr0_blit_compile_object(struct Ratr0Surface *dst,
+                                                    struct Ratr0TileSheet *bobs,
+                                                    int tilex, int tiley,
+                                                    BOOL interleaved)
+{
+    struct Ratr0CompiledBlit *blit = &blit_cache[_blit_cache_index(dst, bobs, tilex, tiley)];
+    if (blit->bobs != bobs || blit->dst != dst || blit->tilex != tilex ||
+        blit->tiley != tiley || blit->interleaved != interleaved) {
+        _compile_object(blit, dst, bobs, tilex, tiley, interleaved);
     }
-    UINT16 dst_row_bytes = dst->width >> 3;
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_row_bytes * dsty * dst->depth) + (dstx >> 3);
+    return blit;
+}
 
-    UINT8 *bobs_addr = ratr0_memory_block_address(bobs->h_imgdata);
-    // interleaved
-    UINT16 tile_offset = (bobs_row_bytes * srcy * bobs->header.bmdepth) + (srcx >> 3);
-    UINT32 src_addr = ((UINT32) bobs_addr) + tile_offset;
+void ratr0_blit_prepare_compiled(struct Ratr0BlitDescriptor *desc,
+                                 struct Ratr0CompiledBlit *blit,
+                                 int dstx, int dsty)
+{
+    INT8 dst_shift = dstx & 0x0f;
+    UINT16 wide = dst_shift >= blit->wide_shift;
+    UINTPTR bobs_addr = (UINTPTR) ratr0_memory_block_address(blit->bobs->h_imgdata);
+    UINTPTR dst_addr = ((UINTPTR) blit->dst->buffer) + blit->dst_line_bytes * dsty +
+        (dstx >> 3) + blit->dst_offset;
+    _describe_object_il(desc, dst_addr, bobs_addr + blit->src_offset,
+                        bobs_addr + blit->mask_offset,
+                        blit->dstmod[wide], blit->srcmod[wide],
+                        dst_shift, wide ? 0 : 0xffff, blit->bltsize[wide]);
+}
 
-    // it's the plane right after the actual image planes
-    UINT32 mask_addr = (UINT32) bobs_addr + bobs_plane_size * bobs->header.bmdepth;
-    mask_addr += tile_offset;
+void ratr0_blitter_flush_cache(void)
+{
+    for (int i = 0; i < BLIT_CACHE_SIZE; i++) blit_cache[i].bobs = NULL;
+}
 
-    UINT16 dstmod = dst_row_bytes - (final_blit_width << 1);
-    UINT16 srcmod = bobs_row_bytes - (final_blit_width << 1);
-    UINT16 bltsize = (UINT16) (blit_height_pixels << 6) | final_blit_width & 0x3f;
-    _blit_object_il(dst_addr, src_addr, mask_addr, dstmod, srcmod,
-                    dst_shift, alwm, bltsize);
+void ratr0_blit_object_il(struct Ratr0Surface *dst,
+                          struct Ratr0TileSheet *bobs,
+                          int tilex, int tiley,
+                          int dstx, int dsty)
+{
+    struct Ratr0BlitDescriptor desc;
+    ratr0_blit_prepare_object_il(&desc, dst, bobs, tilex, tiley, dstx, dsty);
+    _run_blit(&desc);
+}
+
+void ratr0_blit_prepare_object_il(struct Ratr0BlitDescriptor *desc,
+                                  struct Ratr0Surface *dst,
+                                  struct Ratr0TileSheet *bobs,
+                                  int tilex, int tiley,
+                                  int dstx, int dsty)
+{
+    ratr0_blit_prepare_compiled(desc, ratr0_blit_compile_object(dst, bobs, tilex, tiley, TRUE),
+                                dstx, dsty);
 }
 
 void ratr0_blit_rect_1plane(struct Ratr0Surface *dst,
@@ -571,22 +887,22 @@ void ratr0_blit_rect_1plane(struct Ratr0Surface *dst,
         alwm = 0;
     }
     UINT16 dst_row_bytes = dst->width >> 3;
-    UINT32 dst_addr = ((UINT32) dst->buffer) + (dst_row_bytes * dsty * dst->depth) + (dstx >> 3);
+    UINTPTR dst_addr = ((UINTPTR) dst->buffer) + (dst_row_bytes * dsty * dst->depth) + (dstx >> 3);
 
     UINT8 *bobs_addr = ratr0_memory_block_address(bobs->h_imgdata);
     // interleaved
     UINT16 tile_offset = (bobs_row_bytes * srcy * bobs->header.bmdepth) + (srcx >> 3);
-    UINT32 src_addr = ((UINT32) bobs_addr) + tile_offset;
+    UINTPTR src_addr = ((UINTPTR) bobs_addr) + tile_offset;
 
     // it's the plane right after the actual image planes
-    UINT32 mask_addr = (UINT32) bobs_addr + bobs_plane_size * bobs->header.bmdepth;
+    UINTPTR mask_addr = (UINTPTR) bobs_addr + bobs_plane_size * bobs->header.bmdepth;
     mask_addr += tile_offset;
 
     UINT16 dstmod = dst_row_bytes - (final_blit_width << 1);
     UINT16 srcmod = bobs_row_bytes - (final_blit_width << 1);
     UINT16 bltsize = (UINT16) (blit_height_pixels << 6) | final_blit_width & 0x3f;
 
-    WaitBlit();
+    _wait_blitter();
     // D = A => LF = 0xf0, channels A and D turned on => 0x09
     custom.bltcon0 = 0x09f0 | (dst_shift << 12);
     // used
@@ -600,5 +916,149 @@ void ratr0_blit_rect_1plane(struct Ratr0Surface *dst,
 
     custom.bltapt = (UINT8 *) src_addr;
     custom.bltdpt = (UINT8 *) dst_addr;
-    custom.bltsize = bltsize;
+    _start_blit(0x0900, bltsize);
+}
+
+// Memory copy with the blitter: we treat the memory as a surface that
+// is 32 words wide, so a single blit can move up to 64 KB
+#define COPY_MEM_ROW_WORDS (32)
+#define COPY_MEM_MAX_ROWS  (1024)
+
+void ratr0_blit_copy_mem(void *dst, void *src, UINT32 num_bytes)
+{
+    UINT32 num_words = num_bytes >> 1;
+    UINT32 num_rows = num_words / COPY_MEM_ROW_WORDS;
+    UINT16 rest_words = num_words % COPY_MEM_ROW_WORDS;
+    UINTPTR src_addr = (UINTPTR) src;
+    UINTPTR dst_addr = (UINTPTR) dst;
+
+    _wait_blitter();
+    // D = A => LF = 0xf0, channels A and D turned on => 0x09
+    // ascending mode, so overlapping areas work as long as dst < src
+    custom.bltcon0 = 0x09f0;
+    custom.bltcon1 = 0;
+    custom.bltafwm = 0xffff;
+    custom.bltalwm = 0xffff;
+    custom.bltamod = 0;
+    custom.bltdmod = 0;
+
+    while (num_rows > 0) {
+        UINT16 rows = num_rows > COPY_MEM_MAX_ROWS ? COPY_MEM_MAX_ROWS : num_rows;
+        custom.bltapt = (UINT8 *) src_addr;
+        custom.bltdpt = (UINT8 *) dst_addr;
+        // a height of 1024 is encoded as 0
+        _start_blit(0x0900, (UINT16) ((rows & 0x3ff) << 6) | COPY_MEM_ROW_WORDS);
+        src_addr += rows * COPY_MEM_ROW_WORDS * 2;
+        dst_addr += rows * COPY_MEM_ROW_WORDS * 2;
+        num_rows -= rows;
+        _wait_blitter();
+    }
+    if (rest_words > 0) {
+        custom.bltapt = (UINT8 *) src_addr;
+        custom.bltdpt = (UINT8 *) dst_addr;
+        _start_blit(0x0900, (UINT16) (1 << 6) | rest_words);
+        _wait_blitter();
+    }
+}
+
+// *************************************************************
+// **** Blit budget
+// ****************************
+
+/*
+ * Memory cycles per word for the channel enable bits ABCD of BLTCON0,
+ * from the blitter timing table in the Hardware Reference Manual.
+ */
+static const UINT8 CYCLES_PER_WORD[16] = {
+    2, 2, 2, 3, 2, 3, 3, 4, 2, 2, 2, 3, 3, 3, 4, 4
+};
+
+// PAL frame: 313 lines of 227 DMA cycles. Every line, refresh (4), disk (3),
+// audio (4) and sprite (16) DMA use their fixed slots
+#define PAL_LINES           (313)
+#define CYCLES_PER_LINE     (227)
+#define FIXED_DMA_PER_LINE  (27)
+
+UINT32 ratr0_blitter_blit_cycles(UINT16 bltcon0, UINT16 bltsize)
+{
+    UINT32 height = bltsize >> 6;
+    UINT32 width = bltsize & 0x3f;
+    if (height == 0) height = 1024;
+    if (width == 0) width = 64;
+    return width * height * CYCLES_PER_WORD[(bltcon0 >> 8) & 0x0f];
+}
+
+UINT32 ratr0_blitter_frame_budget(UINT16 width, UINT16 height, UINT16 depth,
+                                  BOOL blithog)
+{
+    UINT32 free_cycles = PAL_LINES * (CYCLES_PER_LINE - FIXED_DMA_PER_LINE);
+    // each bitplane fetches a word per 16 pixels of every displayed line
+    UINT32 bitplane_cycles = (UINT32) height * depth * (width >> 4);
+    UINT32 budget = bitplane_cycles < free_cycles ? free_cycles - bitplane_cycles : 0;
+    return blithog ? budget : budget - (budget >> 2);
+}
+
+void ratr0_blitter_set_frame_budget(UINT32 cycles)
+{
+    frame_budget = cycles;
+}
+
+void ratr0_blitter_set_site(Ratr0BlitSite site)
+{
+    current_site = site;
+}
+
+BOOL ratr0_blitter_end_frame(void)
+{
+    BOOL over_budget = frame_budget > 0 && frame_stats.cycles > frame_budget;
+    frame_stats.budget = frame_budget;
+    if (over_budget) {
+        profile.frames_over_budget++;
+        PRINT_DEBUG("Frame %u: blits need %u cycles, budget is %u",
+                    profile.num_frames, frame_stats.cycles, frame_budget);
+    }
+    if (frame_stats.cycles > profile.peak_frame.cycles) profile.peak_frame = frame_stats;
+    profile.last_frame = frame_stats;
+    profile.num_frames++;
+
+    struct Ratr0BlitFrameStats empty = { 0 };
+    frame_stats = empty;
+    return over_budget;
+}
+
+void ratr0_blitter_profile(struct Ratr0BlitProfile *result)
+{
+    *result = profile;
+}
+
+void ratr0_blitter_reset_profile(void)
+{
+    struct Ratr0BlitProfile empty_profile = { 0 };
+    struct Ratr0BlitFrameStats empty_frame = { 0 };
+    profile = empty_profile;
+    frame_stats = empty_frame;
+}
+
+static const char *site_names[] = { "other", "restore", "bobs" };
+
+static void _dump_frame(FILE *fp, const char *title, struct Ratr0BlitFrameStats *stats)
+{
+    fprintf(fp, "%s: %u cycles in %u blits", title, stats->cycles, stats->num_blits);
+    if (stats->budget > 0) {
+        fprintf(fp, ", %u%% of %u cycles budget", stats->cycles * 100 / stats->budget,
+                stats->budget);
+    }
+    fputs("\n", fp);
+    for (int i = 0; i < RATR0_NUM_BLIT_SITES; i++) {
+        fprintf(fp, "  %-8s %8u cycles %5u blits\n", site_names[i],
+                stats->sites[i].cycles, stats->sites[i].num_blits);
+    }
+}
+
+void ratr0_blitter_dump_profile(FILE *fp)
+{
+    fprintf(fp, "Blitter: %u frames, %u over budget\n", profile.num_frames,
+            profile.frames_over_budget);
+    _dump_frame(fp, "last frame", &profile.last_frame);
+    _dump_frame(fp, "peak frame", &profile.peak_frame);
 }
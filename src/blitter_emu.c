@@ -0,0 +1,181 @@
+/** @file blitter_emu.c
+ *
+ * Software model of the Amiga blitter for the host build, see
+ * blitter_emu.h. The model follows the data path that is described in the
+ * Hardware Reference Manual:
+ *
+ *   1. channels A, B and C fetch a word, disabled channels use their
+ *      data register instead
+ *   2. A is masked with the first/last word masks, then A and B are
+ *      shifted together with the previous word of the same channel
+ *   3. the minterm combines A, B and C into D
+ *   4. the fill logic is applied to D, BZERO is updated and D is stored
+ *
+ * After a row, the modulos are added to the pointers of the enabled
+ * channels (subtracted in descending mode). The pointers keep their final
+ * value after the blit, just like on the hardware.
+ */
+#include <ratr0/blitter_emu.h>
+
+#define BLTCON0_USEA (0x0800)
+#define BLTCON0_USEB (0x0400)
+#define BLTCON0_USEC (0x0200)
+#define BLTCON0_USED (0x0100)
+
+struct Custom custom = { .bltsize = RATR0_BLTSIZE_IDLE };
+static UINT32 num_blits;
+static void (*blit_interrupt)(void);
+
+/* Chip memory is big endian, independent of the host */
+static UINT16 _read_word(UINT8 *addr)
+{
+    return (addr[0] << 8) | addr[1];
+}
+
+static void _write_word(UINT8 *addr, UINT16 value)
+{
+    addr[0] = value >> 8;
+    addr[1] = value & 0xff;
+}
+
+/* Like the modulos, bit 0 of the pointer registers is ignored */
+static UINT8 *_word_address(void *ptr)
+{
+    return (UINT8 *) ((UINTPTR) ptr & ~((UINTPTR) 1));
+}
+
+/*
+ * Each bit of the minterm selects one of the 8 combinations of A, B and C,
+ * bit 7 is ABC, bit 0 is ~A~B~C.
+ */
+static UINT16 _minterm(UINT8 lf, UINT16 a, UINT16 b, UINT16 c)
+{
+    UINT16 d = 0;
+    if (lf & 0x01) d |= ~a & ~b & ~c;
+    if (lf & 0x02) d |= ~a & ~b & c;
+    if (lf & 0x04) d |= ~a & b & ~c;
+    if (lf & 0x08) d |= ~a & b & c;
+    if (lf & 0x10) d |= a & ~b & ~c;
+    if (lf & 0x20) d |= a & ~b & c;
+    if (lf & 0x40) d |= a & b & ~c;
+    if (lf & 0x80) d |= a & b & c;
+    return d;
+}
+
+/*
+ * Combines the current and the previous word of a channel. In ascending
+ * mode, the data moves right and the previous word shifts in from the left,
+ * in descending mode it is the other way around.
+ */
+static UINT16 _shift(UINT16 word, UINT16 prev, UINT16 shift, BOOL desc)
+{
+    if (desc) return (UINT16) ((((UINT32) word << 16) | prev) >> (16 - shift));
+    return (UINT16) ((((UINT32) prev << 16) | word) >> shift);
+}
+
+/*
+ * Area fill, processed from the right to the left. Every set bit toggles
+ * the fill carry. The inclusive fill keeps both edges, the exclusive fill
+ * drops the left edge of an area.
+ */
+static UINT16 _fill(UINT16 d, BOOL exclusive, UINT16 *carry)
+{
+    UINT16 result = 0;
+    for (int i = 0; i < 16; i++) {
+        UINT16 bit = (d >> i) & 1;
+        *carry ^= bit;
+        result |= (exclusive ? *carry : (bit | *carry)) << i;
+    }
+    return result;
+}
+
+void WaitBlit(void)
+{
+    if (custom.bltsize == RATR0_BLTSIZE_IDLE) return;
+
+    UINT16 bltsize = custom.bltsize;
+    custom.bltsize = RATR0_BLTSIZE_IDLE;
+    UINT16 height = bltsize >> 6;
+    UINT16 width = bltsize & 0x3f;
+    if (height == 0) height = 1024;
+    if (width == 0) width = 64;
+
+    UINT16 con0 = custom.bltcon0, con1 = custom.bltcon1;
+    if (con1 & RATR0_BC1F_LINE) return;  // not supported
+
+    UINT16 ash = con0 >> 12, bsh = con1 >> 12;
+    UINT8 lf = con0 & 0xff;
+    BOOL use_a = (con0 & BLTCON0_USEA) != 0, use_b = (con0 & BLTCON0_USEB) != 0;
+    BOOL use_c = (con0 & BLTCON0_USEC) != 0;
+    BOOL use_d = (con0 & BLTCON0_USED) && !(con1 & RATR0_BC1F_DOFF);
+    BOOL desc = (con1 & RATR0_BC1F_DESC) != 0;
+    BOOL fill = (con1 & (RATR0_BC1F_IFE | RATR0_BC1F_EFE)) != 0;
+    BOOL exclusive = (con1 & RATR0_BC1F_EFE) != 0;
+    int step = desc ? -2 : 2;
+    // bit 0 of the modulos is ignored by the hardware
+    int amod = (custom.bltamod & ~1) * (desc ? -1 : 1);
+    int bmod = (custom.bltbmod & ~1) * (desc ? -1 : 1);
+    int cmod = (custom.bltcmod & ~1) * (desc ? -1 : 1);
+    int dmod = (custom.bltdmod & ~1) * (desc ? -1 : 1);
+    UINT8 *apt = _word_address(custom.bltapt), *bpt = _word_address(custom.bltbpt);
+    UINT8 *cpt = _word_address(custom.bltcpt), *dpt = _word_address(custom.bltdpt);
+    UINT16 prev_a = 0, prev_b = 0;
+    BOOL all_zero = TRUE;
+
+    for (int row = 0; row < height; row++) {
+        UINT16 carry = (con1 & RATR0_BC1F_FCI) ? 1 : 0;
+        for (int col = 0; col < width; col++) {
+            UINT16 a = custom.bltadat, b = custom.bltbdat, c = custom.bltcdat;
+            if (use_a) { a = custom.bltadat = _read_word(apt); apt += step; }
+            if (use_b) { b = custom.bltbdat = _read_word(bpt); bpt += step; }
+            if (use_c) { c = custom.bltcdat = _read_word(cpt); cpt += step; }
+
+            if (col == 0) a &= custom.bltafwm;
+            if (col == width - 1) a &= custom.bltalwm;
+            UINT16 a_shifted = _shift(a, prev_a, ash, desc);
+            UINT16 b_shifted = _shift(b, prev_b, bsh, desc);
+            prev_a = a;
+            prev_b = b;
+
+            UINT16 d = _minterm(lf, a_shifted, b_shifted, c);
+            if (fill) d = _fill(d, exclusive, &carry);
+            if (d) all_zero = FALSE;
+            if (use_d) { _write_word(dpt, d); dpt += step; }
+        }
+        if (use_a) apt += amod;
+        if (use_b) bpt += bmod;
+        if (use_c) cpt += cmod;
+        if (use_d) dpt += dmod;
+    }
+    custom.bltapt = apt;
+    custom.bltbpt = bpt;
+    custom.bltcpt = cpt;
+    custom.bltdpt = dpt;
+    if (all_zero) custom.dmaconr |= RATR0_DMAF_BZERO;
+    else custom.dmaconr &= ~RATR0_DMAF_BZERO;
+    num_blits++;
+
+    // the handler clears the request and might start the next blit
+    custom.intreq = INTF_BLIT;
+    if (blit_interrupt &&
+        (custom.intena & (INTF_SETCLR | INTF_BLIT)) == (INTF_SETCLR | INTF_BLIT)) {
+        blit_interrupt();
+    }
+}
+
+void ratr0_blitter_emu_reset(void)
+{
+    struct Custom idle = { .bltsize = RATR0_BLTSIZE_IDLE };
+    custom = idle;
+    num_blits = 0;
+}
+
+void ratr0_blitter_emu_set_interrupt(void (*handler)(void))
+{
+    blit_interrupt = handler;
+}
+
+UINT32 ratr0_blitter_emu_num_blits(void)
+{
+    return num_blits;
+}
@@ -0,0 +1,263 @@
+/** @file copper.c */
+#include <string.h>
+#include <ratr0/debug_utils.h>
+#include <ratr0/hw_registers.h>
+#include <ratr0/copper.h>
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_TAG("COPPER", __VA_ARGS__)
+
+/*
+ * Copper instructions are 2 words. MOVE: register offset, value.
+ * WAIT: vpos << 8 | hpos | 1, 0xfffe with the enable masks for all position
+ * bits and the blitter finished bit clear, SKIP: the same with 0xffff.
+ */
+#define WAIT_MASK (0xfffe)
+#define SKIP_MASK (0xffff)
+
+void ratr0_copper_init(struct Ratr0CopperList *list, UINT16 max_words)
+{
+    // the memory system exits if the copies can't be allocated
+    for (int i = 0; i < 2; i++) {
+        list->h_copies[i] = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_DISPLAY,
+                                                        max_words * sizeof(UINT16));
+        list->copies[i] = ratr0_memory_block_address(list->h_copies[i]);
+    }
+    list->max_words = max_words;
+    list->front = 0;
+    ratr0_copper_begin(list);
+}
+
+void ratr0_copper_free(struct Ratr0CopperList *list)
+{
+    if (list->h_copies[0] == -1) return;
+    ratr0_memory_free_block(list->h_copies[1]);
+    ratr0_memory_free_block(list->h_copies[0]);
+    list->h_copies[0] = list->h_copies[1] = -1;
+}
+
+void ratr0_copper_begin(struct Ratr0CopperList *list)
+{
+    list->num_words = 0;
+    list->needs_sync = FALSE;
+    memset(&list->info, 0, sizeof(struct Ratr0CopperListInfo));
+}
+
+static INT16 _emit(struct Ratr0CopperList *list, UINT16 word0, UINT16 word1)
+{
+    // keep space for the END
+    if (list->num_words + 2 * RATR0_COPPER_INSTR_WORDS > list->max_words) {
+        PRINT_DEBUG("ERROR: copper list is full");
+        return -1;
+    }
+    UINT16 *back = ratr0_copper_get_back(list);
+    INT16 index = list->num_words;
+    back[index] = word0;
+    back[index + 1] = word1;
+    list->num_words += RATR0_COPPER_INSTR_WORDS;
+    return index;
+}
+
+INT16 ratr0_copper_move(struct Ratr0CopperList *list, UINT16 reg, UINT16 value)
+{
+    INT16 index = _emit(list, reg, value);
+    return index == -1 ? -1 : index + 1;
+}
+
+INT16 ratr0_copper_wait(struct Ratr0CopperList *list, UINT16 hpos, UINT16 vpos)
+{
+    return _emit(list, ((vpos & 0xff) << 8) | (hpos & 0xfe) | 1, WAIT_MASK);
+}
+
+INT16 ratr0_copper_skip(struct Ratr0CopperList *list, UINT16 hpos, UINT16 vpos)
+{
+    return _emit(list, ((vpos & 0xff) << 8) | (hpos & 0xfe) | 1, SKIP_MASK);
+}
+
+/* Emits MOVEs of 0 to num_regs consecutive registers, returns the first value index */
+static INT16 _move_block(struct Ratr0CopperList *list, UINT16 reg, UINT16 num_regs)
+{
+    INT16 first = ratr0_copper_move(list, reg, 0);
+    for (int i = 1; i < num_regs && first != -1; i++) {
+        if (ratr0_copper_move(list, reg + i * 2, 0) == -1) return -1;
+    }
+    return first;
+}
+
+BOOL ratr0_copper_add_display(struct Ratr0CopperList *list, UINT16 num_colors)
+{
+    // the display sets the windows, BPLCON0/1, the modulos and the pointers
+    struct Ratr0CopperListInfo *info = &list->info;
+    ratr0_copper_move(list, FMODE, 0);
+    info->ddfstrt_index = ratr0_copper_move(list, DDFSTRT, DDFSTRT_VALUE_320);
+    info->ddfstop_index = ratr0_copper_move(list, DDFSTOP, DDFSTOP_VALUE_320);
+    info->diwstrt_index = ratr0_copper_move(list, DIWSTRT, DIWSTRT_VALUE_320);
+    info->diwstop_index = ratr0_copper_move(list, DIWSTOP, DIWSTOP_VALUE_PAL_320);
+    info->bplcon0_index = ratr0_copper_move(list, BPLCON0, 0);
+    info->bplcon1_index = ratr0_copper_move(list, BPLCON1, 0);
+    ratr0_copper_move(list, BPLCON2, 0x060);
+    info->bpl1mod_index = _move_block(list, BPL1MOD, 2);
+    info->bpl1pth_index = _move_block(list, BPL1PTH, 2 * MAX_BITPLANES);
+    info->spr0pth_index = _move_block(list, SPR0PTH, 16);
+    info->color00_index = _move_block(list, COLOR00, num_colors);
+    return info->color00_index != -1;
+}
+
+BOOL ratr0_copper_add_split(struct Ratr0CopperList *list)
+{
+    // the display sets the WAIT positions
+    ratr0_copper_wait(list, 0xde, 0xff);
+    ratr0_copper_wait(list, 0xde, 0xff);
+    list->info.split_index = _move_block(list, BPL1PTH, 2 * MAX_BITPLANES);
+    return list->info.split_index != -1;
+}
+
+/*
+ * The colors of a line are set in the horizontal blank before it, after a
+ * WAIT for the end of the display of the line before. A WAIT only compares
+ * the low 8 bits of the line, so lines after line 255 need a WAIT at the end
+ * of line 255 first, which has a different position to tell it apart.
+ */
+#define PALETTE_WAIT_HPOS  (0xe0)
+#define CROSSING_WAIT_HPOS (0xde)
+
+/* Beam line of the top of the list's display window */
+static UINT16 _display_vstart(struct Ratr0CopperList *list)
+{
+    UINT16 diwstrt = list->info.diwstrt_index ?
+        ratr0_copper_get_back(list)[list->info.diwstrt_index] : DIWSTRT_VALUE_320;
+    return diwstrt >> 8;
+}
+
+BOOL ratr0_copper_add_palette_lines(struct Ratr0CopperList *list,
+                                    struct Ratr0CopperPaletteLines *lines,
+                                    UINT16 *table)
+{
+    UINT16 num_colors = lines->num_colors;
+    INT32 last_wait_line = -1;
+    lines->vstart = _display_vstart(list);
+    lines->index = list->num_words;
+    lines->num_words = 0;
+
+    for (int line = 0; line < lines->num_lines; line++) {
+        UINT16 *colors = &table[line * num_colors];
+        int num_changes = 0;
+        for (int i = 0; i < num_colors; i++) {
+            if (line == 0 || colors[i] != colors[i - num_colors]) num_changes++;
+        }
+        if (num_changes == 0) continue;
+        if (num_changes > RATR0_COPPER_LINE_MOVES) {
+            PRINT_DEBUG("ERROR: line %d changes %d colors", line, num_changes);
+            return FALSE;
+        }
+        UINT16 wait_line = lines->vstart + lines->first_line + line - 1;
+        if (wait_line > 0xff && last_wait_line < 0xff &&
+            ratr0_copper_wait(list, CROSSING_WAIT_HPOS, 0xff) == -1) return FALSE;
+        if (ratr0_copper_wait(list, PALETTE_WAIT_HPOS, wait_line) == -1) return FALSE;
+        last_wait_line = wait_line;
+
+        for (int i = 0; i < num_colors; i++) {
+            if (line > 0 && colors[i] == colors[i - num_colors]) continue;
+            if (ratr0_copper_move(list, COLOR00 + (lines->first_color + i) * 2,
+                                  colors[i]) == -1) return FALSE;
+        }
+    }
+    lines->num_words = list->num_words - lines->index;
+    return TRUE;
+}
+
+void ratr0_copper_set_palette_lines(struct Ratr0CopperList *list,
+                                    struct Ratr0CopperPaletteLines *lines,
+                                    UINT16 *table)
+{
+    UINT16 *words = ratr0_copper_get_back(list) + lines->index;
+    UINT16 *colors = table;
+    UINT16 high_line = (lines->vstart + lines->first_line - 1) & 0x100;
+    UINT16 wait_line = 0;
+
+    for (int i = 0; i < lines->num_words; i += RATR0_COPPER_INSTR_WORDS) {
+        if (words[i] & 1) {
+            if ((words[i] & 0xfe) == CROSSING_WAIT_HPOS) continue;
+            // the lines of the WAITs increase, restore the 9th bit
+            UINT16 line = high_line | (words[i] >> 8);
+            if (line < wait_line) {
+                high_line = 0x100;
+                line |= high_line;
+            }
+            wait_line = line;
+            colors = &table[(wait_line + 1 - lines->vstart - lines->first_line) * lines->num_colors];
+        } else {
+            words[i + 1] = colors[(words[i] - COLOR00) / 2 - lines->first_color];
+        }
+    }
+}
+
+/* a * b / c rounded to the nearest integer, c > 0 */
+static INT16 _scale_rounded(INT16 a, INT16 b, INT16 c)
+{
+    INT32 n = (INT32) a * b;
+    return n >= 0 ? (2 * n + c) / (2 * c) : -((-2 * n + c) / (2 * c));
+}
+
+void ratr0_copper_make_gradient(UINT16 *table, UINT16 num_lines, UINT16 from, UINT16 to)
+{
+    for (int line = 0; line < num_lines; line++) {
+        UINT16 color = 0;
+        for (int shift = 0; shift <= 8; shift += 4) {
+            INT16 c0 = (from >> shift) & 0xf, c1 = (to >> shift) & 0xf;
+            INT16 c = num_lines > 1 ? c0 + _scale_rounded(c1 - c0, line, num_lines - 1) : c0;
+            color |= c << shift;
+        }
+        table[line] = color;
+    }
+}
+
+BOOL ratr0_copper_end(struct Ratr0CopperList *list)
+{
+    // an END can always be emitted, see _emit()
+    UINT16 *back = ratr0_copper_get_back(list);
+    if (list->num_words + RATR0_COPPER_INSTR_WORDS > list->max_words) return FALSE;
+    back[list->num_words++] = 0xffff;
+    back[list->num_words++] = WAIT_MASK;
+    memcpy(ratr0_copper_get_front(list), back, list->num_words * sizeof(UINT16));
+    list->needs_sync = FALSE;
+    return TRUE;
+}
+
+BOOL ratr0_copper_load(struct Ratr0CopperList *list, UINT16 *words, UINT16 num_words,
+                       struct Ratr0CopperListInfo *info)
+{
+    if (num_words > list->max_words) {
+        PRINT_DEBUG("ERROR: copper list of %d words doesn't fit", (int) num_words);
+        return FALSE;
+    }
+    memcpy(list->copies[0], words, num_words * sizeof(UINT16));
+    memcpy(list->copies[1], words, num_words * sizeof(UINT16));
+    list->num_words = num_words;
+    list->needs_sync = FALSE;
+    list->info = *info;
+    return TRUE;
+}
+
+UINT16 *ratr0_copper_get_back(struct Ratr0CopperList *list)
+{
+    return list->copies[list->front ^ 1];
+}
+
+UINT16 *ratr0_copper_get_front(struct Ratr0CopperList *list)
+{
+    return list->copies[list->front];
+}
+
+void ratr0_copper_swap(struct Ratr0CopperList *list)
+{
+    list->front ^= 1;
+    list->needs_sync = TRUE;
+}
+
+void ratr0_copper_sync(struct Ratr0CopperList *list)
+{
+    if (!list->needs_sync) return;
+    memcpy(ratr0_copper_get_back(list), ratr0_copper_get_front(list),
+           list->num_words * sizeof(UINT16));
+    list->needs_sync = FALSE;
+}
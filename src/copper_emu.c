@@ -0,0 +1,398 @@
+/** @file copper_emu.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <ratr0/display.h>
+#include <ratr0/hw_registers.h>
+#include <ratr0/copper_emu.h>
+
+#define FRAME_CLOCKS (RATR0_COPPER_EMU_NUM_LINES * RATR0_COPPER_EMU_LINE_CLOCKS)
+#define NUM_REGISTERS (0x100)
+#define MAX_LINE (256)
+
+/*
+ * REGISTER NAMES
+ */
+static char register_names[NUM_REGISTERS][10];
+
+static const struct { UINT16 reg; const char *name; } fixed_registers[] = {
+    { 0x000, "BLTDDAT" }, { 0x002, "DMACONR" }, { 0x004, "VPOSR" }, { 0x006, "VHPOSR" },
+    { 0x008, "DSKDATR" }, { 0x00a, "JOY0DAT" }, { 0x00c, "JOY1DAT" }, { 0x00e, "CLXDAT" },
+    { 0x010, "ADKCONR" }, { 0x012, "POT0DAT" }, { 0x014, "POT1DAT" }, { 0x016, "POTGOR" },
+    { 0x018, "SERDATR" }, { 0x01a, "DSKBYTR" }, { 0x01c, "INTENAR" }, { 0x01e, "INTREQR" },
+    { 0x020, "DSKPTH" }, { 0x022, "DSKPTL" }, { 0x024, "DSKLEN" }, { 0x026, "DSKDAT" },
+    { 0x028, "REFPTR" }, { 0x02a, "VPOSW" }, { 0x02c, "VHPOSW" }, { 0x02e, "COPCON" },
+    { 0x030, "SERDAT" }, { 0x032, "SERPER" }, { 0x034, "POTGO" }, { 0x036, "JOYTEST" },
+    { 0x038, "STREQU" }, { 0x03a, "STRVBL" }, { 0x03c, "STRHOR" }, { 0x03e, "STRLONG" },
+    { 0x040, "BLTCON0" }, { 0x042, "BLTCON1" }, { 0x044, "BLTAFWM" }, { 0x046, "BLTALWM" },
+    { 0x048, "BLTCPTH" }, { 0x04a, "BLTCPTL" }, { 0x04c, "BLTBPTH" }, { 0x04e, "BLTBPTL" },
+    { 0x050, "BLTAPTH" }, { 0x052, "BLTAPTL" }, { 0x054, "BLTDPTH" }, { 0x056, "BLTDPTL" },
+    { 0x058, "BLTSIZE" }, { 0x05a, "BLTCON0L" }, { 0x05c, "BLTSIZV" }, { 0x05e, "BLTSIZH" },
+    { 0x060, "BLTCMOD" }, { 0x062, "BLTBMOD" }, { 0x064, "BLTAMOD" }, { 0x066, "BLTDMOD" },
+    { 0x070, "BLTCDAT" }, { 0x072, "BLTBDAT" }, { 0x074, "BLTADAT" }, { 0x07c, "DENISEID" },
+    { 0x07e, "DSKSYNC" }, { 0x080, "COP1LCH" }, { 0x082, "COP1LCL" }, { 0x084, "COP2LCH" },
+    { 0x086, "COP2LCL" }, { 0x088, "COPJMP1" }, { 0x08a, "COPJMP2" }, { 0x08c, "COPINS" },
+    { 0x08e, "DIWSTRT" }, { 0x090, "DIWSTOP" }, { 0x092, "DDFSTRT" }, { 0x094, "DDFSTOP" },
+    { 0x096, "DMACON" }, { 0x098, "CLXCON" }, { 0x09a, "INTENA" }, { 0x09c, "INTREQ" },
+    { 0x09e, "ADKCON" }, { 0x100, "BPLCON0" }, { 0x102, "BPLCON1" }, { 0x104, "BPLCON2" },
+    { 0x106, "BPLCON3" }, { 0x108, "BPL1MOD" }, { 0x10a, "BPL2MOD" }, { 0x10c, "BPLCON4" },
+    { 0x10e, "CLXCON2" }, { 0x1c0, "HTOTAL" }, { 0x1c2, "HSSTOP" }, { 0x1c4, "HBSTRT" },
+    { 0x1c6, "HBSTOP" }, { 0x1c8, "VTOTAL" }, { 0x1ca, "VSSTOP" }, { 0x1cc, "VBSTRT" },
+    { 0x1ce, "VBSTOP" }, { 0x1d0, "SPRHSTRT" }, { 0x1d2, "SPRHSTOP" }, { 0x1d4, "BPLHSTRT" },
+    { 0x1d6, "BPLHSTOP" }, { 0x1d8, "HHPOSW" }, { 0x1da, "HHPOSR" }, { 0x1dc, "BEAMCON0" },
+    { 0x1de, "HSSTRT" }, { 0x1e0, "VSSTRT" }, { 0x1e2, "HCENTER" }, { 0x1e4, "DIWHIGH" },
+    { 0x1fc, "FMODE" }, { 0x1fe, "NOOP" }
+};
+
+static void _init_register_names(void)
+{
+    static const char *audio[] = { "LCH", "LCL", "LEN", "PER", "VOL", "DAT" };
+    static const char *sprite[] = { "POS", "CTL", "DATA", "DATB" };
+    if (register_names[0][0]) return;
+    for (int i = 0; i < sizeof(fixed_registers) / sizeof(fixed_registers[0]); i++) {
+        strcpy(register_names[fixed_registers[i].reg >> 1], fixed_registers[i].name);
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 6; j++) {
+            sprintf(register_names[(0x0a0 + i * 0x10 + j * 2) >> 1], "AUD%d%s", i, audio[j]);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        sprintf(register_names[(BPL1PTH + i * 4) >> 1], "BPL%dPTH", i + 1);
+        sprintf(register_names[(BPL1PTL + i * 4) >> 1], "BPL%dPTL", i + 1);
+        sprintf(register_names[(0x110 + i * 2) >> 1], "BPL%dDAT", i + 1);
+        sprintf(register_names[(SPR0PTH + i * 4) >> 1], "SPR%dPTH", i);
+        sprintf(register_names[(SPR0PTL + i * 4) >> 1], "SPR%dPTL", i);
+        for (int j = 0; j < 4; j++) {
+            sprintf(register_names[(0x140 + i * 8 + j * 2) >> 1], "SPR%d%s", i, sprite[j]);
+        }
+    }
+    for (int i = 0; i < 32; i++) {
+        sprintf(register_names[(COLOR00 + i * 2) >> 1], "COLOR%02d", i);
+    }
+}
+
+const char *ratr0_copper_emu_register_name(UINT16 reg)
+{
+    _init_register_names();
+    if (reg >= 2 * NUM_REGISTERS || (reg & 1) || !register_names[reg >> 1][0]) return NULL;
+    return register_names[reg >> 1];
+}
+
+/*
+ * EMULATION
+ */
+
+/* The display registers that decide which slots bitplane DMA takes */
+struct DisplayState {
+    UINT16 ddfstrt, ddfstop, diwstrt, diwstop, num_bitplanes;
+};
+
+/*
+ * The copper can use an even color clock unless the bitplane DMA of a lores
+ * plane 5 or 6 takes it. A fetch unit of 8 clocks from DDFSTRT reads the
+ * planes in the order -, 4, 6, 2, -, 3, 5, 1.
+ */
+static BOOL _is_slot_free(struct DisplayState *display, UINT32 clock)
+{
+    UINT16 vpos = clock / RATR0_COPPER_EMU_LINE_CLOCKS;
+    UINT16 hpos = clock % RATR0_COPPER_EMU_LINE_CLOCKS;
+    if (hpos & 1) return FALSE;
+    if (display->num_bitplanes < 5) return TRUE;
+
+    // the stop line's bit 8 is the inverse of its bit 7
+    UINT16 vstart = display->diwstrt >> 8;
+    UINT16 vstop = (display->diwstop >> 8) | ((display->diwstop & 0x8000) ? 0 : 0x100);
+    if (vpos < vstart || vpos >= vstop ||
+        hpos < display->ddfstrt || hpos >= display->ddfstop + 8) return TRUE;
+    UINT16 slot = (hpos - display->ddfstrt) & 7;
+    return !(slot == 2 && display->num_bitplanes >= 6) && !(slot == 6);
+}
+
+/* Fetches a copper word, returns FALSE if the frame ended */
+static BOOL _fetch(struct DisplayState *display, UINT32 *clock)
+{
+    while (*clock < FRAME_CLOCKS && !_is_slot_free(display, *clock)) (*clock)++;
+    if (*clock >= FRAME_CLOCKS) return FALSE;
+    (*clock)++;
+    return TRUE;
+}
+
+/* The WAIT and SKIP comparison, with the enable bits of the second word */
+static BOOL _is_beam_at(UINT16 word0, UINT16 word1, UINT32 clock)
+{
+    UINT16 vmask = 0x80 | ((word1 >> 8) & 0x7f), hmask = word1 & 0xfe;
+    UINT16 vpos = (clock / RATR0_COPPER_EMU_LINE_CLOCKS) & vmask;
+    UINT16 hpos = (clock % RATR0_COPPER_EMU_LINE_CLOCKS) & hmask;
+    UINT16 wait_vpos = (word0 >> 8) & vmask, wait_hpos = word0 & hmask;
+    return vpos > wait_vpos || (vpos == wait_vpos && hpos >= wait_hpos);
+}
+
+static void _add_issue(struct Ratr0CopperEmu *emu, Ratr0CopperIssueType type,
+                       UINT16 index, UINT32 clock)
+{
+    if (type < RATR0_COPPER_PASSED_WAIT) emu->num_errors++;
+    if (emu->num_issues == RATR0_COPPER_EMU_MAX_ISSUES) return;
+    struct Ratr0CopperIssue *issue = &emu->issues[emu->num_issues++];
+    issue->type = type;
+    issue->index = index;
+    issue->vpos = clock / RATR0_COPPER_EMU_LINE_CLOCKS;
+    issue->hpos = clock % RATR0_COPPER_EMU_LINE_CLOCKS;
+}
+
+static void _add_write(struct Ratr0CopperEmu *emu, struct DisplayState *display,
+                       UINT16 index, UINT16 reg, UINT16 value, UINT32 clock)
+{
+    switch (reg) {
+    case DDFSTRT: display->ddfstrt = value & 0xfc; break;
+    case DDFSTOP: display->ddfstop = value & 0xfc; break;
+    case DIWSTRT: display->diwstrt = value; break;
+    case DIWSTOP: display->diwstop = value; break;
+    case BPLCON0:
+        if (value >> 12) display->num_bitplanes = (value >> 12) & 7;
+        break;
+    default: break;
+    }
+    if (emu->num_writes == RATR0_COPPER_EMU_MAX_WRITES) return;
+    struct Ratr0CopperWrite *write = &emu->writes[emu->num_writes++];
+    write->index = index;
+    write->vpos = clock / RATR0_COPPER_EMU_LINE_CLOCKS;
+    write->hpos = clock % RATR0_COPPER_EMU_LINE_CLOCKS;
+    write->reg = reg;
+    write->value = value;
+}
+
+void ratr0_copper_emu_run(struct Ratr0CopperEmu *emu, UINT16 *words, UINT16 num_words)
+{
+    struct DisplayState display = {
+        DDFSTRT_VALUE_320, DDFSTOP_VALUE_320, DIWSTRT_VALUE_320, DIWSTOP_VALUE_PAL_320,
+        emu->num_bitplanes
+    };
+    UINT32 clock = 0;
+    INT32 wait_line = -1;
+    BOOL overrun = FALSE;
+    emu->num_writes = emu->num_issues = emu->num_errors = 0;
+
+    for (UINT16 index = 0; ; index += 2) {
+        if (index + 1 >= num_words) {
+            _add_issue(emu, RATR0_COPPER_MISSING_END, index, clock);
+            return;
+        }
+        UINT16 word0 = words[index], word1 = words[index + 1];
+        if (word0 == 0xffff && word1 == 0xfffe) return;
+        // the copper restarts at the next frame
+        if (!_fetch(&display, &clock) || !_fetch(&display, &clock)) return;
+        UINT32 instr_clock = clock - 1;
+
+        if (!(word0 & 1)) {
+            // MOVE: registers below 0x40 stop the copper, the blitter
+            // registers up to 0x7e need the danger bit
+            UINT16 reg = word0 & 0x1fe;
+            if (reg < 0x40) {
+                _add_issue(emu, RATR0_COPPER_ILLEGAL_REGISTER, index, instr_clock);
+                return;
+            }
+            if (reg < 0x80 && !emu->danger) {
+                _add_issue(emu, RATR0_COPPER_PROTECTED_REGISTER, index, instr_clock);
+                return;
+            }
+            _add_write(emu, &display, index, reg, word1, instr_clock);
+
+            // MOVEs that belong to a WAIT shouldn't show up in the display
+            // of the next line
+            UINT32 line = instr_clock / RATR0_COPPER_EMU_LINE_CLOCKS;
+            UINT16 hpos = instr_clock % RATR0_COPPER_EMU_LINE_CLOCKS;
+            if (wait_line >= 0 && !overrun &&
+                (line > wait_line + 1 || (line == wait_line + 1 && hpos >= display.ddfstrt))) {
+                _add_issue(emu, RATR0_COPPER_LINE_OVERRUN, index, instr_clock);
+                overrun = TRUE;
+            }
+        } else if (word1 & 1) {
+            // SKIP
+            if (_is_beam_at(word0, word1, clock)) index += 2;
+        } else {
+            // WAIT
+            UINT16 line = (clock / RATR0_COPPER_EMU_LINE_CLOCKS) & 0xff;
+            if (_is_beam_at(word0, word1, clock) && line > (word0 >> 8)) {
+                _add_issue(emu, RATR0_COPPER_PASSED_WAIT, index, clock);
+            }
+            while (clock < FRAME_CLOCKS && !_is_beam_at(word0, word1, clock)) clock++;
+            if (clock >= FRAME_CLOCKS) {
+                _add_issue(emu, RATR0_COPPER_UNREACHABLE_WAIT, index, clock - 1);
+                return;
+            }
+            // the copper wakes up a cycle later
+            clock += 2;
+            wait_line = (clock - 2) / RATR0_COPPER_EMU_LINE_CLOCKS;
+            overrun = FALSE;
+        }
+    }
+}
+
+/*
+ * OUTPUT
+ */
+static void _print_move(UINT16 reg, UINT16 value, FILE *out)
+{
+    const char *name = ratr0_copper_emu_register_name(reg);
+    if (name) fprintf(out, "%s,$%04x", name, value);
+    else fprintf(out, "$%03x,$%04x", reg, value);
+}
+
+void ratr0_copper_emu_disassemble(UINT16 *words, UINT16 num_words, FILE *out)
+{
+    for (UINT16 index = 0; index + 1 < num_words; index += 2) {
+        UINT16 word0 = words[index], word1 = words[index + 1];
+        fprintf(out, "%4d: ", index);
+        if (!(word0 & 1)) {
+            fprintf(out, "MOVE  ");
+            _print_move(word0 & 0x1fe, word1, out);
+        } else if (word0 == 0xffff && word1 == 0xfffe) {
+            fprintf(out, "END");
+        } else {
+            fprintf(out, "%s  $%02x,$%02x", (word1 & 1) ? "SKIP" : "WAIT",
+                    word0 & 0xfe, word0 >> 8);
+            if ((word1 & 0xfffe) != 0xfffe) fprintf(out, " mask $%04x", word1 & 0xfffe);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void ratr0_copper_emu_print_writes(struct Ratr0CopperEmu *emu, FILE *out)
+{
+    for (int i = 0; i < emu->num_writes; i++) {
+        struct Ratr0CopperWrite *write = &emu->writes[i];
+        fprintf(out, "line %3d, $%02x: ", write->vpos, write->hpos);
+        _print_move(write->reg, write->value, out);
+        fprintf(out, "\n");
+    }
+}
+
+void ratr0_copper_emu_print_issues(struct Ratr0CopperEmu *emu, const char *name, FILE *out)
+{
+    static const char *messages[] = {
+        "error: MOVE to a register that stops the copper",
+        "error: MOVE to a register that needs the COPCON danger bit",
+        "error: WAIT is never reached in the frame",
+        "error: the list has no END",
+        "warning: WAIT for a position the beam already passed",
+        "warning: MOVEs after the WAIT reach the display of the next line"
+    };
+    for (int i = 0; i < emu->num_issues; i++) {
+        struct Ratr0CopperIssue *issue = &emu->issues[i];
+        fprintf(out, "%s: word %d: %s (line %d, $%02x)\n", name, issue->index,
+                messages[issue->type], issue->vpos, issue->hpos);
+    }
+}
+
+/*
+ * ASSEMBLER
+ */
+static const struct { const char *name; UINT16 value; } symbols[] = {
+    { "DDFSTRT_VALUE_320", DDFSTRT_VALUE_320 }, { "DDFSTOP_VALUE_320", DDFSTOP_VALUE_320 },
+    { "DDFSTRT_VALUE_288", DDFSTRT_VALUE_288 }, { "DDFSTOP_VALUE_288", DDFSTOP_VALUE_288 },
+    { "DIWSTRT_VALUE_320", DIWSTRT_VALUE_320 }, { "DIWSTOP_VALUE_PAL_320", DIWSTOP_VALUE_PAL_320 },
+    { "DIWSTOP_VALUE_NTSC_320", DIWSTOP_VALUE_NTSC_320 },
+    { "DIWSTRT_VALUE_288", DIWSTRT_VALUE_288 }, { "DIWSTOP_VALUE_PAL_288", DIWSTOP_VALUE_PAL_288 },
+    { "DIWSTOP_VALUE_NTSC_288", DIWSTOP_VALUE_NTSC_288 }
+};
+
+/* Parses a number in C or $ hex notation or a symbol */
+static BOOL _parse_value(const char *s, UINT16 *value)
+{
+    char *end;
+    long v;
+    if (*s == '$') v = strtol(s + 1, &end, 16);
+    else if (isdigit((unsigned char) *s)) v = strtol(s, &end, 0);
+    else {
+        for (int i = 0; i < sizeof(symbols) / sizeof(symbols[0]); i++) {
+            if (!strcmp(s, symbols[i].name)) {
+                *value = symbols[i].value;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+    if (*end || v < 0 || v > 0xffff) return FALSE;
+    *value = v;
+    return TRUE;
+}
+
+static BOOL _parse_register(const char *s, UINT16 *reg)
+{
+    _init_register_names();
+    for (int i = 0; i < NUM_REGISTERS; i++) {
+        if (register_names[i][0] && !strcasecmp(s, register_names[i])) {
+            *reg = i << 1;
+            return TRUE;
+        }
+    }
+    return _parse_value(s, reg) && *reg < 2 * NUM_REGISTERS && !(*reg & 1);
+}
+
+/* Splits "a,b" into trimmed operands, returns the number of operands */
+static int _split_operands(char *s, char *ops[2])
+{
+    int n = 0;
+    while (isspace((unsigned char) *s)) s++;
+    if (!*s) return 0;
+    for (char *tok = strtok(s, ","); tok && n < 3; tok = strtok(NULL, ",")) {
+        while (isspace((unsigned char) *tok)) tok++;
+        char *end = tok + strlen(tok);
+        while (end > tok && isspace((unsigned char) end[-1])) *--end = 0;
+        if (n < 2) ops[n] = tok;
+        n++;
+    }
+    return n;
+}
+
+int ratr0_copper_emu_assemble(FILE *in, const char *name, UINT16 *words, UINT16 max_words)
+{
+    char line[MAX_LINE], mnemonic[MAX_LINE];
+    char *ops[2];
+    int num_words = 0, line_num = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        line_num++;
+        char *s = line, *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+        while (isspace((unsigned char) *s)) s++;
+        int len = 0;
+        while (s[len] && !isspace((unsigned char) s[len])) len++;
+        if (len == 0 || s[len - 1] == ':') continue;  // empty line or label
+
+        memcpy(mnemonic, s, len);
+        mnemonic[len] = 0;
+        int num_ops = _split_operands(s + len, ops);
+        UINT16 word0, word1;
+        BOOL ok;
+        if (!strcasecmp(mnemonic, "MOVE")) {
+            ok = num_ops == 2 && _parse_register(ops[0], &word0) && _parse_value(ops[1], &word1);
+        } else if (!strcasecmp(mnemonic, "WAIT") || !strcasecmp(mnemonic, "SKIP")) {
+            UINT16 hpos, vpos;
+            ok = num_ops == 2 && _parse_value(ops[0], &hpos) && _parse_value(ops[1], &vpos) &&
+                hpos <= 0xff && vpos <= 0xff;
+            word0 = (vpos << 8) | (hpos & 0xfe) | 1;
+            word1 = !strcasecmp(mnemonic, "WAIT") ? 0xfffe : 0xffff;
+        } else if (!strcasecmp(mnemonic, "END")) {
+            ok = num_ops == 0;
+            word0 = 0xffff;
+            word1 = 0xfffe;
+        } else {
+            ok = FALSE;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: syntax error\n", name, line_num);
+            return -1;
+        }
+        if (num_words + 2 > max_words) {
+            fprintf(stderr, "%s:%d: list is too long\n", name, line_num);
+            return -1;
+        }
+        words[num_words++] = word0;
+        words[num_words++] = word1;
+    }
+    return num_words;
+}
@@ -19,39 +19,146 @@ BOOL ratr0_bitset_isset(UINT32 *bitset, UINT16 size, UINT16 index)
     return (bitset[index >> 5] & bitmask) == bitmask;
 }
 
+/* Number of leading zero bits of a byte */
+static const UINT8 clz8[256] = {
+    8, 7, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 4,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/* Number of leading zero bits of a non-zero word, which is the index of
+   its first element */
+static UINT16 _clz32(UINT32 word)
+{
+    if (word & 0xffff0000) {
+        if (word & 0xff000000) return clz8[word >> 24];
+        return 8 + clz8[(word >> 16) & 0xff];
+    }
+    if (word & 0xff00) return 16 + clz8[(word >> 8) & 0xff];
+    return 24 + clz8[word & 0xff];
+}
+
 /**
- * Iterates over all set bits in the set
+ * Iterates over all set bits in the set. Empty words are skipped and
+ * within a word, the leading zero count jumps straight to the next set bit.
  */
 void ratr0_bitset_iterate(UINT32 *bitset, UINT16 size, void (*func)(UINT16, void *), void *userdata)
 {
-    int i, j, k;
-    UINT8 *bytes, mask, b;
-    for (i = 0; i < size; i++) {
-        // We can immediately skip over empty words
-        if (bitset[i] != 0) {
-            // now we can split each UINT32 into UINT8s and do the same
-            // make sure we are aware of endianess, because most modern architectures
-            // are little endian
-            bytes = (UINT8 *) &bitset[i];
-            for (j = 0; j < 4; j++) {
-#ifdef LITTLE_ENDIAN
-                // I hate little endian !!!
-                if (bytes[3-j] != 0) {
-                    b = bytes[3-j];
-#else
-                // see how naturally bytes advance in big endian ?
-                if (bytes[j] != 0) {
-                    b = bytes[j];
-#endif
-                    for (k = 0; k < 8; k++) {
-                        mask = 1 << (7 - k);
-                        if ((b & mask) == mask) {
-                            // call func with index
-                            func((i << 5) + (j << 3) + k, userdata);
-                        }
-                    }
-                }
+    for (UINT16 i = 0; i < size; i++) {
+        UINT32 word = bitset[i];
+        while (word) {
+            UINT16 bit = _clz32(word);
+            func((i << 5) + bit, userdata);
+            word &= ~(0x80000000 >> bit);
+        }
+    }
+}
+
+UINT16 ratr0_bitset_row_shift(UINT16 row_width)
+{
+    UINT16 shift = 0;
+    while ((1 << shift) < row_width) shift++;
+    return shift;
+}
+
+/* A rectangle in grid coordinates */
+struct BitSetRect {
+    UINT16 x, y, w, h;
+};
+#define MAX_RUNS (RATR0_BITSET_MAX_ROW_WIDTH / 2)
+
+/* Finds the runs of set bits in a row, returns the number of runs */
+static int _row_runs(UINT32 *bitset, UINT16 row, UINT16 row_width,
+                     struct BitSetRect *runs)
+{
+    int num_runs = 0;
+    UINT16 index = row * row_width;
+    for (UINT16 x = 0; x < row_width; x++, index++) {
+        if ((index & 31) == 0 && bitset[index >> 5] == 0) {
+            // skip the empty word, the loop increment adds the last one
+            x += 31;
+            index += 31;
+            continue;
+        }
+        if (bitset[index >> 5] & (0x80000000 >> (index & 31))) {
+            if (num_runs > 0 && runs[num_runs - 1].x + runs[num_runs - 1].w == x) {
+                runs[num_runs - 1].w++;
+            } else {
+                runs[num_runs].x = x;
+                runs[num_runs].y = row;
+                runs[num_runs].w = 1;
+                runs[num_runs].h = 1;
+                num_runs++;
             }
         }
     }
+    return num_runs;
+}
+
+void ratr0_bitset_iterate_rects(UINT32 *bitset, UINT16 size, UINT16 row_width,
+                                BOOL merge_rows, Ratr0BitSetRectFunc func,
+                                void *userdata)
+{
+    // rectangles that can still grow downwards, both lists are sorted by x
+    struct BitSetRect open[MAX_RUNS], next[MAX_RUNS], runs[MAX_RUNS];
+    int num_open = 0;
+    UINT16 num_rows = (size << 5) / row_width;
+
+    if (row_width > RATR0_BITSET_MAX_ROW_WIDTH) {
+        // the runs of a row don't fit, every element is its own rectangle
+        for (UINT16 i = 0; i < size; i++) {
+            UINT32 word = bitset[i];
+            while (word) {
+                UINT16 bit = _clz32(word);
+                UINT16 index = (i << 5) + bit;
+                func(index % row_width, index / row_width, 1, 1, userdata);
+                word &= ~(0x80000000 >> bit);
+            }
+        }
+        return;
+    }
+
+    for (UINT16 row = 0; row < num_rows; row++) {
+        int num_runs = _row_runs(bitset, row, row_width, runs);
+        if (!merge_rows) {
+            for (int j = 0; j < num_runs; j++) {
+                func(runs[j].x, runs[j].y, runs[j].w, 1, userdata);
+            }
+            continue;
+        }
+        int i = 0, j = 0, num_next = 0;
+        while (i < num_open || j < num_runs) {
+            if (i < num_open && j < num_runs &&
+                open[i].x == runs[j].x && open[i].w == runs[j].w) {
+                // same span as in the previous row: the rectangle grows
+                open[i].h++;
+                next[num_next++] = open[i++];
+                j++;
+            } else if (i < num_open && (j == num_runs || open[i].x <= runs[j].x)) {
+                // not continued
+                func(open[i].x, open[i].y, open[i].w, open[i].h, userdata);
+                i++;
+            } else {
+                next[num_next++] = runs[j++];
+            }
+        }
+        memcpy(open, next, sizeof(struct BitSetRect) * num_next);
+        num_open = num_next;
+    }
+    for (int i = 0; i < num_open; i++) {
+        func(open[i].x, open[i].y, open[i].w, open[i].h, userdata);
+    }
 }
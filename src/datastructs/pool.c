@@ -0,0 +1,85 @@
+/** @file pool.c */
+#include <string.h>
+#include <ratr0/debug_utils.h>
+#include <ratr0/datastructs/pool.h>
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_TAG("POOL", __VA_ARGS__)
+
+void ratr0_pool_init(struct Ratr0Pool *pool, UINT16 element_size, UINT16 capacity,
+                     Ratr0MemoryType mem_type)
+{
+    // every object needs to be able to hold the free list link and
+    // keep the following objects aligned
+    if (element_size < sizeof(void *)) element_size = sizeof(void *);
+    element_size = (element_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    pool->element_size = element_size;
+    pool->capacity = capacity;
+    pool->num_used = 0;
+    pool->next_unused = 0;
+    pool->first_free = NULL;
+    pool->handle = ratr0_memory_allocate_block(mem_type, (UINT32) element_size * capacity);
+    pool->elements = ratr0_memory_block_address(pool->handle);
+#ifdef DEBUG
+    pool->poison = TRUE;
+#else
+    pool->poison = FALSE;
+#endif
+}
+
+void ratr0_pool_destroy(struct Ratr0Pool *pool)
+{
+    ratr0_memory_free_block(pool->handle);
+    pool->elements = NULL;
+    pool->capacity = pool->num_used = pool->next_unused = 0;
+    pool->first_free = NULL;
+}
+
+void *ratr0_pool_alloc(struct Ratr0Pool *pool)
+{
+    UINT8 *result;
+    if (pool->first_free) {
+        result = pool->first_free;
+        pool->first_free = *((void **) result);
+        if (pool->poison) {
+            for (int i = sizeof(void *); i < pool->element_size; i++) {
+                if (result[i] != RATR0_POOL_POISON) {
+                    PRINT_DEBUG("ERROR: object %u was modified after it was freed",
+                                ratr0_pool_index(pool, result));
+                    break;
+                }
+            }
+        }
+    } else if (pool->next_unused < pool->capacity) {
+        result = ratr0_pool_at(pool, pool->next_unused++);
+    } else {
+        PRINT_DEBUG("ERROR: pool exhausted, capacity: %u", pool->capacity);
+        return NULL;
+    }
+    pool->num_used++;
+    return result;
+}
+
+void ratr0_pool_free(struct Ratr0Pool *pool, void *element)
+{
+    UINT8 *address = element;
+    if (address < pool->elements ||
+        address >= pool->elements + pool->next_unused * pool->element_size ||
+        (address - pool->elements) % pool->element_size != 0) {
+        PRINT_DEBUG("ERROR: trying to free an object that is not in the pool");
+        return;
+    }
+    if (pool->poison && pool->element_size > sizeof(void *)) {
+        // a freed object is poisoned except for its free list link
+        int i = sizeof(void *);
+        while (i < pool->element_size && address[i] == RATR0_POOL_POISON) i++;
+        if (i == pool->element_size) {
+            PRINT_DEBUG("ERROR: object %u was already freed", ratr0_pool_index(pool, address));
+            return;
+        }
+    }
+    if (pool->poison) memset(address, RATR0_POOL_POISON, pool->element_size);
+    *((void **) address) = pool->first_free;
+    pool->first_free = address;
+    pool->num_used--;
+}
@@ -0,0 +1,54 @@
+/** @file rect_set.c */
+#include <ratr0/datastructs/rect_set.h>
+
+void ratr0_rect_set_clear(struct Ratr0RectSet *set)
+{
+    set->num_rects = 0;
+}
+
+static UINT32 _area(struct Ratr0Rect *r)
+{
+    return (UINT32) r->width * r->height;
+}
+
+/*
+ * Merges b into a if they overlap or touch and their bounding box isn't
+ * larger than both of them
+ */
+static BOOL _merge(struct Ratr0Rect *a, struct Ratr0Rect *b)
+{
+    UINT16 x0 = a->x < b->x ? a->x : b->x;
+    UINT16 y0 = a->y < b->y ? a->y : b->y;
+    UINT16 ax1 = a->x + a->width, bx1 = b->x + b->width;
+    UINT16 ay1 = a->y + a->height, by1 = b->y + b->height;
+    UINT16 x1 = ax1 > bx1 ? ax1 : bx1;
+    UINT16 y1 = ay1 > by1 ? ay1 : by1;
+
+    if (a->x > bx1 || b->x > ax1 || a->y > by1 || b->y > ay1) return FALSE;
+    if ((UINT32) (x1 - x0) * (y1 - y0) > _area(a) + _area(b)) return FALSE;
+    a->x = x0;
+    a->y = y0;
+    a->width = x1 - x0;
+    a->height = y1 - y0;
+    return TRUE;
+}
+
+BOOL ratr0_rect_set_insert(struct Ratr0RectSet *set, UINT16 x, UINT16 y,
+                           UINT16 width, UINT16 height)
+{
+    struct Ratr0Rect rect = { x, y, width, height };
+    if (width == 0 || height == 0) return TRUE;
+
+    // a merged rectangle can merge with the ones that were checked before
+    for (int i = 0; i < set->num_rects; ) {
+        if (_merge(&rect, &set->rects[i])) {
+            set->rects[i] = set->rects[--set->num_rects];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (set->num_rects == RATR0_RECT_SET_SIZE) return FALSE;
+    set->rects[set->num_rects++] = rect;
+    return TRUE;
+}
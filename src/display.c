@@ -17,11 +17,14 @@
 
 #include <ratr0/memory.h>
 #include <ratr0/datastructs/bitset.h>
+#include <ratr0/datastructs/rect_set.h>
+#include <ratr0/datastructs/pool.h>
 #include <ratr0/resources.h>
 
 #include <ratr0/hw_registers.h>
 #include <ratr0/display.h>
 #include <ratr0/sprites.h>
+#include <ratr0/copper.h>
 #include <ratr0/blitter.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("DISPLAY", __VA_ARGS__)
@@ -74,35 +77,45 @@ struct Ratr0DisplayInfo {
 struct Ratr0DisplayInfo display_info;
 
 /**
- * current active copper list
+ * current active copper list, current_coplist is its back copy that all
+ * changes go to
  */
 struct Ratr0CopperListInfo *current_copper_info;
 UINT16 *current_coplist;
 int current_coplist_size;
+static struct Ratr0CopperList *current_copper;
+// frame of the last copper list swap
+static UINT16 copper_swap_frame;
+
+// Static copper lists are loaded into the one of these that is not on screen
+#define STATIC_COPPER_MAX_WORDS (512)
+static struct Ratr0CopperList static_coppers[2];
+
+// the sprite chain set that is shown from the next buffer swap on, -1 if none
+static INT16 pending_sprite_chains = -1;
 
 // Double buffer management
-#define MAX_BUFFERS (2)
 static void _update_front_buffers(UINT16 coplist[], int num_words,
-                                  struct Ratr0CopperListInfo *info);
+                                  struct Ratr0CopperListInfo *info,
+                                  BOOL all_playfields);
 
 // For our interrupt handlers
 static struct Interrupt vbint;
 UINT8 frames_elapsed;
-
-// A bitset for each buffer, 10x32 = 320 rectangles each
-// representing 20x16 rectangles of 16x16 pixels on a 320x256 frame
-// We can map a rectangle (x,y) to a bit index by using
-// p_i = y * 20 + x and y = p_i / 20, x = p_i % 20 in row major order
-
-// If we can for example use a base 2 dimension, like the height in this case
-// we can use column major order and compute
-// p_i = x * 20 + y and x = p_i % 16, x = p_i % 16 in column major order
-// which can be faster since we can use bitwise operations instead of
-// divisions
-#define BITSET_SIZE (10)
-#define BITSET_INDEX(x, y) (y * 20 + x)
-#define BITSET_X(idx) (idx % 20)
-#define BITSET_Y(idx) (idx / 20)
+// vertical blanks since startup, never reset
+static volatile UINT16 display_frames;
+// if FALSE, the game loop only waits for the vertical blank when the back
+// buffer is still on screen
+static BOOL wait_vblank = TRUE;
+
+// A bitset for each buffer, representing the display buffer as a grid of
+// 16x16 pixel tiles. The grid is sized from the playfield's buffer size and
+// its row stride is rounded up to a power of 2, so a tile (x, y) maps to
+// the bit index p_i = (y << dirty_shift) + x and back with
+// x = p_i & (stride - 1), y = p_i >> dirty_shift
+#define DIRTY_INDEX(pf, x, y) (((y) << (pf)->dirty_shift) + (x))
+#define DIRTY_X(pf, idx) ((idx) & ((1 << (pf)->dirty_shift) - 1))
+#define DIRTY_Y(pf, idx) ((idx) >> (pf)->dirty_shift)
 
 /**
  * Captures the properties of our display, which can be either 1 or 2
@@ -110,44 +123,129 @@ UINT8 frames_elapsed;
  */
 struct Playfield {
     struct Ratr0DisplayBuffer display_buffer[MAX_BUFFERS];
-    UINT16 back_buffer, front_buffer;
-    UINT32 bitset_arr[MAX_BUFFERS][BITSET_SIZE];
+    // front_buffer is in the copper list, prev_front_buffer was in it
+    // before the last swap and stays on screen until the next vertical
+    // blank after swap_frame
+    UINT16 back_buffer, front_buffer, prev_front_buffer;
+    UINT16 swap_frame;
     UINT32 display_buffer_size;
+    UINT16 num_allocated_buffers;
+    // dirty tile sets of all buffers, dirty_words each
+    Ratr0MemHandle h_dirty;
+    UINT16 dirty_shift, dirty_words;
+    // exact dirty areas of all buffers, in pixels
+    struct Ratr0RectSet dirty_areas[MAX_BUFFERS];
+    // hardware scroll position, applied to the copper list at the next swap
+    UINT16 scroll_x, scroll_y;
+    BOOL scroll_changed;
 };
 static struct Playfield playfields[MAX_PLAYFIELDS];
 
-#define HW_SPRITE_TABLE_SIZE (20)
-// Sprite and bob tables can be in Fastmem
-struct Ratr0HWSprite hw_sprite_table[HW_SPRITE_TABLE_SIZE];
-UINT16 next_hw_sprite = 0;
-struct Ratr0Bob bob_table[20];
-UINT16 next_bob = 0;
+// Sprite and bob pools can be in Fastmem
+static struct Ratr0Pool hw_sprite_pool;
+static struct Ratr0Pool bob_pool;
 
 BOOL ratr0_display_is_pal(void)
 {
     return display_info.is_pal;
 }
 
+UINT16 ratr0_display_get_num_playfields(void)
+{
+    return display_info.num_playfields;
+}
+
+static UINT32 *_dirty_set(struct Playfield *playfield, UINT16 buffer_num)
+{
+    return ((UINT32 *) ratr0_memory_block_address(playfield->h_dirty)) +
+        buffer_num * playfield->dirty_words;
+}
+
+/*
+ * Sizes the dirty tile sets of a playfield for its buffer size. The sets of
+ * all buffers are cleared.
+ */
+static void _init_dirty_sets(struct Playfield *playfield,
+                             struct Ratr0PlayfieldInfo *pfinfo)
+{
+    UINT16 tiles_x = (pfinfo->buffer_width + 15) >> 4;
+    UINT16 tiles_y = (pfinfo->buffer_height + 15) >> 4;
+    if (playfield->h_dirty != -1) ratr0_memory_free_block(playfield->h_dirty);
+    playfield->dirty_shift = ratr0_bitset_row_shift(tiles_x);
+    playfield->dirty_words = RATR0_BITSET_GRID_WORDS(playfield->dirty_shift, tiles_y);
+    playfield->h_dirty = ratr0_memory_allocate_block(RATR0_MEM_FAST | RATR0_MEMTAG_DISPLAY,
+                                                     playfield->dirty_words * sizeof(UINT32) *
+                                                     pfinfo->num_buffers);
+    ratr0_bitset_clear(_dirty_set(playfield, 0), playfield->dirty_words * pfinfo->num_buffers);
+    for (int i = 0; i < MAX_BUFFERS; i++) ratr0_rect_set_clear(&playfield->dirty_areas[i]);
+}
+
 void ratr0_display_add_dirty_rectangle(UINT16 playfield_num, UINT16 x, UINT16 y)
 {
     struct Playfield *playfield = &playfields[playfield_num];
-    // Add the rectangles to both buffers
-    ratr0_bitset_insert(playfield->bitset_arr[playfield->front_buffer],
-                        BITSET_SIZE, BITSET_INDEX(x, y));
-    ratr0_bitset_insert(playfield->bitset_arr[playfield->back_buffer],
-                        BITSET_SIZE, BITSET_INDEX(x, y));
+    struct Ratr0PlayfieldInfo *pfinfo = &display_info.playfield[playfield_num];
+    // the sets are exactly as large as the buffers, a tile outside would
+    // be added to the next buffer's set or behind the memory block
+    if (x >= (pfinfo->buffer_width + 15) >> 4 || y >= (pfinfo->buffer_height + 15) >> 4) return;
+    UINT16 index = DIRTY_INDEX(playfield, x, y);
+    // Add the rectangles to all buffers, each one restores them when it
+    // is the back buffer
+    for (int i = 0; i < pfinfo->num_buffers; i++) {
+        ratr0_bitset_insert(_dirty_set(playfield, i), playfield->dirty_words, index);
+    }
 }
 
-static void (*_process_rect)(struct Ratr0DisplayBuffer *, UINT16 x, UINT16 y);
+void ratr0_display_add_dirty_area(UINT16 playfield_num, UINT16 x, UINT16 y,
+                                  UINT16 width, UINT16 height)
+{
+    struct Playfield *playfield = &playfields[playfield_num];
+    struct Ratr0PlayfieldInfo *pfinfo = &display_info.playfield[playfield_num];
+    // whole words, within the buffer
+    UINT16 x1 = (x + width + 15) & ~0x0f, y1 = y + height;
+    if (x1 > pfinfo->buffer_width) x1 = pfinfo->buffer_width;
+    if (y1 > pfinfo->buffer_height) y1 = pfinfo->buffer_height;
+    x &= ~0x0f;
+    if (x >= x1 || y >= y1) return;
+
+    for (int i = 0; i < pfinfo->num_buffers; i++) {
+        if (!ratr0_rect_set_insert(&playfield->dirty_areas[i], x, y, x1 - x, y1 - y)) {
+            // a full set falls back to the tiles of the area
+            for (UINT16 ty = y >> 4; ty <= (y1 - 1) >> 4; ty++) {
+                for (UINT16 tx = x >> 4; tx < x1 >> 4; tx++) {
+                    ratr0_bitset_insert(_dirty_set(playfield, i), playfield->dirty_words,
+                                        DIRTY_INDEX(playfield, tx, ty));
+                }
+            }
+        }
+    }
+}
+
+static void (*_process_rect)(struct Ratr0DisplayBuffer *, UINT16 x, UINT16 y,
+                             UINT16 w, UINT16 h);
+static Ratr0DirtyRectMode dirty_rect_mode = RATR0_DIRTY_RECTS;
+
+void ratr0_display_set_dirty_rect_mode(Ratr0DirtyRectMode mode)
+{
+    dirty_rect_mode = mode;
+}
+
+static struct Playfield *_process_playfield;
 
 void process_bit(UINT16 index, void *userdata)
 {
-    UINT16 x = BITSET_X(index) << 4;  // * 16
-    UINT16 y = BITSET_Y(index) << 4;
-    _process_rect((struct Ratr0DisplayBuffer *) userdata, x, y);
+    UINT16 x = DIRTY_X(_process_playfield, index) << 4;  // * 16
+    UINT16 y = DIRTY_Y(_process_playfield, index) << 4;
+    _process_rect((struct Ratr0DisplayBuffer *) userdata, x, y, 16, 16);
+}
+
+void process_tile_rect(UINT16 x, UINT16 y, UINT16 w, UINT16 h, void *userdata)
+{
+    _process_rect((struct Ratr0DisplayBuffer *) userdata, x << 4, y << 4, w << 4, h << 4);
 }
 
-void ratr0_display_process_dirty_rectangles(void (*process_dirty_rect)(struct Ratr0DisplayBuffer *, UINT16, UINT16))
+void ratr0_display_process_dirty_rectangles(void (*process_dirty_rect)(struct Ratr0DisplayBuffer *,
+                                                                       UINT16, UINT16,
+                                                                       UINT16, UINT16))
 {
     for (int playfield_num = 0; playfield_num < display_info.num_playfields;
          playfield_num++) {
@@ -156,36 +254,95 @@ void ratr0_display_process_dirty_rectangles(void (*process_dirty_rect)(struct Ra
         struct Ratr0DisplayBuffer *backbuffer =
             &playfield->display_buffer[backbuffer_num];
 
+        UINT32 *dirty_set = _dirty_set(playfield, backbuffer_num);
+
         // Establish the rect processing function
         _process_rect = process_dirty_rect;
-        // 1. Restore background using the dirty tile set
-        ratr0_bitset_iterate(playfield->bitset_arr[backbuffer_num],
-                             BITSET_SIZE, &process_bit, backbuffer);
-        ratr0_bitset_clear(playfield->bitset_arr[backbuffer_num],
-                           10); // clear to reset
+        _process_playfield = playfield;
+        // 1. Restore background using the dirty tile set, adjacent tiles
+        // are restored with a single blit. Rows of buffers that are wider
+        // than 1024 pixels are too long to be combined
+        if (dirty_rect_mode == RATR0_DIRTY_TILES ||
+            (1 << playfield->dirty_shift) > RATR0_BITSET_MAX_ROW_WIDTH) {
+            ratr0_bitset_iterate(dirty_set, playfield->dirty_words, &process_bit, backbuffer);
+        } else {
+            ratr0_bitset_iterate_rects(dirty_set, playfield->dirty_words,
+                                       1 << playfield->dirty_shift,
+                                       dirty_rect_mode == RATR0_DIRTY_RECTS,
+                                       &process_tile_rect, backbuffer);
+        }
+        ratr0_bitset_clear(dirty_set, playfield->dirty_words); // clear to reset
+
+        // 2. Restore the exact areas
+        struct Ratr0RectSet *areas = &playfield->dirty_areas[backbuffer_num];
+        for (int i = 0; i < areas->num_rects; i++) {
+            struct Ratr0Rect *area = &areas->rects[i];
+            process_dirty_rect(backbuffer, area->x, area->y, area->width, area->height);
+        }
+        ratr0_rect_set_clear(areas);
     }
 }
 
 // Swap back and front buffers
 void ratr0_display_swap_buffers(void)
 {
+    // never show a buffer that the blit queue still draws into
+    ratr0_blitter_wait_queue();
     for (int playfield_num = 0; playfield_num < display_info.num_playfields;
          playfield_num++) {
         struct Playfield *playfield = &playfields[playfield_num];
 
+        UINT16 num_buffers = display_info.playfield[playfield_num].num_buffers;
+
         //  just the first buffer single buffering -> next playfield
-        if (display_info.playfield[playfield_num].num_buffers == 1) {
+        if (num_buffers == 1) {
             continue;
         }
 
-        // 1. swap front and back indexes
-        int tmp = playfield->front_buffer;
+        // 1. the back buffer becomes the front buffer. If the previous front
+        // buffer was never displayed, the one before stays on screen
+        if (display_frames != playfield->swap_frame) {
+            playfield->prev_front_buffer = playfield->front_buffer;
+        }
         playfield->front_buffer = playfield->back_buffer;
-        playfield->back_buffer = tmp;
+        playfield->swap_frame = display_frames;
+
+        // 2. the next back buffer is neither on screen nor about to be
+        // shown. With 2 buffers, that's the buffer that is on screen until
+        // the next vertical blank, see ratr0_display_wait_back_buffer()
+        playfield->back_buffer = playfield->prev_front_buffer;
+        for (UINT16 i = 0; i < num_buffers; i++) {
+            if (i != playfield->front_buffer && i != playfield->prev_front_buffer) {
+                playfield->back_buffer = i;
+                break;
+            }
+        }
     }
-    // 2. set new front buffer to copper list
+    // 3. set new front buffer to copper list, the copper picks it up at the
+    // next vertical blank
     _update_front_buffers(current_coplist, current_coplist_size,
-                          current_copper_info);
+                          current_copper_info, FALSE);
+    if (pending_sprite_chains != -1) {
+        for (int i = 0; i < RATR0_NUM_SPRITE_CHANNELS; i++) {
+            ratr0_display_set_sprite(current_coplist, current_coplist_size,
+                                     current_copper_info, i,
+                                     ratr0_sprites_get_chain(pending_sprite_chains, i));
+        }
+        pending_sprite_chains = -1;
+    }
+
+    // 4. the back copy of the copper list with all changes of the frame is
+    // run from the next vertical blank on. current_coplist stays on it
+    // until ratr0_display_wait_back_buffer() has synced the other copy, so
+    // no change can go to a copy that the sync overwrites
+    ratr0_copper_swap(current_copper);
+    custom.cop1lc = (ULONG) ratr0_copper_get_front(current_copper);
+    copper_swap_frame = display_frames;
+}
+
+void ratr0_display_set_sprite_chains(UINT16 set_num)
+{
+    pending_sprite_chains = set_num;
 }
 
 // Our vertical blank server only implements a simple frame counter
@@ -197,6 +354,7 @@ void set_zero_flag(void) = "\tmoveq.l\t#0,d0\n";
 void VertBServer()
 {
     frames_elapsed++;
+    display_frames++;
     ratr0_input_update();
     ratr0_timers_tick();
     set_zero_flag();
@@ -216,6 +374,19 @@ struct Ratr0HWSprite NULL_HW_SPRITE = {
     FALSE, NULL_SPRITE_DATA
 };
 
+/*
+ * Playfields with buffers that are wider than the viewport can scroll
+ * horizontally. The display then fetches an extra word to the left of the
+ * viewport that is shifted in by the BPLCON1 delay.
+ */
+static BOOL _is_fetch_early(void)
+{
+    for (int i = 0; i < display_info.num_playfields; i++) {
+        if (display_info.playfield[i].buffer_width > display_info.vp_width) return TRUE;
+    }
+    return FALSE;
+}
+
 /**
  * We need to adjust the BPLCONx and BPLxMOD values after changing the
  * display mode. This function looks at display_info and will
@@ -237,11 +408,13 @@ static void _set_display_mode(UINT16 coplist[],
     UINT16 playfield_total_depth = is_dual_playfield ?
         playfield0_depth + playfield1_depth : playfield0_depth;
 
+    // the modulo skips the rest of the interleaved row after the fetch
+    UINT16 fetch_bytes = display_info.vp_width / 8 + (_is_fetch_early() ? 2 : 0);
     UINT16 screenrow_bytes0 = playfield0_width / 8;
     UINT16 screenrow_bytes1 = playfield1_width / 8;
-    UINT16 bpl1mod = screenrow_bytes0 * (playfield0_depth - 1);
+    UINT16 bpl1mod = screenrow_bytes0 * playfield0_depth - fetch_bytes;
     UINT16 bpl2mod = is_dual_playfield ?
-        screenrow_bytes1 * (playfield1_depth - 1) : bpl1mod;
+        screenrow_bytes1 * playfield1_depth - fetch_bytes : bpl1mod;
 
     UINT16 bplcon0_value = (playfield_total_depth << 12) | dpf_flag
         | 0x200;
@@ -266,82 +439,171 @@ struct Ratr0DisplayBuffer *ratr0_display_get_back_buffer(UINT16 playfield_num)
     return &playfield->display_buffer[playfield->back_buffer];
 }
 
+struct Ratr0DisplayBuffer *ratr0_display_get_buffer(UINT16 playfield_num,
+                                                    UINT16 buffer_num)
+{
+    if (playfield_num >= display_info.num_playfields ||
+        buffer_num >= display_info.playfield[playfield_num].num_buffers) {
+        return NULL;
+    }
+    return &playfields[playfield_num].display_buffer[buffer_num];
+}
+
+void ratr0_display_get_viewport(UINT16 *width, UINT16 *height)
+{
+    *width = display_info.vp_width;
+    *height = display_info.vp_height;
+}
+
+void ratr0_display_scroll_playfield(UINT16 playfield_num, UINT16 x, UINT16 y)
+{
+    struct Playfield *playfield = &playfields[playfield_num];
+    playfield->scroll_x = x;
+    playfield->scroll_y = y;
+    playfield->scroll_changed = TRUE;
+}
+
 BOOL ratr0_display_blit_surface_to_buffers(struct Ratr0Surface *surface,
                                            UINT16 playfield_num,
                                            UINT16 dstx, UINT16 dsty)
 {
-    struct Ratr0Surface *back_buffer, *front_buffer;
-    front_buffer = &ratr0_display_get_front_buffer(playfield_num)->surface;
-    back_buffer = &ratr0_display_get_back_buffer(playfield_num)->surface;
-    OwnBlitter();
-    ratr0_blit_rect_simple(front_buffer, surface, dstx, dsty, 0, 0,
-                           surface->width, surface->height);
-    ratr0_blit_rect_simple(back_buffer, surface, dstx, dsty, 0, 0,
-                           surface->width, surface->height);
-    DisownBlitter();
+    struct Playfield *playfield = &playfields[playfield_num];
+    ratr0_blitter_own();
+    for (int i = 0; i < display_info.playfield[playfield_num].num_buffers; i++) {
+        ratr0_blit_rect_simple(&playfield->display_buffer[i].surface, surface,
+                               dstx, dsty, 0, 0, surface->width, surface->height);
+    }
+    ratr0_blitter_disown();
     return TRUE;
 }
 
-/**
- * Private function to apply the new front buffers to the copper list.
- * This sets the correct BPLxPTH/BPLxPTL pointers.
- * TODO: if we are working with dual playfield, we need to take
- * the pointers from both playfields' bitmaps
+/*
+ * Writes the BPLxPTH/BPLxPTL pointers of a playfield to the bitplane pointer
+ * block at clidx. In dual playfield mode, playfield 0 uses the odd bitplanes
+ * 1, 3, 5 and playfield 1 the even bitplanes 2, 4, 6, so their pointer
+ * moves are interleaved.
  */
-static void _update_front_buffers(UINT16 coplist[], int num_words,
-                                 struct Ratr0CopperListInfo *info)
-{
-    // TODO: we need to process all playfields. That means
-    // if we have dual playfields, we need to set odd and even playfields
-    //   * Playfield 0 uses bitplanes 1, 3, 5
-    //   * Playfield 1 uses bitplanes 2, 4, 6
-    // Actually, if one playfield does not use double buffering,
-    // we don't even need to update the buffer pointers for the playfield
-    // more than once. Right now, we won't bother, it might actually not matter
-
-    if (display_info.num_playfields ==  1) {
-        struct Playfield *playfield = &playfields[0];
-        struct Ratr0Surface *s = &playfield->display_buffer[playfield->front_buffer].surface;
-        UINT16 screenrow_bytes = s->width / 8;
-        UINT32 plane = (UINT32) s->buffer;
-        UINT32 clidx = info->bpl1pth_index;
-
-        for (int i = 0; i < s->depth; i++) {
-            coplist[clidx] = (plane >> 16) & 0xffff;
-            coplist[clidx + 2] = plane & 0xffff;
-            plane += screenrow_bytes;
-            clidx += 4;
+static void _write_bitplane_pointers(UINT16 coplist[], UINT32 clidx,
+                                     UINT16 playfield_num, UINT32 plane)
+{
+    struct Ratr0PlayfieldInfo *pfinfo = &display_info.playfield[playfield_num];
+    UINT16 screenrow_bytes = pfinfo->buffer_width / 8;
+    UINT16 clstep = 4;
+    if (display_info.num_playfields == 2) {
+        clidx += playfield_num * 4;
+        clstep = 8;
+    }
+    for (int i = 0; i < pfinfo->depth; i++) {
+        coplist[clidx] = (plane >> 16) & 0xffff;
+        coplist[clidx + 2] = plane & 0xffff;
+        plane += screenrow_bytes;
+        clidx += clstep;
+    }
+}
+
+/*
+ * Address of the first displayed line of a playfield's front buffer. With
+ * the early fetch, the pointer starts at the word before the scroll
+ * position and the BPLCON1 delay moves the picture right by the
+ * remaining pixels.
+ */
+static UINT32 _top_address(UINT16 playfield_num, UINT16 *delay)
+{
+    struct Playfield *playfield = &playfields[playfield_num];
+    struct Ratr0PlayfieldInfo *pfinfo = &display_info.playfield[playfield_num];
+    UINT32 row_bytes = (pfinfo->buffer_width / 8) * pfinfo->depth;
+    UINT32 addr = (UINT32) playfield->display_buffer[playfield->front_buffer].surface.buffer +
+        playfield->scroll_y * row_bytes;
+    *delay = 0;
+    if (_is_fetch_early()) {
+        UINT16 words = (playfield->scroll_x + 15) >> 4;
+        *delay = (words << 4) - playfield->scroll_x;
+        return addr + (words << 1) - 2;
+    }
+    return addr + ((playfield->scroll_x >> 4) << 1);
+}
+
+/*
+ * Sets the bitplane pointers and the fine scroll of a playfield's front
+ * buffer in the copper list.
+ */
+static void _set_bitplane_pointers(UINT16 coplist[], struct Ratr0CopperListInfo *info,
+                                   UINT16 playfield_num)
+{
+    UINT16 delay;
+    UINT32 plane = _top_address(playfield_num, &delay);
+    _write_bitplane_pointers(coplist, info->bpl1pth_index, playfield_num, plane);
+
+    if (info->bplcon1_index) {
+        // playfield 0 is PF1 in dual playfield mode, single playfields
+        // delay both
+        UINT16 value = coplist[info->bplcon1_index];
+        if (display_info.num_playfields == 2) {
+            UINT16 shift = playfield_num * 4;
+            value = (value & ~(0x0f << shift)) | (delay << shift);
+        } else {
+            value = (value & 0xff00) | delay | (delay << 4);
         }
-    } else {
-        struct Playfield *playfield1 = &playfields[0];
-        struct Ratr0Surface *s1 =
-            &playfield1->display_buffer[playfield1->front_buffer].surface;
-
-        // dual playfield mode
-        UINT16 screenrow_bytes = s1->width / 8;
-        UINT32 plane = (UINT32) s1->buffer;
-        UINT32 clidx = info->bpl1pth_index;
-
-        for (int i = 0; i < s1->depth; i++) {
-            coplist[clidx] = (plane >> 16) & 0xffff;
-            coplist[clidx + 2] = plane & 0xffff;
-            plane += screenrow_bytes;
-            clidx += 8;
+        coplist[info->bplcon1_index] = value;
+    }
+}
+
+/*
+ * Sets the copper list split for vertically wrapping playfields: at the
+ * first line where a playfield's buffer ends, the copper sets its pointers
+ * back to the top of the buffer. The other playfield's pointers continue
+ * where they are. Without a wrapping playfield the split is just below the
+ * viewport and has no effect.
+ */
+static void _update_split(UINT16 coplist[], struct Ratr0CopperListInfo *info)
+{
+    UINT16 line = display_info.vp_height;
+    for (int i = 0; i < display_info.num_playfields; i++) {
+        UINT16 lines_left = display_info.playfield[i].buffer_height - playfields[i].scroll_y;
+        if (lines_left < line) line = lines_left;
+    }
+    for (int i = 0; i < display_info.num_playfields; i++) {
+        struct Ratr0PlayfieldInfo *pfinfo = &display_info.playfield[i];
+        UINT32 row_bytes = (pfinfo->buffer_width / 8) * pfinfo->depth;
+        UINT16 delay;
+        UINT32 plane = _top_address(i, &delay) + line * row_bytes;
+        if (playfields[i].scroll_y + line >= pfinfo->buffer_height) {
+            plane -= pfinfo->buffer_height * row_bytes;
         }
+        _write_bitplane_pointers(coplist, info->split_index, i, plane);
+    }
+    // wait for the end of the line before the split, past line 255 the
+    // first WAIT waits for the end of line 255
+    UINT16 vpos = (DIWSTRT_VALUE_320 >> 8) + line - 1;
+    UINT16 wait = ((vpos & 0xff) << 8) | 0xdf;
+    coplist[info->split_index - 5] = vpos > 0xff ? 0xffdf : wait;
+    coplist[info->split_index - 4] = 0xfffe;
+    coplist[info->split_index - 3] = wait;
+    coplist[info->split_index - 2] = 0xfffe;
+}
 
-        struct Playfield *playfield2 = &playfields[1];
-        struct Ratr0Surface *s2 =
-            &playfield2->display_buffer[playfield2->front_buffer].surface;
-        screenrow_bytes = s2->width / 8;
-        plane = (UINT32) s2->buffer;
-        clidx = info->bpl1pth_index + 4;
-
-        for (int i = 0; i < s2->depth; i++) {
-            coplist[clidx] = (plane >> 16) & 0xffff;
-            coplist[clidx + 2] = plane & 0xffff;
-            plane += screenrow_bytes;
-            clidx += 8;
+/**
+ * Private function to apply the new front buffers to the copper list.
+ * Single buffered playfields never change their pointers, so they are only
+ * set if all_playfields is TRUE.
+ */
+static void _update_front_buffers(UINT16 coplist[], int num_words,
+                                  struct Ratr0CopperListInfo *info,
+                                  BOOL all_playfields)
+{
+    BOOL scrolled = FALSE;
+    for (int playfield_num = 0; playfield_num < display_info.num_playfields;
+         playfield_num++) {
+        struct Playfield *playfield = &playfields[playfield_num];
+        if (all_playfields || playfield->scroll_changed ||
+            display_info.playfield[playfield_num].num_buffers > 1) {
+            _set_bitplane_pointers(coplist, info, playfield_num);
         }
+        scrolled |= playfield->scroll_changed;
+        playfield->scroll_changed = FALSE;
+    }
+    if (info->split_index && (all_playfields || scrolled)) {
+        _update_split(coplist, info);
     }
 }
 
@@ -379,6 +641,8 @@ void _ratr0_display_init_copperlist(UINT16 coplist[], int num_words,
             coplist[info->diwstop_index] = DIWSTOP_VALUE_NTSC_320;
         }
     }
+    // scrolling playfields fetch one more word
+    if (_is_fetch_early()) coplist[info->ddfstrt_index] -= 8;
 
     // 2. Initialize the sprites with the NULL address (8x8 = 64 bytes)
     for (int i = 0; i < 8; i++) {
@@ -390,12 +654,14 @@ void _ratr0_display_init_copperlist(UINT16 coplist[], int num_words,
     _set_display_mode(coplist, info);
 
     // Establish the playfield display buffers
-    _update_front_buffers(coplist, num_words, info);
+    _update_front_buffers(coplist, num_words, info, TRUE);
 }
 
 static void build_display_buffer(UINT16 num_playfields,
                                  struct Ratr0PlayfieldInfo pf_infos[])
 {
+    // compiled blits refer to the previous surfaces
+    ratr0_blitter_flush_cache();
     for (int playfield_num = 0; playfield_num < num_playfields;
          playfield_num++) {
 
@@ -404,8 +670,12 @@ static void build_display_buffer(UINT16 num_playfields,
             pf_infos[playfield_num].buffer_height *
             pf_infos[playfield_num].depth;
 
-        for (int j = 0; j < pf_infos[playfield_num].num_buffers; j++) {
+        UINT16 num_buffers = pf_infos[playfield_num].num_buffers;
+        if (num_buffers > MAX_BUFFERS) num_buffers = MAX_BUFFERS;
+        playfields[playfield_num].num_allocated_buffers = num_buffers;
+        for (int j = 0; j < num_buffers; j++) {
             playfields[playfield_num].display_buffer[j].buffernum = j;
+            playfields[playfield_num].display_buffer[j].playfield_num = playfield_num;
             playfields[playfield_num].display_buffer[j].surface.width =
                 pf_infos[playfield_num].buffer_width;
             playfields[playfield_num].display_buffer[j].surface.height =
@@ -436,10 +706,11 @@ static void build_display_buffer(UINT16 num_playfields,
 static void free_display_buffer(void)
 {
     for (int playfield_num = 0; playfield_num < display_info.num_playfields; playfield_num++) {
-        for (int j = 0; j < display_info.playfield[playfield_num].num_buffers; j++) {
+        for (int j = 0; j < playfields[playfield_num].num_allocated_buffers; j++) {
             if (playfields[playfield_num].display_buffer[j].surface.buffer != NULL) {
                 FreeMem(playfields[playfield_num].display_buffer[j].surface.buffer,
                         playfields[playfield_num].display_buffer_size);
+                playfields[playfield_num].display_buffer[j].surface.buffer = NULL;
             }
         }
     }
@@ -465,7 +736,9 @@ void _uninstall_interrupts(void)
     RemIntServer(INTB_VERTB, &vbint);
 }
 
-struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng)
+struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng,
+                                                   UINT16 max_hw_sprites,
+                                                   UINT16 max_bobs)
 {
     engine = eng;
     rendering_system.shutdown = &ratr0_display_shutdown;
@@ -482,9 +755,16 @@ struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng)
 
     _install_interrupts();
 
+    current_copper = NULL;
+    for (int i = 0; i < 2; i++) {
+        ratr0_copper_init(&static_coppers[i], STATIC_COPPER_MAX_WORDS);
+    }
+
     // initialize display buffers and display info
     for (int i = 0; i < MAX_PLAYFIELDS; i++) {
         playfields[i].display_buffer_size = 0;
+        playfields[i].num_allocated_buffers = 0;
+        playfields[i].h_dirty = -1;
         display_info.playfield[i].num_buffers = 0;
         display_info.playfield[i].buffer_width = 0;
         display_info.playfield[i].buffer_height = 0;
@@ -492,7 +772,10 @@ struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng)
     }
 
     // Object management initialization
-    next_hw_sprite = next_bob = 0;
+    ratr0_pool_init(&hw_sprite_pool, sizeof(struct Ratr0HWSprite), max_hw_sprites,
+                    RATR0_MEM_DEFAULT | RATR0_MEMTAG_DISPLAY);
+    ratr0_pool_init(&bob_pool, sizeof(struct Ratr0Bob), max_bobs,
+                    RATR0_MEM_DEFAULT | RATR0_MEMTAG_DISPLAY);
     PRINT_DEBUG("Startup finished");
     return &rendering_system;
 }
@@ -523,44 +806,98 @@ void ratr0_display_init_buffers(UINT16 vp_width, UINT16 vp_height,
             pfinfo->depth = pfinit->depth;
             pfinfo->num_buffers = pfinit->num_buffers;
 
-            if (pfinit->num_buffers == 1) {
-                playfield->front_buffer = playfield->back_buffer = 0;
-            } else {
-                playfield->front_buffer = 0;
-                playfield->back_buffer = 1;
+            if (pfinit->num_buffers > MAX_BUFFERS) {
+                PRINT_DEBUG("WARNING: %d buffers requested, using %d",
+                            (int) pfinit->num_buffers, MAX_BUFFERS);
+                pfinfo->num_buffers = MAX_BUFFERS;
             }
+            playfield->front_buffer = playfield->prev_front_buffer = 0;
+            playfield->back_buffer = pfinfo->num_buffers == 1 ? 0 : 1;
+            playfield->swap_frame = display_frames - 1;
+            playfield->scroll_x = playfield->scroll_y = 0;
             // Rebuild the display buffer if the new one would be bigger
+            // or there are more buffers
             int new_display_buffer_size = pfinit->buffer_width / 8 *
                 pfinit->buffer_height * pfinit->depth;
 
-            if (new_display_buffer_size > playfield->display_buffer_size) {
+            if (new_display_buffer_size > playfield->display_buffer_size ||
+                pfinfo->num_buffers > playfield->num_allocated_buffers) {
                 free_display_buffer();
                 build_display_buffer(num_playfields, pf_infos);
             }
-            ratr0_bitset_clear(playfield->bitset_arr[playfield->back_buffer],
-                               BITSET_SIZE);
-            ratr0_bitset_clear(playfield->bitset_arr[playfield->front_buffer],
-                               BITSET_SIZE);
+            _init_dirty_sets(playfield, pfinfo);
         }
     }
+    // the blit queue runs without BLITHOG, so the CPU can work in parallel
+    UINT16 total_depth = 0;
+    for (int i = 0; i < num_playfields; i++) total_depth += display_info.playfield[i].depth;
+    ratr0_blitter_set_frame_budget(ratr0_blitter_frame_budget(vp_width, vp_height,
+                                                              total_depth, FALSE));
  }
 
+void ratr0_display_set_wait_vblank(BOOL wait)
+{
+    wait_vblank = wait;
+}
+
+void ratr0_display_wait_back_buffer(void)
+{
+    if (wait_vblank) {
+        WaitTOF();
+    } else {
+        for (int playfield_num = 0; playfield_num < display_info.num_playfields;
+             playfield_num++) {
+            struct Playfield *playfield = &playfields[playfield_num];
+            while (playfield->back_buffer == playfield->prev_front_buffer &&
+                   display_frames == playfield->swap_frame) {
+                WaitTOF();
+            }
+        }
+        // the copper has to run the copy of the last swap before the other
+        // copy is written to
+        while (current_copper->needs_sync && display_frames == copper_swap_frame) {
+            WaitTOF();
+        }
+    }
+    ratr0_copper_sync(current_copper);
+    current_coplist = ratr0_copper_get_back(current_copper);
+}
+
+void ratr0_display_set_copper_list(struct Ratr0CopperList *list)
+{
+    // set up both copies, the copper runs neither of them yet
+    _ratr0_display_init_copperlist(ratr0_copper_get_back(list), list->num_words, &list->info);
+    ratr0_copper_swap(list);
+    ratr0_copper_sync(list);
+    WaitTOF();
+    current_copper = list;
+    current_copper_info = &list->info;
+    current_coplist_size = list->num_words;
+    current_coplist = ratr0_copper_get_back(list);
+    custom.cop1lc = (ULONG) ratr0_copper_get_front(list);
+}
+
 void ratr0_display_set_copperlist(UINT16 *copperlist, int size,
                                   struct Ratr0CopperListInfo *info)
 {
-    _ratr0_display_init_copperlist(copperlist, size, info);
-    WaitTOF();
-    current_coplist = copperlist;
-    current_copper_info = info;
-    current_coplist_size = size;
-    custom.cop1lc = (ULONG) copperlist;
+    struct Ratr0CopperList *list = current_copper == &static_coppers[0] ?
+        &static_coppers[1] : &static_coppers[0];
+    if (!ratr0_copper_load(list, copperlist, size, info)) return;
+    ratr0_display_set_copper_list(list);
 }
 
 void ratr0_display_shutdown(void)
 {
+    ratr0_blitter_shutdown();
     free_display_buffer();
+    for (int i = 0; i < 2; i++) ratr0_copper_free(&static_coppers[i]);
+    for (int i = 0; i < MAX_PLAYFIELDS; i++) {
+        if (playfields[i].h_dirty != -1) ratr0_memory_free_block(playfields[i].h_dirty);
+    }
     _uninstall_interrupts();
     ratr0_sprites_shutdown();
+    ratr0_pool_destroy(&bob_pool);
+    ratr0_pool_destroy(&hw_sprite_pool);
 
     // Restore the Workbench display by restoring the original copper list
     LoadView(((struct GfxBase *) GfxBase)->ActiView);
@@ -594,8 +931,9 @@ struct Ratr0HWSprite *ratr0_create_sprite(struct Ratr0TileSheet *tilesheet,
     // 1. Reserve memory from engine
     // 2. Convert into sprite data structure and store into allocated memory
     // 3. Return the initialized object
+    struct Ratr0HWSprite *result = ratr0_pool_alloc(&hw_sprite_pool);
+    if (!result) return NULL;
     UINT16 *sprite_data = ratr0_make_sprite_data(tilesheet, frames, num_frames);
-    struct Ratr0HWSprite *result = &hw_sprite_table[next_hw_sprite++];
     result->sprite_data = sprite_data;
     // store sprite information
     return result;
@@ -604,7 +942,8 @@ struct Ratr0HWSprite *ratr0_create_sprite(struct Ratr0TileSheet *tilesheet,
 struct Ratr0HWSprite *ratr0_create_sprite_from_sprite_sheet(struct Ratr0SpriteSheet *sheet,
                                                             UINT8 speed, UINT8 loop_type)
 {
-    struct Ratr0HWSprite *result = &hw_sprite_table[next_hw_sprite++];
+    struct Ratr0HWSprite *result = ratr0_pool_alloc(&hw_sprite_pool);
+    if (!result) return NULL;
     // Data and frame information
     result->sprite_data = (UINT16 *) ratr0_memory_block_address(sheet->h_imgdata);
 
@@ -634,7 +973,8 @@ struct Ratr0HWSprite *ratr0_create_sprite_from_sprite_sheet(struct Ratr0SpriteSh
 
 struct Ratr0HWSprite *ratr0_create_sprite_from_sprite_sheet_frame(struct Ratr0SpriteSheet *sheet, int framenum)
 {
-    struct Ratr0HWSprite *result = &hw_sprite_table[next_hw_sprite++];
+    struct Ratr0HWSprite *result = ratr0_pool_alloc(&hw_sprite_pool);
+    if (!result) return NULL;
     // Data and frame information
     result->sprite_data = (UINT16 *) ratr0_memory_block_address(sheet->h_imgdata);
 
@@ -668,8 +1008,10 @@ struct Ratr0Bob *ratr0_create_bob(struct Ratr0TileSheet *tilesheet,
         PRINT_DEBUG("Can't create BOB with more than %d animation frames !", RATR0_MAX_ANIM_FRAMES);
         return NULL;
     }
-    struct Ratr0Bob *result = &bob_table[next_bob++];
+    struct Ratr0Bob *result = ratr0_pool_alloc(&bob_pool);
+    if (!result) return NULL;
     result->tilesheet = tilesheet;
+    result->playfield_num = 0;
 
     result->base_obj.anim_frames.num_frames = num_frames;
     result->base_obj.anim_frames.current_frame_idx = 0;
@@ -696,6 +1038,16 @@ struct Ratr0Bob *ratr0_create_bob(struct Ratr0TileSheet *tilesheet,
     return result;
 }
 
+void ratr0_destroy_sprite(struct Ratr0HWSprite *sprite)
+{
+    ratr0_pool_free(&hw_sprite_pool, sprite);
+}
+
+void ratr0_destroy_bob(struct Ratr0Bob *bob)
+{
+    ratr0_pool_free(&bob_pool, bob);
+}
+
 void ratr0_dump_copperlist(UINT16 *copperlist, int len, const char *path)
 {
     FILE *fp = fopen(path, "w");
@@ -13,11 +13,17 @@
 #include <ratr0/events.h>
 #include <ratr0/audio.h>
 #include <ratr0/display.h>
+#include <ratr0/blitter.h>
 #include <ratr0/input.h>
 #include <ratr0/resources.h>
 #include <ratr0/stages.h>
 
-#define MAX_TIMERS (10)
+// default object pool capacities
+#define MAX_TIMERS     (10)
+#define MAX_BOBS       (20)
+#define MAX_HW_SPRITES (20)
+#define MAX_STAGES     (10)
+#define MAX_BACKDROPS  (2)
 #define TASK_PRIORITY (20)
 
 #include <clib/exec_protos.h>
@@ -45,7 +51,7 @@ static volatile UINT16 *custom_color00 = (volatile UINT16 *) 0xdff180;
 void ratr0_engine_game_loop(void)
 {
     while (game_state != GAMESTATE_QUIT) {
-        WaitTOF();
+        ratr0_display_wait_back_buffer();
         //*custom_color00 = 0xf00;
         // comment in for visual timing the loop iteration
         ratr0_stages_update(frames_elapsed);
@@ -53,6 +59,8 @@ void ratr0_engine_game_loop(void)
         // we are done with the back buffer. now swap it to the front
         ratr0_display_swap_buffers();
         frames_elapsed = 0;  // Reset the update frame counter
+        ratr0_memory_frame_reset();
+        ratr0_blitter_end_frame();
     }
 }
 
@@ -120,12 +128,17 @@ Ratr0Engine *ratr0_engine_startup(struct Ratr0MemoryConfig *memory_config,
     srand(time(NULL));
     engine.memory_system = ratr0_memory_startup(&engine, memory_config);
     //engine.event_system = ratr0_events_startup(&engine);
-    engine.timer_system = ratr0_timers_startup(&engine, MAX_TIMERS);
+    engine.timer_system = ratr0_timers_startup(&engine, memory_config->max_timers ?
+                                               memory_config->max_timers : MAX_TIMERS);
     engine.input_system = ratr0_input_startup(&engine);
-    engine.rendering_system = ratr0_display_startup(&engine);
+    engine.rendering_system = ratr0_display_startup(&engine,
+        memory_config->max_hw_sprites ? memory_config->max_hw_sprites : MAX_HW_SPRITES,
+        memory_config->max_bobs ? memory_config->max_bobs : MAX_BOBS);
     engine.audio_system = ratr0_audio_startup();
     engine.resource_system = ratr0_resources_startup(&engine);
-    engine.stages_system = ratr0_stages_startup(&engine);
+    engine.stages_system = ratr0_stages_startup(&engine,
+        memory_config->max_stages ? memory_config->max_stages : MAX_STAGES,
+        memory_config->max_backdrops ? memory_config->max_backdrops : MAX_BACKDROPS);
 
     PRINT_DEBUG("Startup finished.");
     return &engine;
@@ -134,6 +147,9 @@ Ratr0Engine *ratr0_engine_startup(struct Ratr0MemoryConfig *memory_config,
 void ratr0_engine_shutdown(void)
 {
     PRINT_DEBUG("Shutting down...");
+#ifdef DEBUG
+    if (debug_fp) ratr0_blitter_dump_profile(debug_fp);
+#endif
     engine.stages_system->shutdown();
     engine.resource_system->shutdown();
     engine.audio_system->shutdown();
@@ -0,0 +1,88 @@
+/** @file fader.c */
+#include <ratr0/debug_utils.h>
+#include <ratr0/display.h>
+#include <ratr0/fader.h>
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_TAG("FADER", __VA_ARGS__)
+
+UINT16 ratr0_fader_mix_color(UINT16 from, UINT16 to, UINT16 step, UINT16 num_steps)
+{
+    UINT16 color = 0;
+    INT32 last = num_steps - 1;
+    if (last <= 0) return from;
+
+    // per component, rounded to the nearest value, halves away from the start
+    for (int shift = 0; shift <= 8; shift += 4) {
+        INT32 c0 = (from >> shift) & 0xf, c1 = (to >> shift) & 0xf;
+        INT32 n = (c1 - c0) * step;
+        INT32 delta = n >= 0 ? (2 * n + last) / (2 * last) : -((-2 * n + last) / (2 * last));
+        color |= (c0 + delta) << shift;
+    }
+    return color;
+}
+
+BOOL ratr0_fader_make_table(struct Ratr0FadeTable *table, UINT16 *from, UINT16 *to,
+                            UINT16 first_color, UINT16 num_colors, UINT16 num_steps)
+{
+    table->h_colors = ratr0_memory_allocate_block(RATR0_MEM_FAST,
+                                                  num_steps * num_colors * sizeof(UINT16));
+    if (table->h_colors == -1) {
+        PRINT_DEBUG("ERROR: can't allocate fade table of %d steps", (int) num_steps);
+        return FALSE;
+    }
+    table->colors = ratr0_memory_block_address(table->h_colors);
+    table->first_color = first_color;
+    table->num_colors = num_colors;
+    table->num_steps = num_steps;
+
+    UINT16 *colors = table->colors;
+    for (int step = 0; step < num_steps; step++) {
+        for (int i = 0; i < num_colors; i++) {
+            *colors++ = ratr0_fader_mix_color(from ? from[i] : 0, to ? to[i] : 0,
+                                              step, num_steps);
+        }
+    }
+    return TRUE;
+}
+
+void ratr0_fader_free_table(struct Ratr0FadeTable *table)
+{
+    if (table->h_colors == -1) return;
+    ratr0_memory_free_block(table->h_colors);
+    table->h_colors = -1;
+    table->colors = NULL;
+}
+
+static void _show_step(struct Ratr0Fader *fader)
+{
+    struct Ratr0FadeTable *table = fader->table;
+    ratr0_display_set_palette(&table->colors[fader->step * table->num_colors],
+                              table->num_colors, table->first_color);
+}
+
+void ratr0_fader_start(struct Ratr0Fader *fader, struct Ratr0FadeTable *table,
+                       UINT16 frames_per_step, BOOL reverse)
+{
+    fader->table = table;
+    fader->reverse = reverse;
+    fader->step = reverse ? table->num_steps - 1 : 0;
+    fader->frames_per_step = frames_per_step;
+    fader->frames_left = frames_per_step;
+    fader->running = table->num_steps > 1;
+    _show_step(fader);
+}
+
+BOOL ratr0_fader_update(struct Ratr0Fader *fader)
+{
+    if (!fader->running) return FALSE;
+    if (--fader->frames_left > 0) return TRUE;
+
+    fader->frames_left = fader->frames_per_step;
+    if (fader->reverse) fader->step--;
+    else fader->step++;
+    _show_step(fader);
+
+    UINT16 last_step = fader->reverse ? 0 : fader->table->num_steps - 1;
+    if (fader->step == last_step) fader->running = FALSE;
+    return fader->running;
+}
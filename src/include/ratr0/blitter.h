@@ -7,7 +7,9 @@
  * for performance reasons. However, it is the caller's responsibility to
  * reserve the blitter for exclusive access to avoid strange effects caused
  * by operating system usage of the blitter, potentially leaving registers in
- * an undefined state.
+ * an undefined state. Inside the engine, e.g. in a stage's update(), use
+ * ratr0_blitter_own() / ratr0_blitter_disown() for that, which can be
+ * nested.
  */
 #pragma once
 #ifndef __RATR0_BLITTER_H__
@@ -21,12 +23,18 @@ struct Ratr0Surface;
 struct Ratr0TileSheet;
 
 /**
- * Starts up the blitter module.
+ * Starts up the blitter module and installs the blitter interrupt handler
+ * that runs the blit queue.
  *
  * @param engine pointer to Ratr0Engine object
  */
 extern void ratr0_blitter_startup(Ratr0Engine *engine);
 
+/**
+ * Waits for the blit queue and removes the blitter interrupt handler.
+ */
+extern void ratr0_blitter_shutdown(void);
+
 
 /******************************************************
  *
@@ -149,6 +157,24 @@ void ratr0_blit_rect_1plane(struct Ratr0Surface *dst,
                                   int tilex, int tiley,
                                   int dstx, int dsty);
 
+/******************************************************
+ *
+ * MEMORY BLITS
+ *
+ ******************************************************/
+
+/**
+ * Copies a block of chip memory with the blitter. Source and destination
+ * can overlap, as long as the destination is at the lower address. In
+ * contrast to the other blit functions, this one waits until the copy is
+ * finished, so the memory can be used immediately.
+ *
+ * @param dst destination address, word aligned
+ * @param src source address, word aligned
+ * @param num_bytes number of bytes to copy, must be even
+ */
+extern void ratr0_blit_copy_mem(void *dst, void *src, UINT32 num_bytes);
+
 /******************************************************
  *
  * MASKED BLITS
@@ -186,4 +212,346 @@ extern void ratr0_blit_object_il(struct Ratr0Surface *dst,
                                  int tilex, int tiley,
                                  int dstx, int dsty);
 
+/******************************************************
+ *
+ * BLIT QUEUE
+ *
+ ******************************************************/
+
+/**
+ * \brief The register values of a prepared blit.
+ */
+struct Ratr0BlitDescriptor {
+    /** \brief BLTCON0 */
+    UINT16 bltcon0;
+    /** \brief BLTCON1 */
+    UINT16 bltcon1;
+    /** \brief first word mask of channel A */
+    UINT16 bltafwm;
+    /** \brief last word mask of channel A */
+    UINT16 bltalwm;
+    /** \brief channel A modulo */
+    UINT16 bltamod;
+    /** \brief channel B modulo */
+    UINT16 bltbmod;
+    /** \brief channel C modulo */
+    UINT16 bltcmod;
+    /** \brief channel D modulo */
+    UINT16 bltdmod;
+    /** \brief channel A pointer */
+    UINT8 *bltapt;
+    /** \brief channel B pointer */
+    UINT8 *bltbpt;
+    /** \brief channel C pointer */
+    UINT8 *bltcpt;
+    /** \brief channel D pointer */
+    UINT8 *bltdpt;
+    /** \brief channel A data, used if channel A is disabled */
+    UINT16 bltadat;
+    /** \brief blit size */
+    UINT16 bltsize;
+};
+
+/**
+ * Prepares the blit of ratr0_blit_rect_simple() for the blit queue. The
+ * blit height times the depth can't exceed 1024 lines.
+ *
+ * @param desc the descriptor to fill
+ * @param dst destination surface
+ * @param src source surface
+ * @param dstx destination x-coordinate
+ * @param dsty destination y-coordinate
+ * @param srcx source x-coordinate
+ * @param srcy source y-coordinate
+ * @param blit_width_pixels blit width in pixels
+ * @param blit_height_pixels blit height in pixels
+ */
+extern void ratr0_blit_prepare_rect_simple(struct Ratr0BlitDescriptor *desc,
+                                           struct Ratr0Surface *dst,
+                                           struct Ratr0Surface *src,
+                                           UINT16 dstx, UINT16 dsty,
+                                           UINT16 srcx, UINT16 srcy,
+                                           UINT16 blit_width_pixels,
+                                           UINT16 blit_height_pixels);
+
+/**
+ * Prepares the blit of ratr0_blit_clear16() for the blit queue. The blit
+ * height times the depth can't exceed 1024 lines.
+ *
+ * @param desc the descriptor to fill
+ * @param dst destination surface
+ * @param dstx destination x-coordinate, a multiple of 16
+ * @param dsty destination y-coordinate
+ * @param width_pixels width in pixels, a multiple of 16
+ * @param height_pixels height in pixels
+ */
+extern void ratr0_blit_prepare_clear16(struct Ratr0BlitDescriptor *desc,
+                                       struct Ratr0Surface *dst,
+                                       UINT16 dstx, UINT16 dsty,
+                                       UINT16 width_pixels, UINT16 height_pixels);
+
+/**
+ * Prepares the blit of ratr0_blit_object_il() for the blit queue.
+ *
+ * @param desc the descriptor to fill
+ * @param dst destination surface
+ * @param bobs source tilesheet
+ * @param tilex tile x-coordinate
+ * @param tiley tile y-coordinate
+ * @param dstx destination x-coordinate
+ * @param dsty destination y-coordinate
+ */
+extern void ratr0_blit_prepare_object_il(struct Ratr0BlitDescriptor *desc,
+                                         struct Ratr0Surface *dst,
+                                         struct Ratr0TileSheet *bobs,
+                                         int tilex, int tiley,
+                                         int dstx, int dsty);
+
+/**
+ * \brief A tile blit with everything precomputed that does not depend on
+ * the destination position.
+ *
+ * Only the word columns of the tile that its mask covers are blitted, and
+ * the extra destination word for the shifted pixels is only added for the
+ * shifts that push covered pixels out of the last word.
+ *
+ * The entries live in a cache that is keyed by the destination surface,
+ * the tilesheet and the tile. Image addresses are stored as offsets, so
+ * they stay valid when the memory system compacts the tilesheet data.
+ */
+struct Ratr0CompiledBlit {
+    /** \brief key: source tilesheet, NULL if the entry is unused */
+    struct Ratr0TileSheet *bobs;
+    /** \brief key: destination surface */
+    struct Ratr0Surface *dst;
+    /** \brief key: tile x-coordinate */
+    UINT16 tilex;
+    /** \brief key: tile y-coordinate */
+    UINT16 tiley;
+    /** \brief key: TRUE for interleaved tilesheets */
+    BOOL interleaved;
+    /** \brief offset of the tile in the image data */
+    UINT32 src_offset;
+    /** \brief offset of the tile's mask in the image data */
+    UINT32 mask_offset;
+    /**
+     * \brief offset of the first blitted word from the destination word of
+     * the tile's left edge, the words before it are transparent
+     */
+    UINT16 dst_offset;
+    /** \brief bytes between two lines of the destination */
+    UINT16 dst_line_bytes;
+    /** \brief bytes of a destination row in a single plane */
+    UINT16 dst_row_bytes;
+    /** \brief size of a tilesheet plane in bytes */
+    UINT16 src_plane_size;
+    /** \brief shifts from this value on need an extra destination word */
+    UINT16 wide_shift;
+    /** \brief destination modulo, without and with the extra word */
+    UINT16 dstmod[2];
+    /** \brief source modulo, without and with the extra word */
+    UINT16 srcmod[2];
+    /** \brief blit size, without and with the extra word */
+    UINT16 bltsize[2];
+};
+
+/**
+ * Looks up the compiled blit of a tile in the cache and compiles it if it
+ * is not there. A later call can replace the returned entry.
+ * ratr0_blit_object_il() and ratr0_blit_object_nonil() use the cache.
+ *
+ * @param dst destination surface
+ * @param bobs source tilesheet
+ * @param tilex tile x-coordinate
+ * @param tiley tile y-coordinate
+ * @param interleaved TRUE if the tilesheet is interleaved
+ * @return pointer to the cache entry
+ */
+extern struct Ratr0CompiledBlit *ratr0_blit_compile_object(struct Ratr0Surface *dst,
+                                                           struct Ratr0TileSheet *bobs,
+                                                           int tilex, int tiley,
+                                                           BOOL interleaved);
+
+/**
+ * Prepares the cookie cut blit of an interleaved compiled blit at the
+ * specified position. Only the shift, the destination address and the
+ * image address are computed.
+ *
+ * @param desc the descriptor to fill
+ * @param blit the compiled blit
+ * @param dstx destination x-coordinate
+ * @param dsty destination y-coordinate
+ */
+extern void ratr0_blit_prepare_compiled(struct Ratr0BlitDescriptor *desc,
+                                        struct Ratr0CompiledBlit *blit,
+                                        int dstx, int dsty);
+
+/**
+ * Empties the compiled blit cache. It has to be called when a tilesheet or
+ * a surface that was blitted is freed or changed. The cache is keyed by the
+ * addresses of the Ratr0Surface and Ratr0TileSheet structs, so a caller
+ * that reuses such a struct, e.g. a local variable, with a different
+ * geometry or depth also has to flush, or it gets the old compiled blits.
+ */
+extern void ratr0_blitter_flush_cache(void);
+
+/**
+ * Appends a prepared blit to the blit queue and returns without waiting.
+ * The blitter interrupt starts the next blit of the queue as soon as the
+ * current one is finished, so the CPU can do other work in the meantime.
+ * The descriptor is copied. If the queue is full, this function waits for
+ * a free entry.
+ *
+ * The other blit functions wait until the queue is empty before they
+ * start, so queued and direct blits can be mixed.
+ *
+ * @param desc the prepared blit
+ */
+extern void ratr0_blit_enqueue(struct Ratr0BlitDescriptor *desc);
+
+/**
+ * Waits until all queued blits are finished.
+ */
+extern void ratr0_blitter_wait_queue(void);
+
+/**
+ * Reserves the blitter for the engine. OwnBlitter() is not reentrant, so
+ * the engine code never calls it directly: only the outermost
+ * ratr0_blitter_own() takes the blitter from the system, nested calls,
+ * e.g. from a stage's update(), which already runs with the blitter
+ * owned, only count. Each call has to be paired with
+ * ratr0_blitter_disown().
+ */
+extern void ratr0_blitter_own(void);
+
+/**
+ * Ends a ratr0_blitter_own(). The blitter is given back to the system
+ * when the outermost reservation ends.
+ */
+extern void ratr0_blitter_disown(void);
+
+/******************************************************
+ *
+ * BLIT BUDGET
+ *
+ ******************************************************/
+
+/**
+ * \brief The part of the engine that issued a blit.
+ */
+typedef enum {
+    RATR0_BLIT_SITE_OTHER,    /**< everything else, like clears and memory moves */
+    RATR0_BLIT_SITE_RESTORE,  /**< restoring the background of dirty rectangles */
+    RATR0_BLIT_SITE_BOBS      /**< drawing BOBs */
+} Ratr0BlitSite;
+
+/** \brief number of blit sites */
+#define RATR0_NUM_BLIT_SITES (3)
+
+/**
+ * \brief Blitter usage of a blit site.
+ */
+struct Ratr0BlitSiteStats {
+    /** \brief estimated blitter DMA cycles */
+    UINT32 cycles;
+    /** \brief number of blits */
+    UINT16 num_blits;
+};
+
+/**
+ * \brief Blitter usage of a single frame.
+ */
+struct Ratr0BlitFrameStats {
+    /** \brief estimated blitter DMA cycles of all blits */
+    UINT32 cycles;
+    /** \brief the frame budget at the time, 0 if there is none */
+    UINT32 budget;
+    /** \brief number of blits */
+    UINT16 num_blits;
+    /** \brief usage per blit site */
+    struct Ratr0BlitSiteStats sites[RATR0_NUM_BLIT_SITES];
+};
+
+/**
+ * \brief Blitter usage over all frames since the last reset.
+ */
+struct Ratr0BlitProfile {
+    /** \brief the last frame that was finished */
+    struct Ratr0BlitFrameStats last_frame;
+    /** \brief the frame that used the most cycles */
+    struct Ratr0BlitFrameStats peak_frame;
+    /** \brief number of finished frames */
+    UINT32 num_frames;
+    /** \brief number of frames that exceeded their budget */
+    UINT32 frames_over_budget;
+};
+
+/**
+ * Estimates the number of DMA cycles a blit takes, based on the cycles per
+ * word of the enabled channels that are listed in the Hardware Reference
+ * Manual. Bus contention with the CPU is not included.
+ *
+ * @param bltcon0 the BLTCON0 value of the blit
+ * @param bltsize the BLTSIZE value of the blit
+ * @return estimated number of DMA cycles
+ */
+extern UINT32 ratr0_blitter_blit_cycles(UINT16 bltcon0, UINT16 bltsize);
+
+/**
+ * Estimates the DMA cycles that are available to the blitter in one PAL
+ * frame, after refresh, disk, audio, sprite and bitplane DMA took theirs.
+ * Without BLITHOG, the blitter has to leave every 4th free cycle to a
+ * waiting CPU.
+ *
+ * @param width display width in pixels
+ * @param height display height in lines
+ * @param depth total number of bitplanes of the display
+ * @param blithog TRUE if the blits run with DMAF_BLITHOG set
+ * @return number of DMA cycles available to the blitter
+ */
+extern UINT32 ratr0_blitter_frame_budget(UINT16 width, UINT16 height, UINT16 depth,
+                                         BOOL blithog);
+
+/**
+ * Sets the number of DMA cycles that the blits of a frame may use. The
+ * display system sets it from the display settings.
+ *
+ * @param cycles the frame budget, 0 disables the check
+ */
+extern void ratr0_blitter_set_frame_budget(UINT32 cycles);
+
+/**
+ * Attributes the following blits to the specified blit site.
+ *
+ * @param site the blit site
+ */
+extern void ratr0_blitter_set_site(Ratr0BlitSite site);
+
+/**
+ * Finishes the blit statistics of the current frame. The game loop calls
+ * this once per frame.
+ *
+ * @return TRUE if the frame's blits exceeded the frame budget
+ */
+extern BOOL ratr0_blitter_end_frame(void);
+
+/**
+ * Retrieves the blitter usage since the last reset.
+ *
+ * @param profile the structure to fill
+ */
+extern void ratr0_blitter_profile(struct Ratr0BlitProfile *profile);
+
+/**
+ * Resets the blitter usage statistics.
+ */
+extern void ratr0_blitter_reset_profile(void);
+
+/**
+ * Prints a report of the blitter usage.
+ *
+ * @param fp the output file
+ */
+extern void ratr0_blitter_dump_profile(FILE *fp);
+
 #endif /* __RATR0_BLITTER_H__ */
@@ -0,0 +1,124 @@
+/** @file blitter_emu.h
+ *
+ * Software model of the Amiga blitter for the host build. It provides the
+ * blitter registers of the custom chip structure and WaitBlit(), so
+ * blitter.c compiles unchanged on the host and its blits can be tested bit
+ * for bit. Memory is read and written as big endian words, just like on
+ * the Amiga, so image data that was loaded from disk can be used as is.
+ *
+ * A blit is started by writing bltsize, just like on the hardware. Since
+ * the write can not be intercepted, the emulator runs the blit on the next
+ * WaitBlit() call, which the blitter code always does before it touches
+ * the registers again.
+ *
+ * When the blitter interrupt is enabled in intena, the handler that was set
+ * with ratr0_blitter_emu_set_interrupt() is called after each blit, from
+ * within WaitBlit().
+ *
+ * Line mode is not supported.
+ */
+#pragma once
+#ifndef __RATR0_BLITTER_EMU_H__
+#define __RATR0_BLITTER_EMU_H__
+
+#include <ratr0/data_types.h>
+
+/** \brief bltsize value when no blit is pending */
+#define RATR0_BLTSIZE_IDLE (0xffffffff)
+
+/** \brief DMACONR: BZERO, the last blit only produced zero words */
+#define RATR0_DMAF_BZERO (0x2000)
+
+/** \brief INTENA/INTREQ: set bits instead of clearing them */
+#define INTF_SETCLR (0x8000)
+/** \brief INTENA/INTREQ: blitter finished */
+#define INTF_BLIT   (0x0040)
+
+/** \brief BLTCON1: descending mode */
+#define RATR0_BC1F_DESC   (0x0002)
+/** \brief BLTCON1: fill carry in */
+#define RATR0_BC1F_FCI    (0x0004)
+/** \brief BLTCON1: inclusive fill */
+#define RATR0_BC1F_IFE    (0x0008)
+/** \brief BLTCON1: exclusive fill */
+#define RATR0_BC1F_EFE    (0x0010)
+/** \brief BLTCON1: disable channel D output (ECS) */
+#define RATR0_BC1F_DOFF   (0x0080)
+/** \brief BLTCON1: line mode */
+#define RATR0_BC1F_LINE   (0x0001)
+
+/**
+ * The blitter registers of the custom chips, named like in
+ * hardware/custom.h.
+ */
+struct Custom {
+    /** \brief DMA control read, only BZERO is maintained */
+    UINT16 dmaconr;
+    /** \brief interrupt enable, holds the last written value */
+    UINT16 intena;
+    /** \brief interrupt request, INTF_BLIT is set after each blit */
+    UINT16 intreq;
+    /** \brief blitter control 0: A shift, channel enables and minterm */
+    UINT16 bltcon0;
+    /** \brief blitter control 1: B shift and mode bits */
+    UINT16 bltcon1;
+    /** \brief first word mask for channel A */
+    UINT16 bltafwm;
+    /** \brief last word mask for channel A */
+    UINT16 bltalwm;
+    /** \brief channel C pointer */
+    void *bltcpt;
+    /** \brief channel B pointer */
+    void *bltbpt;
+    /** \brief channel A pointer */
+    void *bltapt;
+    /** \brief channel D pointer */
+    void *bltdpt;
+    /** \brief blit size, writing it starts the blit. Wider than on the
+        hardware, so a pending blit can be told apart from RATR0_BLTSIZE_IDLE */
+    UINT32 bltsize;
+    /** \brief channel C modulo */
+    INT16 bltcmod;
+    /** \brief channel B modulo */
+    INT16 bltbmod;
+    /** \brief channel A modulo */
+    INT16 bltamod;
+    /** \brief channel D modulo */
+    INT16 bltdmod;
+    /** \brief channel C data */
+    UINT16 bltcdat;
+    /** \brief channel B data */
+    UINT16 bltbdat;
+    /** \brief channel A data */
+    UINT16 bltadat;
+};
+
+/** \brief the emulated custom chip registers */
+extern struct Custom custom;
+
+/**
+ * Runs the pending blit, if there is one. On the host, the blit is
+ * finished when this function returns.
+ */
+extern void WaitBlit(void);
+
+/**
+ * Resets all blitter registers, so no blit is pending.
+ */
+extern void ratr0_blitter_emu_reset(void);
+
+/**
+ * Sets the handler of the blitter interrupt.
+ *
+ * @param handler the interrupt handler, NULL to remove it
+ */
+extern void ratr0_blitter_emu_set_interrupt(void (*handler)(void));
+
+/**
+ * Number of blits that were run since the last reset.
+ *
+ * @return blit count
+ */
+extern UINT32 ratr0_blitter_emu_num_blits(void);
+
+#endif /* __RATR0_BLITTER_EMU_H__ */
@@ -0,0 +1,258 @@
+/** @file copper.h
+ *
+ * Runtime copper lists. A copper list is built with the MOVE, WAIT and SKIP
+ * emitters, which keep track of the indexes the display needs in the list's
+ * Ratr0CopperListInfo. A static list that ratr0-makecoplist generated can be
+ * loaded instead.
+ *
+ * Every list has 2 copies in chip memory. The copper runs the front copy,
+ * all changes go to the back copy, which the display shows from the next
+ * ratr0_display_swap_buffers() on. After the copper started the new front
+ * copy, the back copy is brought up to date with ratr0_copper_sync(), so the
+ * list that the copper reads is never written to. The display only hands
+ * out the back copy after the sync, and the copper lists must not be
+ * changed from interrupt code, e.g. timer callbacks, which could write
+ * to the back copy right before the sync overwrites it.
+ */
+#pragma once
+#ifndef __RATR0_COPPER_H__
+#define __RATR0_COPPER_H__
+#include <ratr0/data_types.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+
+/** \brief size of a copper instruction in words */
+#define RATR0_COPPER_INSTR_WORDS (2)
+
+/** \brief number of words that ratr0_copper_add_display() emits with 32 colors */
+#define RATR0_COPPER_DISPLAY_WORDS (2 * (10 + 12 + 16 + 32))
+/** \brief number of words that ratr0_copper_add_split() emits */
+#define RATR0_COPPER_SPLIT_WORDS (2 * (2 + 12))
+
+/**
+ * \brief number of MOVEs that fit between the end of a line's display and
+ * the data fetch start of the next line
+ */
+#define RATR0_COPPER_LINE_MOVES (14)
+
+/**
+ * A double buffered copper list. Set it up with ratr0_copper_init().
+ */
+struct Ratr0CopperList {
+    /** \brief memory handles of the 2 copies */
+    Ratr0MemHandle h_copies[2];
+    /** \brief the 2 copies */
+    UINT16 *copies[2];
+    /** \brief index of the copy that the copper runs */
+    UINT16 front;
+    /** \brief capacity of a copy in words */
+    UINT16 max_words;
+    /** \brief number of words in the list, including the END instruction */
+    UINT16 num_words;
+    /** \brief TRUE if the back copy is older than the front copy */
+    BOOL needs_sync;
+    /** \brief indexes of the display registers in the list */
+    struct Ratr0CopperListInfo info;
+};
+
+/**
+ * Per-line colors in a copper list, see ratr0_copper_add_palette_lines().
+ * The table has num_colors colors for each of the num_lines lines.
+ */
+struct Ratr0CopperPaletteLines {
+    /** \brief first line, relative to the top of the display window */
+    UINT16 first_line;
+    /** \brief number of lines in the table */
+    UINT16 num_lines;
+    /** \brief first color register that the table sets */
+    UINT16 first_color;
+    /** \brief number of colors per line, at most RATR0_COPPER_LINE_MOVES */
+    UINT16 num_colors;
+
+    /** \brief index of the first emitted word, set by the emitter */
+    UINT16 index;
+    /** \brief number of emitted words, set by the emitter */
+    UINT16 num_words;
+    /** \brief beam line of the display window's top, set by the emitter */
+    UINT16 vstart;
+};
+
+/**
+ * Allocates the 2 copies of a copper list in chip memory and starts an empty
+ * list. Like every allocation, this exits the engine if there is not
+ * enough chip memory.
+ *
+ * @param list the copper list
+ * @param max_words capacity of the list in words, including the END
+ */
+extern void ratr0_copper_init(struct Ratr0CopperList *list, UINT16 max_words);
+
+/**
+ * Frees the copies of a copper list. The list must not be displayed.
+ *
+ * @param list the copper list
+ */
+extern void ratr0_copper_free(struct Ratr0CopperList *list);
+
+/**
+ * Starts building the list from scratch.
+ *
+ * @param list the copper list
+ */
+extern void ratr0_copper_begin(struct Ratr0CopperList *list);
+
+/**
+ * Emits a MOVE instruction.
+ *
+ * @param list the copper list
+ * @param reg custom register offset, see hw_registers.h
+ * @param value the value to move into the register
+ * @return index of the value word in the list, -1 if the list is full
+ */
+extern INT16 ratr0_copper_move(struct Ratr0CopperList *list, UINT16 reg, UINT16 value);
+
+/**
+ * Emits a WAIT instruction for a beam position.
+ *
+ * @param list the copper list
+ * @param hpos horizontal beam position, a multiple of 2 up to 0xe2
+ * @param vpos vertical beam position, the low 8 bits are compared
+ * @return index of the first instruction word, -1 if the list is full
+ */
+extern INT16 ratr0_copper_wait(struct Ratr0CopperList *list, UINT16 hpos, UINT16 vpos);
+
+/**
+ * Emits a SKIP instruction, which skips the next instruction if the beam
+ * reached the position.
+ *
+ * @param list the copper list
+ * @param hpos horizontal beam position, a multiple of 2 up to 0xe2
+ * @param vpos vertical beam position, the low 8 bits are compared
+ * @return index of the first instruction word, -1 if the list is full
+ */
+extern INT16 ratr0_copper_skip(struct Ratr0CopperList *list, UINT16 hpos, UINT16 vpos);
+
+/**
+ * Emits the display setup the engine maintains: the data fetch and display
+ * windows, BPLCON0-2, the modulos, the bitplane and sprite pointers and the
+ * colors. Records their indexes in the list's info.
+ *
+ * @param list the copper list
+ * @param num_colors number of colors, at most 32
+ * @return TRUE if the list had enough space, FALSE otherwise
+ */
+extern BOOL ratr0_copper_add_display(struct Ratr0CopperList *list, UINT16 num_colors);
+
+/**
+ * Emits the split for vertically wrapping playfields, see
+ * Ratr0CopperListInfo. It has to come after everything that waits for a
+ * line above the viewport's last line.
+ *
+ * @param list the copper list
+ * @return TRUE if the list had enough space, FALSE otherwise
+ */
+extern BOOL ratr0_copper_add_split(struct Ratr0CopperList *list);
+
+/**
+ * Emits the colors of a per-line palette table, e.g. a gradient. Each line
+ * that differs from the line before gets a WAIT for the end of the line
+ * before and the MOVEs of the colors that changed, lines that are the same
+ * as the one before don't cost anything. The first line sets all colors.
+ * The line positions are relative to the display window in the list's
+ * DIWSTRT, or the default display window if it doesn't have one, so the
+ * display setup must come first. Lines below line 255 of the frame are
+ * handled. Like everything that waits for a line, the colors need to come
+ * before the split.
+ *
+ * @param list the copper list
+ * @param lines the lines and colors that the table covers, the emitter sets
+ *        the position of the colors in the list
+ * @param table num_lines * num_colors colors, line by line
+ * @return TRUE if the list had enough space and no line changes more than
+ *         RATR0_COPPER_LINE_MOVES colors, FALSE otherwise
+ */
+extern BOOL ratr0_copper_add_palette_lines(struct Ratr0CopperList *list,
+                                           struct Ratr0CopperPaletteLines *lines,
+                                           UINT16 *table);
+
+/**
+ * Writes the colors of a new table to per-line colors that are in the
+ * list's back copy. The list isn't rebuilt, so the new table has to change
+ * the same colors on the same lines as the table that was emitted, e.g. a
+ * faded version of it, or the next step of a color cycle over a table in
+ * which every line differs.
+ *
+ * @param list the copper list
+ * @param lines the per-line colors that ratr0_copper_add_palette_lines()
+ *        emitted
+ * @param table num_lines * num_colors colors, line by line
+ */
+extern void ratr0_copper_set_palette_lines(struct Ratr0CopperList *list,
+                                           struct Ratr0CopperPaletteLines *lines,
+                                           UINT16 *table);
+
+/**
+ * Fills a table of one color per line with a gradient in RGB4 colors.
+ *
+ * @param table the table, num_lines colors
+ * @param num_lines number of lines
+ * @param from color of the first line
+ * @param to color of the last line
+ */
+extern void ratr0_copper_make_gradient(UINT16 *table, UINT16 num_lines, UINT16 from, UINT16 to);
+
+/**
+ * Ends the list and makes both copies the same. Call this before the list
+ * is displayed.
+ *
+ * @param list the copper list
+ * @return TRUE if the list had enough space, FALSE otherwise
+ */
+extern BOOL ratr0_copper_end(struct Ratr0CopperList *list);
+
+/**
+ * Loads a static copper list, e.g. one that ratr0-makecoplist generated,
+ * into both copies.
+ *
+ * @param list the copper list
+ * @param words the copper list words, including the END
+ * @param num_words number of words
+ * @param info indexes of the display registers in the list
+ * @return TRUE if the list had enough space, FALSE otherwise
+ */
+extern BOOL ratr0_copper_load(struct Ratr0CopperList *list, UINT16 *words, UINT16 num_words,
+                              struct Ratr0CopperListInfo *info);
+
+/**
+ * Returns the back copy, which changes go to.
+ *
+ * @param list the copper list
+ * @return pointer to the back copy
+ */
+extern UINT16 *ratr0_copper_get_back(struct Ratr0CopperList *list);
+
+/**
+ * Returns the front copy, which the copper runs.
+ *
+ * @param list the copper list
+ * @return pointer to the front copy
+ */
+extern UINT16 *ratr0_copper_get_front(struct Ratr0CopperList *list);
+
+/**
+ * Makes the back copy the front copy. The back copy has to be synced
+ * before it is changed again.
+ *
+ * @param list the copper list
+ */
+extern void ratr0_copper_swap(struct Ratr0CopperList *list);
+
+/**
+ * Copies the front copy to the back copy if it changed since the last sync.
+ * Only call this when the copper doesn't run the back copy anymore.
+ *
+ * @param list the copper list
+ */
+extern void ratr0_copper_sync(struct Ratr0CopperList *list);
+
+#endif /* __RATR0_COPPER_H__ */
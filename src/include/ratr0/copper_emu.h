@@ -0,0 +1,153 @@
+/** @file copper_emu.h
+ *
+ * Host side model of the Amiga copper for checking copper lists without
+ * running them on an Amiga. The emulator runs a list over a PAL frame with a
+ * modelled beam position and records every register write with the line
+ * and position it happens at. It reports:
+ *
+ *   - errors: writes to registers that stop the copper, WAITs that the beam
+ *     never reaches in the frame, a list without END
+ *   - warnings: WAITs for a position the beam already passed, and MOVEs
+ *     after a WAIT that run so long that they reach the display fetch start
+ *     of the next line
+ *
+ * Timing: the copper fetches a word in every free even color clock, a line
+ * has 227 color clocks. Bitplane DMA takes the even slots of planes 5 and 6
+ * in the data fetch window of the lines within the display window, which
+ * are taken from the list's own DDFSTRT, DDFSTOP, DIWSTRT, DIWSTOP and
+ * BPLCON0 writes. Lores only.
+ *
+ * ratr0_copper_emu_assemble() reads the .copper source format of
+ * ratr0-makecoplist.
+ */
+#pragma once
+#ifndef __RATR0_COPPER_EMU_H__
+#define __RATR0_COPPER_EMU_H__
+#include <stdio.h>
+#include <ratr0/data_types.h>
+
+/** \brief maximum number of recorded register writes */
+#define RATR0_COPPER_EMU_MAX_WRITES (1024)
+/** \brief maximum number of recorded issues */
+#define RATR0_COPPER_EMU_MAX_ISSUES (32)
+/** \brief number of lines of a PAL frame */
+#define RATR0_COPPER_EMU_NUM_LINES (313)
+/** \brief number of color clocks of a line */
+#define RATR0_COPPER_EMU_LINE_CLOCKS (227)
+
+/** \brief kinds of problems in a copper list */
+typedef enum {
+    /** \brief error: a MOVE to a register that stops the copper */
+    RATR0_COPPER_ILLEGAL_REGISTER,
+    /** \brief error: a MOVE to a register that needs the COPCON danger bit */
+    RATR0_COPPER_PROTECTED_REGISTER,
+    /** \brief error: a WAIT for a position that the frame never reaches */
+    RATR0_COPPER_UNREACHABLE_WAIT,
+    /** \brief error: the list has no END */
+    RATR0_COPPER_MISSING_END,
+    /** \brief warning: a WAIT for a position the beam already passed */
+    RATR0_COPPER_PASSED_WAIT,
+    /** \brief warning: MOVEs after a WAIT reach the next line's display */
+    RATR0_COPPER_LINE_OVERRUN
+} Ratr0CopperIssueType;
+
+/** \brief a problem in a copper list */
+struct Ratr0CopperIssue {
+    /** \brief what is wrong */
+    Ratr0CopperIssueType type;
+    /** \brief word index of the instruction */
+    UINT16 index;
+    /** \brief beam position when the copper ran the instruction */
+    UINT16 vpos, hpos;
+};
+
+/** \brief a register write of the copper */
+struct Ratr0CopperWrite {
+    /** \brief word index of the MOVE */
+    UINT16 index;
+    /** \brief beam position of the write */
+    UINT16 vpos, hpos;
+    /** \brief register offset and value */
+    UINT16 reg, value;
+};
+
+/**
+ * Emulator state and results. Set num_bitplanes and danger, then call
+ * ratr0_copper_emu_run().
+ */
+struct Ratr0CopperEmu {
+    /**
+     * \brief number of bitplanes to assume if the list doesn't write
+     * BPLCON0, e.g. because the display sets it at runtime
+     */
+    UINT16 num_bitplanes;
+    /** \brief if TRUE, the COPCON danger bit is set */
+    BOOL danger;
+
+    /** \brief the recorded register writes in the order of execution */
+    struct Ratr0CopperWrite writes[RATR0_COPPER_EMU_MAX_WRITES];
+    /** \brief number of recorded writes */
+    UINT16 num_writes;
+    /** \brief the problems that were found */
+    struct Ratr0CopperIssue issues[RATR0_COPPER_EMU_MAX_ISSUES];
+    /** \brief number of problems */
+    UINT16 num_issues;
+    /** \brief number of problems that are errors */
+    UINT16 num_errors;
+};
+
+/**
+ * Runs a copper list for one frame.
+ *
+ * @param emu the emulator, the results are written to it
+ * @param words the copper list
+ * @param num_words number of words in the list
+ */
+extern void ratr0_copper_emu_run(struct Ratr0CopperEmu *emu, UINT16 *words, UINT16 num_words);
+
+/**
+ * Returns the name of a custom register.
+ *
+ * @param reg register offset
+ * @return the name, NULL if reg is not a register
+ */
+extern const char *ratr0_copper_emu_register_name(UINT16 reg);
+
+/**
+ * Writes a readable listing of a copper list.
+ *
+ * @param words the copper list
+ * @param num_words number of words in the list
+ * @param out output stream
+ */
+extern void ratr0_copper_emu_disassemble(UINT16 *words, UINT16 num_words, FILE *out);
+
+/**
+ * Writes the register writes of the last run, line by line.
+ *
+ * @param emu the emulator
+ * @param out output stream
+ */
+extern void ratr0_copper_emu_print_writes(struct Ratr0CopperEmu *emu, FILE *out);
+
+/**
+ * Writes the problems of the last run.
+ *
+ * @param emu the emulator
+ * @param name name of the list for the messages
+ * @param out output stream
+ */
+extern void ratr0_copper_emu_print_issues(struct Ratr0CopperEmu *emu, const char *name, FILE *out);
+
+/**
+ * Translates a copper list in the .copper source format.
+ *
+ * @param in the source
+ * @param name name of the source for error messages
+ * @param words the words of the list are written here
+ * @param max_words capacity of words
+ * @return the number of words, -1 on a syntax error
+ */
+extern int ratr0_copper_emu_assemble(FILE *in, const char *name, UINT16 *words, UINT16 max_words);
+
+#endif /* __RATR0_COPPER_EMU_H__ */
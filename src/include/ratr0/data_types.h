@@ -51,6 +51,12 @@ typedef unsigned char UINT8;
  */
 typedef char CHAR;
 
+/**
+ * \var typedef unsigned int UINTPTR
+ * \brief An unsigned integer that can hold an address.
+ */
+typedef unsigned int UINTPTR;
+
 #else
 
 #include <stdint.h>
@@ -69,6 +75,7 @@ typedef int16_t INT16;
 typedef uint16_t UINT16;
 typedef int8_t INT8;
 typedef uint8_t UINT8;
+typedef uintptr_t UINTPTR;
 
 typedef char CHAR;
 typedef int16_t BOOL;
@@ -52,4 +52,43 @@ typedef void (*Ratr0BitSetIterFunc)(UINT16 index, void *userdata);
  */
 void ratr0_bitset_iterate(UINT32 *bitset, UINT16 size, void (*func)(UINT16, void *), void *userdata);
 
+/**
+ * Computes the row stride of a grid as a power of 2, so a grid element
+ * (x, y) has the index (y << shift) + x.
+ *
+ * @param row_width number of elements in a grid row
+ * @return the smallest shift with (1 << shift) >= row_width
+ */
+UINT16 ratr0_bitset_row_shift(UINT16 row_width);
+
+/** \brief number of 32 bit words of a grid with the specified row shift and rows */
+#define RATR0_BITSET_GRID_WORDS(shift, rows) (((((UINT32) (rows)) << (shift)) + 31) >> 5)
+
+/** \brief maximum row width for ratr0_bitset_iterate_rects() */
+#define RATR0_BITSET_MAX_ROW_WIDTH (64)
+
+/** \brief Function pointer for iterating over rectangles of the set. */
+typedef void (*Ratr0BitSetRectFunc)(UINT16 x, UINT16 y, UINT16 w, UINT16 h, void *userdata);
+
+/**
+ * Interprets the set as a grid with rows of row_width elements and iterates
+ * over rectangles that cover all set elements. Runs of adjacent elements
+ * in a row are combined into a span. If merge_rows is TRUE, spans with the
+ * same position and width in consecutive rows are combined as well.
+ * Every element is covered by exactly one rectangle.
+ *
+ * @param bitset a bitset, stored as an array of 32 bit unsigned integers
+ * @param size the size of the bitset array
+ * @param row_width number of elements in a grid row. Rows that are wider
+ *        than RATR0_BITSET_MAX_ROW_WIDTH are not combined, each element is
+ *        a rectangle on its own
+ * @param merge_rows TRUE to combine spans across rows
+ * @param func a function that is called with the grid position and size
+ *        of each rectangle
+ * @param userdata a pointer that is passed to the function
+ */
+void ratr0_bitset_iterate_rects(UINT32 *bitset, UINT16 size, UINT16 row_width,
+                                BOOL merge_rows, Ratr0BitSetRectFunc func,
+                                void *userdata);
+
 #endif /* __RATR0_BITSET_H__ */
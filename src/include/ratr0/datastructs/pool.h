@@ -0,0 +1,100 @@
+/** @file pool.h
+ *
+ * Fixed-size object pools. A pool reserves storage for a fixed number of
+ * objects of the same size from the memory subsystem when it is created.
+ * Allocating and freeing objects are O(1): freed objects are kept in a
+ * free list that is stored in the objects themselves, so a pool has no
+ * overhead per object.
+ * Pools that are created at engine startup sit at the start of the memory
+ * pool, so they are never moved by ratr0_memory_compact().
+ */
+#pragma once
+#ifndef __RATR0_POOL_H__
+#define __RATR0_POOL_H__
+
+#include <ratr0/data_types.h>
+#include <ratr0/memory.h>
+
+/** \brief byte that freed objects are filled with if poisoning is enabled */
+#define RATR0_POOL_POISON (0xdb)
+
+/**
+ * A pool of equally sized objects.
+ */
+struct Ratr0Pool {
+    /** \brief memory handle of the object storage */
+    Ratr0MemHandle handle;
+    /** \brief start address of the object storage */
+    UINT8 *elements;
+    /** \brief size of an object in bytes, at least the size of a pointer */
+    UINT16 element_size;
+    /** \brief maximum number of objects */
+    UINT16 capacity;
+    /** \brief number of allocated objects */
+    UINT16 num_used;
+    /** \brief objects from this index on have never been allocated */
+    UINT16 next_unused;
+    /** \brief first freed object, its first bytes link to the next one */
+    void *first_free;
+    /**
+     * \brief if TRUE, freed objects are filled with RATR0_POOL_POISON and
+     * checked when they are allocated again, TRUE by default in debug builds
+     */
+    BOOL poison;
+};
+
+/**
+ * Creates a pool.
+ *
+ * @param pool the pool to initialize
+ * @param element_size size of an object in bytes
+ * @param capacity maximum number of objects
+ * @param mem_type memory type of the storage, optionally or'ed with a tag
+ */
+extern void ratr0_pool_init(struct Ratr0Pool *pool, UINT16 element_size, UINT16 capacity,
+                            Ratr0MemoryType mem_type);
+
+/**
+ * Releases the storage of a pool. All objects of the pool become invalid.
+ *
+ * @param pool the pool
+ */
+extern void ratr0_pool_destroy(struct Ratr0Pool *pool);
+
+/**
+ * Allocates an object from the pool. The object is not initialized.
+ *
+ * @param pool the pool
+ * @return pointer to the object, NULL if the pool is exhausted
+ */
+extern void *ratr0_pool_alloc(struct Ratr0Pool *pool);
+
+/**
+ * Returns an object to the pool. If poisoning is enabled, objects that
+ * are still poisoned were already freed and are rejected.
+ *
+ * @param pool the pool
+ * @param element pointer to an object that was allocated from this pool
+ */
+extern void ratr0_pool_free(struct Ratr0Pool *pool, void *element);
+
+/**
+ * Retrieves the object at the specified index.
+ *
+ * @param pool the pool
+ * @param index index of the object
+ * @return pointer to the object
+ */
+#define ratr0_pool_at(pool, index) ((void *) ((pool)->elements + (index) * (pool)->element_size))
+
+/**
+ * Determines the index of an object in its pool, e.g. to use it as a handle.
+ *
+ * @param pool the pool
+ * @param element pointer to an object of the pool
+ * @return index of the object
+ */
+#define ratr0_pool_index(pool, element) \
+    ((UINT16) ((((UINT8 *) (element)) - (pool)->elements) / (pool)->element_size))
+
+#endif /* __RATR0_POOL_H__ */
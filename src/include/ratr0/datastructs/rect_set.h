@@ -0,0 +1,61 @@
+/** @file rect_set.h
+ *
+ * A small set of rectangles that merges a rectangle with the ones it
+ * overlaps or touches when that is cheaper than keeping them apart, e.g.
+ * for restoring the exact areas that BOBs covered. Rectangles are only
+ * merged if their bounding box isn't larger than both of them together,
+ * so merging never increases the covered area that is processed.
+ * Insertion is O(n) in the number of rectangles.
+ */
+#pragma once
+#ifndef __RATR0_RECT_SET_H__
+#define __RATR0_RECT_SET_H__
+
+#include <ratr0/data_types.h>
+
+/** \brief maximum number of rectangles in a set */
+#define RATR0_RECT_SET_SIZE (32)
+
+/**
+ * \brief a rectangle of a set
+ */
+struct Ratr0Rect {
+    /** \brief position of the top left corner */
+    UINT16 x, y;
+    /** \brief size */
+    UINT16 width, height;
+};
+
+/**
+ * \brief a set of rectangles
+ */
+struct Ratr0RectSet {
+    /** \brief the rectangles */
+    struct Ratr0Rect rects[RATR0_RECT_SET_SIZE];
+    /** \brief number of rectangles */
+    UINT16 num_rects;
+};
+
+/**
+ * Removes all rectangles from the set.
+ *
+ * @param set the set
+ */
+void ratr0_rect_set_clear(struct Ratr0RectSet *set);
+
+/**
+ * Inserts a rectangle and merges it with the rectangles it overlaps or
+ * touches as long as their bounding box isn't larger than the rectangles
+ * together. Empty rectangles are ignored.
+ *
+ * @param set the set
+ * @param x x-coordinate of the rectangle
+ * @param y y-coordinate of the rectangle
+ * @param width width of the rectangle
+ * @param height height of the rectangle
+ * @return FALSE if the set was full and the rectangle wasn't inserted
+ */
+BOOL ratr0_rect_set_insert(struct Ratr0RectSet *set, UINT16 x, UINT16 y,
+                           UINT16 width, UINT16 height);
+
+#endif /* __RATR0_RECT_SET_H__ */
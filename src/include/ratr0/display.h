@@ -47,6 +47,8 @@
 #define DISP_SPRITE_Y0 (44)
 
 #define MAX_PLAYFIELDS (2)
+/** \brief maximum number of display buffers per playfield */
+#define MAX_BUFFERS (4)
 #define MAX_BITPLANES (6)
 
 #ifdef AMIGA
@@ -66,7 +68,9 @@ struct Ratr0PlayfieldInfo {
     UINT8 depth;
 
     /** \brief number of display buffer, this is the main buffer + any
-     amount of back buffers for the playfield */
+     amount of back buffers for the playfield, at most MAX_BUFFERS. With 3
+     buffers, the next frame can be drawn while the last one waits for the
+     vertical blank, see ratr0_display_set_wait_vblank() */
     UINT8 num_buffers;
 
     /**
@@ -98,9 +102,13 @@ struct Ratr0RenderingSystem {
  * Start up the display subsystem.
  *
  * @param engine pointer to engine instance
+ * @param max_hw_sprites maximum number of hardware sprite objects
+ * @param max_bobs maximum number of BOB objects
  * @return pointer to rendering subsystem object
  */
-struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng);
+struct Ratr0RenderingSystem *ratr0_display_startup(Ratr0Engine *eng,
+                                                   UINT16 max_hw_sprites,
+                                                   UINT16 max_bobs);
 
 /**
  * Information about the current display in this object.
@@ -131,6 +139,8 @@ struct Ratr0DisplayBuffer {
     struct Ratr0Surface surface;
     /** \brief the logical number of this buffer  */
     int buffernum;
+    /** \brief the playfield this buffer belongs to */
+    UINT16 playfield_num;
 };
 
 /**
@@ -161,17 +171,60 @@ extern void ratr0_display_init_buffers(UINT16 vp_width, UINT16 vp_height,
                                        UINT16 num_playfields,
                                        struct Ratr0PlayfieldInfo pf_infos[]);
 
+/**
+ * Returns the number of playfields of the display.
+ *
+ * @return 1 for a single playfield, 2 in dual playfield mode
+ */
+extern UINT16 ratr0_display_get_num_playfields(void);
+
 /**
  * Swap back buffer with the front buffer if available. Affects both playfields.
+ * The back buffer is shown from the next vertical blank on and the next
+ * back buffer is a buffer that is neither shown nor about to be shown. With
+ * 2 buffers, that's the buffer that is on screen until the next vertical
+ * blank. The copies of the copper list are swapped as well, so the changes
+ * to the copper list are shown with the back buffer.
  */
 extern void ratr0_display_swap_buffers(void);
 
+/**
+ * Points the sprite channels to a set of sprite chains that
+ * ratr0_sprites_multiplex() built. Like the back buffer, they are shown
+ * from the next ratr0_display_swap_buffers() on.
+ *
+ * @param set_num the chain buffer set
+ */
+extern void ratr0_display_set_sprite_chains(UINT16 set_num);
+
+/**
+ * Sets whether the game loop waits for the vertical blank before every
+ * frame, which is the default. Without waiting, the next frame is drawn
+ * right after the swap if there is a free buffer, which needs at least 3
+ * buffers. A frame that takes longer than a vertical blank interval then
+ * delays the display of only that frame instead of stalling the loop.
+ *
+ * @param wait TRUE to wait for the vertical blank before each frame
+ */
+extern void ratr0_display_set_wait_vblank(BOOL wait);
+
+/**
+ * Called by the game loop before a frame is drawn. Waits for the vertical
+ * blank, or, if ratr0_display_set_wait_vblank() was set to FALSE, only
+ * until the back buffer and the back copy of the copper list are not on
+ * screen anymore. Then it brings the back copy of the copper list up to date.
+ */
+extern void ratr0_display_wait_back_buffer(void);
+
 //
 // Quick access functions to the copper list.
 //
 
 /**
  * Sets the display palette. Allows to set the colors at an offset within the palette.
+ * Like all copper list changes, this must not be called from interrupt
+ * code, e.g. a timer callback, because it can race the copper list swap.
+ * Set a flag in the interrupt and change the palette in the stage update.
  *
  * @param colors array of colors
  * @param num_colors length of array
@@ -187,6 +240,18 @@ struct Ratr0CopperListInfo {
     int ddfstrt_index, ddfstop_index, diwstrt_index, diwstop_index;
     int bplcon0_index, bpl1mod_index;
     int bpl1pth_index, spr0pth_index, color00_index;
+    /**
+     * \brief optional index of the BPLCON1 value for fine scrolling, 0 if
+     * the copper list doesn't have it
+     */
+    int bplcon1_index;
+    /**
+     * \brief optional split for vertically wrapping playfields, 0 if the
+     * copper list doesn't have it. This is the index of the BPL1PTH value of
+     * a bitplane pointer block like the one at bpl1pth_index, which follows
+     * 2 WAIT instructions and should be the last thing in the list
+     */
+    int split_index;
 };
 
 /**
@@ -206,7 +271,43 @@ extern struct Ratr0DisplayBuffer *ratr0_display_get_front_buffer(UINT16 playfiel
 extern struct Ratr0DisplayBuffer *ratr0_display_get_back_buffer(UINT16 playfield_num);
 
 /**
- * Blits the specified surface to the front and back buffers. Can be
+ * Returns a display buffer of a playfield.
+ *
+ * @param playfield_num the number of the playfield (0 or 1)
+ * @param buffer_num the number of the buffer
+ * @return pointer to the display buffer, NULL if the playfield doesn't
+ *         have that many buffers
+ */
+extern struct Ratr0DisplayBuffer *ratr0_display_get_buffer(UINT16 playfield_num,
+                                                           UINT16 buffer_num);
+
+/**
+ * Returns the size of the viewport.
+ *
+ * @param width returns the viewport width
+ * @param height returns the viewport height
+ */
+extern void ratr0_display_get_viewport(UINT16 *width, UINT16 *height);
+
+/**
+ * Hardware scrolling: sets the position of the viewport within the buffers
+ * of a playfield, the change is applied with the next buffer swap.
+ * Playfields with buffers that are wider than the viewport are fetched one
+ * word early, so x can be any value from 0 to buffer width - viewport width,
+ * with the fine scroll written to BPLCON1. Vertically, the buffers wrap
+ * around: if y + viewport height is larger than the buffer height, the
+ * display continues at the top of the buffers from the copper list split.
+ * The copper list has a single split, so only one playfield can wrap at a
+ * time.
+ *
+ * @param playfield_num the number of the playfield (0 or 1)
+ * @param x horizontal position in pixels
+ * @param y vertical position in pixels
+ */
+extern void ratr0_display_scroll_playfield(UINT16 playfield_num, UINT16 x, UINT16 y);
+
+/**
+ * Blits the specified surface to all display buffers of the playfield. Can be
  * used to blit a background that will be restored using a custom mechanism.
  *
  * @param surface the Ratr0Surface to blit
@@ -218,13 +319,17 @@ extern BOOL ratr0_display_blit_surface_to_buffers(struct Ratr0Surface *surface,
                                                   UINT16 playfield_num,
                                                   UINT16 dstx, UINT16 dsty);
 
+/** \brief index info of the displayed copper list */
 extern struct Ratr0CopperListInfo *current_copper_info;
+/** \brief back copy of the displayed copper list, changes go here */
 extern UINT16 *current_coplist;
+/** \brief number of words in the displayed copper list */
 extern int current_coplist_size;
 
 /**
  * Adds a dirty rectangle to the list at the specified position. The coordinates
- * are based on 16 pixel tiles rather than individual pixels.
+ * are based on 16 pixel tiles rather than individual pixels. Tiles outside
+ * of the display buffer are ignored.
  *
  * @param playfield_num the number of the playfield (0 or 1)
  * @param x coordinate of the dirty tile
@@ -234,11 +339,53 @@ extern void ratr0_display_add_dirty_rectangle(UINT16 playfield_num,
                                               UINT16 x, UINT16 y);
 
 /**
- * Processes the dirty rectangle list of the current back buffer.
+ * Adds an area to the exact dirty areas of all buffers of a playfield.
+ * The area is extended to whole words horizontally and clipped to the
+ * buffer. Areas that overlap are merged when their bounding box isn't
+ * larger than the areas together. If a buffer has too many areas, the
+ * 16x16 tiles under the area are added instead.
  *
- * @param process_dirty_rect a function that is called for every dirty rectangle
+ * @param playfield_num the number of the playfield (0 or 1)
+ * @param x x-coordinate of the area in pixels
+ * @param y y-coordinate of the area in pixels
+ * @param width width of the area in pixels
+ * @param height height of the area in pixels
+ */
+extern void ratr0_display_add_dirty_area(UINT16 playfield_num, UINT16 x, UINT16 y,
+                                         UINT16 width, UINT16 height);
+
+/**
+ * How dirty tiles are combined before they are processed.
  */
-extern void ratr0_display_process_dirty_rectangles(void (*process_dirty_rect)(struct Ratr0DisplayBuffer *display_buffer, UINT16 x, UINT16 y));
+typedef enum {
+    /** \brief every dirty tile is a separate 16x16 rectangle */
+    RATR0_DIRTY_TILES,
+    /** \brief adjacent dirty tiles in a row are combined into a span */
+    RATR0_DIRTY_SPANS,
+    /** \brief spans of the same width in consecutive rows are combined as well */
+    RATR0_DIRTY_RECTS
+} Ratr0DirtyRectMode;
+
+/**
+ * Sets how dirty tiles are combined. The default is RATR0_DIRTY_RECTS.
+ * Playfields with buffers wider than 1024 pixels always use RATR0_DIRTY_TILES.
+ *
+ * @param mode the combination mode
+ */
+extern void ratr0_display_set_dirty_rect_mode(Ratr0DirtyRectMode mode);
+
+/**
+ * Processes the dirty rectangle list of the current back buffer: first the
+ * dirty tiles, then the exact dirty areas.
+ *
+ * @param process_dirty_rect a function that is called for every dirty
+ *        rectangle with its position and size in pixels. The x-coordinate
+ *        and the width are multiples of 16, for dirty tiles the y-coordinate
+ *        and the height as well
+ */
+extern void ratr0_display_process_dirty_rectangles(void (*process_dirty_rect)(struct Ratr0DisplayBuffer *display_buffer,
+                                                                              UINT16 x, UINT16 y,
+                                                                              UINT16 w, UINT16 h));
 
 /**
  * \brief frame counter to show how many frames have elapsed since the last reset
@@ -380,6 +527,8 @@ struct Ratr0Bob {
     struct Ratr0Sprite base_obj;
     /** \brief BOB image data, stored in a tile sheet */
     struct Ratr0TileSheet *tilesheet;
+    /** \brief the playfield the BOB is drawn on, 0 by default */
+    UINT16 playfield_num;
 };
 
 struct Ratr0TileSheet;
@@ -392,7 +541,8 @@ struct Ratr0SpriteSheet;
  * @param frames array containing the frames of the animation
  * @param num_frames length of the frames array
  * @param speed animation speed in frames
- * @return pointer to an initialized sprite data structure
+ * @return pointer to an initialized sprite data structure, NULL if the
+ *         sprite pool is exhausted
  */
 extern struct Ratr0HWSprite *ratr0_create_sprite(struct Ratr0TileSheet *tilesheet,
                                                  UINT8 frames[], UINT8 num_frames,
@@ -426,12 +576,29 @@ extern struct Ratr0HWSprite *ratr0_create_sprite_from_sprite_sheet_frame(struct
  * @param frames array containing the frames of the animation
  * @param num_frames length of the frames array
  * @param speed animation speed in frames
- * @return pointer to an initialized BOB data structure
+ * @return pointer to an initialized BOB data structure, NULL if the
+ *         BOB pool is exhausted
  */
 extern struct Ratr0Bob *ratr0_create_bob(struct Ratr0TileSheet *tilesheet,
                                          UINT8 frames[], UINT8 num_frames,
                                          UINT8 speed);
 
+/**
+ * Returns a hardware sprite object to the sprite pool, so it can be reused.
+ * The sprite image data is not freed.
+ *
+ * @param sprite the sprite to destroy
+ */
+extern void ratr0_destroy_sprite(struct Ratr0HWSprite *sprite);
+
+/**
+ * Returns a BOB object to the BOB pool, so it can be reused. Remove it from
+ * its stage first.
+ *
+ * @param bob the BOB to destroy
+ */
+extern void ratr0_destroy_bob(struct Ratr0Bob *bob);
+
 /**
  * Points the specified sprite to the image data.
  *
@@ -456,7 +623,10 @@ extern void ratr0_display_set_sprite(UINT16 *coplist, int size,
 extern void ratr0_dump_copperlist(UINT16 *copperlist, int len, const char *path);
 
 /**
- * Sets a new copper list to the display.
+ * Sets a new static copper list to the display. The list is loaded into a
+ * double buffered copper list of the display, so it can have at most 512
+ * words and changes to it go to the display's copy, see
+ * ratr0_display_set_copper_list().
  *
  * @param copperlist pointer to new copper list
  * @param size number of words in the copper list
@@ -465,4 +635,17 @@ extern void ratr0_dump_copperlist(UINT16 *copperlist, int len, const char *path)
 extern void ratr0_display_set_copperlist(UINT16 *copperlist, int size,
                                          struct Ratr0CopperListInfo *info);
 
+struct Ratr0CopperList;
+
+/**
+ * Sets a double buffered copper list to the display, see copper.h. The
+ * display writes its registers into the back copy and swaps the copies in
+ * ratr0_display_swap_buffers(). current_coplist points to the back copy, so
+ * all changes of a frame are shown together. The list must not be the one
+ * that is currently displayed.
+ *
+ * @param list a copper list that was built or loaded
+ */
+extern void ratr0_display_set_copper_list(struct Ratr0CopperList *list);
+
 #endif /* __RATR0_DISPLAY_H__ */
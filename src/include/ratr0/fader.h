@@ -0,0 +1,103 @@
+/** @file fader.h
+ *
+ * Palette fades. A fade table holds the palette of every step of a fade,
+ * which is either baked into the game with the ratr0-fader tool or computed
+ * once with ratr0_fader_make_table(). A Ratr0Fader plays a table by writing
+ * one step of colors to the COLORxx values of the displayed copper list's
+ * back copy, so a running fade costs no arithmetic.
+ */
+#pragma once
+#ifndef __RATR0_FADER_H__
+#define __RATR0_FADER_H__
+#include <ratr0/data_types.h>
+#include <ratr0/memory.h>
+
+/**
+ * The palettes of the steps of a fade for a range of color registers.
+ */
+struct Ratr0FadeTable {
+    /** \brief first color register of the range */
+    UINT16 first_color;
+    /** \brief number of colors in the range */
+    UINT16 num_colors;
+    /** \brief number of steps, including the start and end palette */
+    UINT16 num_steps;
+    /** \brief num_steps * num_colors RGB4 colors, step by step */
+    UINT16 *colors;
+    /** \brief memory handle of the colors, -1 for a baked table */
+    Ratr0MemHandle h_colors;
+};
+
+/**
+ * Computes a fade table in fast memory. Each color is interpolated linearly
+ * per component, the same way ratr0-fader does it.
+ *
+ * @param table the table
+ * @param from start palette of the range, NULL for black
+ * @param to end palette of the range, NULL for black
+ * @param first_color first color register of the range
+ * @param num_colors number of colors in the range, at most 32
+ * @param num_steps number of steps, at least 2
+ * @return TRUE if the table could be allocated, FALSE otherwise
+ */
+extern BOOL ratr0_fader_make_table(struct Ratr0FadeTable *table, UINT16 *from, UINT16 *to,
+                                   UINT16 first_color, UINT16 num_colors, UINT16 num_steps);
+
+/**
+ * Frees the colors of a table that ratr0_fader_make_table() computed.
+ *
+ * @param table the table
+ */
+extern void ratr0_fader_free_table(struct Ratr0FadeTable *table);
+
+/**
+ * Returns the color of a step of a fade between 2 RGB4 colors.
+ *
+ * @param from start color
+ * @param to end color
+ * @param step the step, 0 is the start color
+ * @param num_steps number of steps, num_steps - 1 is the end color
+ * @return the color of the step
+ */
+extern UINT16 ratr0_fader_mix_color(UINT16 from, UINT16 to, UINT16 step, UINT16 num_steps);
+
+/**
+ * Plays a fade table.
+ */
+struct Ratr0Fader {
+    /** \brief the table that is played */
+    struct Ratr0FadeTable *table;
+    /** \brief the step that is displayed */
+    UINT16 step;
+    /** \brief TRUE if the table is played from the last step to the first */
+    BOOL reverse;
+    /** \brief number of frames that a step is displayed */
+    UINT16 frames_per_step;
+    /** \brief frames until the next step */
+    UINT16 frames_left;
+    /** \brief TRUE while the fade runs */
+    BOOL running;
+};
+
+/**
+ * Starts a fade and displays its first step.
+ *
+ * @param fader the fader
+ * @param table the table to play
+ * @param frames_per_step number of frames that a step is displayed, at least 1
+ * @param reverse if TRUE, the table is played backwards, e.g. to fade out
+ *        with a fade in table
+ */
+extern void ratr0_fader_start(struct Ratr0Fader *fader, struct Ratr0FadeTable *table,
+                              UINT16 frames_per_step, BOOL reverse);
+
+/**
+ * Advances a fade by one frame and displays the next step when it's due.
+ * Call this once per frame, e.g. in the stage's update function.
+ *
+ * @param fader the fader
+ * @return TRUE while the fade runs, FALSE after the last step was displayed
+ */
+extern BOOL ratr0_fader_update(struct Ratr0Fader *fader);
+
+#endif /* __RATR0_FADER_H__ */
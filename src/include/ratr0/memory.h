@@ -17,8 +17,40 @@
 /**
  * \brief Type of memory to reserve. Some systems (e.g.) will require special memory
  * to do certain operations.
+ *
+ *   - RATR0_MEM_DEFAULT: the general pool, for the game logic's data
+ *   - RATR0_MEM_CHIP: the chip pool, for data that is read or written by
+ *     DMA, e.g. by the blitter, sprites, copper or audio
+ *   - RATR0_MEM_FAST: data that only the CPU accesses, e.g. asset data that
+ *     is never displayed. It is placed in the general pool if that is in fast
+ *     memory and has room, otherwise in the chip pool
+ */
+typedef enum { RATR0_MEM_DEFAULT, RATR0_MEM_CHIP, RATR0_MEM_FAST } Ratr0MemoryType;
+
+/**
+ * \brief Allocation tags. A tag can be or'ed into the memory type of an
+ * allocation to attribute the block to a subsystem in the memory statistics,
+ * e.g. RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES. Untagged blocks belong to
+ * RATR0_MEMTAG_USER.
  */
-typedef enum { RATR0_MEM_DEFAULT, RATR0_MEM_CHIP } Ratr0MemoryType;
+typedef enum {
+    RATR0_MEMTAG_USER = 0x000,
+    RATR0_MEMTAG_TIMERS = 0x100,
+    RATR0_MEMTAG_RESOURCES = 0x200,
+    RATR0_MEMTAG_DISPLAY = 0x300,
+    RATR0_MEMTAG_STAGES = 0x400
+} Ratr0MemoryTag;
+
+/** \brief the bits of a memory type argument that select the pool */
+#define RATR0_MEM_TYPE_MASK (0xff)
+/** \brief the bits of a memory type argument that hold the tag */
+#define RATR0_MEMTAG_MASK   (0xff00)
+#define RATR0_MEMTAG_SHIFT  (8)
+/** \brief number of allocation tags, index of a tag is tag >> RATR0_MEMTAG_SHIFT */
+#define RATR0_NUM_MEMTAGS   (5)
+/** \brief flag that can be or'ed into the memory type of an allocation, so the
+    block belongs to the innermost memory scope, see ratr0_memory_push_scope() */
+#define RATR0_MEM_SCOPED    (0x10000)
 
 /**
  * \brief handle to a memory block. Memory access goes through handle.
@@ -39,6 +71,82 @@ struct Ratr0MemoryConfig {
     UINT32 chip_pool_size;
     /** \brief num entries in table */
     UINT32 chip_table_size;
+
+    /** \brief size of the per-frame scratch memory in bytes, taken from
+        the general pool, can be 0 */
+    UINT32 frame_pool_size;
+
+    // Object pool capacities. The pools are allocated from the general
+    // pool, 0 selects the engine default.
+    /** \brief maximum number of timers, default: 10 */
+    UINT16 max_timers;
+    /** \brief maximum number of BOBs, default: 20 */
+    UINT16 max_bobs;
+    /** \brief maximum number of hardware sprite objects, default: 20 */
+    UINT16 max_hw_sprites;
+    /** \brief maximum number of stages, default: 10 */
+    UINT16 max_stages;
+    /** \brief maximum number of backdrops, default: 2 */
+    UINT16 max_backdrops;
+};
+
+/**
+ * \brief Allocation counters of a single tag in a pool.
+ */
+struct Ratr0MemoryTagStats {
+    /** \brief currently allocated bytes */
+    UINT32 live_bytes;
+    /** \brief maximum of live_bytes since startup */
+    UINT32 peak_bytes;
+    /** \brief currently allocated blocks */
+    UINT32 live_blocks;
+    /** \brief maximum of live_blocks since startup */
+    UINT32 peak_blocks;
+};
+
+/**
+ * \brief Statistics of a memory pool. Byte counts of allocations are the
+ * requested sizes, without block headers.
+ */
+struct Ratr0MemoryPoolStats {
+    /** \brief size of the pool in bytes */
+    UINT32 pool_size;
+    /** \brief number of entries in the handle table */
+    UINT32 table_size;
+    /** \brief currently allocated bytes */
+    UINT32 live_bytes;
+    /** \brief maximum of live_bytes since startup */
+    UINT32 peak_bytes;
+    /** \brief currently used handles */
+    UINT32 live_blocks;
+    /** \brief maximum of live_blocks since startup, compare to table_size */
+    UINT32 peak_blocks;
+    /** \brief total free bytes */
+    UINT32 free_bytes;
+    /** \brief number of free regions */
+    UINT32 num_free_blocks;
+    /** \brief size of the largest allocation that can currently succeed */
+    UINT32 largest_free_block;
+    /** \brief percentage of free memory outside of the largest free block */
+    UINT32 fragmentation;
+    /** \brief counters per tag */
+    struct Ratr0MemoryTagStats tags[RATR0_NUM_MEMTAGS];
+};
+
+/**
+ * \brief Statistics of the memory subsystem.
+ */
+struct Ratr0MemoryStats {
+    /** \brief general purpose pool */
+    struct Ratr0MemoryPoolStats general;
+    /** \brief chip memory pool */
+    struct Ratr0MemoryPoolStats chip;
+    /** \brief size of the frame memory in bytes */
+    UINT32 frame_size;
+    /** \brief maximum frame memory used by two consecutive frames */
+    UINT32 frame_peak;
+    /** \brief TRUE if the general pool is in fast memory */
+    BOOL general_is_fast;
 };
 
 /**
@@ -64,14 +172,16 @@ extern struct Ratr0MemorySystem *ratr0_memory_startup(Ratr0Engine *engine,
 /**
  * Allocates a memory block.
  *
- * @param mem_type memory type
+ * @param mem_type memory type, optionally or'ed with a Ratr0MemoryTag
  * @param size size of the memory block
  */
 extern Ratr0MemHandle ratr0_memory_allocate_block(Ratr0MemoryType mem_type,
                                                   UINT32 size);
 
 /**
- * Free the specified memory block.
+ * Free the specified memory block. The memory is merged with its free
+ * neighbors and the handle is recycled, so it must not be used after this
+ * call.
  *
  * @param handle handle to the memory block that should be freed
  */
@@ -85,4 +195,74 @@ extern void ratr0_memory_free_block(Ratr0MemHandle handle);
  */
 extern void *ratr0_memory_block_address(Ratr0MemHandle handle);
 
+/**
+ * Compacts the specified memory pool by moving all allocated blocks
+ * together, so the free memory forms a single block again. Chip memory
+ * is moved with the blitter.
+ * Handles stay valid, but addresses that were obtained through
+ * ratr0_memory_block_address() before the call are invalid if any blocks
+ * were moved. This includes objects that keep a copy of the address, like
+ * backdrops, hardware sprites and surfaces initialized from tile sheets.
+ * Only call this between stages, while no DMA channel reads from the pool.
+ *
+ * @param mem_type the memory pool to compact
+ * @return number of blocks that were moved
+ */
+extern UINT32 ratr0_memory_compact(Ratr0MemoryType mem_type);
+
+/**
+ * Starts a new allocation scope. Blocks that are allocated with the
+ * RATR0_MEM_SCOPED flag until the matching ratr0_memory_pop_scope() belong
+ * to the scope, all other blocks are not affected by it. Without an active
+ * scope, RATR0_MEM_SCOPED has no effect. Scoped blocks can still be freed
+ * with ratr0_memory_free_block() before the scope ends.
+ * Scopes can be nested, up to a depth of 8.
+ *
+ * @return TRUE if the scope was pushed, FALSE if the maximum depth is exceeded
+ */
+extern BOOL ratr0_memory_push_scope(void);
+
+/**
+ * Ends the innermost allocation scope and frees every block of the scope
+ * that was not freed yet. The handles of these blocks are cleared, so they
+ * resolve to NULL until their table entries are reused. The blocks of a
+ * scope are kept in a list, so this takes time in the number of the
+ * scope's remaining blocks, not in the size of the handle table.
+ */
+extern void ratr0_memory_pop_scope(void);
+
+/**
+ * Allocates scratch memory that only lives for a short time, e.g. temporary
+ * result lists or blit descriptors. The memory is taken from the frame
+ * memory by advancing a pointer and does not occupy a table entry.
+ * It stays valid until the end of the frame that follows the current one,
+ * there is no need to free it.
+ *
+ * @param size size of the memory in bytes
+ * @return pointer to the memory, NULL if the frame memory is exhausted
+ */
+extern void *ratr0_memory_frame_alloc(UINT32 size);
+
+/**
+ * Releases the frame memory of the frame before the current one. Called
+ * by the engine at the end of every game loop iteration.
+ */
+extern void ratr0_memory_frame_reset(void);
+
+/**
+ * Retrieves the current memory statistics. Use the peak values to size
+ * the Ratr0MemoryConfig of a game.
+ *
+ * @param stats the structure to fill
+ */
+extern void ratr0_memory_stats(struct Ratr0MemoryStats *stats);
+
+/**
+ * Writes the statistics of each pool, followed by a map of its blocks in
+ * physical order, to the specified file.
+ *
+ * @param fp output file, debug_fp if NULL in debug builds
+ */
+extern void ratr0_memory_dump(FILE *fp);
+
 #endif /* __RATR0_MEMORY_H__ */
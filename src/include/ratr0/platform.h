@@ -0,0 +1,67 @@
+/** @file platform.h
+ *
+ * RATR0 platform layer. The memory subsystem obtains its pools and moves
+ * chip memory through these functions, so it does not depend on exec.library
+ * or the blitter directly. The Amiga implementation is in platform_amiga.c,
+ * a POSIX implementation for the host test build is in platform_posix.c.
+ */
+#pragma once
+#ifndef __RATR0_PLATFORM_H__
+#define __RATR0_PLATFORM_H__
+
+#include <ratr0/data_types.h>
+
+/**
+ * \brief Kind of system memory to allocate.
+ */
+typedef enum { RATR0_PLATFORM_MEM_ANY, RATR0_PLATFORM_MEM_CHIP } Ratr0PlatformMemType;
+
+/**
+ * Allocates cleared memory from the system.
+ *
+ * @param size size in bytes
+ * @param mem_type RATR0_PLATFORM_MEM_CHIP if the memory needs to be
+ *        accessible by the custom chips
+ * @return pointer to the memory or NULL if there is not enough memory
+ */
+extern void *ratr0_platform_alloc_mem(UINT32 size, Ratr0PlatformMemType mem_type);
+
+/**
+ * Returns memory to the system.
+ *
+ * @param mem pointer that was returned by ratr0_platform_alloc_mem()
+ * @param size the size that was passed to ratr0_platform_alloc_mem()
+ */
+extern void ratr0_platform_free_mem(void *mem, UINT32 size);
+
+/**
+ * Determines whether the specified memory is accessible by the custom chips.
+ *
+ * @param mem pointer to the memory
+ * @return TRUE if the memory is chip memory
+ */
+extern BOOL ratr0_platform_is_chip_mem(void *mem);
+
+/**
+ * Gains exclusive access to the hardware that moves chip memory. Call
+ * before a sequence of ratr0_platform_move_chip_mem() calls.
+ */
+extern void ratr0_platform_begin_chip_moves(void);
+
+/**
+ * Moves a block of chip memory to a lower, possibly overlapping address.
+ * On the Amiga, this is done by the blitter.
+ *
+ * @param dst destination address, must be word aligned
+ * @param src source address, must be word aligned
+ * @param num_bytes number of bytes to move
+ */
+extern void ratr0_platform_move_chip_mem(void *dst, void *src, UINT32 num_bytes);
+
+/**
+ * Releases the hardware that was obtained with
+ * ratr0_platform_begin_chip_moves().
+ */
+extern void ratr0_platform_end_chip_moves(void);
+
+#endif /* __RATR0_PLATFORM_H__ */
@@ -15,6 +15,9 @@
 
 #include <ratr0/blitter.h>
 #include <ratr0/sprites.h>
+#include <ratr0/tilemap.h>
+#include <ratr0/copper.h>
+#include <ratr0/fader.h>
 #include <ratr0/audio.h>
 
 #endif /* __RATR0_RATR0_H */
@@ -9,6 +9,9 @@
 #include <ratr0/engine.h>
 #include <ratr0/memory.h>
 
+/** \brief surface reference from display.h */
+struct Ratr0Surface;
+
 /** \brief length of file identifier */
 #define FILE_ID_LEN (8)
 
@@ -103,6 +106,9 @@ struct Ratr0SpriteSheet {
     UINT16 *sprite_offsets;
     UINT16 *colors;
 
+    /** \brief handle to the offsets and colors */
+    Ratr0MemHandle h_info;
+
     /** \brief handle to image data */
     Ratr0MemHandle h_imgdata;
 };
@@ -116,8 +122,10 @@ struct Ratr0AudioSample {
 };
 
 struct Ratr0AudioProtrackerMod {
-    /** \brief handle to Protracker mod data */
+    /** \brief handle to Protracker mod data, the header and the patterns */
     Ratr0MemHandle h_data;
+    /** \brief handle to the sample data, 0 if it follows the patterns in h_data */
+    Ratr0MemHandle h_samples;
 };
 
 /**
@@ -129,6 +137,18 @@ struct Ratr0AudioProtrackerMod {
  */
 extern BOOL ratr0_resources_read_tilesheet(const char *filename,
                                            struct Ratr0TileSheet *sheet);
+
+/**
+ * Reads a tilesheet whose image data is only accessed by the CPU, e.g. a
+ * collision mask or level data. The image data is placed in fast memory if
+ * available, so it can't be used as a blitter source.
+ *
+ * @param filename the path to the tilesheet file
+ * @param sheet pointer to an unitialized tilesheet structure
+ * @return FALSE if error, TRUE if success
+ */
+extern BOOL ratr0_resources_read_cpu_tilesheet(const char *filename,
+                                               struct Ratr0TileSheet *sheet);
 /**
  * Frees the data in a tilesheet and returns it to the memory system.
  *
@@ -180,7 +200,9 @@ extern BOOL ratr0_resources_read_audiosample(const char *filename,
 extern void ratr0_resources_free_audiosample_data(struct Ratr0AudioSample *sample);
 
 /**
- * Reads a protracker module from the file system.
+ * Reads a protracker module from the file system. The samples of a 31
+ * sample module are loaded into chip memory, while the song data is placed
+ * in fast memory if available.
  *
  * @param filename the path to the Protracker module
  * @param sample pointer to an uninitialized mod structure
@@ -0,0 +1,101 @@
+/** @file save_stack.h
+ *
+ * Save-under stacks. A save stack keeps the background areas under the
+ * BOBs that were drawn into a display buffer, so they can be put back
+ * the next time the buffer is drawn, the last saved area first. The saves
+ * and restores are queued as blits.
+ */
+#pragma once
+#ifndef __RATR0_SAVE_STACK_H__
+#define __RATR0_SAVE_STACK_H__
+#include <ratr0/data_types.h>
+#include <ratr0/memory.h>
+
+struct Ratr0Surface;
+
+/** \brief maximum number of areas on a save stack */
+#define RATR0_SAVE_STACK_MAX_AREAS (16)
+
+/**
+ * A saved background area.
+ */
+struct Ratr0SavedArea {
+    /** \brief position and size in the display buffer, word aligned */
+    UINT16 x, y, width, height;
+    /** \brief offset of the saved data in the stack memory */
+    UINT32 offset;
+};
+
+/**
+ * The saved areas of a display buffer.
+ */
+struct Ratr0SaveStack {
+    /** \brief chip memory of the saved data, -1 if there is none */
+    Ratr0MemHandle h_data;
+    /** \brief size of the memory in bytes */
+    UINT32 size;
+    /** \brief bytes in use */
+    UINT32 top;
+    /** \brief the saved areas, in the order they were saved */
+    struct Ratr0SavedArea areas[RATR0_SAVE_STACK_MAX_AREAS];
+    /** \brief number of saved areas */
+    UINT16 num_areas;
+};
+
+/**
+ * Empties a save stack without memory. Memory that it had before is not
+ * freed, use this after the memory scope of the stack was released.
+ *
+ * @param stack the stack
+ */
+extern void ratr0_save_stack_init(struct Ratr0SaveStack *stack);
+
+/**
+ * Returns the memory that saving the area under a BOB needs at any x
+ * position, a shifted BOB covers an extra word.
+ *
+ * @param width BOB width in pixels
+ * @param height BOB height in pixels
+ * @param depth number of bitplanes of the display buffer
+ * @return size in bytes
+ */
+extern UINT32 ratr0_save_stack_area_size(UINT16 width, UINT16 height, UINT16 depth);
+
+/**
+ * Makes sure the stack has at least the specified amount of memory. A
+ * larger block is allocated in chip memory, in the current memory scope,
+ * and the saved areas are copied over. Only call this while no queued
+ * blits read or write the stack. Like every allocation, this exits the
+ * engine if there is not enough chip memory.
+ *
+ * @param stack the stack
+ * @param size minimum size in bytes
+ */
+extern void ratr0_save_stack_reserve(struct Ratr0SaveStack *stack, UINT32 size);
+
+/**
+ * Queues the blits that save the word aligned area of a surface that a
+ * BOB at the specified position covers. The area is clipped to the surface.
+ *
+ * @param stack the stack
+ * @param surface the display buffer's surface
+ * @param x BOB x-coordinate
+ * @param y BOB y-coordinate
+ * @param width BOB width in pixels
+ * @param height BOB height in pixels
+ * @return FALSE if the stack is full and the area wasn't saved
+ */
+extern BOOL ratr0_save_stack_push(struct Ratr0SaveStack *stack, struct Ratr0Surface *surface,
+                                  UINT16 x, UINT16 y, UINT16 width, UINT16 height);
+
+/**
+ * Queues the blits that put all saved areas back into the surface, the
+ * last saved first, so overlapping BOBs are undone in the reverse order
+ * they were drawn. The stack is empty afterwards.
+ *
+ * @param stack the stack
+ * @param surface the display buffer's surface
+ */
+extern void ratr0_save_stack_restore(struct Ratr0SaveStack *stack, struct Ratr0Surface *surface);
+
+#endif /* __RATR0_SAVE_STACK_H__ */
@@ -1,5 +1,5 @@
 /** @file sprites.h
-samiga *
+ *
  * Amiga sprite module.
  */
 #pragma once
@@ -40,4 +40,41 @@ extern UINT16 *ratr0_make_sprite_data(struct Ratr0TileSheet *tilesheet,
  */
 extern void ratr0_sprites_set_pos(UINT16 *sprite_data, UINT16 hstart, UINT16 vstart, UINT16 vstop);
 
+/** \brief number of hardware sprite channels */
+#define RATR0_NUM_SPRITE_CHANNELS (8)
+/** \brief maximum number of sprites that are multiplexed in a frame */
+#define RATR0_MAX_MUX_SPRITES (32)
+
+struct Ratr0HWSprite;
+
+/**
+ * Sprite multiplexer. Sorts the sprites by their vertical position and
+ * packs sprites that don't overlap vertically into the same channel, by
+ * chaining their control words and data in a chain buffer per channel.
+ * A sprite can start at the earliest one line below the end of the previous
+ * sprite in its channel, because the sprite DMA fetches the next control
+ * words in that line. Attached sprites take an even and the following odd
+ * channel. Sprites that don't fit into any channel are not shown. Rows
+ * below the viewport are clipped.
+ *
+ * There is a set of chain buffers for each display buffer, the chains of a
+ * set are shown with ratr0_display_set_sprite_chains().
+ *
+ * @param sprites the sprites to show
+ * @param num_sprites length of the sprites array, at most RATR0_MAX_MUX_SPRITES
+ * @param set_num the chain buffer set to build, below MAX_BUFFERS
+ * @return the number of sprites that are shown
+ */
+extern UINT16 ratr0_sprites_multiplex(struct Ratr0HWSprite *sprites[], UINT16 num_sprites,
+                                      UINT16 set_num);
+
+/**
+ * Returns the sprite chain of a channel that ratr0_sprites_multiplex() built.
+ *
+ * @param set_num the chain buffer set
+ * @param channel the sprite channel
+ * @return pointer to the sprite data for the channel's sprite pointer
+ */
+extern UINT16 *ratr0_sprites_get_chain(UINT16 set_num, UINT16 channel);
+
 #endif /* __RATR0_SPRITES_H__ */
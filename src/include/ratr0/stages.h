@@ -9,11 +9,18 @@
 #include <ratr0/engine.h>
 #include <ratr0/resources.h>
 #include <ratr0/display.h>
+#include <ratr0/copper.h>
 
 
 // just to make the compiler happy
 struct Ratr0Stage;
 
+/** \brief maximum number of BOBs in a stage */
+#define RATR0_MAX_STAGE_BOBS (10)
+
+/** \brief maximum number of hardware sprites in a stage */
+#define RATR0_MAX_STAGE_SPRITES (32)
+
 /**
  * A stage is a component of a game. It contains the movable and static game
  * objects and the assets. The game can also provide functions for transitions
@@ -24,11 +31,13 @@ struct Ratr0Stage {
     /** \brief pointer to engine instance */
     Ratr0Engine *engine;
 
-    /** \brief memory handle to this stage's copper list */
-    Ratr0MemHandle h_copper_list;
-
-    /** \brief quick pointer to this stage's copper list */
-    UINT16 *copper_list;
+    /**
+     * \brief this stage's copper list, which is displayed when the stage
+     * becomes the current stage. NULL to keep the displayed list, e.g. if
+     * on_enter sets a static list with ratr0_display_set_copperlist().
+     * The list has to outlive the stage's memory scope
+     */
+    struct Ratr0CopperList *copper_list;
 
     /**
      * \brief this stage's backdrop object
@@ -43,24 +52,65 @@ struct Ratr0Stage {
      */
     struct Ratr0Backdrop *backdrop;
 
+    /**
+     * \brief backdrop of playfield 1 in dual playfield mode
+     *
+     * Like backdrop, but for the second playfield. A single buffered
+     * playfield without BOBs, e.g. a parallax background, is drawn once
+     * and never needs a restore blit. Without a backdrop, the dirty
+     * rectangles of a playfield are cleared, which makes them transparent
+     * in dual playfield mode.
+     */
+    struct Ratr0Backdrop *backdrop1;
+
     //
     // The animated objects in the stage that are visible/active. The stages
     // module will automatically render objects in these lists.
     // On Amiga, these are both sprites and BOBs, and we keep these separate
     // so we won't need any type checks.
     //
-    /** \brief list of active BOBs in the stage */
-    struct Ratr0Bob *bobs[10];
+    /** \brief list of active BOBs in the stage, each BOB is drawn on the
+        playfield in its playfield_num */
+    struct Ratr0Bob *bobs[RATR0_MAX_STAGE_BOBS];
 
     /** \brief number of bobs in the array */
     int num_bobs;
 
-    /** \brief list of active hardware sprites in the stage */
-    struct Ratr0HWSprite *sprites[8];
+    /**
+     * \brief list of active hardware sprites in the stage. Without
+     * multiplexing, only the first 8 channels are used
+     */
+    struct Ratr0HWSprite *sprites[RATR0_MAX_STAGE_SPRITES];
 
     /** \brief number of sprites in the array */
     int num_sprites;
 
+    /**
+     * \brief if TRUE, the sprites are multiplexed with
+     * ratr0_sprites_multiplex() instead of taking a channel each, so
+     * more than 8 sprites can be shown if they are vertically apart.
+     * FALSE by default
+     */
+    BOOL multiplex_sprites;
+
+    /**
+     * \brief if TRUE, a BOB that moved or changed its frame restores
+     * exactly the word aligned area it covered instead of the 16x16 tiles
+     * it touched, which saves blitter cycles for BOBs that are small or
+     * not aligned to the tiles. FALSE by default
+     */
+    BOOL exact_restore;
+
+    /**
+     * \brief if TRUE, the background under each BOB is saved before the
+     * BOB is drawn and put back the next time the same buffer is drawn,
+     * so BOBs need neither a backdrop nor dirty tiles, e.g. on a
+     * scrolling tile map. The save memory holds RATR0_MAX_STAGE_BOBS of
+     * the largest BOB in the stage and grows when a larger BOB is added.
+     * FALSE by default
+     */
+    BOOL save_under;
+
     /**
      * Adds a bob to the stage.
      *
@@ -88,6 +138,10 @@ struct Ratr0Stage {
     /**
      * User provided function that is called on every frame of the game loop
      * while this stage is the current active stage.
+     * The engine owns the blitter during the call, so blits can be issued
+     * without OwnBlitter(), which must not be called here because it is not
+     * reentrant. Use ratr0_blitter_own() where ownership is needed. They are run after the restore and bob blits
+     * that are queued for the back buffer.
      *
      * @param this_stage pointer to this stage
      * @param backbuffer pointer to the display back buffer
@@ -105,7 +159,8 @@ struct Ratr0NodeFactory {
     /**
      * Creates a new Ratr0Stage object.
      *
-     * @return pointer to an initialized Ratr0Stage object
+     * @return pointer to an initialized Ratr0Stage object, NULL if the
+     *         stage pool is exhausted
      */
     struct Ratr0Stage *(*create_stage)(void);
 
@@ -133,9 +188,32 @@ struct Ratr0NodeFactory {
      * Creates a new backdrop.
      *
      * @param tilesheet pointer to a tilesheet
-     * @return pointer to an initialized backdrop
+     * @return pointer to an initialized backdrop, NULL if the backdrop
+     *         pool is exhausted
      */
     struct Ratr0Backdrop *(*create_backdrop)(struct Ratr0TileSheet *tilesheet);
+
+    /**
+     * Returns a stage to the stage pool. The stage can't be the current stage.
+     *
+     * @param stage the stage to destroy
+     */
+    void (*destroy_stage)(struct Ratr0Stage *stage);
+
+    /**
+     * Returns a sprite to its pool.
+     *
+     * @param sprite the sprite to destroy
+     * @param is_hw TRUE if the sprite is a hardware sprite, FALSE if it is a BOB
+     */
+    void (*destroy_sprite)(struct Ratr0Sprite *sprite, BOOL is_hw);
+
+    /**
+     * Returns a backdrop to the backdrop pool.
+     *
+     * @param backdrop the backdrop to destroy
+     */
+    void (*destroy_backdrop)(struct Ratr0Backdrop *backdrop);
 };
 
 
@@ -153,9 +231,12 @@ struct Ratr0StagesSystem {
  * Start up the stage subsystem.
  *
  * @param eng the engine object
+ * @param max_stages maximum number of stages
+ * @param max_backdrops maximum number of backdrops
  * @return an initialized Ratr0StagesSystem instance
  */
-extern struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng);
+extern struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng, UINT16 max_stages,
+                                                      UINT16 max_backdrops);
 
 /**
  * Retrieve the singleton node factory instance.
@@ -166,6 +247,10 @@ extern struct Ratr0NodeFactory *ratr0_stages_get_node_factory(void);
 
 /**
  * Sets the currently active stage.
+ * Each stage runs in its own memory scope: all memory that is allocated
+ * while the stage is current, e.g. assets that are loaded in on_enter(),
+ * is released automatically after the stage's on_exit() was called.
+ * Allocate memory that should outlive the stage before setting it.
  *
  * @param stage the stage to set
  */
@@ -0,0 +1,112 @@
+/** @file tilemap.h
+ *
+ * Hardware scrolling tile maps. A tile map is rendered from a tile sheet into
+ * the buffers of a playfield that are larger than the viewport and is
+ * scrolled by moving the bitplane pointers. The buffers are used as a ring of
+ * tiles in both directions, so scrolling only blits the tiles that come into
+ * view and the map wraps around at its edges without a redraw:
+ *
+ *   - Vertically, a map row is drawn at its row modulo the number of rows
+ *     in the buffer and the copper list split continues the display at the
+ *     top of the buffer, see ratr0_display_scroll_playfield().
+ *   - Horizontally, a line can't be split, so the buffer holds the ring of
+ *     columns plus a copy of the first viewport width of columns after it.
+ *     Newly exposed columns in that range are drawn twice.
+ *
+ * Tiles are 16x16 pixels. Size the playfield buffers with
+ * RATR0_TILEMAP_BUFFER_WIDTH() and RATR0_TILEMAP_BUFFER_HEIGHT(). Since the
+ * edges are drawn to all buffers of the playfield, it doesn't need more than
+ * one buffer, BOBs are better drawn to the other playfield in dual playfield
+ * mode. The copper list needs the BPLCON1 move and the split, see
+ * Ratr0CopperListInfo.
+ */
+#pragma once
+#ifndef __RATR0_TILEMAP_H__
+#define __RATR0_TILEMAP_H__
+#include <ratr0/data_types.h>
+#include <ratr0/display.h>
+
+struct Ratr0TileSheet;
+
+/** \brief minimum playfield buffer width for a tile map with this viewport width */
+#define RATR0_TILEMAP_BUFFER_WIDTH(vp_width) ((2 * ((vp_width) / 16) + 2) * 16)
+/** \brief minimum playfield buffer height for a tile map with this viewport height */
+#define RATR0_TILEMAP_BUFFER_HEIGHT(vp_height) (((vp_height) + 15) / 16 * 16 + 32)
+
+/**
+ * A tile map. Set it up with ratr0_tilemap_init().
+ */
+struct Ratr0TileMap {
+    /** \brief tile sheet with the tile images */
+    struct Ratr0TileSheet *tilesheet;
+    /** \brief tile numbers row by row, width * height entries */
+    UINT8 *tiles;
+    /** \brief map width in tiles */
+    UINT16 width;
+    /** \brief map height in tiles */
+    UINT16 height;
+    /** \brief the playfield the map is rendered to */
+    UINT16 playfield_num;
+
+    /** \brief the tile sheet as a blit source */
+    struct Ratr0Surface tiles_surface;
+    /** \brief number of tile columns and rows that the display fetches */
+    UINT16 view_cols, view_rows;
+    /** \brief number of tile columns and rows in the buffer ring */
+    UINT16 ring_cols, ring_rows;
+    /**
+     * \brief view position in pixels. It keeps counting past the map
+     * edges, so the position in the buffer ring stays continuous
+     */
+    INT32 x, y;
+};
+
+/**
+ * Initializes a tile map for a playfield. Call ratr0_display_init_buffers()
+ * first, the map is laid out for the playfield's buffers.
+ *
+ * @param map the tile map to initialize
+ * @param tilesheet tile sheet with 16x16 tiles
+ * @param tiles tile numbers row by row, width * height entries
+ * @param width map width in tiles
+ * @param height map height in tiles
+ * @param playfield_num the playfield to render to
+ * @return TRUE if the playfield's buffers can hold the map, FALSE otherwise
+ */
+extern BOOL ratr0_tilemap_init(struct Ratr0TileMap *map,
+                               struct Ratr0TileSheet *tilesheet,
+                               UINT8 *tiles, UINT16 width, UINT16 height,
+                               UINT16 playfield_num);
+
+/**
+ * Moves the view to a position of the map and draws all visible tiles. The
+ * blits go through the blit queue, so call this from a stage update.
+ *
+ * @param map the tile map
+ * @param x horizontal view position in pixels
+ * @param y vertical view position in pixels
+ */
+extern void ratr0_tilemap_set_position(struct Ratr0TileMap *map, UINT16 x, UINT16 y);
+
+/**
+ * Scrolls the view and draws the tiles that come into view. Moving more
+ * than 16 pixels in a frame can show tiles before they are drawn, and
+ * moving more than the viewport redraws everything. The blits go through
+ * the blit queue, so call this from a stage update.
+ *
+ * @param map the tile map
+ * @param dx horizontal movement in pixels
+ * @param dy vertical movement in pixels
+ */
+extern void ratr0_tilemap_scroll(struct Ratr0TileMap *map, INT16 dx, INT16 dy);
+
+/**
+ * Returns the view position in map pixels, within the map.
+ *
+ * @param map the tile map
+ * @param x returns the horizontal position
+ * @param y returns the vertical position
+ */
+extern void ratr0_tilemap_get_position(struct Ratr0TileMap *map, UINT16 *x, UINT16 *y);
+
+#endif /* __RATR0_TILEMAP_H__ */
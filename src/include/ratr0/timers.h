@@ -3,7 +3,8 @@
  * RATR0 Timer Subsystem. This system helps with the management of timers.
  * Timers are updated by the Vertical blank interrupt, therefore a timer
  * tick is 1/60 of a second on an NTSC system while it is 1/50 of a second
- * on a PAL system.
+ * on a PAL system. The callbacks run in the interrupt, so they must not
+ * change the copper list, e.g. with ratr0_display_set_palette().
  */
 #pragma once
 #ifndef __RATR0_TIMERS_H__
@@ -31,10 +32,10 @@ struct Ratr0Timer {
      */
     void (*timeout_fun)(void);
 
-    // private, for management of free timers in the pool
-    /** \brief next free timer in the pool, -1 is undefined  */
+    // private, for management of the used timers
+    /** \brief next used timer, -1 is undefined  */
     INT16 next;
-    /** \brief previous free timer in the pool, -1 is undefined */
+    /** \brief previous used timer, -1 is undefined */
     INT16 prev;
 };
 
@@ -81,7 +82,7 @@ extern Ratr0TimerHandle ratr0_timers_create(INT32 start_value,
 extern struct Ratr0Timer *ratr0_timers_get(Ratr0TimerHandle handle);
 
 /**
- * Free a timer object.
+ * Free a timer object. Handles of timers that are not in use are ignored.
  *
  * @param handle handle to the Ratr0Timer object
  */
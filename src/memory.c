@@ -1,10 +1,12 @@
 /** @file memory.c */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 
-#include <clib/exec_protos.h>
 #include <ratr0/debug_utils.h>
 #include <ratr0/memory.h>
+#include <ratr0/platform.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("MEMORY", __VA_ARGS__)
 
@@ -24,72 +26,608 @@ static Ratr0Engine *engine;
  * Because we have 2 memory pools, we use bit 31 as a tag, to indicate which pool
  * the handle is using. If bit 31 is set, we use the chip memory pool, otherwise
  * the general purpose pool.
+ *
+ * Each pool is managed by a TLSF (two-level segregated fit) allocator:
+ * free blocks are kept in segregated lists that are indexed by a first level
+ * (power of 2) and a second level (linear subdivision of the power of 2 range).
+ * Two bitmaps tell us which lists are non-empty, so finding a fitting block,
+ * allocating and freeing are all O(1). Freed blocks are immediately coalesced
+ * with their free physical neighbors, which keeps fragmentation low.
+ *
+ * Scopes: blocks that are allocated with RATR0_MEM_SCOPED while a scope is
+ * active are regular TLSF blocks whose table entry records the scope depth.
+ * The entries of a scope are chained into a doubly linked list per pool and
+ * depth, so they can be freed one by one like any other block in O(1), and
+ * popping a scope only visits the remaining blocks of that scope. Their
+ * table entries are cleared, so stale handles resolve to NULL.
+ *
+ * Frame scratch memory: a block of the general pool is reserved at startup
+ * for data that only lives for a frame. It is double ended: even frames
+ * allocate upwards from the start of the block, odd frames downwards from
+ * its end. At the end of a frame, the direction switches and the side of
+ * the new frame is reset, so scratch data of a frame stays valid during the
+ * following frame, e.g. for blits that are still queued.
+ *
+ * Placement: the general pool is allocated without restrictions, so the
+ * system places it in fast memory if there is any. Data that is only
+ * accessed by the CPU (RATR0_MEM_FAST) goes to the general pool in that
+ * case and only falls back to the chip pool if the general pool is
+ * exhausted. Without fast memory, it is placed in the chip pool right away.
+ *
+ * Telemetry: every handle carries the tag of the subsystem that allocated
+ * it. Each pool counts live and peak bytes in total and per tag.
+ */
+#define CHIP_HANDLE_TAG   (0x80000000)
+#define HANDLE_INDEX_MASK (0x7fffffff)
+
+/*
+ * TLSF parameters. Block sizes are multiples of the pointer size, which
+ * frees up the lowest 2 bits of the size field for the block flags.
  */
-static void *general_mem_pool, *chip_mem_pool;
-static UINT32 chip_pool_size, general_pool_size;
+#define ALIGN_SIZE            (sizeof(void *))
+#define ALIGN_SIZE_LOG2       (sizeof(void *) == 8 ? 3 : 2)
+#define SL_INDEX_COUNT_LOG2   (4)
+#define SL_INDEX_COUNT        (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_MAX          (24)
+#define FL_INDEX_SHIFT        (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_COUNT        (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE      (1 << FL_INDEX_SHIFT)
+
+#define MAX_SCOPE_DEPTH (8)
+
+#define BLOCK_FREE      (1)
+#define BLOCK_PREV_FREE (2)
+#define BLOCK_FLAGS     (BLOCK_FREE | BLOCK_PREV_FREE)
+
+/**
+ * Header of a physical block in a pool. The header precedes the block data.
+ * The free list links are only valid while the block is free and occupy
+ * the first bytes of the block data, so they don't add to the overhead of
+ * used blocks.
+ */
+struct Ratr0MemBlock {
+    /** \brief previous physical block, only valid if BLOCK_PREV_FREE is set */
+    struct Ratr0MemBlock *prev_phys;
+    /** \brief size of the data area in bytes, lowest 2 bits are the flags */
+    UINT32 size;
+    /** \brief table index of the handle that owns the block */
+    UINT32 handle;
+    /** \brief next block in the free list */
+    struct Ratr0MemBlock *next_free;
+    /** \brief previous block in the free list */
+    struct Ratr0MemBlock *prev_free;
+};
+
+#define BLOCK_HEADER_SIZE (offsetof(struct Ratr0MemBlock, next_free))
+#define BLOCK_SIZE_MIN    (sizeof(struct Ratr0MemBlock) - BLOCK_HEADER_SIZE)
+#define BLOCK_SIZE_MAX    ((UINT32) 1 << FL_INDEX_MAX)
 
+/**
+ * Handle table entry. Unused entries are chained into a free list through
+ * next_free, so handle slots can be recycled.
+ */
 struct AllocatedBlock {
     void *block_address;
     UINT32 block_size;
+    INT32 next_free;
+    UINT16 tag;
+    /** \brief depth of the scope the block belongs to, 0 if it is not scoped */
+    UINT8 scope;
+    /** \brief neighbors in the list of the block's scope, -1 at the ends */
+    INT32 scope_prev, scope_next;
 };
+
 /**
- * These tables hold our allocated blocks
- * TODO: Instead void *[], it should be struct AllocatedBlock[] so
- * we know the size of the block
+ * A memory pool: the memory area, its TLSF control structure and the
+ * handle table of the blocks allocated from the pool.
  */
-static struct AllocatedBlock *general_mem_table;
-static struct AllocatedBlock *chip_mem_table;
-static UINT32 chip_table_size, general_table_size;
-static UINT32 first_free_chip, first_free_general;
-static UINT32 first_free_chip_table, first_free_general_table;
+struct Ratr0MemPool {
+    /** \brief start address of the pool memory */
+    UINT8 *base;
+    /** \brief size of the pool memory in bytes */
+    UINT32 size;
+    /** \brief bit n is set if free_lists[n] has a non-empty list */
+    UINT32 fl_bitmap;
+    /** \brief bit m of sl_bitmap[n] is set if free_lists[n][m] is non-empty */
+    UINT32 sl_bitmap[FL_INDEX_COUNT];
+    /** \brief segregated free lists */
+    struct Ratr0MemBlock *free_lists[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+    /** \brief handle table */
+    struct AllocatedBlock *table;
+    /** \brief number of entries in the handle table */
+    UINT32 table_size;
+    /** \brief first recycled table slot, -1 if there is none */
+    INT32 first_free_slot;
+    /** \brief table slots from this index on have never been used */
+    UINT32 next_unused_slot;
+    /** \brief tag that is or'ed into every handle from this pool */
+    UINT32 handle_tag;
+    /** \brief first table slot of each scope depth, -1 if it has none */
+    INT32 scope_heads[MAX_SCOPE_DEPTH + 1];
+
+    /** \brief live and peak counters, the free space is computed on demand */
+    struct Ratr0MemoryPoolStats stats;
+};
+
+static struct Ratr0MemPool general_pool, chip_pool;
+static int scope_depth;
+// TRUE if the general pool was placed in fast memory by the system
+static BOOL general_pool_is_fast;
+
+// frame scratch memory
+static UINT8 *frame_start, *frame_end;
+static UINT8 *frame_low_top, *frame_high_top;
+static BOOL frame_is_low;
+static UINT32 frame_peak;
+
+// Lookup table for the most significant bit of a byte, -1 for 0
+static INT8 msb_table[256];
 
 // Forward declarations for the generic memory allocator
 void ratr0_memory_shutdown(void);
 
+/*
+ * Bit scan functions. The 68000 does not have an instruction for finding
+ * the first set bit, so we use a lookup table for each byte.
+ */
+static int _fls(UINT32 word)
+{
+    if (word & 0xffff0000) {
+        if (word & 0xff000000) return 24 + msb_table[word >> 24];
+        return 16 + msb_table[(word >> 16) & 0xff];
+    }
+    if (word & 0xff00) return 8 + msb_table[(word >> 8) & 0xff];
+    return msb_table[word & 0xff];
+}
+
+static int _ffs(UINT32 word)
+{
+    return _fls(word & (~word + 1));
+}
+
+/*
+ * Block helpers
+ */
+static UINT32 _block_size(struct Ratr0MemBlock *block)
+{
+    return block->size & ~BLOCK_FLAGS;
+}
+
+static void *_block_data(struct Ratr0MemBlock *block)
+{
+    return ((UINT8 *) block) + BLOCK_HEADER_SIZE;
+}
+
+static struct Ratr0MemBlock *_block_from_data(void *data)
+{
+    return (struct Ratr0MemBlock *) (((UINT8 *) data) - BLOCK_HEADER_SIZE);
+}
+
+static struct Ratr0MemBlock *_block_next(struct Ratr0MemBlock *block)
+{
+    return (struct Ratr0MemBlock *) (((UINT8 *) block) + BLOCK_HEADER_SIZE +
+                                     _block_size(block));
+}
+
+/*
+ * Map a block size to its free list indexes. Small blocks are kept in
+ * linearly subdivided lists in the first level 0.
+ */
+static void _mapping_insert(UINT32 size, int *fli, int *sli)
+{
+    int fl, sl;
+    if (size < SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+    } else {
+        fl = _fls(size);
+        sl = (size >> (fl - SL_INDEX_COUNT_LOG2)) ^ (1 << SL_INDEX_COUNT_LOG2);
+        fl -= (FL_INDEX_SHIFT - 1);
+    }
+    *fli = fl;
+    *sli = sl;
+}
+
+/*
+ * Same as _mapping_insert(), but rounds the size up to the next list, so
+ * every block in the resulting list is large enough.
+ */
+static void _mapping_search(UINT32 size, int *fli, int *sli)
+{
+    if (size >= SMALL_BLOCK_SIZE) {
+        size += (1 << (_fls(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    _mapping_insert(size, fli, sli);
+}
+
+static void _insert_free_block(struct Ratr0MemPool *pool,
+                               struct Ratr0MemBlock *block)
+{
+    int fl, sl;
+    _mapping_insert(_block_size(block), &fl, &sl);
+    struct Ratr0MemBlock *head = pool->free_lists[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) head->prev_free = block;
+    pool->free_lists[fl][sl] = block;
+    pool->fl_bitmap |= 1 << fl;
+    pool->sl_bitmap[fl] |= 1 << sl;
+}
+
+static void _remove_free_block(struct Ratr0MemPool *pool,
+                               struct Ratr0MemBlock *block)
+{
+    int fl, sl;
+    _mapping_insert(_block_size(block), &fl, &sl);
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    if (pool->free_lists[fl][sl] == block) {
+        pool->free_lists[fl][sl] = block->next_free;
+        if (!block->next_free) {
+            pool->sl_bitmap[fl] &= ~(1 << sl);
+            if (!pool->sl_bitmap[fl]) pool->fl_bitmap &= ~(1 << fl);
+        }
+    }
+}
+
+static struct Ratr0MemBlock *_find_free_block(struct Ratr0MemPool *pool,
+                                              UINT32 size)
+{
+    int fl, sl;
+    _mapping_search(size, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT) return NULL;
+
+    UINT32 sl_map = pool->sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map) {
+        // nothing in this first level, try the next larger one
+        UINT32 fl_map = pool->fl_bitmap & (~0U << (fl + 1));
+        if (!fl_map) return NULL;
+        fl = _ffs(fl_map);
+        sl_map = pool->sl_bitmap[fl];
+    }
+    sl = _ffs(sl_map);
+    return pool->free_lists[fl][sl];
+}
+
+/*
+ * Mark the block as used and tell its physical successor.
+ */
+static void _mark_used(struct Ratr0MemBlock *block)
+{
+    block->size &= ~BLOCK_FREE;
+    _block_next(block)->size &= ~BLOCK_PREV_FREE;
+}
+
+static void _mark_free(struct Ratr0MemBlock *block)
+{
+    struct Ratr0MemBlock *next = _block_next(block);
+    block->size |= BLOCK_FREE;
+    next->prev_phys = block;
+    next->size |= BLOCK_PREV_FREE;
+}
+
+static void _pool_init(struct Ratr0MemPool *pool, void *mem, UINT32 size,
+                       struct AllocatedBlock *table, UINT32 table_size,
+                       UINT32 handle_tag)
+{
+    pool->base = (UINT8 *) mem;
+    pool->size = size;
+    pool->table = table;
+    pool->table_size = table_size;
+    pool->first_free_slot = -1;
+    pool->next_unused_slot = 0;
+    pool->handle_tag = handle_tag;
+    for (int i = 0; i <= MAX_SCOPE_DEPTH; i++) pool->scope_heads[i] = -1;
+    memset(&pool->stats, 0, sizeof(struct Ratr0MemoryPoolStats));
+    pool->stats.pool_size = size;
+    pool->stats.table_size = table_size;
+    pool->fl_bitmap = 0;
+    for (int i = 0; i < FL_INDEX_COUNT; i++) {
+        pool->sl_bitmap[i] = 0;
+        for (int j = 0; j < SL_INDEX_COUNT; j++) pool->free_lists[i][j] = NULL;
+    }
+
+    // The whole pool is one big free block, followed by a used sentinel
+    // block of size 0, so every block has a valid physical successor
+    UINT32 block_size = (size - 2 * BLOCK_HEADER_SIZE) & ~(ALIGN_SIZE - 1);
+    if (block_size >= BLOCK_SIZE_MAX) {
+        PRINT_DEBUG("Pool size exceeds maximum block size, truncating.");
+        block_size = BLOCK_SIZE_MAX - ALIGN_SIZE;
+    }
+    struct Ratr0MemBlock *block = (struct Ratr0MemBlock *) mem;
+    block->prev_phys = NULL;
+    block->size = block_size;
+    block->handle = 0;
+    struct Ratr0MemBlock *sentinel = _block_next(block);
+    sentinel->size = 0;
+    sentinel->handle = 0;
+    _mark_free(block);
+    _insert_free_block(pool, block);
+}
+
+static void *_pool_alloc(struct Ratr0MemPool *pool, UINT32 size)
+{
+    if (size < BLOCK_SIZE_MIN) size = BLOCK_SIZE_MIN;
+    size = (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1);
+
+    struct Ratr0MemBlock *block = _find_free_block(pool, size);
+    if (!block) return NULL;
+    _remove_free_block(pool, block);
+
+    // split off the rest if it is large enough to be a block on its own
+    UINT32 block_size = _block_size(block);
+    if (block_size >= size + sizeof(struct Ratr0MemBlock)) {
+        struct Ratr0MemBlock *rest = (struct Ratr0MemBlock *)
+            (((UINT8 *) _block_data(block)) + size);
+        rest->size = block_size - size - BLOCK_HEADER_SIZE;
+        block->size = size | (block->size & BLOCK_FLAGS);
+        _mark_free(rest);
+        _insert_free_block(pool, rest);
+    }
+    _mark_used(block);
+    return _block_data(block);
+}
+
+static void _pool_free(struct Ratr0MemPool *pool, void *data)
+{
+    struct Ratr0MemBlock *block = _block_from_data(data);
+    struct Ratr0MemBlock *next = _block_next(block);
+
+    // coalesce with free physical neighbors
+    if (block->size & BLOCK_PREV_FREE) {
+        struct Ratr0MemBlock *prev = block->prev_phys;
+        _remove_free_block(pool, prev);
+        prev->size += BLOCK_HEADER_SIZE + _block_size(block);
+        block = prev;
+    }
+    if (next->size & BLOCK_FREE) {
+        _remove_free_block(pool, next);
+        block->size += BLOCK_HEADER_SIZE + _block_size(next);
+    }
+    _mark_free(block);
+    _insert_free_block(pool, block);
+}
+
+/*
+ * Handle table management
+ */
+static INT32 _alloc_slot(struct Ratr0MemPool *pool)
+{
+    INT32 slot = pool->first_free_slot;
+    if (slot != -1) {
+        pool->first_free_slot = pool->table[slot].next_free;
+        return slot;
+    }
+    if (pool->next_unused_slot < pool->table_size) {
+        return pool->next_unused_slot++;
+    }
+    return -1;
+}
+
+static void _free_slot(struct Ratr0MemPool *pool, INT32 slot)
+{
+    pool->table[slot].block_address = NULL;
+    pool->table[slot].block_size = 0;
+    pool->table[slot].next_free = pool->first_free_slot;
+    pool->first_free_slot = slot;
+}
+
+/*
+ * Telemetry counters
+ */
+static void _count_alloc(struct Ratr0MemPool *pool, UINT16 tag, UINT32 size)
+{
+    struct Ratr0MemoryPoolStats *stats = &pool->stats;
+    struct Ratr0MemoryTagStats *tag_stats = &stats->tags[tag];
+    stats->live_bytes += size;
+    stats->live_blocks++;
+    if (stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+    if (stats->live_blocks > stats->peak_blocks) stats->peak_blocks = stats->live_blocks;
+    tag_stats->live_bytes += size;
+    tag_stats->live_blocks++;
+    if (tag_stats->live_bytes > tag_stats->peak_bytes) {
+        tag_stats->peak_bytes = tag_stats->live_bytes;
+    }
+    if (tag_stats->live_blocks > tag_stats->peak_blocks) {
+        tag_stats->peak_blocks = tag_stats->live_blocks;
+    }
+}
+
+static void _count_free(struct Ratr0MemPool *pool, UINT16 tag, UINT32 size)
+{
+    pool->stats.live_bytes -= size;
+    pool->stats.live_blocks--;
+    pool->stats.tags[tag].live_bytes -= size;
+    pool->stats.tags[tag].live_blocks--;
+}
+
+/*
+ * Scope lists
+ */
+static void _scope_link(struct Ratr0MemPool *pool, INT32 slot, UINT8 scope)
+{
+    struct AllocatedBlock *entry = &pool->table[slot];
+    entry->scope = scope;
+    entry->scope_prev = entry->scope_next = -1;
+    if (scope == 0) return;
+    entry->scope_next = pool->scope_heads[scope];
+    if (entry->scope_next != -1) pool->table[entry->scope_next].scope_prev = slot;
+    pool->scope_heads[scope] = slot;
+}
+
+static void _scope_unlink(struct Ratr0MemPool *pool, INT32 slot)
+{
+    struct AllocatedBlock *entry = &pool->table[slot];
+    if (entry->scope == 0) return;
+    if (entry->scope_prev != -1) {
+        pool->table[entry->scope_prev].scope_next = entry->scope_next;
+    } else {
+        pool->scope_heads[entry->scope] = entry->scope_next;
+    }
+    if (entry->scope_next != -1) pool->table[entry->scope_next].scope_prev = entry->scope_prev;
+    entry->scope = 0;
+}
+
+static void _free_block(struct Ratr0MemPool *pool, UINT32 slot)
+{
+    _count_free(pool, pool->table[slot].tag, pool->table[slot].block_size);
+    _pool_free(pool, pool->table[slot].block_address);
+    _scope_unlink(pool, slot);
+    _free_slot(pool, slot);
+}
+
+/*
+ * Free the remaining blocks of the specified scope depth, only the scope's
+ * own list is visited.
+ */
+static void _scope_release(struct Ratr0MemPool *pool, int depth)
+{
+    while (pool->scope_heads[depth] != -1) {
+        _free_block(pool, pool->scope_heads[depth]);
+    }
+}
+
+static struct Ratr0MemPool *_pool_for_handle(Ratr0MemHandle handle)
+{
+    return (handle & CHIP_HANDLE_TAG) == CHIP_HANDLE_TAG ? &chip_pool : &general_pool;
+}
+
+/*
+ * Move a block's data to a lower address. Chip memory is moved with the
+ * blitter, which is a lot faster than the CPU on chip memory.
+ */
+static void _move_data(struct Ratr0MemPool *pool, void *dst, void *src,
+                       UINT32 num_bytes)
+{
+    if (pool == &chip_pool) {
+        ratr0_platform_move_chip_mem(dst, src, num_bytes);
+        return;
+    }
+    memmove(dst, src, num_bytes);
+}
+
+/*
+ * Slide all used blocks of the pool towards its start, so all free space
+ * ends up in a single block at the end of the pool.
+ */
+static UINT32 _pool_compact(struct Ratr0MemPool *pool)
+{
+    struct Ratr0MemBlock *block = (struct Ratr0MemBlock *) pool->base;
+    struct Ratr0MemBlock *dst = block, *prev = NULL;
+    UINT32 num_moved = 0;
+
+    // the sentinel is the only used block with a size of 0
+    while (_block_size(block) > 0 || (block->size & BLOCK_FREE)) {
+        struct Ratr0MemBlock *next = _block_next(block);
+        if (!(block->size & BLOCK_FREE)) {
+            if (block != dst) {
+                // the data move can overwrite the old header, so
+                // read it first
+                UINT32 size = _block_size(block);
+                UINT32 handle = block->handle;
+                void *src_data = _block_data(block);
+                dst->prev_phys = prev;
+                dst->size = size;
+                dst->handle = handle;
+                _move_data(pool, _block_data(dst), src_data, size);
+                pool->table[handle].block_address = _block_data(dst);
+                num_moved++;
+            }
+            prev = dst;
+            dst = _block_next(dst);
+        }
+        block = next;
+    }
+
+    // rebuild the free lists: there is at most a single free block left
+    pool->fl_bitmap = 0;
+    for (int i = 0; i < FL_INDEX_COUNT; i++) {
+        pool->sl_bitmap[i] = 0;
+        for (int j = 0; j < SL_INDEX_COUNT; j++) pool->free_lists[i][j] = NULL;
+    }
+    if (dst != block) {
+        dst->prev_phys = prev;
+        dst->size = ((UINT8 *) block) - ((UINT8 *) dst) - BLOCK_HEADER_SIZE;
+        _mark_free(dst);
+        _insert_free_block(pool, dst);
+    }
+    return num_moved;
+}
+
 struct Ratr0MemorySystem *ratr0_memory_startup(Ratr0Engine *eng, struct Ratr0MemoryConfig *config)
 {
     engine = eng;
     memory_system.shutdown = &ratr0_memory_shutdown;
 
+    UINT32 chip_table_size = config->chip_table_size;
+    UINT32 general_table_size = config->general_table_size;
+    UINT32 chip_pool_size = config->chip_pool_size;
+    UINT32 general_pool_size = config->general_pool_size;
 
-    chip_table_size = config->chip_table_size;
-    general_table_size = config->general_table_size;
-    chip_pool_size = config->chip_pool_size;
-    general_pool_size = config->general_pool_size;
-
-    general_mem_pool = (void *) AllocMem(general_pool_size, MEMF_CLEAR);
+    void *general_mem_pool = ratr0_platform_alloc_mem(general_pool_size,
+                                                      RATR0_PLATFORM_MEM_ANY);
     if (!general_mem_pool) {
         PRINT_DEBUG("Can't allocate enough memory for general memory pool");
         exit(-1);
     }
-    chip_mem_pool = (void *) AllocMem(chip_pool_size, MEMF_CHIP|MEMF_CLEAR);
+    void *chip_mem_pool = ratr0_platform_alloc_mem(chip_pool_size,
+                                                   RATR0_PLATFORM_MEM_CHIP);
     if (!chip_mem_pool) {
         PRINT_DEBUG("Can't allocate enough memory for chip memory pool");
-        FreeMem(general_mem_pool, general_pool_size);
+        ratr0_platform_free_mem(general_mem_pool, general_pool_size);
         exit(-1);
     }
 
-    general_mem_table = (struct AllocatedBlock *)
-        AllocMem(sizeof(struct AllocatedBlock) * general_table_size, MEMF_CLEAR);
+    struct AllocatedBlock *general_mem_table = (struct AllocatedBlock *)
+        ratr0_platform_alloc_mem(sizeof(struct AllocatedBlock) * general_table_size,
+                                 RATR0_PLATFORM_MEM_ANY);
     if (!general_mem_table) {
         PRINT_DEBUG("Can't allocate enough memory for general memory table");
-        FreeMem(general_mem_pool, general_pool_size);
-        FreeMem(chip_mem_pool, chip_pool_size);
+        ratr0_platform_free_mem(general_mem_pool, general_pool_size);
+        ratr0_platform_free_mem(chip_mem_pool, chip_pool_size);
         exit(-1);
     }
-    chip_mem_table = (struct AllocatedBlock *)
-        AllocMem(sizeof(struct AllocatedBlock) * chip_table_size, MEMF_CLEAR);
+    struct AllocatedBlock *chip_mem_table = (struct AllocatedBlock *)
+        ratr0_platform_alloc_mem(sizeof(struct AllocatedBlock) * chip_table_size,
+                                 RATR0_PLATFORM_MEM_ANY);
     if (!chip_mem_table) {
         PRINT_DEBUG("Can't allocate enough memory for chip memory table");
-        FreeMem(general_mem_table,
+        ratr0_platform_free_mem(general_mem_table,
                 sizeof(struct AllocatedBlock) * general_table_size);
-        FreeMem(general_mem_pool, general_pool_size);
-        FreeMem(chip_mem_pool, chip_pool_size);
+        ratr0_platform_free_mem(general_mem_pool, general_pool_size);
+        ratr0_platform_free_mem(chip_mem_pool, chip_pool_size);
         exit(-1);
     }
 
-    first_free_chip = first_free_general = 0;
-    first_free_chip_table = first_free_general_table = 0;
+    scope_depth = 0;
+    msb_table[0] = -1;
+    for (int i = 1; i < 256; i++) {
+        msb_table[i] = msb_table[i >> 1] + 1;
+    }
+    _pool_init(&general_pool, general_mem_pool, general_pool_size,
+               general_mem_table, general_table_size, 0);
+    _pool_init(&chip_pool, chip_mem_pool, chip_pool_size,
+               chip_mem_table, chip_table_size, CHIP_HANDLE_TAG);
+    general_pool_is_fast = !ratr0_platform_is_chip_mem(general_mem_pool);
+    PRINT_DEBUG("General memory pool is in %s memory.", general_pool_is_fast ? "fast" : "chip");
+
+    // Reserve the frame scratch memory, it's never freed, so it does
+    // not need a handle
+    frame_start = frame_end = NULL;
+    if (config->frame_pool_size > 0) {
+        frame_start = _pool_alloc(&general_pool, config->frame_pool_size);
+        if (!frame_start) {
+            PRINT_DEBUG("Can't reserve frame memory from general memory pool");
+            ratr0_memory_shutdown();
+            exit(-1);
+        }
+        frame_end = frame_start + (config->frame_pool_size & ~(ALIGN_SIZE - 1));
+    }
+    frame_low_top = frame_start;
+    frame_high_top = frame_end;
+    frame_is_low = TRUE;
+    frame_peak = 0;
 
     PRINT_DEBUG("Startup finished.");
     return &memory_system;
@@ -97,79 +635,244 @@ struct Ratr0MemorySystem *ratr0_memory_startup(Ratr0Engine *eng, struct Ratr0Mem
 
 void ratr0_memory_shutdown(void)
 {
-    FreeMem(general_mem_table, sizeof(void *) * general_table_size);
-    FreeMem(chip_mem_table, sizeof(void *) * chip_table_size);
-    FreeMem(general_mem_pool, general_pool_size);
-    FreeMem(chip_mem_pool, chip_pool_size);
+    ratr0_platform_free_mem(general_pool.table,
+                            sizeof(struct AllocatedBlock) * general_pool.table_size);
+    ratr0_platform_free_mem(chip_pool.table,
+                            sizeof(struct AllocatedBlock) * chip_pool.table_size);
+    ratr0_platform_free_mem(general_pool.base, general_pool.size);
+    ratr0_platform_free_mem(chip_pool.base, chip_pool.size);
     PRINT_DEBUG("Shutdown finished.");
 }
 
+/*
+ * Allocates a block and its handle from the pool. Returns NULL if the pool
+ * is exhausted, slot is -1 in case the handle table is exhausted.
+ */
+static void *_allocate(struct Ratr0MemPool *pool, UINT32 size, UINT16 tag, UINT8 scope,
+                       INT32 *slot)
+{
+    *slot = _alloc_slot(pool);
+    if (*slot == -1) return NULL;
+
+    void *mem_block = _pool_alloc(pool, size);
+    if (!mem_block) {
+        // give back the handle slot
+        _free_slot(pool, *slot);
+        return NULL;
+    }
+    _block_from_data(mem_block)->handle = *slot;
+    pool->table[*slot].block_address = mem_block;
+    pool->table[*slot].block_size = size;
+    pool->table[*slot].tag = tag;
+    _scope_link(pool, *slot, scope);
+    _count_alloc(pool, tag, size);
+    return mem_block;
+}
+
 Ratr0MemHandle ratr0_memory_allocate_block(Ratr0MemoryType mem_type, UINT32 size)
 {
-    if (size % 2 == 1) {
-#ifdef DEBUG
-        fprintf(debug_fp, "requested to allocate odd number of bytes, adding a byte\n");
-        fflush(debug_fp);
-#endif
-        size++;
+    UINT16 tag = (mem_type & RATR0_MEMTAG_MASK) >> RATR0_MEMTAG_SHIFT;
+    if (tag >= RATR0_NUM_MEMTAGS) tag = 0;
+    UINT8 scope = (mem_type & RATR0_MEM_SCOPED) ? scope_depth : 0;
+    mem_type &= RATR0_MEM_TYPE_MASK;
+
+    struct Ratr0MemPool *pool = NULL;
+    void *mem_block = NULL;
+    INT32 slot = -1;
+    if (mem_type == RATR0_MEM_FAST && general_pool_is_fast) {
+        pool = &general_pool;
+        mem_block = _allocate(pool, size, tag, scope, &slot);
+        if (!mem_block) {
+            PRINT_DEBUG("Fast memory exhausted, placing %u bytes in chip memory.", size);
+        }
     }
-    if (mem_type == RATR0_MEM_CHIP) {
-        if (first_free_chip + size > chip_pool_size) {
-            // This is a fatal error -> Exit the engine !!
-            PRINT_DEBUG("Chip memory exhausted, can't reserve more.");
-            ratr0_memory_shutdown();
-            exit(-1);
+    // without fast memory, CPU only data goes to the chip pool, so the
+    // general pool is kept for the engine's logic data
+    if (!mem_block) {
+        pool = mem_type == RATR0_MEM_DEFAULT ? &general_pool : &chip_pool;
+        mem_block = _allocate(pool, size, tag, scope, &slot);
+    }
+    if (!mem_block) {
+        // This is a fatal error -> Exit the engine !!
+        if (slot == -1) {
+            PRINT_DEBUG("%s memory table exhausted, can't reserve more.",
+                        pool == &chip_pool ? "Chip" : "General");
+        } else {
+            PRINT_DEBUG("%s memory exhausted, can't reserve more.",
+                        pool == &chip_pool ? "Chip" : "General");
         }
-        Ratr0MemHandle result = first_free_chip_table;
-        void *mem_block = (void *) ((UINT32) chip_mem_pool + first_free_chip);
-        chip_mem_table[first_free_chip_table].block_address = mem_block;
-        chip_mem_table[first_free_chip_table++].block_size = size;
-        first_free_chip += size;
+        ratr0_memory_shutdown();
+        exit(-1);
+    }
+    if (pool == &chip_pool) {
         PRINT_DEBUG("Allocated %u bytes of chip memory.", size);
-        return result | 0x80000000;  // add a chip mem tag
     } else {
-        if (first_free_general + size > general_pool_size) {
-            // This is a fatal error -> Exit the engine !!
-            PRINT_DEBUG("General memory exhausted, can't reserve more.");
-            ratr0_memory_shutdown();
-            exit(-1);
-        }
-        Ratr0MemHandle result = first_free_general_table;
-        void *mem_block = (void *) ((UINT32)general_mem_pool + first_free_general);
-        general_mem_table[first_free_general_table].block_address = mem_block;
-        general_mem_table[first_free_general_table++].block_size = size;
-        first_free_general += size;
         PRINT_DEBUG("Allocated %u bytes of general purpose memory.", size);
-        return result;
     }
+    return slot | pool->handle_tag;
 }
 
 void ratr0_memory_free_block(Ratr0MemHandle handle)
 {
-    // This is a no-op for now
-    // As a first approach we should be able to free the last
-    // allocated block. This is easy because it simply resets
-    // the
-    if ((handle & 0x80000000) == 0x80000000) {
-        int chip_table_idx = handle & 0x7fffffff;
-        if (chip_table_idx == (first_free_chip_table - 1)) {
-#ifdef DEBUG
-            fprintf(debug_fp, "Freeing the last allocated chip block, %u bytes\n",
-                    chip_mem_table[chip_table_idx].block_size);
-#endif
-            first_free_chip -= chip_mem_table[chip_table_idx].block_size;
-            // TODO:
-            // first_free_chip_table--
-        }
+    struct Ratr0MemPool *pool = _pool_for_handle(handle);
+    UINT32 slot = handle & HANDLE_INDEX_MASK;
+    if (slot >= pool->next_unused_slot || !pool->table[slot].block_address) {
+        PRINT_DEBUG("ERROR: trying to free invalid memory handle");
+        return;
     }
+    _free_block(pool, slot);
 }
 
 void *ratr0_memory_block_address(Ratr0MemHandle handle)
 {
-    if ((handle & 0x80000000) == 0x80000000) {
-        // chip mem
-        return chip_mem_table[handle & 0x7fffffff].block_address;
+    return _pool_for_handle(handle)->table[handle & HANDLE_INDEX_MASK].block_address;
+}
+
+UINT32 ratr0_memory_compact(Ratr0MemoryType mem_type)
+{
+    mem_type &= RATR0_MEM_TYPE_MASK;
+    struct Ratr0MemPool *pool = mem_type == RATR0_MEM_CHIP ? &chip_pool : &general_pool;
+    if (pool == &chip_pool) ratr0_platform_begin_chip_moves();
+    UINT32 num_moved = _pool_compact(pool);
+    if (pool == &chip_pool) ratr0_platform_end_chip_moves();
+    PRINT_DEBUG("Compaction moved %u blocks.", num_moved);
+    return num_moved;
+}
+
+BOOL ratr0_memory_push_scope(void)
+{
+    if (scope_depth == MAX_SCOPE_DEPTH) {
+        PRINT_DEBUG("ERROR: maximum scope depth (%d) exceeded", MAX_SCOPE_DEPTH);
+        return FALSE;
+    }
+    scope_depth++;
+    return TRUE;
+}
+
+void ratr0_memory_pop_scope(void)
+{
+    if (scope_depth == 0) {
+        PRINT_DEBUG("ERROR: pop without matching push");
+        return;
+    }
+    // deeper scopes were already popped, so only this depth has blocks left
+    _scope_release(&general_pool, scope_depth);
+    _scope_release(&chip_pool, scope_depth);
+    scope_depth--;
+}
+
+void *ratr0_memory_frame_alloc(UINT32 size)
+{
+    size = (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1);
+    if (size > frame_high_top - frame_low_top) {
+        PRINT_DEBUG("ERROR: frame memory exhausted");
+        return NULL;
+    }
+    void *result;
+    if (frame_is_low) {
+        result = frame_low_top;
+        frame_low_top += size;
     } else {
-        return general_mem_table[handle].block_address;
+        frame_high_top -= size;
+        result = frame_high_top;
     }
+    UINT32 frame_used = (frame_low_top - frame_start) + (frame_end - frame_high_top);
+    if (frame_used > frame_peak) frame_peak = frame_used;
+    return result;
+}
+
+void ratr0_memory_frame_reset(void)
+{
+    frame_is_low = !frame_is_low;
+    if (frame_is_low) {
+        frame_low_top = frame_start;
+    } else {
+        frame_high_top = frame_end;
+    }
+}
+
+/*
+ * Collect the free space statistics of a pool.
+ */
+static void _pool_stats(struct Ratr0MemPool *pool, struct Ratr0MemoryPoolStats *stats)
+{
+    *stats = pool->stats;
+    stats->free_bytes = stats->largest_free_block = stats->num_free_blocks = 0;
+    for (int i = 0; i < FL_INDEX_COUNT; i++) {
+        for (int j = 0; j < SL_INDEX_COUNT; j++) {
+            for (struct Ratr0MemBlock *block = pool->free_lists[i][j]; block;
+                 block = block->next_free) {
+                UINT32 size = _block_size(block);
+                stats->free_bytes += size;
+                stats->num_free_blocks++;
+                if (size > stats->largest_free_block) stats->largest_free_block = size;
+            }
+        }
+    }
+    // pools are at most 16 MB, so the percentage can't overflow
+    stats->fragmentation = stats->free_bytes == 0 ? 0 :
+        100 - stats->largest_free_block * 100 / stats->free_bytes;
+}
+
+void ratr0_memory_stats(struct Ratr0MemoryStats *stats)
+{
+    _pool_stats(&general_pool, &stats->general);
+    _pool_stats(&chip_pool, &stats->chip);
+    stats->frame_size = frame_end - frame_start;
+    stats->frame_peak = frame_peak;
+    stats->general_is_fast = general_pool_is_fast;
+}
+
+static const char *tag_names[RATR0_NUM_MEMTAGS] = {
+    "user", "timers", "resources", "display", "stages"
+};
+
+static void _dump_pool(FILE *fp, const char *name, struct Ratr0MemPool *pool)
+{
+    struct Ratr0MemoryPoolStats stats;
+    _pool_stats(pool, &stats);
+    fprintf(fp, "%s pool: %u bytes, live: %u (peak: %u), free: %u in %u blocks, "
+            "largest: %u, fragmentation: %u%%\n",
+            name, stats.pool_size, stats.live_bytes, stats.peak_bytes,
+            stats.free_bytes, stats.num_free_blocks, stats.largest_free_block,
+            stats.fragmentation);
+    fprintf(fp, "  handles: %u/%u (peak: %u)\n", stats.live_blocks,
+            stats.table_size, stats.peak_blocks);
+    for (int tag = 0; tag < RATR0_NUM_MEMTAGS; tag++) {
+        if (stats.tags[tag].peak_blocks == 0) continue;
+        fprintf(fp, "  %-9s live: %u bytes in %u blocks, peak: %u bytes in %u blocks\n",
+                tag_names[tag], stats.tags[tag].live_bytes,
+                stats.tags[tag].live_blocks, stats.tags[tag].peak_bytes,
+                stats.tags[tag].peak_blocks);
+    }
+
+    // the pool map: one line per physical block, up to the sentinel
+    struct Ratr0MemBlock *block = (struct Ratr0MemBlock *) pool->base;
+    while (_block_size(block) > 0 || (block->size & BLOCK_FREE)) {
+        UINT32 offset = ((UINT8 *) block) - pool->base;
+        UINT32 size = _block_size(block);
+        if (block->size & BLOCK_FREE) {
+            fprintf(fp, "  %08x %8u free\n", offset, size);
+        } else if (pool == &general_pool && _block_data(block) == frame_start) {
+            fprintf(fp, "  %08x %8u frame memory\n", offset, size);
+        } else {
+            struct AllocatedBlock *entry = &pool->table[block->handle];
+            fprintf(fp, "  %08x %8u %-9s handle: %u, requested: %u, scope: %u\n",
+                    offset, size, tag_names[entry->tag], block->handle,
+                    entry->block_size, entry->scope);
+        }
+        block = _block_next(block);
+    }
+}
+
+void ratr0_memory_dump(FILE *fp)
+{
+#ifdef DEBUG
+    if (!fp) fp = debug_fp;
+#endif
+    if (!fp) return;
+    _dump_pool(fp, "General", &general_pool);
+    _dump_pool(fp, "Chip", &chip_pool);
+    fprintf(fp, "Frame memory: %u bytes (peak: %u)\n",
+            (UINT32) (frame_end - frame_start), frame_peak);
 }
@@ -0,0 +1,40 @@
+/** @file platform_amiga.c
+ *
+ * Amiga implementation of the platform layer.
+ */
+#include <clib/exec_protos.h>
+#include <clib/graphics_protos.h>
+
+#include <ratr0/blitter.h>
+#include <ratr0/platform.h>
+
+void *ratr0_platform_alloc_mem(UINT32 size, Ratr0PlatformMemType mem_type)
+{
+    return (void *) AllocMem(size, mem_type == RATR0_PLATFORM_MEM_CHIP ?
+                             MEMF_CHIP|MEMF_CLEAR : MEMF_CLEAR);
+}
+
+void ratr0_platform_free_mem(void *mem, UINT32 size)
+{
+    FreeMem(mem, size);
+}
+
+BOOL ratr0_platform_is_chip_mem(void *mem)
+{
+    return (TypeOfMem(mem) & MEMF_CHIP) == MEMF_CHIP;
+}
+
+void ratr0_platform_begin_chip_moves(void)
+{
+    ratr0_blitter_own();
+}
+
+void ratr0_platform_move_chip_mem(void *dst, void *src, UINT32 num_bytes)
+{
+    ratr0_blit_copy_mem(dst, src, num_bytes);
+}
+
+void ratr0_platform_end_chip_moves(void)
+{
+    ratr0_blitter_disown();
+}
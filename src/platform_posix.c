@@ -0,0 +1,33 @@
+/** @file platform_posix.c
+ *
+ * POSIX implementation of the platform layer for the host test build.
+ * There is no chip memory on the host, so all memory comes from the heap.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <ratr0/platform.h>
+
+void *ratr0_platform_alloc_mem(UINT32 size, Ratr0PlatformMemType mem_type)
+{
+    return calloc(1, size);
+}
+
+void ratr0_platform_free_mem(void *mem, UINT32 size)
+{
+    free(mem);
+}
+
+BOOL ratr0_platform_is_chip_mem(void *mem)
+{
+    return FALSE;
+}
+
+void ratr0_platform_begin_chip_moves(void) { }
+
+void ratr0_platform_move_chip_mem(void *dst, void *src, UINT32 num_bytes)
+{
+    memmove(dst, src, num_bytes);
+}
+
+void ratr0_platform_end_chip_moves(void) { }
@@ -1,9 +1,11 @@
 /** @file resources.c */
 #include <stdio.h>
+#include <string.h>
 #include <ratr0/debug_utils.h>
 #include <ratr0/memory.h>
 #include <ratr0/display.h>
 #include <ratr0/resources.h>
+#include <ratr0/blitter.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("RESOURCES", __VA_ARGS__)
 
@@ -22,17 +24,25 @@ static UINT32 byteswap32(UINT32 value)
 
 void ratr0_resources_shutdown(void);
 
+/*
+ * Placement policy: only the parts of an asset that are read by DMA are
+ * loaded into chip memory. Everything that only the CPU reads, like sprite
+ * offsets and MOD pattern data, is loaded as RATR0_MEM_FAST, which the memory
+ * subsystem places in fast memory if there is any.
+ */
 static struct Ratr0ResourceSystem resource_system;
 static Ratr0Engine *engine;
-#define MAX_INFO_WORDS (40)
-UINT16 info_words[MAX_INFO_WORDS];
-UINT16 num_info_words;
+
+// Protracker module layout
+#define MOD_POSITIONS_OFFSET (952)
+#define MOD_NUM_POSITIONS    (128)
+#define MOD_PATTERNS_OFFSET  (1084)
+#define MOD_PATTERN_SIZE     (1024)
 
 struct Ratr0ResourceSystem *ratr0_resources_startup(Ratr0Engine *eng)
 {
     engine = eng;
     resource_system.shutdown = &ratr0_resources_shutdown;
-    num_info_words = 0;
 
     PRINT_DEBUG("Startup finished.");
     return &resource_system;
@@ -43,8 +53,8 @@ void ratr0_resources_shutdown(void)
     PRINT_DEBUG("Shutdown finished.");
 }
 
-BOOL ratr0_resources_read_tilesheet(const char *filename,
-                                    struct Ratr0TileSheet *sheet)
+static BOOL _read_tilesheet(const char *filename, struct Ratr0TileSheet *sheet,
+                            Ratr0MemoryType mem_type)
 {
     int elems_read;
     FILE *fp = fopen(filename, "rb");
@@ -61,7 +71,9 @@ BOOL ratr0_resources_read_tilesheet(const char *filename,
         UINT32 imgdata_size = byteswap32(sheet->header.imgdata_size);
 #endif
         elems_read = fread(&sheet->palette, sizeof(UINT16), palette_size, fp);
-        Ratr0MemHandle handle = ratr0_memory_allocate_block(RATR0_MEM_CHIP, imgdata_size);
+        Ratr0MemHandle handle = ratr0_memory_allocate_block(mem_type | RATR0_MEMTAG_RESOURCES |
+                                                            RATR0_MEM_SCOPED,
+                                                            imgdata_size);
         sheet->h_imgdata = handle;
         UINT8 *imgdata = ratr0_memory_block_address(handle);
         elems_read = fread(imgdata, sizeof(unsigned char), imgdata_size, fp);
@@ -77,12 +89,27 @@ BOOL ratr0_resources_read_tilesheet(const char *filename,
     }
 }
 
+BOOL ratr0_resources_read_tilesheet(const char *filename,
+                                    struct Ratr0TileSheet *sheet)
+{
+    // the blitter reads the image data
+    return _read_tilesheet(filename, sheet, RATR0_MEM_CHIP);
+}
+
+BOOL ratr0_resources_read_cpu_tilesheet(const char *filename,
+                                        struct Ratr0TileSheet *sheet)
+{
+    return _read_tilesheet(filename, sheet, RATR0_MEM_FAST);
+}
+
 /**
  * Frees the memory that was allocated for the specified RATR0 tile sheet.
  */
 void ratr0_resources_free_tilesheet_data(struct Ratr0TileSheet *sheet)
 {
     if (sheet && sheet->h_imgdata) ratr0_memory_free_block(sheet->h_imgdata);
+    // compiled blits of this sheet are invalid now
+    ratr0_blitter_flush_cache();
 }
 
 BOOL ratr0_resources_read_spritesheet(const char *filename, struct Ratr0SpriteSheet *sheet)
@@ -103,11 +130,14 @@ BOOL ratr0_resources_read_spritesheet(const char *filename, struct Ratr0SpriteSh
         PRINT_DEBUG("read_spritesheet(), palette size: %d imgdata_size: %d",
                 (int) palette_size, (int) imgdata_size);
 
-        // TODO: 0. reserve info chunk memory for offsets and colors
-        sheet->sprite_offsets = &info_words[num_info_words];
-        num_info_words += sheet->header.num_sprites;
-        sheet->colors = &info_words[num_info_words];
-        num_info_words += palette_size;
+        // 0. reserve info chunk memory for offsets and colors, they are
+        // only read by the CPU
+        sheet->h_info = ratr0_memory_allocate_block(RATR0_MEM_FAST | RATR0_MEMTAG_RESOURCES |
+                                                    RATR0_MEM_SCOPED,
+                                                    (sheet->header.num_sprites + palette_size) *
+                                                    sizeof(UINT16));
+        sheet->sprite_offsets = ratr0_memory_block_address(sheet->h_info);
+        sheet->colors = sheet->sprite_offsets + sheet->header.num_sprites;
 
         // 1. Read offsets
         elems_read = fread(sheet->sprite_offsets, sizeof(UINT16),
@@ -115,8 +145,9 @@ BOOL ratr0_resources_read_spritesheet(const char *filename, struct Ratr0SpriteSh
         // 2. read sprite colors
         elems_read = fread(sheet->colors, sizeof(UINT16), palette_size, fp);
 
-        // 3. read image data
-        Ratr0MemHandle handle = ratr0_memory_allocate_block(RATR0_MEM_CHIP,
+        // 3. read image data, sprite DMA needs it in chip memory
+        Ratr0MemHandle handle = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES |
+                                                            RATR0_MEM_SCOPED,
                                                             imgdata_size);
         sheet->h_imgdata = handle;
         UINT8 *imgdata = ratr0_memory_block_address(handle);
@@ -139,6 +170,7 @@ BOOL ratr0_resources_read_spritesheet(const char *filename, struct Ratr0SpriteSh
 void ratr0_resources_free_spritesheet_data(struct Ratr0SpriteSheet *sheet)
 {
     if (sheet && sheet->h_imgdata) ratr0_memory_free_block(sheet->h_imgdata);
+    if (sheet && sheet->h_info) ratr0_memory_free_block(sheet->h_info);
 }
 
 BOOL ratr0_resources_read_audiosample(const char *filename,
@@ -151,7 +183,8 @@ BOOL ratr0_resources_read_audiosample(const char *filename,
         if ((filesize % 2) == 1) {
             filesize++;
         }
-        sample->h_data = ratr0_memory_allocate_block(RATR0_MEM_CHIP,
+        sample->h_data = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES |
+                                                     RATR0_MEM_SCOPED,
                                                      filesize);
         sample->num_bytes = filesize;
 
@@ -175,6 +208,31 @@ void ratr0_resources_free_audiosample_data(struct Ratr0AudioSample *sample)
     if (sample && sample->h_data) ratr0_memory_free_block(sample->h_data);
 }
 
+/*
+ * Determine the size of the song data of a 31 sample Protracker module,
+ * which is the header and the patterns. Returns 0 for unknown formats.
+ */
+static UINT32 _mod_song_size(FILE *fp, UINT32 filesize)
+{
+    UINT8 positions[MOD_NUM_POSITIONS + 4];
+    if (filesize < MOD_PATTERNS_OFFSET) return 0;
+    fseek(fp, MOD_POSITIONS_OFFSET, SEEK_SET);
+    if (fread(positions, sizeof(UINT8), sizeof(positions), fp) != sizeof(positions)) {
+        return 0;
+    }
+    UINT8 *id = &positions[MOD_NUM_POSITIONS];
+    if (strncmp((char *) id, "M.K.", 4) && strncmp((char *) id, "M!K!", 4) &&
+        strncmp((char *) id, "FLT4", 4) && strncmp((char *) id, "4CHN", 4)) {
+        return 0;
+    }
+    UINT8 num_patterns = 0;
+    for (int i = 0; i < MOD_NUM_POSITIONS; i++) {
+        if (positions[i] >= num_patterns) num_patterns = positions[i] + 1;
+    }
+    UINT32 song_size = MOD_PATTERNS_OFFSET + (UINT32) num_patterns * MOD_PATTERN_SIZE;
+    return song_size <= filesize ? song_size : 0;
+}
+
 BOOL ratr0_resources_read_protracker(const char *filename,
                                      struct Ratr0AudioProtrackerMod *mod)
 {
@@ -182,13 +240,31 @@ BOOL ratr0_resources_read_protracker(const char *filename,
     if (fp) {
         UINT32 file_offset = fseek(fp, 0, SEEK_END);
         UINT32 filesize = ftell(fp);
-        mod->h_data = ratr0_memory_allocate_block(RATR0_MEM_CHIP,
-                                                     filesize);
-
-        // read sample data into memory
-        UINT8 *moddata = ratr0_memory_block_address(mod->h_data);
+        UINT32 song_size = _mod_song_size(fp, filesize);
         file_offset = fseek(fp, 0, SEEK_SET);
-        UINT32 elems_read = fread(moddata, sizeof(UINT8), filesize, fp);
+        if (song_size == 0) {
+            // unknown layout: keep everything together in chip memory
+            mod->h_data = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES |
+                                                      RATR0_MEM_SCOPED,
+                                                      filesize);
+            mod->h_samples = 0;
+            UINT8 *moddata = ratr0_memory_block_address(mod->h_data);
+            UINT32 elems_read = fread(moddata, sizeof(UINT8), filesize, fp);
+            fclose(fp);
+            return TRUE;
+        }
+        // The song data is only read by the replay routine, the samples are
+        // played by audio DMA
+        mod->h_data = ratr0_memory_allocate_block(RATR0_MEM_FAST | RATR0_MEMTAG_RESOURCES |
+                                                  RATR0_MEM_SCOPED,
+                                                  song_size);
+        mod->h_samples = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES |
+                                                     RATR0_MEM_SCOPED,
+                                                     filesize - song_size);
+        UINT8 *moddata = ratr0_memory_block_address(mod->h_data);
+        UINT8 *sampledata = ratr0_memory_block_address(mod->h_samples);
+        UINT32 elems_read = fread(moddata, sizeof(UINT8), song_size, fp);
+        elems_read = fread(sampledata, sizeof(UINT8), filesize - song_size, fp);
         fclose(fp);
         return TRUE;
     } else {
@@ -198,6 +274,7 @@ BOOL ratr0_resources_read_protracker(const char *filename,
 
 void ratr0_resources_free_protracker_data(struct Ratr0AudioProtrackerMod *mod)
 {
+    if (mod && mod->h_samples) ratr0_memory_free_block(mod->h_samples);
     if (mod && mod->h_data) ratr0_memory_free_block(mod->h_data);
 }
 
@@ -0,0 +1,99 @@
+/** @file save_stack.c */
+#include <string.h>
+#include <ratr0/debug_utils.h>
+#include <ratr0/display.h>
+#include <ratr0/blitter.h>
+#include <ratr0/save_stack.h>
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_TAG("SAVE_STACK", __VA_ARGS__)
+
+void ratr0_save_stack_init(struct Ratr0SaveStack *stack)
+{
+    stack->h_data = -1;
+    stack->size = stack->top = 0;
+    stack->num_areas = 0;
+}
+
+UINT32 ratr0_save_stack_area_size(UINT16 width, UINT16 height, UINT16 depth)
+{
+    UINT32 words = ((width + 15) >> 4) + 1;
+    return words * 2 * height * depth;
+}
+
+void ratr0_save_stack_reserve(struct Ratr0SaveStack *stack, UINT32 size)
+{
+    if (size <= stack->size) return;
+    Ratr0MemHandle h_data = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_STAGES |
+                                                        RATR0_MEM_SCOPED, size);
+    if (stack->h_data != -1) {
+        // the saved areas still have to be put back
+        memcpy(ratr0_memory_block_address(h_data), ratr0_memory_block_address(stack->h_data),
+               stack->top);
+        ratr0_memory_free_block(stack->h_data);
+    }
+    stack->h_data = h_data;
+    stack->size = size;
+}
+
+/**
+ * Copies a rectangle between surfaces in blits of at most 1024 lines
+ */
+static void _enqueue_copy(struct Ratr0Surface *dst, struct Ratr0Surface *src,
+                          UINT16 dstx, UINT16 dsty, UINT16 srcx, UINT16 srcy,
+                          UINT16 w, UINT16 h)
+{
+    struct Ratr0BlitDescriptor desc;
+    UINT16 max_rows = (1024 / dst->depth) & ~0x0f;
+    while (h > 0) {
+        UINT16 rows = h > max_rows ? max_rows : h;
+        ratr0_blit_prepare_rect_simple(&desc, dst, src, dstx, dsty, srcx, srcy, w, rows);
+        ratr0_blit_enqueue(&desc);
+        dsty += rows;
+        srcy += rows;
+        h -= rows;
+    }
+}
+
+BOOL ratr0_save_stack_push(struct Ratr0SaveStack *stack, struct Ratr0Surface *surface,
+                           UINT16 x, UINT16 y, UINT16 width, UINT16 height)
+{
+    UINT16 x0 = x & ~0x0f;
+    UINT16 x1 = (x + width + 15) & ~0x0f;
+    UINT16 y1 = y + height;
+    if (x1 > surface->width) x1 = surface->width;
+    if (y1 > surface->height) y1 = surface->height;
+    if (x0 >= x1 || y >= y1) return TRUE;
+
+    UINT32 size = (UINT32) ((x1 - x0) >> 3) * (y1 - y) * surface->depth;
+    if (stack->num_areas == RATR0_SAVE_STACK_MAX_AREAS || stack->top + size > stack->size) {
+        PRINT_DEBUG("ERROR: save stack is full");
+        return FALSE;
+    }
+    struct Ratr0SavedArea *area = &stack->areas[stack->num_areas++];
+    area->x = x0;
+    area->y = y;
+    area->width = x1 - x0;
+    area->height = y1 - y;
+    area->offset = stack->top;
+    stack->top += size;
+
+    struct Ratr0Surface saved = {
+        area->width, area->height, surface->depth, TRUE,
+        (UINT8 *) ratr0_memory_block_address(stack->h_data) + area->offset
+    };
+    _enqueue_copy(&saved, surface, 0, 0, x0, y, area->width, area->height);
+    return TRUE;
+}
+
+void ratr0_save_stack_restore(struct Ratr0SaveStack *stack, struct Ratr0Surface *surface)
+{
+    UINT8 *data = stack->h_data != -1 ? ratr0_memory_block_address(stack->h_data) : NULL;
+    while (stack->num_areas > 0) {
+        struct Ratr0SavedArea *area = &stack->areas[--stack->num_areas];
+        struct Ratr0Surface saved = {
+            area->width, area->height, surface->depth, TRUE, data + area->offset
+        };
+        _enqueue_copy(surface, &saved, area->x, area->y, 0, 0, area->width, area->height);
+    }
+    stack->top = 0;
+}
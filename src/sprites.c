@@ -2,6 +2,8 @@
 #include <ratr0/debug_utils.h>
 #include <ratr0/memory.h>
 #include <ratr0/resources.h>
+#include <ratr0/display.h>
+#include <ratr0/sprites.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("SPRITES", __VA_ARGS__)
 
@@ -19,13 +21,28 @@
 // We also maintain a table of sprite data structure entries
 static Ratr0Engine *engine;
 
+// Multiplexer chain buffers: a set for every display buffer, with a chain
+// of chain_words for each channel. A chain of sprites that are at least a
+// line apart covers at most the viewport height + 1 lines, so it never
+// needs more than 2 words for each of these lines and the end words.
+// The sets are allocated on first use, outside of the stage's memory scope,
+// because the sprite DMA keeps reading them across stage changes.
+static Ratr0MemHandle h_chains[MAX_BUFFERS];
+static UINT16 chain_words;
+
 void  ratr0_sprites_startup(Ratr0Engine *eng)
 {
     engine = eng;
+    for (int i = 0; i < MAX_BUFFERS; i++) h_chains[i] = -1;
+    chain_words = 0;
 }
 
 void  ratr0_sprites_shutdown(void)
 {
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (h_chains[i] != -1) ratr0_memory_free_block(h_chains[i]);
+        h_chains[i] = -1;
+    }
 }
 
 void ratr0_sprites_set_pos(UINT16 *sprite_data, UINT16 hstart, UINT16 vstart, UINT16 vstop)
@@ -55,7 +72,8 @@ UINT16 *ratr0_make_sprite_data(struct Ratr0TileSheet *tilesheet, UINT8 frames[],
                 num_frames, words_to_reserve);
     UINT16 *imgdata = (UINT16 *) ratr0_memory_block_address(tilesheet->h_imgdata);
 
-    Ratr0MemHandle sprite_handle = ratr0_memory_allocate_block(RATR0_MEM_CHIP,
+    Ratr0MemHandle sprite_handle = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_DISPLAY |
+                                                               RATR0_MEM_SCOPED,
                                                                words_to_reserve * sizeof(UINT16));
     UINT16 *sprite_data = ratr0_memory_block_address(sprite_handle);
 
@@ -83,3 +101,134 @@ UINT16 *ratr0_make_sprite_data(struct Ratr0TileSheet *tilesheet, UINT8 frames[],
     sprite_data[words_to_reserve - 1] = 0;
     return sprite_data;
 }
+
+/*
+ * A sprite that the multiplexer places, with its display lines, its first
+ * visible row and the frame data of its channels.
+ */
+struct MuxSprite {
+    UINT16 vstart, rows, first_row;
+    UINT16 *frame_data[2];
+    struct Ratr0HWSprite *sprite;
+};
+
+static void _chain_sprite(UINT16 *chain, UINT16 *pos, UINT16 *frame_data,
+                          UINT16 hstart, UINT16 vstart, UINT16 first_row, UINT16 rows)
+{
+    UINT16 *dst = chain + *pos;
+    // the attach bit is in the control word of the frame
+    dst[1] = frame_data[1];
+    ratr0_sprites_set_pos(dst, hstart, vstart, vstart + rows);
+    UINT32 *src_rows = (UINT32 *) (frame_data + 2) + first_row;
+    UINT32 *dst_rows = (UINT32 *) (dst + 2);
+    for (int i = 0; i < rows; i++) *dst_rows++ = *src_rows++;
+    *pos += 2 + 2 * rows;
+}
+
+UINT16 ratr0_sprites_multiplex(struct Ratr0HWSprite *sprites[], UINT16 num_sprites,
+                               UINT16 set_num)
+{
+    static struct MuxSprite mux[RATR0_MAX_MUX_SPRITES];
+    struct MuxSprite tmp;
+    UINT16 vp_width, vp_height, num_mux = 0, num_shown = 0;
+    UINT16 last_vstop[RATR0_NUM_SPRITE_CHANNELS];
+    UINT16 chain_pos[RATR0_NUM_SPRITE_CHANNELS];
+
+    ratr0_display_get_viewport(&vp_width, &vp_height);
+    if (chain_words != 2 * vp_height + 4) {
+        ratr0_sprites_shutdown();
+        chain_words = 2 * vp_height + 4;
+    }
+    if (h_chains[set_num] == -1) {
+        h_chains[set_num] = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_DISPLAY,
+                                                        RATR0_NUM_SPRITE_CHANNELS *
+                                                        chain_words * sizeof(UINT16));
+    }
+    UINT16 *chains = ratr0_memory_block_address(h_chains[set_num]);
+    if (num_sprites > RATR0_MAX_MUX_SPRITES) num_sprites = RATR0_MAX_MUX_SPRITES;
+
+    // 1. insertion sort of the visible sprites by their line, the order
+    // rarely changes between frames
+    for (int i = 0; i < num_sprites; i++) {
+        struct Ratr0HWSprite *sprite = sprites[i];
+        // a sprite above the viewport is clipped at line 0
+        INT16 y = (INT16) sprite->base_obj.bounds.y;
+        UINT16 height = sprite->base_obj.bounds.height, first_row = 0;
+        // frames have 2 control words, the rows and 2 end words
+        UINT16 frame_words = (height + 2) * 2;
+        if (y < 0) {
+            if (-y >= height) continue;
+            first_row = -y;
+            height -= first_row;
+            y = 0;
+        }
+        if (height == 0 || y >= vp_height) continue;
+
+        UINT16 frames_per_sprite = sprite->is_attached ? 2 : 1;
+        int frame_index = sprite->base_obj.anim_frames.frames[sprite->base_obj.anim_frames.current_frame_idx];
+        tmp.sprite = sprite;
+        tmp.vstart = y + DISP_SPRITE_Y0;
+        tmp.rows = y + height > vp_height ? vp_height - y : height;
+        tmp.first_row = first_row;
+        tmp.frame_data[0] = sprite->sprite_data + frame_index * frames_per_sprite * frame_words;
+        tmp.frame_data[1] = tmp.frame_data[0] + frame_words;
+
+        int j = num_mux++;
+        while (j > 0 && mux[j - 1].vstart > tmp.vstart) {
+            mux[j] = mux[j - 1];
+            j--;
+        }
+        mux[j] = tmp;
+    }
+
+    // 2. place them from top to bottom into the first channel where the
+    // previous sprite ended above their start. A single sprite takes the
+    // free channel that became free last, which keeps channel pairs free
+    // for attached sprites.
+    for (int c = 0; c < RATR0_NUM_SPRITE_CHANNELS; c++) {
+        last_vstop[c] = 0;
+        chain_pos[c] = c * chain_words;
+    }
+    for (int i = 0; i < num_mux; i++) {
+        struct MuxSprite *m = &mux[i];
+        UINT16 hstart = m->sprite->base_obj.bounds.x + DISP_SPRITE_X0_320;
+        int channel = -1;
+        if (m->sprite->is_attached) {
+            for (int c = 0; c < RATR0_NUM_SPRITE_CHANNELS; c += 2) {
+                if (last_vstop[c] < m->vstart && last_vstop[c + 1] < m->vstart) {
+                    channel = c;
+                    break;
+                }
+            }
+        } else {
+            for (int c = 0; c < RATR0_NUM_SPRITE_CHANNELS; c++) {
+                if (last_vstop[c] < m->vstart &&
+                    (channel == -1 || last_vstop[c] > last_vstop[channel])) {
+                    channel = c;
+                }
+            }
+        }
+        if (channel == -1) continue;
+
+        _chain_sprite(chains, &chain_pos[channel], m->frame_data[0], hstart, m->vstart,
+                      m->first_row, m->rows);
+        last_vstop[channel] = m->vstart + m->rows;
+        if (m->sprite->is_attached) {
+            _chain_sprite(chains, &chain_pos[channel + 1], m->frame_data[1],
+                          hstart, m->vstart, m->first_row, m->rows);
+            last_vstop[channel + 1] = m->vstart + m->rows;
+        }
+        num_shown++;
+    }
+    // 3. end the chains
+    for (int c = 0; c < RATR0_NUM_SPRITE_CHANNELS; c++) {
+        chains[chain_pos[c]] = chains[chain_pos[c] + 1] = 0;
+    }
+    return num_shown;
+}
+
+UINT16 *ratr0_sprites_get_chain(UINT16 set_num, UINT16 channel)
+{
+    UINT16 *chains = ratr0_memory_block_address(h_chains[set_num]);
+    return chains + channel * chain_words;
+}
@@ -2,14 +2,16 @@
 #include <stdio.h>
 #include <ratr0/debug_utils.h>
 #include <ratr0/engine.h>
+#include <ratr0/memory.h>
+#include <ratr0/datastructs/pool.h>
 #include <ratr0/stages.h>
 
 #include <hardware/custom.h>
-#include <hardware/dmabits.h>
 #include <clib/graphics_protos.h>
 #include <ratr0/display.h>
 #include <ratr0/sprites.h>
 #include <ratr0/blitter.h>
+#include <ratr0/save_stack.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("STAGES", __VA_ARGS__)
 
@@ -25,20 +27,22 @@ static struct Ratr0StagesSystem stages_system;
 static struct Ratr0NodeFactory node_factory;
 static Ratr0Engine *engine;
 static struct Ratr0Stage *current_stage = NULL;
-static struct Ratr0Backdrop *backdrop = NULL;
+static struct Ratr0Backdrop *backdrops[MAX_PLAYFIELDS];
+
+/**
+ * Save-under: the backgrounds under the BOBs that were drawn into a display
+ * buffer
+ */
+static struct Ratr0SaveStack save_stacks[MAX_PLAYFIELDS][MAX_BUFFERS];
+static void _init_save_stacks(void);
 
 static void ratr0_stages_shutdown(void);
 
 /**
  * Node factory
  */
-// *do not* make the arrays static !!!! Otherwise bad things happen when you
-// try accessing them outside of the module
-struct Ratr0Stage _stages[10];
-static UINT16 next_stage = 0;
-
-struct Ratr0Backdrop _backdrops[2]; // we don't have many of those
-static UINT16 next_backdrop = 0;
+static struct Ratr0Pool stage_pool;
+static struct Ratr0Pool backdrop_pool;
 
 struct Ratr0NodeFactory *ratr0_stages_get_node_factory(void)
 {
@@ -47,23 +51,39 @@ struct Ratr0NodeFactory *ratr0_stages_get_node_factory(void)
 
 static struct Ratr0Stage *ratr0_stages_create_stage(void)
 {
-    struct Ratr0Stage *result = &_stages[next_stage++];
+    struct Ratr0Stage *result = ratr0_pool_alloc(&stage_pool);
+    if (!result) return NULL;
     result->engine = engine;
     result->num_bobs = 0;
     result->num_sprites = 0;
-    result->h_copper_list = 0;
+    result->multiplex_sprites = FALSE;
+    result->exact_restore = FALSE;
+    result->save_under = FALSE;
     result->copper_list = NULL;
     result->backdrop = NULL;
+    result->backdrop1 = NULL;
 
     return result;
 }
 
+static void ratr0_stages_destroy_stage(struct Ratr0Stage *stage)
+{
+    if (stage == current_stage) {
+        PRINT_DEBUG("ERROR: can't destroy the current stage");
+        return;
+    }
+    ratr0_pool_free(&stage_pool, stage);
+}
+
 static struct Ratr0Sprite *ratr0_nf_create_sprite(struct Ratr0TileSheet *,
                                                   UINT8[], UINT8, UINT8, BOOL);
+static void ratr0_nf_destroy_sprite(struct Ratr0Sprite *, BOOL);
 
 struct Ratr0Backdrop *ratr0_nf_create_backdrop(struct Ratr0TileSheet *tilesheet);
+static void ratr0_nf_destroy_backdrop(struct Ratr0Backdrop *);
 
-struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng)
+struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng, UINT16 max_stages,
+                                               UINT16 max_backdrops)
 {
     engine = eng;
     current_stage = NULL;
@@ -74,6 +94,14 @@ struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng)
     node_factory.create_stage = &ratr0_stages_create_stage;
     node_factory.create_sprite = &ratr0_nf_create_sprite;
     node_factory.create_backdrop = &ratr0_nf_create_backdrop;
+    node_factory.destroy_stage = &ratr0_stages_destroy_stage;
+    node_factory.destroy_sprite = &ratr0_nf_destroy_sprite;
+    node_factory.destroy_backdrop = &ratr0_nf_destroy_backdrop;
+
+    ratr0_pool_init(&stage_pool, sizeof(struct Ratr0Stage), max_stages,
+                    RATR0_MEM_DEFAULT | RATR0_MEMTAG_STAGES);
+    ratr0_pool_init(&backdrop_pool, sizeof(struct Ratr0Backdrop), max_backdrops,
+                    RATR0_MEM_DEFAULT | RATR0_MEMTAG_STAGES);
 
     PRINT_DEBUG("Startup finished.");
     return &stages_system;
@@ -81,31 +109,55 @@ struct Ratr0StagesSystem *ratr0_stages_startup(Ratr0Engine *eng)
 
 static void ratr0_stages_shutdown(void)
 {
+    ratr0_pool_destroy(&backdrop_pool);
+    ratr0_pool_destroy(&stage_pool);
     PRINT_DEBUG("Shutdown finished.");
 }
 
 void ratr0_stages_set_current_stage(struct Ratr0Stage *stage)
 {
+    // Stages switch from their update(), while the queued blits of the
+    // frame still read the old stage's assets and write its save stacks
+    ratr0_blitter_wait_queue();
+
     // Leave previous stage if existing
-    if (current_stage && current_stage->on_exit) {
-        current_stage->on_exit(stage);
+    if (current_stage) {
+        if (current_stage->on_exit) {
+            current_stage->on_exit(stage);
+        }
+        // release the assets the stage loaded while it was current, their
+        // compiled blits are invalid now
+        ratr0_memory_pop_scope();
+        ratr0_blitter_flush_cache();
     }
 
     current_stage = stage;
 
     // Enter new stage
-    UINT16 playfield_num = 0;
-    if (current_stage && current_stage->backdrop) {
-        // Make this the new backdrop for efficiency this is module global
-        backdrop = current_stage->backdrop;
-        // Blit the backdrop once if it exists
-        ratr0_display_blit_surface_to_buffers(&backdrop->surface,
-                                              playfield_num,
-                                              0, 0);
+    if (current_stage) {
+        ratr0_memory_push_scope();
+    }
+    if (current_stage) {
+        // Make these the new backdrops for efficiency this is module global
+        backdrops[0] = current_stage->backdrop;
+        backdrops[1] = current_stage->backdrop1;
+        // Blit the backdrops once if they exist
+        for (int playfield_num = 0; playfield_num < ratr0_display_get_num_playfields();
+             playfield_num++) {
+            if (backdrops[playfield_num]) {
+                ratr0_display_blit_surface_to_buffers(&backdrops[playfield_num]->surface,
+                                                      playfield_num, 0, 0);
+            }
+        }
+    }
+    if (current_stage && current_stage->copper_list) {
+        ratr0_display_set_copper_list(current_stage->copper_list);
     }
     if (current_stage && current_stage->on_enter) {
         current_stage->on_enter(stage);
     }
+    // after on_enter, so the BOBs it adds are included
+    _init_save_stacks();
 }
 
 static struct Ratr0Sprite *ratr0_nf_create_sprite(struct Ratr0TileSheet *tilesheet,
@@ -119,9 +171,19 @@ static struct Ratr0Sprite *ratr0_nf_create_sprite(struct Ratr0TileSheet *tileshe
     }
 }
 
+static void ratr0_nf_destroy_sprite(struct Ratr0Sprite *sprite, BOOL is_hw)
+{
+    if (is_hw) {
+        ratr0_destroy_sprite((struct Ratr0HWSprite *) sprite);
+    } else {
+        ratr0_destroy_bob((struct Ratr0Bob *) sprite);
+    }
+}
+
 struct Ratr0Backdrop *ratr0_nf_create_backdrop(struct Ratr0TileSheet *tilesheet)
 {
-    struct Ratr0Backdrop *result = &_backdrops[next_backdrop++];
+    struct Ratr0Backdrop *result = ratr0_pool_alloc(&backdrop_pool);
+    if (!result) return NULL;
 
     // Initialize the backdrop
     result->surface.width = tilesheet->header.width;
@@ -134,22 +196,37 @@ struct Ratr0Backdrop *ratr0_nf_create_backdrop(struct Ratr0TileSheet *tilesheet)
     return result;
 }
 
+static void ratr0_nf_destroy_backdrop(struct Ratr0Backdrop *to_destroy)
+{
+    for (int i = 0; i < MAX_PLAYFIELDS; i++) {
+        if (to_destroy == backdrops[i]) backdrops[i] = NULL;
+    }
+    ratr0_pool_free(&backdrop_pool, to_destroy);
+}
+
 
 /**
- * Restore dirty rectangles from backdrop image
+ * Restore dirty rectangles from the playfield's backdrop image, or clear
+ * them if it has none
  */
-static UINT16 dirty_bltsize = 0;
-//struct Ratr0Surface *back_buffer;
 void process_dirty_rect(struct Ratr0DisplayBuffer *backbuffer,
-                        UINT16 x, UINT16 y)
+                        UINT16 x, UINT16 y, UINT16 w, UINT16 h)
 {
-    if (!dirty_bltsize) {
-        dirty_bltsize = ratr0_blit_rect_simple(&backbuffer->surface,
-                                               &backdrop->surface,
-                                               x, y, x, y, 16, 16);
-    } else {
-        ratr0_blit_rect_simple2(&backbuffer->surface, &backdrop->surface, x, y,
-                                x, y, dirty_bltsize);
+    struct Ratr0BlitDescriptor desc;
+    struct Ratr0Backdrop *backdrop = backdrops[backbuffer->playfield_num];
+    // a blit can have at most 1024 lines, over all bitplanes
+    UINT16 max_rows = (1024 / backbuffer->surface.depth) & ~0x0f;
+    while (h > 0) {
+        UINT16 rows = h > max_rows ? max_rows : h;
+        if (backdrop) {
+            ratr0_blit_prepare_rect_simple(&desc, &backbuffer->surface, &backdrop->surface,
+                                           x, y, x, y, w, rows);
+        } else {
+            ratr0_blit_prepare_clear16(&desc, &backbuffer->surface, x, y, w, rows);
+        }
+        ratr0_blit_enqueue(&desc);
+        y += rows;
+        h -= rows;
     }
 }
 
@@ -158,11 +235,12 @@ void add_restore_tiles_for_bob(struct Ratr0Bob *bob)
 {
     // Compute dirty rectangles for the BOB
     // determine first and last horizontal tile positions horizontal and vertical
-    UINT16 playfield_num = 0;
+    UINT16 playfield_num = bob->playfield_num;
     int tx0 = bob->base_obj.bounds.x >> 4;
     int ty0 = bob->base_obj.bounds.y >> 4;
-    int txn = (bob->base_obj.bounds.x + bob->base_obj.bounds.width) >> 4;
-    int tyn = (bob->base_obj.bounds.y + bob->base_obj.bounds.height) >> 4;
+    // tiles of the last pixel
+    int txn = (bob->base_obj.bounds.x + bob->base_obj.bounds.width - 1) >> 4;
+    int tyn = (bob->base_obj.bounds.y + bob->base_obj.bounds.height - 1) >> 4;
     int x, y;
     for (y = ty0; y <= tyn; y++) {
         for (x = tx0; x <= txn; x++) {
@@ -171,6 +249,82 @@ void add_restore_tiles_for_bob(struct Ratr0Bob *bob)
     }
 }
 
+/**
+ * Makes sure the save stacks of the current stage can save every BOB that
+ * a playfield can hold at the size of its largest BOB. The stacks only
+ * grow, so this is cheap when no BOB was added or resized
+ */
+static void _reserve_save_stacks(void)
+{
+    for (int p = 0; p < MAX_PLAYFIELDS; p++) {
+        struct Ratr0DisplayBuffer *buffer = ratr0_display_get_buffer(p, 0);
+        UINT32 largest = 0;
+        if (!buffer || !current_stage || !current_stage->save_under) continue;
+        for (int i = 0; i < current_stage->num_bobs; i++) {
+            struct Ratr0Bob *bob = current_stage->bobs[i];
+            if (bob->playfield_num != p) continue;
+            UINT32 size = ratr0_save_stack_area_size(bob->base_obj.bounds.width,
+                                                     bob->base_obj.bounds.height,
+                                                     buffer->surface.depth);
+            if (size > largest) largest = size;
+        }
+        UINT32 needed = RATR0_MAX_STAGE_BOBS * largest;
+        for (int n = 0; n < MAX_BUFFERS; n++) {
+            struct Ratr0SaveStack *stack = &save_stacks[p][n];
+            if (needed > stack->size && ratr0_display_get_buffer(p, n)) {
+                // the old memory may still be read by queued restores
+                ratr0_blitter_wait_queue();
+                ratr0_save_stack_reserve(stack, needed);
+            }
+        }
+    }
+}
+
+/**
+ * Empties the save stacks and allocates the save memory of the current
+ * stage. The memory belongs to the stage's scope
+ */
+static void _init_save_stacks(void)
+{
+    for (int p = 0; p < MAX_PLAYFIELDS; p++) {
+        for (int n = 0; n < MAX_BUFFERS; n++) ratr0_save_stack_init(&save_stacks[p][n]);
+    }
+    _reserve_save_stacks();
+}
+
+/**
+ * Puts back the saved backgrounds of the back buffers
+ */
+static void _restore_saved_backgrounds(void)
+{
+    for (int p = 0; p < ratr0_display_get_num_playfields(); p++) {
+        struct Ratr0DisplayBuffer *backbuffer = ratr0_display_get_back_buffer(p);
+        ratr0_save_stack_restore(&save_stacks[p][backbuffer->buffernum], &backbuffer->surface);
+    }
+}
+
+/**
+ * Saves the word aligned area of the back buffer that the BOB is drawn to
+ */
+static void _save_background(struct Ratr0Bob *bob,
+                             struct Ratr0DisplayBuffer *backbuffer)
+{
+    ratr0_save_stack_push(&save_stacks[bob->playfield_num][backbuffer->buffernum],
+                          &backbuffer->surface,
+                          bob->base_obj.bounds.x, bob->base_obj.bounds.y,
+                          bob->base_obj.bounds.width, bob->base_obj.bounds.height);
+}
+
+/**
+ * Marks the word aligned area that the BOB covers as dirty
+ */
+void add_restore_area_for_bob(struct Ratr0Bob *bob)
+{
+    ratr0_display_add_dirty_area(bob->playfield_num,
+                                 bob->base_obj.bounds.x, bob->base_obj.bounds.y,
+                                 bob->base_obj.bounds.width, bob->base_obj.bounds.height);
+}
+
 /**
  * just fake animation for now until we know it works
  */
@@ -203,9 +357,8 @@ void move_bob(struct Ratr0Bob *bob)
 }
 
 static current_frame_sprites = 0;
-static void _update_sprite(struct Ratr0HWSprite *sprite)
+static void _animate_sprite(struct Ratr0HWSprite *sprite)
 {
-    UINT16 hstart, vstart, vstop;
     sprite->base_obj.anim_frames.current_tick++;
     // update frame animation
     if (sprite->base_obj.anim_frames.current_tick >= sprite->base_obj.anim_frames.speed) {
@@ -229,6 +382,12 @@ static void _update_sprite(struct Ratr0HWSprite *sprite)
         }
         sprite->base_obj.anim_frames.current_tick = 0;
     }
+}
+
+static void _update_sprite(struct Ratr0HWSprite *sprite)
+{
+    UINT16 hstart, vstart, vstop;
+    _animate_sprite(sprite);
 
     // Set the sprite data to the sprite channel. If it is a an attached
     // sprite, set 2 channels that are at the same position
@@ -283,56 +442,87 @@ static void _update_sprite(struct Ratr0HWSprite *sprite)
 
 static void _update_sprites(void)
 {
-    // update sprites
-    for (int i = 0; i < current_stage->num_sprites; i++) {
-        _update_sprite(current_stage->sprites[i]);
+    if (current_stage->multiplex_sprites) {
+        // the chains are built for the back buffer and shown with it
+        for (int i = 0; i < current_stage->num_sprites; i++) {
+            _animate_sprite(current_stage->sprites[i]);
+        }
+        UINT16 set_num = ratr0_display_get_back_buffer(0)->buffernum;
+        ratr0_sprites_multiplex(current_stage->sprites, current_stage->num_sprites, set_num);
+        ratr0_display_set_sprite_chains(set_num);
+    } else {
+        // update sprites
+        for (int i = 0; i < current_stage->num_sprites && current_frame_sprites < RATR0_NUM_SPRITE_CHANNELS; i++) {
+            _update_sprite(current_stage->sprites[i]);
+        }
     }
 }
 
 void ratr0_stages_update(UINT8 frames_elapsed)
 {
-    UINT16 playfield_num = 0;
     if (current_stage) {
-        struct Ratr0DisplayBuffer *backbuffer = ratr0_display_get_back_buffer(playfield_num);
-        // update the stage
+        struct Ratr0DisplayBuffer *backbuffer;
+        struct Ratr0BlitDescriptor desc;
+        struct Ratr0Bob *bob;
+
+        // 1. Queue the blits for the back buffer, the blitter interrupt
+        // runs them while the CPU does the game logic below. The bobs are
+        // drawn at the positions of the previous update.
+        // In save-under mode, the BOBs of the buffer's last frame are
+        // undone first and the backgrounds are saved before any BOB is
+        // drawn.
+        ratr0_blitter_own();
+        ratr0_blitter_set_site(RATR0_BLIT_SITE_RESTORE);
+        if (current_stage->save_under) {
+            _reserve_save_stacks();
+            _restore_saved_backgrounds();
+        }
+        ratr0_display_process_dirty_rectangles(process_dirty_rect);
+        if (current_stage->save_under) {
+            for (int i = 0; i < current_stage->num_bobs; i++) {
+                bob = current_stage->bobs[i];
+                _save_background(bob, ratr0_display_get_back_buffer(bob->playfield_num));
+            }
+        }
+
+        ratr0_blitter_set_site(RATR0_BLIT_SITE_BOBS);
+        for (int i = 0; i < current_stage->num_bobs; i++) {
+            bob = current_stage->bobs[i];
+            backbuffer = ratr0_display_get_back_buffer(bob->playfield_num);
+            ratr0_blit_prepare_object_il(&desc, &backbuffer->surface, bob->tilesheet,
+                                         0,
+                                         bob->base_obj.anim_frames.frames[bob->base_obj.anim_frames.current_frame_idx],
+                                         bob->base_obj.bounds.x,
+                                         bob->base_obj.bounds.y);
+            ratr0_blit_enqueue(&desc);
+        }
+        ratr0_blitter_set_site(RATR0_BLIT_SITE_OTHER);
+
+        // 2. update the stage, blits in here are done after the queue
         if (current_stage->update) {
             current_stage->update(current_stage, frames_elapsed);
         }
         // process all the BOBS
-        struct Ratr0Bob *bob;
         for (int i = 0; i < current_stage->num_bobs; i++) {
             bob = current_stage->bobs[i];
             if (update_bob(bob)) {
-                // enqueue dirties
-                add_restore_tiles_for_bob(bob);
+                // enqueue dirties, saved backgrounds don't need them
+                if (current_stage->exact_restore && !current_stage->save_under) {
+                    add_restore_area_for_bob(bob);
+                } else if (!current_stage->save_under) {
+                    add_restore_tiles_for_bob(bob);
+                }
                 move_bob(bob);
 
                 // TODO: check/handle collisions
             }
         }
 
-        OwnBlitter();
-        // Enable blitter nasty
-        custom.dmacon = DMAF_SETCLR | DMAF_BLITHOG;
-
-        ratr0_display_process_dirty_rectangles(process_dirty_rect);
-        // reset bltsize since it's used to determine the first blit of the chain
-        dirty_bltsize = 0;
-
-        // 2. Blit updated objects
-        for (int i = 0; i < current_stage->num_bobs; i++) {
-            bob = current_stage->bobs[i];
-            ratr0_blit_object_il(&backbuffer->surface, bob->tilesheet,
-                                 0,
-                                 bob->base_obj.anim_frames.frames[bob->base_obj.anim_frames.current_frame_idx],
-                                 bob->base_obj.bounds.x,
-                                 bob->base_obj.bounds.y);
-        }
-        // Disable blitter nasty
-        custom.dmacon = DMAF_BLITHOG;
-        DisownBlitter();
-
         current_frame_sprites = 0;
         _update_sprites();
+
+        // 3. the back buffer has to be complete before it is swapped
+        ratr0_blitter_wait_queue();
+        ratr0_blitter_disown();
     }
 }
@@ -0,0 +1,96 @@
+/*
+ * Dirty tile iteration benchmark. Compares ratr0_bitset_iterate() with
+ * the previous iterator, which tested every bit of a non-empty word
+ * through byte splits, on the dirty tile grids of a 320x256 display and a
+ * 640x512 scrolling buffer at different fill levels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ratr0/datastructs/bitset.h>
+
+#define NUM_ITERATIONS (200000)
+#define MAX_WORDS      (1024)
+
+static UINT32 bitset[MAX_WORDS];
+
+static double seconds_since(clock_t start)
+{
+    return ((double) (clock() - start)) / CLOCKS_PER_SEC;
+}
+
+/* The iterator before the leading zero count, for reference */
+static void iterate_bytes(UINT32 *bitset, UINT16 size, void (*func)(UINT16, void *), void *userdata)
+{
+    int i, j, k;
+    UINT8 *bytes, mask, b;
+    for (i = 0; i < size; i++) {
+        if (bitset[i] != 0) {
+            bytes = (UINT8 *) &bitset[i];
+            for (j = 0; j < 4; j++) {
+#ifdef LITTLE_ENDIAN
+                if (bytes[3-j] != 0) {
+                    b = bytes[3-j];
+#else
+                if (bytes[j] != 0) {
+                    b = bytes[j];
+#endif
+                    for (k = 0; k < 8; k++) {
+                        mask = 1 << (7 - k);
+                        if ((b & mask) == mask) {
+                            func((i << 5) + (j << 3) + k, userdata);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void add_index(UINT16 index, void *userdata)
+{
+    *((UINT32 *) userdata) += index;
+}
+
+/* Marks a random fraction of the tiles of a tiles_x by tiles_y grid */
+static UINT16 fill_grid(UINT16 tiles_x, UINT16 tiles_y, int percent)
+{
+    UINT16 shift = ratr0_bitset_row_shift(tiles_x);
+    UINT16 num_words = RATR0_BITSET_GRID_WORDS(shift, tiles_y);
+    ratr0_bitset_clear(bitset, num_words);
+    for (int y = 0; y < tiles_y; y++) {
+        for (int x = 0; x < tiles_x; x++) {
+            if (rand() % 100 < percent) ratr0_bitset_insert(bitset, num_words, (y << shift) + x);
+        }
+    }
+    return num_words;
+}
+
+static void run(const char *name, UINT16 tiles_x, UINT16 tiles_y, int percent)
+{
+    UINT16 num_words = fill_grid(tiles_x, tiles_y, percent);
+    UINT32 sum_bytes = 0, sum_clz = 0;
+
+    clock_t start = clock();
+    for (int i = 0; i < NUM_ITERATIONS; i++) iterate_bytes(bitset, num_words, add_index, &sum_bytes);
+    double t_bytes = seconds_since(start);
+
+    start = clock();
+    for (int i = 0; i < NUM_ITERATIONS; i++) ratr0_bitset_iterate(bitset, num_words, add_index, &sum_clz);
+    double t_clz = seconds_since(start);
+
+    printf("%-10s %3d%%  bytes: %6.3f s  clz: %6.3f s  %s\n", name, percent, t_bytes, t_clz,
+           sum_bytes == sum_clz ? "" : "MISMATCH");
+}
+
+int main(int argc, char **argv)
+{
+    int percents[] = { 2, 10, 50 };
+    srand(1);
+    printf("%d iterations per grid\n", NUM_ITERATIONS);
+    for (int i = 0; i < 3; i++) {
+        run("320x256", 20, 16, percents[i]);
+        run("640x512", 40, 32, percents[i]);
+    }
+    return 0;
+}
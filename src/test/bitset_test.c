@@ -56,6 +56,113 @@ CHIBI_TEST(TestIterate)
     chibi_assert_eq_int(100, result);
 }
 
+CHIBI_TEST(TestIterateAllBits)
+{
+    UINT32 bitset_arr[2] = { 0xffffffff, 0x00000001 };
+    UINT32 result = 0;
+    ratr0_bitset_iterate(bitset_arr, 2, &process_bit, &result);
+    // 0 + 1 + ... + 31 + 63
+    chibi_assert_eq_int(496 + 63, result);
+}
+
+CHIBI_TEST(TestRowShift)
+{
+    chibi_assert_eq_int(0, ratr0_bitset_row_shift(1));
+    // 288 and 320 pixel wide displays
+    chibi_assert_eq_int(5, ratr0_bitset_row_shift(18));
+    chibi_assert_eq_int(5, ratr0_bitset_row_shift(20));
+    chibi_assert_eq_int(5, ratr0_bitset_row_shift(32));
+    chibi_assert_eq_int(6, ratr0_bitset_row_shift(33));
+    // 16 rows of 32 tiles
+    chibi_assert_eq_int(16, RATR0_BITSET_GRID_WORDS(5, 16));
+    chibi_assert_eq_int(1, RATR0_BITSET_GRID_WORDS(2, 3));
+}
+
+struct RectList {
+    int num_rects, covered;
+    UINT16 rects[32][4];
+};
+
+void collect_rect(UINT16 x, UINT16 y, UINT16 w, UINT16 h, void *data)
+{
+    struct RectList *list = (struct RectList *) data;
+    if (list->num_rects < 32) {
+        list->rects[list->num_rects][0] = x;
+        list->rects[list->num_rects][1] = y;
+        list->rects[list->num_rects][2] = w;
+        list->rects[list->num_rects][3] = h;
+    }
+    list->num_rects++;
+    list->covered += w * h;
+}
+
+CHIBI_TEST(TestIterateRects)
+{
+    // a 20x16 grid like the dirty tiles of a 320x256 display
+    UINT32 bitset_arr[10];
+    struct RectList spans = {0}, rects = {0};
+    ratr0_bitset_clear(bitset_arr, 10);
+
+    // a formation of 11x4 tiles and a single tile at the right border
+    for (int y = 2; y < 6; y++) {
+        for (int x = 3; x < 14; x++) ratr0_bitset_insert(bitset_arr, 10, y * 20 + x);
+    }
+    ratr0_bitset_insert(bitset_arr, 10, 7 * 20 + 19);
+    // an L shape: a 2 tile span on top of a 1 tile span
+    ratr0_bitset_insert(bitset_arr, 10, 10 * 20 + 0);
+    ratr0_bitset_insert(bitset_arr, 10, 10 * 20 + 1);
+    ratr0_bitset_insert(bitset_arr, 10, 11 * 20 + 0);
+
+    ratr0_bitset_iterate_rects(bitset_arr, 10, 20, FALSE, collect_rect, &spans);
+    chibi_assert_eq_int(7, spans.num_rects);
+    chibi_assert_eq_int(48, spans.covered);
+
+    ratr0_bitset_iterate_rects(bitset_arr, 10, 20, TRUE, collect_rect, &rects);
+    chibi_assert_eq_int(4, rects.num_rects);
+    chibi_assert_eq_int(48, rects.covered);
+    // the formation is the first rectangle that is complete
+    chibi_assert_eq_int(3, rects.rects[0][0]);
+    chibi_assert_eq_int(2, rects.rects[0][1]);
+    chibi_assert_eq_int(11, rects.rects[0][2]);
+    chibi_assert_eq_int(4, rects.rects[0][3]);
+    // the L shape can't be merged
+    chibi_assert_eq_int(2, rects.rects[2][2]);
+    chibi_assert_eq_int(1, rects.rects[2][3]);
+
+    // the same tiles with a power of 2 row stride
+    UINT32 grid32[16];
+    struct RectList rects32 = {0};
+    ratr0_bitset_clear(grid32, 16);
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 20; x++) {
+            if (ratr0_bitset_isset(bitset_arr, 10, y * 20 + x)) {
+                ratr0_bitset_insert(grid32, 16, (y << 5) + x);
+            }
+        }
+    }
+    ratr0_bitset_iterate_rects(grid32, 16, 32, TRUE, collect_rect, &rects32);
+    chibi_assert_eq_int(4, rects32.num_rects);
+    chibi_assert(memcmp(rects.rects, rects32.rects, sizeof(UINT16) * 4 * 4) == 0);
+}
+
+CHIBI_TEST(TestIterateRectsWideRows)
+{
+    // a 128x2 grid like the dirty tiles of a 2048 pixel wide buffer
+    UINT32 grid[8];
+    struct RectList rects = {0};
+    ratr0_bitset_clear(grid, 8);
+    // more runs in a row than fit the run lists
+    for (int x = 0; x < 128; x += 2) ratr0_bitset_insert(grid, 8, x);
+    ratr0_bitset_insert(grid, 8, 128 + 100);
+    ratr0_bitset_insert(grid, 8, 128 + 101);
+
+    ratr0_bitset_iterate_rects(grid, 8, 128, TRUE, collect_rect, &rects);
+    chibi_assert_eq_int(66, rects.num_rects);
+    chibi_assert_eq_int(66, rects.covered);
+    chibi_assert_eq_int(2, rects.rects[1][0]);
+    chibi_assert_eq_int(0, rects.rects[1][1]);
+}
+
 /*
  * SUITE DEFINITION
  */
@@ -67,6 +174,10 @@ chibi_suite *CoreSuite(void)
     chibi_suite_add_test(suite, TestClearBitSet);
     chibi_suite_add_test(suite, TestInsertIsSet);
     chibi_suite_add_test(suite, TestIterate);
+    chibi_suite_add_test(suite, TestIterateAllBits);
+    chibi_suite_add_test(suite, TestRowShift);
+    chibi_suite_add_test(suite, TestIterateRects);
+    chibi_suite_add_test(suite, TestIterateRectsWideRows);
 
     return suite;
 }
@@ -0,0 +1,92 @@
+/*
+ * Blit budget report. Renders a typical frame of a BOB based game, 16x16
+ * pixel dirty rectangle restores followed by 16x16 pixel BOBs, on the
+ * host blitter model and compares the estimated blitter DMA cycles with
+ * the PAL frame budget for 1 to 5 bitplanes, with and without BLITHOG.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/resources.h>
+#include <ratr0/blitter.h>
+#include <ratr0/blitter_emu.h>
+
+#define DISPLAY_WIDTH  (320)
+#define DISPLAY_HEIGHT (256)
+#define MAX_DEPTH      (5)
+#define NUM_BOBS       (20)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemoryConfig mem_config = {
+    16384, 10,
+    2 * DISPLAY_WIDTH / 8 * DISPLAY_HEIGHT * MAX_DEPTH + 16384, 10,
+    0
+};
+
+static void render_frame(struct Ratr0Surface *backbuffer, struct Ratr0Surface *backdrop,
+                         struct Ratr0TileSheet *bobs)
+{
+    // every BOB dirties 2x2 tiles
+    ratr0_blitter_set_site(RATR0_BLIT_SITE_RESTORE);
+    for (int i = 0; i < NUM_BOBS; i++) {
+        int x = (i * 48) % (DISPLAY_WIDTH - 32), y = (i * 40) % (DISPLAY_HEIGHT - 32);
+        for (int ty = 0; ty < 2; ty++) {
+            for (int tx = 0; tx < 2; tx++) {
+                int rx = (x & ~15) + tx * 16, ry = (y & ~15) + ty * 16;
+                ratr0_blit_rect_simple(backbuffer, backdrop, rx, ry, rx, ry, 16, 16);
+                WaitBlit();
+            }
+        }
+    }
+    ratr0_blitter_set_site(RATR0_BLIT_SITE_BOBS);
+    for (int i = 0; i < NUM_BOBS; i++) {
+        int x = (i * 48) % (DISPLAY_WIDTH - 32) + 3, y = (i * 40) % (DISPLAY_HEIGHT - 32);
+        ratr0_blit_object_il(backbuffer, bobs, 0, 0, x, y);
+        WaitBlit();
+    }
+    ratr0_blitter_set_site(RATR0_BLIT_SITE_OTHER);
+}
+
+int main(int argc, char **argv)
+{
+    ratr0_memory_startup(&mock_engine, &mem_config);
+    UINT32 buffer_size = DISPLAY_WIDTH / 8 * DISPLAY_HEIGHT * MAX_DEPTH;
+    Ratr0MemHandle h_back = ratr0_memory_allocate_block(RATR0_MEM_CHIP, buffer_size);
+    Ratr0MemHandle h_backdrop = ratr0_memory_allocate_block(RATR0_MEM_CHIP, buffer_size);
+
+    printf("%d BOBs of 16x16 pixels on a %dx%d display\n", NUM_BOBS, DISPLAY_WIDTH,
+           DISPLAY_HEIGHT);
+    printf("depth   cycles   budget (hog)  budget (no hog)\n");
+    for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+        struct Ratr0Surface backbuffer = { DISPLAY_WIDTH, DISPLAY_HEIGHT, depth, TRUE,
+                                           ratr0_memory_block_address(h_back) };
+        struct Ratr0Surface backdrop = backbuffer;
+        backdrop.buffer = ratr0_memory_block_address(h_backdrop);
+
+        struct Ratr0TileSheet bobs;
+        memset(&bobs, 0, sizeof(bobs));
+        bobs.header.bmdepth = depth;
+        bobs.header.width = bobs.header.tile_width = 16;
+        bobs.header.height = bobs.header.tile_height = 16;
+        bobs.h_imgdata = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 2 * 16 * 2 * depth);
+
+        UINT32 hog_budget = ratr0_blitter_frame_budget(DISPLAY_WIDTH, DISPLAY_HEIGHT, depth, TRUE);
+        UINT32 budget = ratr0_blitter_frame_budget(DISPLAY_WIDTH, DISPLAY_HEIGHT, depth, FALSE);
+        ratr0_blitter_reset_profile();
+        ratr0_blitter_set_frame_budget(budget);
+        render_frame(&backbuffer, &backdrop, &bobs);
+        BOOL over_budget = ratr0_blitter_end_frame();
+
+        struct Ratr0BlitProfile profile;
+        ratr0_blitter_profile(&profile);
+        printf("%5d %8u %14u %16u%s\n", depth, profile.last_frame.cycles, hog_budget, budget,
+               over_budget ? "  OVER BUDGET" : "");
+        if (depth == MAX_DEPTH) ratr0_blitter_dump_profile(stdout);
+        ratr0_memory_free_block(bobs.h_imgdata);
+        // the next depth reuses the addresses of the surfaces and the sheet
+        ratr0_blitter_flush_cache();
+    }
+    return 0;
+}
@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/resources.h>
+#include <ratr0/blitter.h>
+#include <ratr0/blitter_emu.h>
+#include "../../chibi_test/chibi.h"
+
+#define SURFACE_WIDTH  (64)
+#define SURFACE_HEIGHT (16)
+#define SURFACE_DEPTH  (2)
+#define SURFACE_BYTES  (SURFACE_WIDTH / 8 * SURFACE_HEIGHT * SURFACE_DEPTH)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    4096, 10,
+    4096, 10,
+    0
+};
+static UINT8 dst_buffer[SURFACE_BYTES], src_buffer[SURFACE_BYTES];
+static struct Ratr0Surface dst, src;
+
+void blittertest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    ratr0_blitter_emu_reset();
+    ratr0_blitter_startup(&mock_engine);
+    struct Ratr0Surface surface = { SURFACE_WIDTH, SURFACE_HEIGHT, SURFACE_DEPTH, TRUE, NULL };
+    dst = src = surface;
+    dst.buffer = dst_buffer;
+    src.buffer = src_buffer;
+    memset(dst_buffer, 0, SURFACE_BYTES);
+    for (int i = 0; i < SURFACE_BYTES; i++) src_buffer[i] = (i * 37 + 11) & 0xff;
+}
+
+void blittertest_teardown(void *userdata)
+{
+    ratr0_blitter_shutdown();
+    memsys->shutdown();
+}
+
+/*
+ * Reference pixel access for interleaved bitmaps, bit 7 of a byte is the
+ * leftmost pixel
+ */
+static int get_pixel(UINT8 *buffer, int width, int depth, int x, int y)
+{
+    int row_bytes = width / 8, color = 0;
+    for (int p = 0; p < depth; p++) {
+        UINT8 byte = buffer[(y * depth + p) * row_bytes + x / 8];
+        color |= ((byte >> (7 - (x & 7))) & 1) << p;
+    }
+    return color;
+}
+
+static void set_pixel(UINT8 *buffer, int width, int depth, int x, int y, int color)
+{
+    int row_bytes = width / 8;
+    for (int p = 0; p < depth; p++) {
+        UINT8 *byte = &buffer[(y * depth + p) * row_bytes + x / 8];
+        UINT8 bit = 0x80 >> (x & 7);
+        if (color & (1 << p)) *byte |= bit;
+        else *byte &= ~bit;
+    }
+}
+
+/* Runs a 1 word blit on the data registers only */
+static UINT16 blit_data(UINT16 con0, UINT16 con1, UINT16 a, UINT16 b, UINT16 c)
+{
+    UINT8 result[2];
+    custom.bltcon0 = con0 | 0x0100;
+    custom.bltcon1 = con1;
+    custom.bltafwm = custom.bltalwm = 0xffff;
+    custom.bltadat = a;
+    custom.bltbdat = b;
+    custom.bltcdat = c;
+    custom.bltdpt = result;
+    custom.bltdmod = 0;
+    custom.bltsize = (1 << 6) | 1;
+    WaitBlit();
+    return (result[0] << 8) | result[1];
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestAllMinterms)
+{
+    UINT16 a = 0xff00, b = 0xf0f0, c = 0xcccc;
+    for (int lf = 0; lf < 256; lf++) {
+        UINT16 d = blit_data(lf, 0, a, b, c);
+        for (int i = 0; i < 16; i++) {
+            int index = (((a >> i) & 1) << 2) | (((b >> i) & 1) << 1) | ((c >> i) & 1);
+            chibi_assert_eq_int((lf >> index) & 1, (d >> i) & 1);
+        }
+    }
+}
+
+CHIBI_TEST(TestBZero)
+{
+    // D = A & B
+    blit_data(0x00c0, 0, 0xff00, 0x00ff, 0);
+    chibi_assert(custom.dmaconr & RATR0_DMAF_BZERO);
+    blit_data(0x00c0, 0, 0xff00, 0x0f0f, 0);
+    chibi_assert((custom.dmaconr & RATR0_DMAF_BZERO) == 0);
+}
+
+CHIBI_TEST(TestFillModes)
+{
+    // D = A, descending
+    chibi_assert_eq_int(0x7ffe, blit_data(0x00f0, RATR0_BC1F_DESC | RATR0_BC1F_IFE,
+                                          0x4002, 0, 0));
+    chibi_assert_eq_int(0x3ffe, blit_data(0x00f0, RATR0_BC1F_DESC | RATR0_BC1F_EFE,
+                                          0x4002, 0, 0));
+    // the carry in fills everything right of the first edge
+    chibi_assert_eq_int(0x3fff, blit_data(0x00f0, RATR0_BC1F_DESC | RATR0_BC1F_FCI |
+                                          RATR0_BC1F_EFE, 0x4000, 0, 0));
+}
+
+CHIBI_TEST(TestShiftAndDirection)
+{
+    UINT8 data[4] = { 0x12, 0x34, 0x56, 0x78 };
+    UINT8 result[4];
+
+    // ascending: A shifted right by 4 pixels
+    custom.bltcon0 = 0x49f0;
+    custom.bltcon1 = 0;
+    custom.bltafwm = custom.bltalwm = 0xffff;
+    custom.bltamod = custom.bltdmod = 0;
+    custom.bltapt = data;
+    custom.bltdpt = result;
+    custom.bltsize = (1 << 6) | 2;
+    WaitBlit();
+    chibi_assert(result[0] == 0x01 && result[1] == 0x23 && result[2] == 0x45 && result[3] == 0x67);
+    // the pointers continue after the blit
+    chibi_assert(custom.bltapt == data + 4);
+
+    // descending: the pointers start at the last word, shifts go to the left
+    custom.bltcon1 = RATR0_BC1F_DESC;
+    custom.bltapt = data + 2;
+    custom.bltdpt = result + 2;
+    custom.bltsize = (1 << 6) | 2;
+    WaitBlit();
+    chibi_assert(result[0] == 0x23 && result[1] == 0x45 && result[2] == 0x67 && result[3] == 0x80);
+}
+
+CHIBI_TEST(TestRectSimple)
+{
+    ratr0_blit_rect_simple(&dst, &src, 16, 3, 32, 1, 32, 4);
+    WaitBlit();
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            int expected = 0;
+            if (x >= 16 && x < 48 && y >= 3 && y < 7) {
+                expected = get_pixel(src_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x + 16, y - 2);
+            }
+            chibi_assert_eq_int(expected, get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y));
+        }
+    }
+}
+
+CHIBI_TEST(TestRectSimpleOverlapping)
+{
+    UINT8 expected[SURFACE_BYTES];
+    memcpy(expected, src_buffer, SURFACE_BYTES);
+    // moving the whole surface down by 2 lines needs a descending blit
+    memmove(expected + 2 * 16, expected, 8 * 16);
+    ratr0_blit_rect_simple(&src, &src, 0, 2, 0, 0, SURFACE_WIDTH, 8);
+    WaitBlit();
+    chibi_assert(memcmp(expected, src_buffer, SURFACE_BYTES) == 0);
+}
+
+CHIBI_TEST(TestRectSimpleSaveUnder)
+{
+    // save an area into a surface of its own size and put it back, the
+    // restore runs descending because the destination is below the source
+    UINT8 expected[SURFACE_BYTES], saved_buffer[4 * 4 * SURFACE_DEPTH];
+    struct Ratr0Surface saved = { 32, 4, SURFACE_DEPTH, TRUE, saved_buffer };
+    struct Ratr0BlitDescriptor desc;
+    memcpy(expected, src_buffer, SURFACE_BYTES);
+    ratr0_blit_prepare_rect_simple(&desc, &saved, &src, 0, 0, 16, 3, 32, 4);
+    ratr0_blit_enqueue(&desc);
+    ratr0_blit_prepare_clear16(&desc, &src, 16, 3, 32, 4);
+    ratr0_blit_enqueue(&desc);
+    ratr0_blitter_wait_queue();
+    chibi_assert_eq_int(0, get_pixel(src_buffer, SURFACE_WIDTH, SURFACE_DEPTH, 20, 4));
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 32; x++) {
+            chibi_assert_eq_int(get_pixel(expected, SURFACE_WIDTH, SURFACE_DEPTH, x + 16, y + 3),
+                                get_pixel(saved_buffer, 32, SURFACE_DEPTH, x, y));
+        }
+    }
+    ratr0_blit_prepare_rect_simple(&desc, &src, &saved, 16, 3, 0, 0, 32, 4);
+    ratr0_blit_enqueue(&desc);
+    ratr0_blitter_wait_queue();
+    chibi_assert(memcmp(expected, src_buffer, SURFACE_BYTES) == 0);
+}
+
+CHIBI_TEST(TestClear16)
+{
+    memset(dst_buffer, 0xff, SURFACE_BYTES);
+    ratr0_blit_clear16(&dst, 16, 2, 32, 5);
+    WaitBlit();
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            int expected = (x >= 16 && x < 48 && y >= 2 && y < 7) ? 0 : 3;
+            chibi_assert_eq_int(expected, get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y));
+        }
+    }
+}
+
+CHIBI_TEST(TestPrepareClear16)
+{
+    struct Ratr0BlitDescriptor desc;
+    memset(dst_buffer, 0xff, SURFACE_BYTES);
+    ratr0_blit_prepare_clear16(&desc, &dst, 16, 2, 32, 3);
+    ratr0_blit_enqueue(&desc);
+    ratr0_blitter_wait_queue();
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            int expected = (x >= 16 && x < 48 && y >= 2 && y < 5) ? 0 : 3;
+            chibi_assert_eq_int(expected, get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y));
+        }
+    }
+}
+
+CHIBI_TEST(TestClear8)
+{
+    memset(dst_buffer, 0xff, SURFACE_BYTES);
+    ratr0_blit_clear8(&dst, 8, 1, 8, 2);
+    WaitBlit();
+    ratr0_blit_clear8(&dst, 36, 5, 16, 3);
+    WaitBlit();
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            BOOL cleared = (x >= 8 && x < 16 && y >= 1 && y < 3) ||
+                (x >= 36 && x < 52 && y >= 5 && y < 8);
+            chibi_assert_eq_int(cleared ? 0 : 3,
+                                get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y));
+        }
+    }
+}
+
+CHIBI_TEST(TestBlitAdD)
+{
+    memset(dst_buffer, 0x11, SURFACE_BYTES);
+    UINT8 before[SURFACE_BYTES];
+    memcpy(before, dst_buffer, SURFACE_BYTES);
+    // D = A | B, 16 pixels shifted by 4, the extra word is masked out
+    ratr0_blit_ad_d(&dst, &src, 0, 0, 16, 4, 0xfc, 4, 0xffff, 0x0000, 2, 3);
+    WaitBlit();
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            int expected = get_pixel(before, SURFACE_WIDTH, SURFACE_DEPTH, x, y);
+            if (x >= 20 && x < 36 && y >= 4 && y < 7) {
+                expected |= get_pixel(src_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x - 20, y - 4);
+            }
+            chibi_assert_eq_int(expected, get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y));
+        }
+    }
+}
+
+/*
+ * Builds an interleaved tile sheet with 2 tiles of 16x8 pixels and a mask
+ * that is stored after the image planes
+ */
+static void make_bobs(struct Ratr0TileSheet *bobs, int depth)
+{
+    int width = 32, height = 8, row_bytes = width / 8;
+    int plane_bytes = row_bytes * height * depth;
+    memset(bobs, 0, sizeof(struct Ratr0TileSheet));
+    bobs->header.bmdepth = depth;
+    bobs->header.width = width;
+    bobs->header.height = height;
+    bobs->header.tile_width = 16;
+    bobs->header.tile_height = height;
+    bobs->h_imgdata = ratr0_memory_allocate_block(RATR0_MEM_CHIP, plane_bytes * 2);
+    UINT8 *imgdata = ratr0_memory_block_address(bobs->h_imgdata);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // a diamond in each tile
+            int dx = (x & 15) - 8, dy = y - 4;
+            BOOL inside = abs(dx) + abs(dy) < 5;
+            set_pixel(imgdata, width, depth, x, y, inside ? ((x + y) % 3) + 1 : 0);
+            // the mask has the same layout as the image
+            set_pixel(imgdata + plane_bytes, width, depth, x, y, inside ? (1 << depth) - 1 : 0);
+        }
+    }
+}
+
+/* Compares the destination with tile 1 of make_bobs() cookie cut at dstx, dsty */
+static BOOL check_bob(UINT8 *before, UINT8 *imgdata, int dstx, int dsty)
+{
+    for (int y = 0; y < SURFACE_HEIGHT; y++) {
+        for (int x = 0; x < SURFACE_WIDTH; x++) {
+            int expected = get_pixel(before, SURFACE_WIDTH, SURFACE_DEPTH, x, y);
+            int tx = x - dstx, ty = y - dsty;
+            if (tx >= 0 && tx < 16 && ty >= 0 && ty < 8 &&
+                get_pixel(imgdata + 64, 32, SURFACE_DEPTH, tx + 16, ty)) {
+                expected = get_pixel(imgdata, 32, SURFACE_DEPTH, tx + 16, ty);
+            }
+            if (expected != get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, x, y)) return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+CHIBI_TEST(TestBlitObjectIl)
+{
+    struct Ratr0TileSheet bobs;
+    make_bobs(&bobs, SURFACE_DEPTH);
+    UINT8 *imgdata = ratr0_memory_block_address(bobs.h_imgdata);
+    memset(dst_buffer, 0x5a, SURFACE_BYTES);
+    UINT8 before[SURFACE_BYTES];
+    memcpy(before, dst_buffer, SURFACE_BYTES);
+
+    ratr0_blit_object_il(&dst, &bobs, 1, 0, 21, 3);
+    WaitBlit();
+    chibi_assert(check_bob(before, imgdata, 21, 3));
+}
+
+CHIBI_TEST(TestCompiledBlitCache)
+{
+    struct Ratr0TileSheet bobs;
+    make_bobs(&bobs, SURFACE_DEPTH);
+    UINT8 *imgdata = ratr0_memory_block_address(bobs.h_imgdata);
+    UINT8 before[SURFACE_BYTES];
+    memset(before, 0xa5, SURFACE_BYTES);
+
+    struct Ratr0CompiledBlit *blit = ratr0_blit_compile_object(&dst, &bobs, 1, 0, TRUE);
+    chibi_assert(blit == ratr0_blit_compile_object(&dst, &bobs, 1, 0, TRUE));
+    chibi_assert(blit->tilex == 1 && blit->bobs == &bobs);
+    // the diamond covers pixels 4-12, so shifts up to 3 fit into one word
+    chibi_assert_eq_int(4, blit->wide_shift);
+    struct Ratr0BlitDescriptor desc;
+    ratr0_blit_prepare_compiled(&desc, blit, 3, 5);
+    chibi_assert_eq_int((8 * SURFACE_DEPTH << 6) | 1, desc.bltsize);
+    ratr0_blit_prepare_compiled(&desc, blit, 4, 5);
+    chibi_assert_eq_int((8 * SURFACE_DEPTH << 6) | 2, desc.bltsize);
+
+    // all shifts from the cached entry
+    for (int dstx = 0; dstx <= 16; dstx++) {
+        memcpy(dst_buffer, before, SURFACE_BYTES);
+        ratr0_blit_object_il(&dst, &bobs, 1, 0, dstx, 5);
+        WaitBlit();
+        chibi_assert(check_bob(before, imgdata, dstx, 5));
+    }
+    ratr0_blitter_flush_cache();
+    chibi_assert(blit->bobs == NULL);
+}
+
+CHIBI_TEST(TestBlitRect1Plane)
+{
+    struct Ratr0TileSheet bobs;
+    make_bobs(&bobs, 1);
+    UINT8 *imgdata = ratr0_memory_block_address(bobs.h_imgdata);
+    dst.depth = 1;
+
+    ratr0_blit_rect_1plane(&dst, &bobs, 0, 0, 32, 2);
+    WaitBlit();
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 16; x++) {
+            chibi_assert_eq_int(get_pixel(imgdata, 32, 1, x, y),
+                                get_pixel(dst_buffer, SURFACE_WIDTH, 1, x + 32, y + 2));
+        }
+    }
+}
+
+CHIBI_TEST(TestBlitCycles)
+{
+    // ABCD: 4 cycles per word
+    chibi_assert_eq_int(2 * 16 * 4, ratr0_blitter_blit_cycles(0x0fca, (16 << 6) | 2));
+    // AD: 2 cycles per word, a size of 0 means 1024 lines of 64 words
+    chibi_assert_eq_int(64 * 1024 * 2, ratr0_blitter_blit_cycles(0x09f0, 0));
+    // 320x256 with 4 bitplanes, without BLITHOG the CPU gets every 4th cycle
+    chibi_assert_eq_int(313 * 200 - 256 * 4 * 20, ratr0_blitter_frame_budget(320, 256, 4, TRUE));
+    chibi_assert_eq_int((313 * 200 - 256 * 4 * 20) * 3 / 4,
+                        ratr0_blitter_frame_budget(320, 256, 4, FALSE));
+}
+
+CHIBI_TEST(TestFrameOverBudget)
+{
+    struct Ratr0BlitProfile profile;
+    ratr0_blitter_set_frame_budget(50);
+    ratr0_blit_clear16(&dst, 0, 0, 32, 8);
+    WaitBlit();
+    ratr0_blitter_set_site(RATR0_BLIT_SITE_RESTORE);
+    ratr0_blit_rect_simple(&dst, &src, 0, 0, 0, 0, 16, 4);
+    WaitBlit();
+    chibi_assert(ratr0_blitter_end_frame());
+    chibi_assert(!ratr0_blitter_end_frame());
+
+    ratr0_blitter_profile(&profile);
+    chibi_assert_eq_int(2, profile.num_frames);
+    chibi_assert_eq_int(1, profile.frames_over_budget);
+    chibi_assert_eq_int(0, profile.last_frame.cycles);
+    // D only: 2 words * 16 lines * 2 cycles, AD: 1 word * 8 lines * 2 cycles
+    chibi_assert_eq_int(64, profile.peak_frame.sites[RATR0_BLIT_SITE_OTHER].cycles);
+    chibi_assert_eq_int(16, profile.peak_frame.sites[RATR0_BLIT_SITE_RESTORE].cycles);
+    chibi_assert_eq_int(80, profile.peak_frame.cycles);
+    chibi_assert_eq_int(2, profile.peak_frame.num_blits);
+}
+
+CHIBI_TEST(TestBlitQueue)
+{
+    struct Ratr0BlitDescriptor desc;
+    struct Ratr0BlitProfile profile;
+    // more blits than the queue can hold, each row of each word column
+    // is copied 3 times
+    for (int i = 0; i < 192; i++) {
+        int row = i % SURFACE_HEIGHT, x = ((i / SURFACE_HEIGHT) % 4) * 16;
+        ratr0_blit_prepare_rect_simple(&desc, &dst, &src, x, row, x, row, 16, 1);
+        ratr0_blit_enqueue(&desc);
+    }
+    ratr0_blitter_wait_queue();
+    chibi_assert(memcmp(src_buffer, dst_buffer, SURFACE_BYTES) == 0);
+    chibi_assert_eq_int(192, ratr0_blitter_emu_num_blits());
+
+    // a direct blit waits for the queue
+    ratr0_blit_prepare_rect_simple(&desc, &dst, &src, 0, 0, 16, 0, 16, 1);
+    ratr0_blit_enqueue(&desc);
+    ratr0_blit_clear16(&dst, 0, 0, 16, 1);
+    WaitBlit();
+    chibi_assert_eq_int(0, get_pixel(dst_buffer, SURFACE_WIDTH, SURFACE_DEPTH, 3, 0));
+    chibi_assert_eq_int(194, ratr0_blitter_emu_num_blits());
+
+    // queued blits are counted when they are enqueued
+    ratr0_blitter_end_frame();
+    ratr0_blitter_profile(&profile);
+    chibi_assert_eq_int(194, profile.last_frame.num_blits);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.BlitterSuite", blittertest_setup,
+                                                 blittertest_teardown, NULL);
+    chibi_suite_add_test(suite, TestAllMinterms);
+    chibi_suite_add_test(suite, TestBZero);
+    chibi_suite_add_test(suite, TestFillModes);
+    chibi_suite_add_test(suite, TestShiftAndDirection);
+    chibi_suite_add_test(suite, TestRectSimple);
+    chibi_suite_add_test(suite, TestRectSimpleOverlapping);
+    chibi_suite_add_test(suite, TestRectSimpleSaveUnder);
+    chibi_suite_add_test(suite, TestClear16);
+    chibi_suite_add_test(suite, TestPrepareClear16);
+    chibi_suite_add_test(suite, TestClear8);
+    chibi_suite_add_test(suite, TestBlitAdD);
+    chibi_suite_add_test(suite, TestBlitObjectIl);
+    chibi_suite_add_test(suite, TestCompiledBlitCache);
+    chibi_suite_add_test(suite, TestBlitRect1Plane);
+    chibi_suite_add_test(suite, TestBlitCycles);
+    chibi_suite_add_test(suite, TestFrameOverBudget);
+    chibi_suite_add_test(suite, TestBlitQueue);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
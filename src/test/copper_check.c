@@ -0,0 +1,60 @@
+/*
+ * Copper list checker. Translates .copper files, runs them on the host
+ * copper model for a PAL frame and reports the problems it finds.
+ *
+ * usage: copper_check [-d] [-w] [-p <bitplanes>] file.copper...
+ *
+ *   -d  write a disassembly of each list
+ *   -w  write the register writes with their beam positions
+ *   -p  number of bitplanes if the list doesn't set BPLCON0, default 5
+ *
+ * Exits with 1 if a list has errors, warnings don't change the exit code.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/copper_emu.h>
+
+#define MAX_WORDS (4096)
+
+static UINT16 words[MAX_WORDS];
+static struct Ratr0CopperEmu emu;
+
+int main(int argc, char **argv)
+{
+    BOOL disassemble = FALSE, print_writes = FALSE;
+    int num_errors = 0;
+    emu.num_bitplanes = 5;
+    emu.danger = FALSE;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d")) {
+            disassemble = TRUE;
+        } else if (!strcmp(argv[i], "-w")) {
+            print_writes = TRUE;
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            emu.num_bitplanes = atoi(argv[++i]);
+        } else {
+            FILE *fp = fopen(argv[i], "r");
+            if (!fp) {
+                fprintf(stderr, "%s: can't open file\n", argv[i]);
+                num_errors++;
+                continue;
+            }
+            int num_words = ratr0_copper_emu_assemble(fp, argv[i], words, MAX_WORDS);
+            fclose(fp);
+            if (num_words < 0) {
+                num_errors++;
+                continue;
+            }
+            ratr0_copper_emu_run(&emu, words, num_words);
+            if (disassemble) ratr0_copper_emu_disassemble(words, num_words, stdout);
+            if (print_writes) ratr0_copper_emu_print_writes(&emu, stdout);
+            ratr0_copper_emu_print_issues(&emu, argv[i], stdout);
+            printf("%s: %d words, %d writes, %d errors, %d warnings\n", argv[i], num_words,
+                   emu.num_writes, emu.num_errors, emu.num_issues - emu.num_errors);
+            num_errors += emu.num_errors;
+        }
+    }
+    return num_errors > 0 ? 1 : 0;
+}
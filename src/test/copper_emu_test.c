@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include <ratr0/hw_registers.h>
+#include <ratr0/copper_emu.h>
+#include "../../chibi_test/chibi.h"
+
+#define MAX_WORDS (256)
+
+static struct Ratr0CopperEmu emu;
+static UINT16 words[MAX_WORDS];
+
+void copperemutest_setup(void *userdata)
+{
+    memset(&emu, 0, sizeof(struct Ratr0CopperEmu));
+}
+
+void copperemutest_teardown(void *userdata) { }
+
+static int assemble(const char *source)
+{
+    FILE *fp = fmemopen((void *) source, strlen(source), "r");
+    int num_words = ratr0_copper_emu_assemble(fp, "test", words, MAX_WORDS);
+    fclose(fp);
+    return num_words;
+}
+
+/* Assembles and runs the source, returns the number of issues */
+static int run(const char *source)
+{
+    int num_words = assemble(source);
+    if (num_words < 0) return -1;
+    ratr0_copper_emu_run(&emu, words, num_words);
+    return emu.num_issues;
+}
+
+/* A WAIT followed by num_moves color MOVEs */
+static const char *moves_after_wait(const char *wait, int num_moves)
+{
+    static char source[2048];
+    strcpy(source, wait);
+    for (int i = 0; i < num_moves; i++) strcat(source, "MOVE COLOR01,0\n");
+    strcat(source, "END\n");
+    return source;
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestCopperEmuAssemble)
+{
+    chibi_assert_eq_int(10, assemble("# comment\n"
+                                     "LABEL_INDEX:\n"
+                                     "    MOVE  DDFSTRT,DDFSTRT_VALUE_320\n"
+                                     "    move  color17,$0f0   # green\n"
+                                     "    WAIT  0xe0,0xf3\n"
+                                     "    SKIP  0,0x10\n"
+                                     "    END\n"));
+    UINT16 expected[] = { DDFSTRT, 0x38, COLOR17, 0x0f0, 0xf3e1, 0xfffe, 0x1001, 0xffff,
+                          0xffff, 0xfffe };
+    chibi_assert(memcmp(expected, words, sizeof(expected)) == 0);
+
+    chibi_assert_eq_int(-1, assemble("MOVE NOREG,0\n"));
+    chibi_assert_eq_int(-1, assemble("MOVE COLOR00\n"));
+    chibi_assert_eq_int(-1, assemble("WAIT 0x100,0x10\n"));
+    chibi_assert_eq_int(-1, assemble("JUMP 0\n"));
+    chibi_assert_eq_int(-1, assemble("END 1\n"));
+}
+
+CHIBI_TEST(TestCopperEmuWrites)
+{
+    chibi_assert_eq_int(0, run("MOVE COLOR00,0x123\n"
+                               "WAIT 0x40,0x80\n"
+                               "MOVE COLOR00,0x456\n"
+                               "WAIT 0xde,0xff\n"
+                               "WAIT 0x00,0x10\n"
+                               "MOVE COLOR00,0x789\n"
+                               "END\n"));
+    chibi_assert_eq_int(3, emu.num_writes);
+    chibi_assert_eq_int(0, emu.writes[0].vpos);
+    chibi_assert_eq_int(COLOR00, emu.writes[0].reg);
+    chibi_assert_eq_int(0x123, emu.writes[0].value);
+    chibi_assert_eq_int(0x80, emu.writes[1].vpos);
+    chibi_assert(emu.writes[1].hpos > 0x40 && emu.writes[1].hpos < 0x50);
+    // past line 255, the next WAIT compares the low 8 bits
+    chibi_assert_eq_int(0x110, emu.writes[2].vpos);
+}
+
+CHIBI_TEST(TestCopperEmuRegisters)
+{
+    chibi_assert_eq_int(1, run("MOVE COPCON,2\nMOVE COLOR00,0\nEND\n"));
+    chibi_assert_eq_int(RATR0_COPPER_ILLEGAL_REGISTER, emu.issues[0].type);
+    chibi_assert_eq_int(0, emu.num_writes);
+
+    chibi_assert_eq_int(1, run("MOVE BLTSIZE,0x41\nEND\n"));
+    chibi_assert_eq_int(RATR0_COPPER_PROTECTED_REGISTER, emu.issues[0].type);
+    chibi_assert_eq_int(1, emu.num_errors);
+    emu.danger = TRUE;
+    chibi_assert_eq_int(0, run("MOVE BLTSIZE,0x41\nEND\n"));
+}
+
+CHIBI_TEST(TestCopperEmuWaits)
+{
+    // line 352 doesn't exist in a PAL frame
+    chibi_assert_eq_int(1, run("WAIT 0xde,0xff\nWAIT 0xe0,0x60\nEND\n"));
+    chibi_assert_eq_int(RATR0_COPPER_UNREACHABLE_WAIT, emu.issues[0].type);
+    chibi_assert_eq_int(1, emu.num_errors);
+
+    chibi_assert_eq_int(1, run("WAIT 0,0x80\nWAIT 0,0x40\nEND\n"));
+    chibi_assert_eq_int(RATR0_COPPER_PASSED_WAIT, emu.issues[0].type);
+    chibi_assert_eq_int(0, emu.num_errors);
+
+    chibi_assert_eq_int(1, run("MOVE COLOR00,0\n"));
+    chibi_assert_eq_int(RATR0_COPPER_MISSING_END, emu.issues[0].type);
+}
+
+CHIBI_TEST(TestCopperEmuOverrun)
+{
+    // MOVEs that start at the end of a line have until the display fetch
+    // of the next line
+    chibi_assert_eq_int(0, run(moves_after_wait("WAIT 0xe0,0x80\n", 10)));
+    chibi_assert_eq_int(1, run(moves_after_wait("WAIT 0xe0,0x80\n", 20)));
+    chibi_assert_eq_int(RATR0_COPPER_LINE_OVERRUN, emu.issues[0].type);
+    chibi_assert_eq_int(0, emu.num_errors);
+}
+
+CHIBI_TEST(TestCopperEmuBitplaneDMA)
+{
+    // in the fetch window, 5 bitplanes leave 3 of 4 even slots, 6 leave 2
+    for (int planes = 0; planes <= 6; planes++) {
+        emu.num_bitplanes = planes;
+        chibi_assert_eq_int(0, run(moves_after_wait("WAIT 0x40,0x80\n", 9)));
+        int clocks = emu.writes[8].hpos - emu.writes[0].hpos;
+        if (planes < 5) chibi_assert_eq_int(32, clocks);
+        else if (planes == 5) chibi_assert(clocks > 40 && clocks < 46);
+        else chibi_assert_eq_int(64, clocks);
+    }
+    // the list's BPLCON0 decides
+    emu.num_bitplanes = 0;
+    chibi_assert_eq_int(0, run(moves_after_wait("MOVE BPLCON0,0x6200\nWAIT 0x40,0x80\n", 9)));
+    chibi_assert_eq_int(64, emu.writes[9].hpos - emu.writes[1].hpos);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.CopperEmuSuite", copperemutest_setup,
+                                                 copperemutest_teardown, NULL);
+    chibi_suite_add_test(suite, TestCopperEmuAssemble);
+    chibi_suite_add_test(suite, TestCopperEmuWrites);
+    chibi_suite_add_test(suite, TestCopperEmuRegisters);
+    chibi_suite_add_test(suite, TestCopperEmuWaits);
+    chibi_suite_add_test(suite, TestCopperEmuOverrun);
+    chibi_suite_add_test(suite, TestCopperEmuBitplaneDMA);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/hw_registers.h>
+#include <ratr0/copper.h>
+#include <ratr0/copper_emu.h>
+#include "../../chibi_test/chibi.h"
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    4096, 10,
+    16384, 10,
+    0
+};
+static struct Ratr0CopperList list;
+
+void coppertest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    ratr0_copper_init(&list, 256);
+}
+
+void coppertest_teardown(void *userdata)
+{
+    ratr0_copper_free(&list);
+    memsys->shutdown();
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestCopperInstructions)
+{
+    chibi_assert_eq_int(1, ratr0_copper_move(&list, COLOR00, 0x123));
+    chibi_assert_eq_int(2, ratr0_copper_wait(&list, 0xe0, 0x12c));
+    chibi_assert_eq_int(4, ratr0_copper_skip(&list, 0x40, 0x80));
+    chibi_assert(ratr0_copper_end(&list));
+    chibi_assert_eq_int(8, list.num_words);
+
+    UINT16 expected[] = { COLOR00, 0x123, 0x2ce1, 0xfffe, 0x8041, 0xffff, 0xffff, 0xfffe };
+    chibi_assert(memcmp(expected, ratr0_copper_get_front(&list), sizeof(expected)) == 0);
+    chibi_assert(memcmp(expected, ratr0_copper_get_back(&list), sizeof(expected)) == 0);
+}
+
+CHIBI_TEST(TestCopperDisplay)
+{
+    UINT16 *words = ratr0_copper_get_back(&list);
+    chibi_assert(ratr0_copper_add_display(&list, 16));
+    chibi_assert(ratr0_copper_add_split(&list));
+    chibi_assert(ratr0_copper_end(&list));
+    chibi_assert_eq_int(RATR0_COPPER_DISPLAY_WORDS - 32 + RATR0_COPPER_SPLIT_WORDS + 2,
+                        list.num_words);
+
+    // the indexes point to the values of their registers
+    struct Ratr0CopperListInfo *info = &list.info;
+    chibi_assert_eq_int(DDFSTRT, words[info->ddfstrt_index - 1]);
+    chibi_assert_eq_int(DDFSTOP, words[info->ddfstop_index - 1]);
+    chibi_assert_eq_int(DIWSTRT, words[info->diwstrt_index - 1]);
+    chibi_assert_eq_int(DIWSTOP, words[info->diwstop_index - 1]);
+    chibi_assert_eq_int(BPLCON0, words[info->bplcon0_index - 1]);
+    chibi_assert_eq_int(BPLCON1, words[info->bplcon1_index - 1]);
+    chibi_assert_eq_int(BPL1MOD, words[info->bpl1mod_index - 1]);
+    chibi_assert_eq_int(BPL2MOD, words[info->bpl1mod_index + 1]);
+    chibi_assert_eq_int(BPL6PTL, words[info->bpl1pth_index + 21]);
+    chibi_assert_eq_int(SPR7PTL, words[info->spr0pth_index + 29]);
+    chibi_assert_eq_int(COLOR15, words[info->color00_index + 29]);
+    // the split pointers follow 2 WAITs
+    chibi_assert_eq_int(BPL1PTH, words[info->split_index - 1]);
+    chibi_assert_eq_int(0xfffe, words[info->split_index - 2]);
+    chibi_assert_eq_int(0xfffe, words[info->split_index - 4]);
+}
+
+CHIBI_TEST(TestCopperFull)
+{
+    ratr0_copper_free(&list);
+    ratr0_copper_init(&list, 8);
+    chibi_assert(ratr0_copper_move(&list, COLOR00, 0) != -1);
+    chibi_assert(ratr0_copper_move(&list, COLOR01, 0) != -1);
+    chibi_assert(ratr0_copper_move(&list, COLOR02, 0) != -1);
+    // the END always fits
+    chibi_assert_eq_int(-1, ratr0_copper_move(&list, COLOR03, 0));
+    chibi_assert(!ratr0_copper_add_display(&list, 32));
+    chibi_assert(ratr0_copper_end(&list));
+    chibi_assert_eq_int(8, list.num_words);
+}
+
+CHIBI_TEST(TestCopperSwap)
+{
+    struct Ratr0CopperListInfo info = { 0 };
+    UINT16 words[] = { COLOR00, 0x000, COLOR01, 0x111, 0xffff, 0xfffe };
+    info.color00_index = 1;
+    chibi_assert(ratr0_copper_load(&list, words, 6, &info));
+    chibi_assert_eq_int(1, list.info.color00_index);
+
+    // changes go to the back copy and are shown after the swap
+    UINT16 *back = ratr0_copper_get_back(&list);
+    back[1] = 0xf00;
+    chibi_assert_eq_int(0x000, ratr0_copper_get_front(&list)[1]);
+    ratr0_copper_swap(&list);
+    chibi_assert(ratr0_copper_get_front(&list) == back);
+    chibi_assert(ratr0_copper_get_back(&list) != back);
+
+    // the other copy gets them with the sync
+    chibi_assert(list.needs_sync);
+    ratr0_copper_sync(&list);
+    chibi_assert(!list.needs_sync);
+    chibi_assert(memcmp(ratr0_copper_get_back(&list), ratr0_copper_get_front(&list),
+                        sizeof(words)) == 0);
+    chibi_assert_eq_int(0xf00, ratr0_copper_get_back(&list)[1]);
+
+    // a list that's too long isn't loaded
+    chibi_assert(!ratr0_copper_load(&list, words, 300, &info));
+}
+
+CHIBI_TEST(TestCopperGradient)
+{
+    UINT16 table[16];
+    ratr0_copper_make_gradient(table, 16, 0x00f, 0xf00);
+    chibi_assert_eq_int(0x00f, table[0]);
+    chibi_assert_eq_int(0x807, table[8]);
+    chibi_assert_eq_int(0xf00, table[15]);
+    ratr0_copper_make_gradient(table, 1, 0x123, 0xfff);
+    chibi_assert_eq_int(0x123, table[0]);
+}
+
+CHIBI_TEST(TestCopperPaletteLines)
+{
+    UINT16 table[] = { 0x111, 0x222, 0x111, 0x222, 0x111, 0x333, 0x111, 0x333 };
+    struct Ratr0CopperPaletteLines lines = { 10, 4, 1, 2 };
+    UINT16 *words = ratr0_copper_get_back(&list);
+    ratr0_copper_move(&list, COLOR00, 0);
+    chibi_assert(ratr0_copper_add_palette_lines(&list, &lines, table));
+    chibi_assert(ratr0_copper_end(&list));
+
+    // lines 1 and 3 are the same as the line before, line 2 changes 1 color
+    UINT16 expected[] = {
+        ((0x2c + 9) << 8) | 0xe1, 0xfffe, COLOR01, 0x111, COLOR02, 0x222,
+        ((0x2c + 11) << 8) | 0xe1, 0xfffe, COLOR02, 0x333
+    };
+    chibi_assert_eq_int(2, lines.index);
+    chibi_assert_eq_int(10, lines.num_words);
+    chibi_assert(memcmp(expected, &words[2], sizeof(expected)) == 0);
+
+    // a table with the same changes is written in place
+    UINT16 faded[] = { 0x000, 0x111, 0x000, 0x111, 0x000, 0x222, 0x000, 0x222 };
+    ratr0_copper_set_palette_lines(&list, &lines, faded);
+    chibi_assert_eq_int(0x000, words[5]);
+    chibi_assert_eq_int(0x111, words[7]);
+    chibi_assert_eq_int(0x222, words[11]);
+
+    // a line can't change more colors than fit in the horizontal blank
+    UINT16 many[2 * 16] = { 0 };
+    for (int i = 0; i < 16; i++) many[16 + i] = 0xfff;
+    struct Ratr0CopperPaletteLines too_many = { 20, 2, 0, 16 };
+    chibi_assert(!ratr0_copper_add_palette_lines(&list, &too_many, many));
+}
+
+static struct Ratr0CopperEmu emu;
+
+/* The colors of every line are written in the horizontal blank before it */
+static BOOL colors_in_blank(struct Ratr0CopperPaletteLines *lines, UINT16 *table)
+{
+    ratr0_copper_emu_run(&emu, ratr0_copper_get_back(&list), list.num_words);
+    if (emu.num_issues > 0) return FALSE;
+    int num_colors = 0;
+    for (int i = 0; i < emu.num_writes; i++) {
+        struct Ratr0CopperWrite *write = &emu.writes[i];
+        if (write->index < lines->index || write->index >= lines->index + lines->num_words) continue;
+        int line = write->vpos - lines->vstart - lines->first_line;
+        if (write->hpos >= DDFSTRT_VALUE_320) line++;
+        int color = (write->reg - COLOR00) / 2 - lines->first_color;
+        if (write->value != table[line * lines->num_colors + color]) return FALSE;
+        num_colors++;
+    }
+    return num_colors == lines->num_lines * lines->num_colors;
+}
+
+CHIBI_TEST(TestCopperPaletteLinesTiming)
+{
+    // every line changes the most colors that fit, past line 255
+    static UINT16 table[40 * RATR0_COPPER_LINE_MOVES];
+    struct Ratr0CopperPaletteLines lines = { 200, 40, 3, RATR0_COPPER_LINE_MOVES };
+    for (int i = 0; i < 40 * RATR0_COPPER_LINE_MOVES; i++) table[i] = i & 0xfff;
+    ratr0_copper_free(&list);
+    ratr0_copper_init(&list, 2048);
+    chibi_assert(ratr0_copper_add_display(&list, 32));
+    chibi_assert(ratr0_copper_add_palette_lines(&list, &lines, table));
+    chibi_assert(ratr0_copper_end(&list));
+
+    emu.num_bitplanes = 5;
+    emu.danger = FALSE;
+    chibi_assert(colors_in_blank(&lines, table));
+
+    for (int i = 0; i < 40 * RATR0_COPPER_LINE_MOVES; i++) table[i] = (i + 1) & 0xfff;
+    ratr0_copper_set_palette_lines(&list, &lines, table);
+    chibi_assert(colors_in_blank(&lines, table));
+}
+
+/*
+ * SUITE DEFINITION
+ */
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.CopperSuite", coppertest_setup,
+                                                 coppertest_teardown, NULL);
+    chibi_suite_add_test(suite, TestCopperInstructions);
+    chibi_suite_add_test(suite, TestCopperDisplay);
+    chibi_suite_add_test(suite, TestCopperFull);
+    chibi_suite_add_test(suite, TestCopperSwap);
+    chibi_suite_add_test(suite, TestCopperGradient);
+    chibi_suite_add_test(suite, TestCopperPaletteLines);
+    chibi_suite_add_test(suite, TestCopperPaletteLinesTiming);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
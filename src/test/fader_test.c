@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/fader.h>
+#include "../../chibi_test/chibi.h"
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    4096, 10,
+    4096, 10,
+    0
+};
+static UINT16 palette[32];
+static int num_palette_writes;
+
+/*
+ * The display function the fader uses
+ */
+void ratr0_display_set_palette(UINT16 *colors, UINT8 num_colors, UINT8 offset)
+{
+    memcpy(&palette[offset], colors, num_colors * sizeof(UINT16));
+    num_palette_writes++;
+}
+
+void fadertest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    memset(palette, 0xff, sizeof(palette));
+    num_palette_writes = 0;
+}
+
+void fadertest_teardown(void *userdata)
+{
+    memsys->shutdown();
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestFaderMixColor)
+{
+    chibi_assert_eq_int(0x000, ratr0_fader_mix_color(0x000, 0xfff, 0, 16));
+    chibi_assert_eq_int(0x888, ratr0_fader_mix_color(0x000, 0xfff, 8, 16));
+    chibi_assert_eq_int(0xfff, ratr0_fader_mix_color(0x000, 0xfff, 15, 16));
+    // each component on its own, rounded to the nearest value
+    chibi_assert_eq_int(0x1e8, ratr0_fader_mix_color(0x0f8, 0x3c8, 1, 4));
+    chibi_assert_eq_int(0x2d8, ratr0_fader_mix_color(0x0f8, 0x3c8, 1, 3));
+}
+
+CHIBI_TEST(TestFaderMakeTable)
+{
+    struct Ratr0FadeTable table;
+    UINT16 from[] = { 0xf00, 0x0f0 }, to[] = { 0x00f, 0xfff };
+    chibi_assert(ratr0_fader_make_table(&table, from, to, 4, 2, 4));
+    chibi_assert_eq_int(4, table.first_color);
+    UINT16 expected[] = { 0xf00, 0x0f0, 0xa05, 0x5f5, 0x50a, 0xafa, 0x00f, 0xfff };
+    chibi_assert(memcmp(expected, table.colors, sizeof(expected)) == 0);
+    ratr0_fader_free_table(&table);
+    chibi_assert_eq_int(-1, table.h_colors);
+
+    // NULL is black
+    chibi_assert(ratr0_fader_make_table(&table, NULL, to, 0, 2, 2));
+    chibi_assert_eq_int(0x000, table.colors[0]);
+    chibi_assert_eq_int(0xfff, table.colors[3]);
+    ratr0_fader_free_table(&table);
+}
+
+CHIBI_TEST(TestFaderPlay)
+{
+    UINT16 colors[] = { 0x000, 0x000, 0x444, 0x111, 0x888, 0x222 };
+    struct Ratr0FadeTable table = { 3, 2, 3, colors, -1 };
+    struct Ratr0Fader fader;
+
+    // the first step is shown at the start, then a step every 2 frames
+    ratr0_fader_start(&fader, &table, 2, FALSE);
+    chibi_assert_eq_int(1, num_palette_writes);
+    chibi_assert_eq_int(0xffff, palette[2]);
+    chibi_assert_eq_int(0x000, palette[3]);
+    chibi_assert(ratr0_fader_update(&fader));
+    chibi_assert_eq_int(1, num_palette_writes);
+    chibi_assert(ratr0_fader_update(&fader));
+    chibi_assert_eq_int(0x444, palette[3]);
+    chibi_assert_eq_int(0x111, palette[4]);
+    chibi_assert(ratr0_fader_update(&fader));
+    chibi_assert(!ratr0_fader_update(&fader));
+    chibi_assert_eq_int(0x888, palette[3]);
+    chibi_assert_eq_int(0xffff, palette[5]);
+    chibi_assert_eq_int(3, num_palette_writes);
+    chibi_assert(!ratr0_fader_update(&fader));
+    chibi_assert_eq_int(3, num_palette_writes);
+
+    // backwards
+    ratr0_fader_start(&fader, &table, 1, TRUE);
+    chibi_assert_eq_int(0x888, palette[3]);
+    chibi_assert(ratr0_fader_update(&fader));
+    chibi_assert_eq_int(0x444, palette[3]);
+    chibi_assert(!ratr0_fader_update(&fader));
+    chibi_assert_eq_int(0x000, palette[3]);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.FaderSuite", fadertest_setup,
+                                                 fadertest_teardown, NULL);
+    chibi_suite_add_test(suite, TestFaderMixColor);
+    chibi_suite_add_test(suite, TestFaderMakeTable);
+    chibi_suite_add_test(suite, TestFaderPlay);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
@@ -0,0 +1,82 @@
+/*
+ * Allocation throughput benchmark for the memory subsystem. Runs a
+ * random mix of allocations and frees of typical asset sizes against
+ * the engine allocator and against malloc()/free() for comparison.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ratr0/memory.h>
+
+#define NUM_SLOTS      (64)
+#define NUM_OPERATIONS (2000000)
+#define MAX_BLOCK_SIZE (4096)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemoryConfig mem_config = {
+    NUM_SLOTS * MAX_BLOCK_SIZE * 2, NUM_SLOTS,
+    NUM_SLOTS * MAX_BLOCK_SIZE * 2, NUM_SLOTS,
+    0
+};
+
+static UINT32 sizes[NUM_OPERATIONS];
+
+static double seconds_since(clock_t start)
+{
+    return ((double) (clock() - start)) / CLOCKS_PER_SEC;
+}
+
+static double run_ratr0(void)
+{
+    Ratr0MemHandle handles[NUM_SLOTS];
+    BOOL used[NUM_SLOTS] = { 0 };
+    struct Ratr0MemorySystem *memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+
+    clock_t start = clock();
+    for (int i = 0; i < NUM_OPERATIONS; i++) {
+        int slot = sizes[i] % NUM_SLOTS;
+        if (used[slot]) {
+            ratr0_memory_free_block(handles[slot]);
+            used[slot] = FALSE;
+        } else {
+            handles[slot] = ratr0_memory_allocate_block(slot & 1 ? RATR0_MEM_CHIP :
+                                                        RATR0_MEM_DEFAULT,
+                                                        sizes[i]);
+            used[slot] = TRUE;
+        }
+    }
+    double elapsed = seconds_since(start);
+    memsys->shutdown();
+    return elapsed;
+}
+
+static double run_malloc(void)
+{
+    void *blocks[NUM_SLOTS] = { 0 };
+    clock_t start = clock();
+    for (int i = 0; i < NUM_OPERATIONS; i++) {
+        int slot = sizes[i] % NUM_SLOTS;
+        if (blocks[slot]) {
+            free(blocks[slot]);
+            blocks[slot] = NULL;
+        } else {
+            blocks[slot] = malloc(sizes[i]);
+        }
+    }
+    double elapsed = seconds_since(start);
+    for (int i = 0; i < NUM_SLOTS; i++) free(blocks[i]);
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    srand(42);
+    for (int i = 0; i < NUM_OPERATIONS; i++) sizes[i] = 16 + rand() % MAX_BLOCK_SIZE;
+
+    double ratr0_time = run_ratr0();
+    double malloc_time = run_malloc();
+    printf("%d alloc/free operations\n", NUM_OPERATIONS);
+    printf("ratr0_memory: %8.3f s, %12.0f ops/s\n", ratr0_time, NUM_OPERATIONS / ratr0_time);
+    printf("malloc/free:  %8.3f s, %12.0f ops/s\n", malloc_time, NUM_OPERATIONS / malloc_time);
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include "../../chibi_test/chibi.h"
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    16384, 20,   // 16k general purpose memory with max 20 mem blocks
+    16384, 20,   // 16k chip memory with max 20 mem blocks
+    1024         // 1k frame memory
+};
+
+void memorytest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+}
+
+void memorytest_teardown(void *userdata)
+{
+    memsys->shutdown();
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestAllocateBlock)
+{
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT, 100);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 100);
+    UINT8 *addr1 = ratr0_memory_block_address(h1);
+    UINT8 *addr2 = ratr0_memory_block_address(h2);
+
+    chibi_assert_not_null(addr1);
+    chibi_assert_not_null(addr2);
+    chibi_assert(addr1 != addr2);
+    // the handles only differ in the pool tag
+    chibi_assert(h1 != h2);
+    chibi_assert_eq_int(0, ((UINT32) (uintptr_t) addr1) % sizeof(void *));
+    memset(addr1, 0xff, 100);
+    memset(addr2, 0xff, 100);
+}
+
+CHIBI_TEST(TestFreeBlockRecyclesHandle)
+{
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT, 100);
+    ratr0_memory_free_block(h1);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT, 40);
+    chibi_assert_eq_int(h1, h2);
+}
+
+CHIBI_TEST(TestFreeBlockCoalesces)
+{
+    struct Ratr0MemoryStats before, after;
+    ratr0_memory_stats(&before);
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 1000);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 2000);
+    Ratr0MemHandle h3 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 3000);
+    ratr0_memory_free_block(h1);
+    ratr0_memory_free_block(h3);
+    ratr0_memory_free_block(h2);
+    ratr0_memory_stats(&after);
+
+    chibi_assert_eq_int(1, after.chip.num_free_blocks);
+    chibi_assert_eq_int(before.chip.largest_free_block, after.chip.largest_free_block);
+    chibi_assert_eq_int(0, after.chip.fragmentation);
+}
+
+CHIBI_TEST(TestCompactKeepsData)
+{
+    struct Ratr0MemoryStats stats;
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 1000);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 2000);
+    Ratr0MemHandle h3 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 3000);
+    memset(ratr0_memory_block_address(h1), 1, 1000);
+    memset(ratr0_memory_block_address(h3), 3, 3000);
+    ratr0_memory_free_block(h2);
+    ratr0_memory_stats(&stats);
+    chibi_assert(stats.chip.fragmentation > 0);
+
+    chibi_assert_eq_int(1, ratr0_memory_compact(RATR0_MEM_CHIP));
+    ratr0_memory_stats(&stats);
+    chibi_assert_eq_int(0, stats.chip.fragmentation);
+
+    UINT8 *addr1 = ratr0_memory_block_address(h1);
+    UINT8 *addr3 = ratr0_memory_block_address(h3);
+    chibi_assert(addr3 < addr1 + 2000);
+    chibi_assert(addr1[0] == 1 && addr1[999] == 1);
+    chibi_assert(addr3[0] == 3 && addr3[2999] == 3);
+}
+
+CHIBI_TEST(TestPopScopeReleasesBlocks)
+{
+    struct Ratr0MemoryStats before, after;
+    ratr0_memory_stats(&before);
+    chibi_assert(ratr0_memory_push_scope());
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 500);
+    ratr0_memory_allocate_block(RATR0_MEM_DEFAULT | RATR0_MEM_SCOPED, 500);
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.chip.live_bytes + 500, after.chip.live_bytes);
+
+    ratr0_memory_pop_scope();
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.chip.live_bytes, after.chip.live_bytes);
+    chibi_assert_eq_int(before.general.live_bytes, after.general.live_bytes);
+    chibi_assert_eq_int(before.chip.free_bytes, after.chip.free_bytes);
+    chibi_assert_eq_int(before.chip.live_blocks, after.chip.live_blocks);
+    // the handle does not point into the released memory
+    chibi_assert(ratr0_memory_block_address(h1) == NULL);
+}
+
+CHIBI_TEST(TestUnscopedBlockSurvivesPop)
+{
+    struct Ratr0MemoryStats before, after;
+    ratr0_memory_stats(&before);
+    chibi_assert(ratr0_memory_push_scope());
+    ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 500);
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP, 300);
+    ratr0_memory_pop_scope();
+
+    ratr0_memory_stats(&after);
+    chibi_assert_not_null(ratr0_memory_block_address(h1));
+    chibi_assert_eq_int(before.chip.live_bytes + 300, after.chip.live_bytes);
+    ratr0_memory_free_block(h1);
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.chip.free_bytes, after.chip.free_bytes);
+}
+
+CHIBI_TEST(TestScopeFreeAnyBlock)
+{
+    struct Ratr0MemoryStats before, after;
+    chibi_assert(ratr0_memory_push_scope());
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT | RATR0_MEM_SCOPED, 100);
+    ratr0_memory_allocate_block(RATR0_MEM_DEFAULT | RATR0_MEM_SCOPED, 100);
+    ratr0_memory_stats(&before);
+
+    // the first block of the scope is returned right away
+    ratr0_memory_free_block(h1);
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.general.live_bytes - 100, after.general.live_bytes);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT | RATR0_MEM_SCOPED, 100);
+    chibi_assert_eq_int(h1, h2);
+    ratr0_memory_pop_scope();
+}
+
+CHIBI_TEST(TestNestedScopes)
+{
+    struct Ratr0MemoryStats before, after;
+    ratr0_memory_stats(&before);
+    chibi_assert(ratr0_memory_push_scope());
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 100);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 200);
+    Ratr0MemHandle h3 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 300);
+    chibi_assert(ratr0_memory_push_scope());
+    Ratr0MemHandle h4 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 400);
+
+    // a block from the middle of the outer scope's list
+    ratr0_memory_free_block(h2);
+    ratr0_memory_pop_scope();
+    chibi_assert(ratr0_memory_block_address(h4) == NULL);
+    chibi_assert_not_null(ratr0_memory_block_address(h1));
+    chibi_assert_not_null(ratr0_memory_block_address(h3));
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.chip.live_bytes + 400, after.chip.live_bytes);
+
+    ratr0_memory_pop_scope();
+    chibi_assert(ratr0_memory_block_address(h1) == NULL);
+    chibi_assert(ratr0_memory_block_address(h3) == NULL);
+    ratr0_memory_stats(&after);
+    chibi_assert_eq_int(before.chip.live_bytes, after.chip.live_bytes);
+    chibi_assert_eq_int(before.chip.free_bytes, after.chip.free_bytes);
+}
+
+CHIBI_TEST(TestFrameAlloc)
+{
+    UINT8 *frame0 = ratr0_memory_frame_alloc(500);
+    chibi_assert_not_null(frame0);
+    chibi_assert(ratr0_memory_frame_alloc(600) == NULL);
+    memset(frame0, 0xaa, 500);
+
+    // the next frame allocates from the other end, frame 0 stays intact
+    ratr0_memory_frame_reset();
+    UINT8 *frame1 = ratr0_memory_frame_alloc(500);
+    chibi_assert_not_null(frame1);
+    chibi_assert(frame1 >= frame0 + 500);
+    chibi_assert(frame0[499] == 0xaa);
+
+    // frame 2 can reuse the memory of frame 0
+    ratr0_memory_frame_reset();
+    chibi_assert(ratr0_memory_frame_alloc(500) == frame0);
+}
+
+CHIBI_TEST(TestStatsPerTag)
+{
+    struct Ratr0MemoryStats stats;
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEMTAG_RESOURCES, 300);
+    ratr0_memory_allocate_block(RATR0_MEM_DEFAULT | RATR0_MEMTAG_TIMERS, 200);
+    ratr0_memory_allocate_block(RATR0_MEM_CHIP, 100);
+    ratr0_memory_free_block(h1);
+    ratr0_memory_stats(&stats);
+
+    int resources = RATR0_MEMTAG_RESOURCES >> RATR0_MEMTAG_SHIFT;
+    int timers = RATR0_MEMTAG_TIMERS >> RATR0_MEMTAG_SHIFT;
+    chibi_assert_eq_int(0, stats.chip.tags[resources].live_bytes);
+    chibi_assert_eq_int(300, stats.chip.tags[resources].peak_bytes);
+    chibi_assert_eq_int(100, stats.chip.tags[RATR0_MEMTAG_USER].live_bytes);
+    chibi_assert_eq_int(200, stats.general.tags[timers].live_bytes);
+    chibi_assert_eq_int(100, stats.chip.live_bytes);
+    chibi_assert_eq_int(400, stats.chip.peak_bytes);
+    chibi_assert_eq_int(2, stats.chip.peak_blocks);
+    chibi_assert_eq_int(20, stats.chip.table_size);
+}
+
+CHIBI_TEST(TestFastFallsBackToChip)
+{
+    struct Ratr0MemoryStats stats;
+    ratr0_memory_stats(&stats);
+    // the host has no chip memory, so the general pool counts as fast
+    chibi_assert(stats.general_is_fast);
+    ratr0_memory_allocate_block(RATR0_MEM_FAST, 1000);
+    ratr0_memory_stats(&stats);
+    chibi_assert_eq_int(1000, stats.general.live_bytes);
+
+    // when fast memory is exhausted, the block is placed in chip memory
+    ratr0_memory_allocate_block(RATR0_MEM_FAST, stats.general.largest_free_block + 16);
+    ratr0_memory_stats(&stats);
+    chibi_assert_eq_int(1000, stats.general.live_bytes);
+    chibi_assert_eq_int(1, stats.chip.live_blocks);
+}
+
+CHIBI_TEST(TestLargePoolIsTruncated)
+{
+    struct Ratr0MemoryConfig large_config = { 24 * 1024 * 1024, 20, 16384, 20, 1024 };
+    struct Ratr0MemoryStats stats;
+    memsys->shutdown();
+    memsys = ratr0_memory_startup(&mock_engine, &large_config);
+
+    // blocks are limited to 16MB, the rest of the pool is not used
+    ratr0_memory_stats(&stats);
+    chibi_assert(stats.general.largest_free_block < 16 * 1024 * 1024);
+    chibi_assert(stats.general.largest_free_block > 15 * 1024 * 1024);
+
+    Ratr0MemHandle h1 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT, 12 * 1024 * 1024);
+    Ratr0MemHandle h2 = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT, 100);
+    chibi_assert_not_null(ratr0_memory_block_address(h1));
+    chibi_assert_not_null(ratr0_memory_block_address(h2));
+    ratr0_memory_free_block(h1);
+    ratr0_memory_free_block(h2);
+    ratr0_memory_stats(&stats);
+    chibi_assert_eq_int(1, stats.general.num_free_blocks);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.MemorySuite", memorytest_setup,
+                                                 memorytest_teardown, NULL);
+    chibi_suite_add_test(suite, TestAllocateBlock);
+    chibi_suite_add_test(suite, TestFreeBlockRecyclesHandle);
+    chibi_suite_add_test(suite, TestFreeBlockCoalesces);
+    chibi_suite_add_test(suite, TestCompactKeepsData);
+    chibi_suite_add_test(suite, TestPopScopeReleasesBlocks);
+    chibi_suite_add_test(suite, TestUnscopedBlockSurvivesPop);
+    chibi_suite_add_test(suite, TestScopeFreeAnyBlock);
+    chibi_suite_add_test(suite, TestNestedScopes);
+    chibi_suite_add_test(suite, TestFrameAlloc);
+    chibi_suite_add_test(suite, TestStatsPerTag);
+    chibi_suite_add_test(suite, TestFastFallsBackToChip);
+    chibi_suite_add_test(suite, TestLargePoolIsTruncated);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
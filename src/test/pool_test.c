@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/datastructs/pool.h>
+#include "../../chibi_test/chibi.h"
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = { 4096, 10, 4096, 10 };
+
+struct TestObject {
+    UINT32 a, b, c;
+};
+
+void pooltest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+}
+
+void pooltest_teardown(void *userdata)
+{
+    memsys->shutdown();
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestInitPool)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 5, RATR0_MEM_DEFAULT);
+    chibi_assert_not_null(pool.elements);
+    chibi_assert_eq_int(5, pool.capacity);
+    chibi_assert_eq_int(0, pool.num_used);
+    chibi_assert(pool.element_size >= sizeof(struct TestObject));
+    chibi_assert_eq_int(0, pool.element_size % sizeof(void *));
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestSmallElementsHoldLink)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, 1, 5, RATR0_MEM_DEFAULT);
+    chibi_assert_eq_int(sizeof(void *), pool.element_size);
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestAllocUntilExhausted)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 3, RATR0_MEM_DEFAULT);
+    struct TestObject *obj0 = ratr0_pool_alloc(&pool);
+    struct TestObject *obj1 = ratr0_pool_alloc(&pool);
+    struct TestObject *obj2 = ratr0_pool_alloc(&pool);
+
+    chibi_assert(obj0 == ratr0_pool_at(&pool, 0));
+    chibi_assert(obj1 == ratr0_pool_at(&pool, 1));
+    chibi_assert_eq_int(2, ratr0_pool_index(&pool, obj2));
+    chibi_assert(ratr0_pool_alloc(&pool) == NULL);
+    chibi_assert_eq_int(3, pool.num_used);
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestFreeRecyclesObjects)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 3, RATR0_MEM_DEFAULT);
+    struct TestObject *obj0 = ratr0_pool_alloc(&pool);
+    struct TestObject *obj1 = ratr0_pool_alloc(&pool);
+    struct TestObject *obj2 = ratr0_pool_alloc(&pool);
+    chibi_assert_not_null(obj1);
+    chibi_assert(obj1 != obj0 && obj1 != obj2);
+    ratr0_pool_free(&pool, obj0);
+    ratr0_pool_free(&pool, obj2);
+    chibi_assert_eq_int(1, pool.num_used);
+
+    // freed objects come back in reverse order
+    chibi_assert(ratr0_pool_alloc(&pool) == obj2);
+    chibi_assert(ratr0_pool_alloc(&pool) == obj0);
+    chibi_assert(ratr0_pool_alloc(&pool) == NULL);
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestFreeInvalidObject)
+{
+    struct Ratr0Pool pool;
+    struct TestObject outside;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 3, RATR0_MEM_DEFAULT);
+    struct TestObject *obj0 = ratr0_pool_alloc(&pool);
+
+    ratr0_pool_free(&pool, &outside);
+    ratr0_pool_free(&pool, ((UINT8 *) obj0) + 1);
+    // never allocated
+    ratr0_pool_free(&pool, ratr0_pool_at(&pool, 2));
+    chibi_assert_eq_int(1, pool.num_used);
+    chibi_assert(pool.first_free == NULL);
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestPoisonFreedObject)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 3, RATR0_MEM_DEFAULT);
+    pool.poison = TRUE;
+    struct TestObject *obj0 = ratr0_pool_alloc(&pool);
+    obj0->a = obj0->b = obj0->c = 0;
+    ratr0_pool_free(&pool, obj0);
+
+    UINT8 *bytes = (UINT8 *) obj0;
+    for (int i = sizeof(void *); i < pool.element_size; i++) {
+        chibi_assert_eq_int(RATR0_POOL_POISON, bytes[i]);
+    }
+    ratr0_pool_destroy(&pool);
+}
+
+CHIBI_TEST(TestFreePoisonedObject)
+{
+    struct Ratr0Pool pool;
+    ratr0_pool_init(&pool, sizeof(struct TestObject), 3, RATR0_MEM_DEFAULT);
+    pool.poison = TRUE;
+    struct TestObject *obj0 = ratr0_pool_alloc(&pool);
+    struct TestObject *obj1 = ratr0_pool_alloc(&pool);
+    obj0->a = obj0->b = obj0->c = 0;
+    ratr0_pool_free(&pool, obj0);
+    ratr0_pool_free(&pool, obj0);
+    chibi_assert_eq_int(1, pool.num_used);
+
+    // obj0 is only once in the free list
+    chibi_assert(ratr0_pool_alloc(&pool) == obj0);
+    chibi_assert(ratr0_pool_alloc(&pool) == ratr0_pool_at(&pool, 2));
+    chibi_assert(ratr0_pool_alloc(&pool) == NULL);
+    ratr0_pool_free(&pool, obj1);
+    ratr0_pool_destroy(&pool);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.PoolSuite", pooltest_setup,
+                                                 pooltest_teardown, NULL);
+    chibi_suite_add_test(suite, TestInitPool);
+    chibi_suite_add_test(suite, TestSmallElementsHoldLink);
+    chibi_suite_add_test(suite, TestAllocUntilExhausted);
+    chibi_suite_add_test(suite, TestFreeRecyclesObjects);
+    chibi_suite_add_test(suite, TestFreeInvalidObject);
+    chibi_suite_add_test(suite, TestPoisonFreedObject);
+    chibi_suite_add_test(suite, TestFreePoisonedObject);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/datastructs/rect_set.h>
+#include "../../chibi_test/chibi.h"
+
+static struct Ratr0RectSet set;
+
+void rect_set_test_setup(void *userdata)
+{
+    ratr0_rect_set_clear(&set);
+}
+
+void rect_set_test_teardown(void *userdata) { }
+
+/* TRUE if the set has exactly the specified rectangle */
+static BOOL has_rect(UINT16 x, UINT16 y, UINT16 width, UINT16 height)
+{
+    for (int i = 0; i < set.num_rects; i++) {
+        struct Ratr0Rect *r = &set.rects[i];
+        if (r->x == x && r->y == y && r->width == width && r->height == height) return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestRectSetInsert)
+{
+    chibi_assert(ratr0_rect_set_insert(&set, 16, 10, 32, 8));
+    chibi_assert(ratr0_rect_set_insert(&set, 96, 10, 16, 8));
+    chibi_assert(ratr0_rect_set_insert(&set, 0, 0, 0, 8));
+    chibi_assert_eq_int(2, set.num_rects);
+    chibi_assert(has_rect(16, 10, 32, 8));
+    chibi_assert(has_rect(96, 10, 16, 8));
+    ratr0_rect_set_clear(&set);
+    chibi_assert_eq_int(0, set.num_rects);
+}
+
+CHIBI_TEST(TestRectSetMerge)
+{
+    // the same rectangle and one inside it
+    ratr0_rect_set_insert(&set, 16, 10, 32, 8);
+    ratr0_rect_set_insert(&set, 16, 10, 32, 8);
+    ratr0_rect_set_insert(&set, 32, 12, 16, 4);
+    chibi_assert_eq_int(1, set.num_rects);
+    chibi_assert(has_rect(16, 10, 32, 8));
+
+    // a BOB that moved 2 pixels down overlaps its old position
+    ratr0_rect_set_insert(&set, 16, 12, 32, 8);
+    chibi_assert_eq_int(1, set.num_rects);
+    chibi_assert(has_rect(16, 10, 32, 10));
+
+    // touching in a row
+    ratr0_rect_set_insert(&set, 48, 10, 16, 10);
+    chibi_assert_eq_int(1, set.num_rects);
+    chibi_assert(has_rect(16, 10, 48, 10));
+}
+
+CHIBI_TEST(TestRectSetNoMerge)
+{
+    // diagonal neighbors: the bounding box is twice their area
+    ratr0_rect_set_insert(&set, 0, 0, 16, 16);
+    ratr0_rect_set_insert(&set, 16, 16, 16, 16);
+    chibi_assert_eq_int(2, set.num_rects);
+
+    // a small overlap at the corner doesn't pay off either
+    ratr0_rect_set_insert(&set, 64, 0, 32, 32);
+    ratr0_rect_set_insert(&set, 80, 28, 32, 32);
+    chibi_assert_eq_int(4, set.num_rects);
+}
+
+CHIBI_TEST(TestRectSetCascade)
+{
+    // the rectangle that fills the gap merges all of them
+    ratr0_rect_set_insert(&set, 0, 0, 16, 8);
+    ratr0_rect_set_insert(&set, 32, 0, 16, 8);
+    ratr0_rect_set_insert(&set, 64, 0, 16, 8);
+    chibi_assert_eq_int(3, set.num_rects);
+    ratr0_rect_set_insert(&set, 16, 0, 48, 8);
+    chibi_assert_eq_int(1, set.num_rects);
+    chibi_assert(has_rect(0, 0, 80, 8));
+}
+
+CHIBI_TEST(TestRectSetFull)
+{
+    for (int i = 0; i < RATR0_RECT_SET_SIZE; i++) {
+        chibi_assert(ratr0_rect_set_insert(&set, i * 32, 0, 16, 16));
+    }
+    chibi_assert(!ratr0_rect_set_insert(&set, 0, 100, 16, 16));
+    // a rectangle that merges still fits
+    chibi_assert(ratr0_rect_set_insert(&set, 0, 8, 16, 16));
+    chibi_assert_eq_int(RATR0_RECT_SET_SIZE, set.num_rects);
+}
+
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.RectSetSuite", rect_set_test_setup,
+                                                 rect_set_test_teardown, NULL);
+    chibi_suite_add_test(suite, TestRectSetInsert);
+    chibi_suite_add_test(suite, TestRectSetMerge);
+    chibi_suite_add_test(suite, TestRectSetNoMerge);
+    chibi_suite_add_test(suite, TestRectSetCascade);
+    chibi_suite_add_test(suite, TestRectSetFull);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/blitter.h>
+#include <ratr0/blitter_emu.h>
+#include <ratr0/save_stack.h>
+#include "../../chibi_test/chibi.h"
+
+#define SURFACE_WIDTH  (64)
+#define SURFACE_HEIGHT (16)
+#define SURFACE_DEPTH  (2)
+#define SURFACE_BYTES  (SURFACE_WIDTH / 8 * SURFACE_HEIGHT * SURFACE_DEPTH)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    4096, 10,
+    4096, 10,
+    0
+};
+static UINT8 background[SURFACE_BYTES], buffer_data[SURFACE_BYTES];
+static struct Ratr0Surface buffer;
+static struct Ratr0SaveStack stack;
+
+void savestacktest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    ratr0_blitter_emu_reset();
+    ratr0_blitter_startup(&mock_engine);
+    struct Ratr0Surface surface = { SURFACE_WIDTH, SURFACE_HEIGHT, SURFACE_DEPTH, TRUE,
+                                    buffer_data };
+    buffer = surface;
+    for (int i = 0; i < SURFACE_BYTES; i++) background[i] = (i * 37 + 11) & 0xff;
+    memcpy(buffer_data, background, SURFACE_BYTES);
+    ratr0_save_stack_init(&stack);
+}
+
+void savestacktest_teardown(void *userdata)
+{
+    ratr0_blitter_shutdown();
+    memsys->shutdown();
+}
+
+/* Draws a BOB as a filled rectangle of 0 pixels */
+static void draw_bob(UINT16 x, UINT16 y, UINT16 width, UINT16 height)
+{
+    struct Ratr0BlitDescriptor desc;
+    ratr0_blit_prepare_clear16(&desc, &buffer, x & ~0x0f, y, width, height);
+    ratr0_blit_enqueue(&desc);
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestAreaSize)
+{
+    // a 16 pixel BOB covers 2 words when it is shifted
+    chibi_assert_eq_int(2 * 2 * 10 * 3, ratr0_save_stack_area_size(16, 10, 3));
+    chibi_assert_eq_int(3 * 2 * 10 * 3, ratr0_save_stack_area_size(17, 10, 3));
+}
+
+CHIBI_TEST(TestRestoreLastSavedFirst)
+{
+    ratr0_save_stack_reserve(&stack, 2 * ratr0_save_stack_area_size(16, 8, 2));
+
+    // the second BOB is saved after the first one was drawn, so its saved
+    // area contains a part of the first BOB
+    chibi_assert(ratr0_save_stack_push(&stack, &buffer, 3, 2, 16, 8));
+    draw_bob(3, 2, 16, 8);
+    chibi_assert(ratr0_save_stack_push(&stack, &buffer, 13, 6, 16, 8));
+    draw_bob(13, 6, 16, 8);
+    ratr0_blitter_wait_queue();
+    chibi_assert_eq_int(2, stack.num_areas);
+    chibi_assert_eq_int(0, stack.areas[0].x);
+    chibi_assert_eq_int(32, stack.areas[0].width);
+    chibi_assert(memcmp(background, buffer_data, SURFACE_BYTES) != 0);
+
+    ratr0_save_stack_restore(&stack, &buffer);
+    ratr0_blitter_wait_queue();
+    chibi_assert(memcmp(background, buffer_data, SURFACE_BYTES) == 0);
+    chibi_assert_eq_int(0, stack.num_areas);
+    chibi_assert_eq_int(0, stack.top);
+}
+
+CHIBI_TEST(TestPushClipsAndFails)
+{
+    ratr0_save_stack_reserve(&stack, ratr0_save_stack_area_size(16, 4, 2));
+    // clipped at the bottom right corner, 1 word of 4 lines
+    chibi_assert(ratr0_save_stack_push(&stack, &buffer, 56, 12, 16, 8));
+    chibi_assert_eq_int(16, stack.areas[0].width);
+    chibi_assert_eq_int(4, stack.areas[0].height);
+    // the full area doesn't fit anymore
+    chibi_assert(!ratr0_save_stack_push(&stack, &buffer, 0, 0, 16, 8));
+    chibi_assert_eq_int(1, stack.num_areas);
+    ratr0_blitter_wait_queue();
+}
+
+CHIBI_TEST(TestReserveKeepsSavedAreas)
+{
+    ratr0_save_stack_reserve(&stack, ratr0_save_stack_area_size(16, 8, 2));
+    chibi_assert(ratr0_save_stack_push(&stack, &buffer, 3, 2, 16, 8));
+    draw_bob(3, 2, 16, 8);
+    ratr0_blitter_wait_queue();
+
+    // a larger BOB was added, the saved area of the smaller one moves along
+    Ratr0MemHandle h_data = stack.h_data;
+    ratr0_save_stack_reserve(&stack, 2 * ratr0_save_stack_area_size(32, 8, 2));
+    chibi_assert(stack.h_data != h_data);
+    ratr0_save_stack_reserve(&stack, 100);
+    chibi_assert_eq_int(2 * ratr0_save_stack_area_size(32, 8, 2), stack.size);
+    chibi_assert(ratr0_save_stack_push(&stack, &buffer, 20, 6, 32, 8));
+    draw_bob(20, 6, 32, 8);
+
+    ratr0_save_stack_restore(&stack, &buffer);
+    ratr0_blitter_wait_queue();
+    chibi_assert(memcmp(background, buffer_data, SURFACE_BYTES) == 0);
+}
+
+/*
+ * SUITE DEFINITION
+ */
+
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.SaveStackSuite", savestacktest_setup,
+                                                 savestacktest_teardown, NULL);
+    chibi_suite_add_test(suite, TestAreaSize);
+    chibi_suite_add_test(suite, TestRestoreLastSavedFirst);
+    chibi_suite_add_test(suite, TestPushClipsAndFails);
+    chibi_suite_add_test(suite, TestReserveKeepsSavedAreas);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
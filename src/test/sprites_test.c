@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/sprites.h>
+#include "../../chibi_test/chibi.h"
+
+#define VP_WIDTH    (320)
+#define VP_HEIGHT   (256)
+#define NUM_SPRITES (12)
+#define HEIGHT      (16)
+#define FRAME_WORDS ((HEIGHT + 2) * 2)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    65536, 10,
+    65536, 10,
+    0
+};
+static struct Ratr0HWSprite hw_sprites[NUM_SPRITES];
+static struct Ratr0HWSprite *sprites[NUM_SPRITES];
+// 4 frames or 2 attached frames with 2 halves
+static UINT16 sprite_data[NUM_SPRITES][4 * FRAME_WORDS];
+
+/* The display function the multiplexer uses */
+void ratr0_display_get_viewport(UINT16 *width, UINT16 *height)
+{
+    *width = VP_WIDTH;
+    *height = VP_HEIGHT;
+}
+
+/*
+ * Sprite i's data words are (i << 12) | (half << 10) | (frame << 8) | word,
+ * so every data word tells which sprite, half and frame it comes from. The
+ * sprite shows frame 1.
+ */
+static void init_sprite(int i, int x, int y, BOOL is_attached)
+{
+    struct Ratr0HWSprite *sprite = &hw_sprites[i];
+    memset(sprite, 0, sizeof(struct Ratr0HWSprite));
+    sprite->base_obj.bounds.x = x;
+    sprite->base_obj.bounds.y = y;
+    sprite->base_obj.bounds.width = 16;
+    sprite->base_obj.bounds.height = HEIGHT;
+    sprite->base_obj.anim_frames.frames[0] = 1;
+    sprite->base_obj.anim_frames.num_frames = 1;
+    sprite->is_attached = is_attached;
+    sprite->sprite_data = sprite_data[i];
+    for (int k = 0; k < 4; k++) {
+        int frame = is_attached ? k / 2 : k, half = is_attached ? k % 2 : 0;
+        UINT16 *data = &sprite_data[i][k * FRAME_WORDS];
+        data[0] = 0;
+        data[1] = half == 1 ? 0x80 : 0;
+        for (int w = 0; w < HEIGHT * 2; w++) {
+            data[2 + w] = (i << 12) | (half << 10) | (frame << 8) | w;
+        }
+        data[FRAME_WORDS - 2] = data[FRAME_WORDS - 1] = 0;
+    }
+    sprites[i] = sprite;
+}
+
+void spritestest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    ratr0_sprites_startup(&mock_engine);
+}
+
+void spritestest_teardown(void *userdata)
+{
+    ratr0_sprites_shutdown();
+    memsys->shutdown();
+}
+
+/*
+ * Reads the chain of every channel like the sprite DMA does and checks that
+ * each sprite is shown once, at its position and with all its rows, and
+ * that the next control words are fetched after the previous sprite ended.
+ * shown[i] returns the channel of sprite i, -1 if it's not shown.
+ */
+static BOOL check_chains(UINT16 set_num, int num_sprites, int shown[])
+{
+    for (int i = 0; i < num_sprites; i++) shown[i] = -1;
+    for (int c = 0; c < RATR0_NUM_SPRITE_CHANNELS; c++) {
+        UINT16 *chain = ratr0_sprites_get_chain(set_num, c);
+        int last_vstop = 0;
+        while (chain[0] != 0 || chain[1] != 0) {
+            UINT16 vstart = (chain[0] >> 8) | ((chain[1] >> 2) & 1) << 8;
+            UINT16 vstop = (chain[1] >> 8) | ((chain[1] >> 1) & 1) << 8;
+            UINT16 hstart = ((chain[0] & 0xff) << 1) | (chain[1] & 1);
+            if (vstart <= last_vstop || vstop <= vstart) { printf("A c=%d %d %d %d\n", c, vstart, vstop, last_vstop); return FALSE; }
+
+            int i = chain[2] >> 12, half = (chain[2] >> 10) & 3;
+            if (i >= num_sprites) return FALSE;
+            struct Ratr0HWSprite *sprite = &hw_sprites[i];
+            if (sprite->is_attached) {
+                if (half != (c & 1) || ((chain[1] & 0x80) != 0) != (half == 1)) return FALSE;
+                if (half == 0 && shown[i] != -1) return FALSE;
+                if (half == 1 && shown[i] != c - 1) return FALSE;
+            } else if (half != 0 || shown[i] != -1) {
+                return FALSE;
+            }
+            if (half == 0) shown[i] = c;
+            if (hstart != sprite->base_obj.bounds.x + 128 ||
+                vstart != sprite->base_obj.bounds.y + 44) return FALSE;
+
+            int rows = vstop - vstart;
+            int expected_rows = VP_HEIGHT - sprite->base_obj.bounds.y;
+            if (expected_rows > HEIGHT) expected_rows = HEIGHT;
+            if (rows != expected_rows) return FALSE;
+            for (int w = 0; w < rows * 2; w++) {
+                if (chain[2 + w] != ((i << 12) | (half << 10) | (1 << 8) | w)) return FALSE;
+            }
+            last_vstop = vstop;
+            chain += 2 + rows * 2;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestMultiplexColumns)
+{
+    int shown[NUM_SPRITES];
+    // 3 rows of 4 sprites each, unsorted, the rows are 1 line apart
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        init_sprite(i, i * 20, ((i * 5) % 3) * (HEIGHT + 1), FALSE);
+    }
+    chibi_assert_eq_int(NUM_SPRITES, ratr0_sprites_multiplex(sprites, NUM_SPRITES, 0));
+    chibi_assert(check_chains(0, NUM_SPRITES, shown));
+    for (int i = 0; i < NUM_SPRITES; i++) chibi_assert(shown[i] != -1);
+
+    // 2 rows of 6 without a line in between, a sprite can't follow in the
+    // same channel
+    for (int i = 0; i < NUM_SPRITES; i++) {
+        init_sprite(i, i * 20, (i % 2) * HEIGHT, FALSE);
+    }
+    chibi_assert_eq_int(8, ratr0_sprites_multiplex(sprites, NUM_SPRITES, 1));
+    chibi_assert(check_chains(1, NUM_SPRITES, shown));
+}
+
+CHIBI_TEST(TestMultiplexOverlap)
+{
+    int shown[NUM_SPRITES], num_shown = 0;
+    for (int i = 0; i < 9; i++) init_sprite(i, i * 10, 100 + i, FALSE);
+    chibi_assert_eq_int(8, ratr0_sprites_multiplex(sprites, 9, 0));
+    chibi_assert(check_chains(0, 9, shown));
+    for (int i = 0; i < 9; i++) if (shown[i] != -1) num_shown++;
+    chibi_assert_eq_int(8, num_shown);
+    chibi_assert_eq_int(-1, shown[8]);
+}
+
+CHIBI_TEST(TestMultiplexAttached)
+{
+    int shown[NUM_SPRITES];
+    init_sprite(0, 0, 0, FALSE);
+    for (int i = 1; i < 4; i++) init_sprite(i, i * 30, 10, TRUE);
+    init_sprite(4, 0, 50, TRUE);
+    chibi_assert_eq_int(5, ratr0_sprites_multiplex(sprites, 5, 0));
+    chibi_assert(check_chains(0, 5, shown));
+    for (int i = 1; i < 5; i++) chibi_assert_eq_int(0, shown[i] & 1);
+
+    // the single sprite blocks the last free pair
+    init_sprite(4, 0, 12, TRUE);
+    chibi_assert_eq_int(4, ratr0_sprites_multiplex(sprites, 5, 0));
+    chibi_assert(check_chains(0, 5, shown));
+    chibi_assert_eq_int(-1, shown[4]);
+}
+
+CHIBI_TEST(TestMultiplexClip)
+{
+    int shown[NUM_SPRITES];
+    init_sprite(0, 0, VP_HEIGHT - 5, FALSE);
+    init_sprite(1, 0, VP_HEIGHT, FALSE);
+    init_sprite(2, 0, 100, FALSE);
+    hw_sprites[2].base_obj.bounds.height = 0;
+    chibi_assert_eq_int(1, ratr0_sprites_multiplex(sprites, 3, 0));
+    hw_sprites[2].base_obj.bounds.height = HEIGHT;
+    chibi_assert(check_chains(0, 2, shown));
+    chibi_assert(shown[0] != -1);
+    chibi_assert_eq_int(-1, shown[1]);
+}
+
+CHIBI_TEST(TestMultiplexClipTop)
+{
+    // 5 rows above the viewport, the other sprite is completely above it
+    init_sprite(0, 0, -5, FALSE);
+    init_sprite(1, 0, -HEIGHT, FALSE);
+    chibi_assert_eq_int(1, ratr0_sprites_multiplex(sprites, 2, 0));
+
+    UINT16 *chain = ratr0_sprites_get_chain(0, 0);
+    UINT16 vstart = (chain[0] >> 8) | ((chain[1] >> 2) & 1) << 8;
+    UINT16 vstop = (chain[1] >> 8) | ((chain[1] >> 1) & 1) << 8;
+    chibi_assert_eq_int(44, vstart);
+    chibi_assert_eq_int(44 + HEIGHT - 5, vstop);
+    // the chain starts with row 5 of frame 1
+    for (int w = 0; w < (HEIGHT - 5) * 2; w++) {
+        chibi_assert_eq_int((1 << 8) | (10 + w), chain[2 + w]);
+    }
+    chibi_assert_eq_int(0, chain[2 + (HEIGHT - 5) * 2]);
+    chibi_assert_eq_int(0, chain[3 + (HEIGHT - 5) * 2]);
+}
+
+CHIBI_TEST(TestChainsOutliveScope)
+{
+    int shown[NUM_SPRITES];
+    for (int i = 0; i < 4; i++) init_sprite(i, i * 20, 0, FALSE);
+
+    // the first multiplex happens while a stage is current
+    chibi_assert(ratr0_memory_push_scope());
+    chibi_assert_eq_int(4, ratr0_sprites_multiplex(sprites, 4, 0));
+    UINT16 *chain = ratr0_sprites_get_chain(0, 0);
+    ratr0_memory_pop_scope();
+
+    // the next stage's assets don't overwrite the chains
+    chibi_assert(ratr0_memory_push_scope());
+    UINT8 *asset = ratr0_memory_block_address(
+        ratr0_memory_allocate_block(RATR0_MEM_CHIP | RATR0_MEM_SCOPED, 1024));
+    memset(asset, 0xff, 1024);
+    chibi_assert(ratr0_sprites_get_chain(0, 0) == chain);
+    chibi_assert(check_chains(0, 4, shown));
+    chibi_assert_eq_int(4, ratr0_sprites_multiplex(sprites, 4, 0));
+    chibi_assert(asset[0] == 0xff && asset[1023] == 0xff);
+    ratr0_memory_pop_scope();
+}
+
+/*
+ * SUITE DEFINITION
+ */
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.SpritesSuite", spritestest_setup,
+                                                 spritestest_teardown, NULL);
+    chibi_suite_add_test(suite, TestMultiplexColumns);
+    chibi_suite_add_test(suite, TestMultiplexOverlap);
+    chibi_suite_add_test(suite, TestMultiplexAttached);
+    chibi_suite_add_test(suite, TestMultiplexClip);
+    chibi_suite_add_test(suite, TestMultiplexClipTop);
+    chibi_suite_add_test(suite, TestChainsOutliveScope);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ratr0/memory.h>
+#include <ratr0/display.h>
+#include <ratr0/resources.h>
+#include <ratr0/blitter.h>
+#include <ratr0/blitter_emu.h>
+#include <ratr0/tilemap.h>
+#include "../../chibi_test/chibi.h"
+
+#define VP_WIDTH      (64)
+#define VP_HEIGHT     (32)
+#define BUFFER_WIDTH  RATR0_TILEMAP_BUFFER_WIDTH(VP_WIDTH)
+#define BUFFER_HEIGHT RATR0_TILEMAP_BUFFER_HEIGHT(VP_HEIGHT)
+#define DEPTH         (2)
+#define BUFFER_BYTES  (BUFFER_WIDTH / 8 * BUFFER_HEIGHT * DEPTH)
+#define NUM_BUFFERS   (2)
+#define MAP_WIDTH     (7)
+#define MAP_HEIGHT    (5)
+#define SHEET_SIZE    (32)
+
+static Ratr0Engine mock_engine;
+static struct Ratr0MemorySystem *memsys;
+static struct Ratr0MemoryConfig mem_config = {
+    4096, 10,
+    4096, 10,
+    0
+};
+static UINT8 buffer_data[NUM_BUFFERS][BUFFER_BYTES];
+static struct Ratr0DisplayBuffer buffers[NUM_BUFFERS];
+static UINT16 scroll_x, scroll_y;
+static struct Ratr0TileSheet sheet;
+static UINT8 map_tiles[MAP_WIDTH * MAP_HEIGHT];
+
+/*
+ * The display functions the tile map uses
+ */
+struct Ratr0DisplayBuffer *ratr0_display_get_buffer(UINT16 playfield_num, UINT16 buffer_num)
+{
+    return buffer_num < NUM_BUFFERS ? &buffers[buffer_num] : NULL;
+}
+
+void ratr0_display_get_viewport(UINT16 *width, UINT16 *height)
+{
+    *width = VP_WIDTH;
+    *height = VP_HEIGHT;
+}
+
+void ratr0_display_scroll_playfield(UINT16 playfield_num, UINT16 x, UINT16 y)
+{
+    scroll_x = x;
+    scroll_y = y;
+}
+
+static int get_pixel(UINT8 *buffer, int width, int depth, int x, int y)
+{
+    int row_bytes = width / 8, color = 0;
+    for (int p = 0; p < depth; p++) {
+        UINT8 byte = buffer[(y * depth + p) * row_bytes + x / 8];
+        color |= ((byte >> (7 - (x & 7))) & 1) << p;
+    }
+    return color;
+}
+
+static void set_pixel(UINT8 *buffer, int width, int depth, int x, int y, int color)
+{
+    int row_bytes = width / 8;
+    for (int p = 0; p < depth; p++) {
+        UINT8 *byte = &buffer[(y * depth + p) * row_bytes + x / 8];
+        UINT8 bit = 0x80 >> (x & 7);
+        if (color & (1 << p)) *byte |= bit;
+        else *byte &= ~bit;
+    }
+}
+
+void tilemaptest_setup(void *userdata)
+{
+    memsys = ratr0_memory_startup(&mock_engine, &mem_config);
+    ratr0_blitter_emu_reset();
+    ratr0_blitter_startup(&mock_engine);
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        struct Ratr0Surface surface = { BUFFER_WIDTH, BUFFER_HEIGHT, DEPTH, TRUE, buffer_data[i] };
+        buffers[i].surface = surface;
+        buffers[i].buffernum = i;
+        buffers[i].playfield_num = 0;
+        memset(buffer_data[i], 0, BUFFER_BYTES);
+    }
+    // 4 tiles of 16x16 with different patterns
+    memset(&sheet, 0, sizeof(struct Ratr0TileSheet));
+    sheet.header.bmdepth = DEPTH;
+    sheet.header.width = SHEET_SIZE;
+    sheet.header.height = SHEET_SIZE;
+    sheet.header.tile_width = 16;
+    sheet.header.tile_height = 16;
+    sheet.h_imgdata = ratr0_memory_allocate_block(RATR0_MEM_CHIP,
+                                                  SHEET_SIZE / 8 * SHEET_SIZE * DEPTH);
+    UINT8 *imgdata = ratr0_memory_block_address(sheet.h_imgdata);
+    for (int y = 0; y < SHEET_SIZE; y++) {
+        for (int x = 0; x < SHEET_SIZE; x++) {
+            int tile = (y / 16) * 2 + x / 16;
+            set_pixel(imgdata, SHEET_SIZE, DEPTH, x, y,
+                      (tile * 3 + (x & 15) / 3 + (y & 15) / 5 * 2) & 3);
+        }
+    }
+    srand(3);
+    for (int i = 0; i < MAP_WIDTH * MAP_HEIGHT; i++) map_tiles[i] = rand() % 4;
+}
+
+void tilemaptest_teardown(void *userdata)
+{
+    ratr0_blitter_shutdown();
+    memsys->shutdown();
+}
+
+/*
+ * Compares what the display shows of every buffer with the map: line y of
+ * the viewport is buffer line scroll_y + y, wrapped around, and the
+ * fine scroll puts buffer pixel scroll_x at the left edge.
+ */
+static BOOL check_view(struct Ratr0TileMap *map)
+{
+    UINT8 *imgdata = ratr0_memory_block_address(sheet.h_imgdata);
+    UINT16 mapx, mapy;
+    ratr0_blitter_wait_queue();
+    ratr0_tilemap_get_position(map, &mapx, &mapy);
+    if (scroll_x > BUFFER_WIDTH - VP_WIDTH || scroll_y >= BUFFER_HEIGHT) return FALSE;
+
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        for (int y = 0; y < VP_HEIGHT; y++) {
+            for (int x = 0; x < VP_WIDTH; x++) {
+                int px = (mapx + x) % (MAP_WIDTH * 16), py = (mapy + y) % (MAP_HEIGHT * 16);
+                int tile = map_tiles[(py / 16) * MAP_WIDTH + px / 16];
+                int expected = get_pixel(imgdata, SHEET_SIZE, DEPTH,
+                                         (tile % 2) * 16 + (px & 15), (tile / 2) * 16 + (py & 15));
+                int actual = get_pixel(buffer_data[i], BUFFER_WIDTH, DEPTH, scroll_x + x,
+                                       (scroll_y + y) % BUFFER_HEIGHT);
+                if (expected != actual) return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* Copies what the display shows of buffer 0 */
+static void get_view(UINT8 view[VP_HEIGHT][VP_WIDTH])
+{
+    for (int y = 0; y < VP_HEIGHT; y++) {
+        for (int x = 0; x < VP_WIDTH; x++) {
+            view[y][x] = get_pixel(buffer_data[0], BUFFER_WIDTH, DEPTH, scroll_x + x,
+                                   (scroll_y + y) % BUFFER_HEIGHT);
+        }
+    }
+}
+
+/*
+ * TEST CASES
+ */
+CHIBI_TEST(TestTileMapInit)
+{
+    struct Ratr0TileMap map;
+    chibi_assert(ratr0_tilemap_init(&map, &sheet, map_tiles, MAP_WIDTH, MAP_HEIGHT, 0));
+    chibi_assert_eq_int(5, map.view_cols);
+    chibi_assert_eq_int(3, map.view_rows);
+    chibi_assert_eq_int(6, map.ring_cols);
+    chibi_assert_eq_int(4, map.ring_rows);
+
+    buffers[0].surface.width = BUFFER_WIDTH - 16;
+    chibi_assert(!ratr0_tilemap_init(&map, &sheet, map_tiles, MAP_WIDTH, MAP_HEIGHT, 0));
+    buffers[0].surface.width = BUFFER_WIDTH;
+    sheet.header.tile_height = 8;
+    chibi_assert(!ratr0_tilemap_init(&map, &sheet, map_tiles, MAP_WIDTH, MAP_HEIGHT, 0));
+}
+
+CHIBI_TEST(TestTileMapSetPosition)
+{
+    struct Ratr0TileMap map;
+    ratr0_tilemap_init(&map, &sheet, map_tiles, MAP_WIDTH, MAP_HEIGHT, 0);
+    ratr0_tilemap_set_position(&map, 0, 0);
+    chibi_assert(check_view(&map));
+    ratr0_tilemap_set_position(&map, 37, 61);
+    chibi_assert(check_view(&map));
+}
+
+CHIBI_TEST(TestTileMapScroll)
+{
+    struct Ratr0TileMap map;
+    ratr0_tilemap_init(&map, &sheet, map_tiles, MAP_WIDTH, MAP_HEIGHT, 0);
+    ratr0_tilemap_set_position(&map, 5, 0);
+    chibi_assert(check_view(&map));
+
+    // past the map edges and around the buffer ring in all directions. The
+    // edges are drawn while the previous position is on screen and must
+    // not change it
+    INT16 moves[][2] = { { 3, 0 }, { 0, 5 }, { -7, -9 }, { 16, 16 }, { -16, 1 } };
+    UINT8 before[VP_HEIGHT][VP_WIDTH], after[VP_HEIGHT][VP_WIDTH];
+    for (int m = 0; m < 5; m++) {
+        for (int i = 0; i < 60; i++) {
+            UINT16 old_x = scroll_x, old_y = scroll_y;
+            get_view(before);
+            ratr0_tilemap_scroll(&map, moves[m][0], moves[m][1]);
+            chibi_assert(check_view(&map));
+            UINT16 new_x = scroll_x, new_y = scroll_y;
+            scroll_x = old_x;
+            scroll_y = old_y;
+            get_view(after);
+            chibi_assert(memcmp(before, after, sizeof(before)) == 0);
+            scroll_x = new_x;
+            scroll_y = new_y;
+        }
+    }
+
+    // a horizontal step of a tile only draws a column, at most twice, into
+    // every buffer
+    UINT32 num_blits = ratr0_blitter_emu_num_blits();
+    ratr0_tilemap_scroll(&map, 16, 0);
+    chibi_assert(ratr0_blitter_emu_num_blits() - num_blits <= 2 * map.view_rows * NUM_BUFFERS);
+    chibi_assert(check_view(&map));
+
+    // a jump redraws everything
+    ratr0_tilemap_scroll(&map, 200, -100);
+    chibi_assert(check_view(&map));
+}
+
+/*
+ * SUITE DEFINITION
+ */
+chibi_suite *CoreSuite(void)
+{
+    chibi_suite *suite = chibi_suite_new_fixture("ratr0.TileMapSuite", tilemaptest_setup,
+                                                 tilemaptest_teardown, NULL);
+    chibi_suite_add_test(suite, TestTileMapInit);
+    chibi_suite_add_test(suite, TestTileMapSetPosition);
+    chibi_suite_add_test(suite, TestTileMapScroll);
+
+    return suite;
+}
+
+int main(int argc, char **argv)
+{
+    chibi_summary_data summary;
+    chibi_suite *suite = CoreSuite();
+
+    chibi_suite_run(suite, &summary);
+    chibi_suite_delete(suite);
+    return summary.num_failures;
+}
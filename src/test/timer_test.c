@@ -202,6 +202,26 @@ CHIBI_TEST(TestCreateAndFreeTimers)
     chibi_assert_eq_int(-1, timer2->next);
 }
 
+CHIBI_TEST(TestFreeTimerTwice)
+{
+    struct Ratr0TimerSystem *timer_sys = ratr0_timers_startup(&mock_engine, 3);
+    Ratr0TimerHandle timer_handle1 = ratr0_timers_create(3, 0, NULL);
+    Ratr0TimerHandle timer_handle2 = ratr0_timers_create(3, 0, NULL);
+
+    ratr0_timers_free(timer_handle1);
+    ratr0_timers_free(timer_handle1);
+    ratr0_timers_free(timer_handle2);
+    ratr0_timers_free(timer_handle2);
+
+    // the freed timers are handed out once each
+    Ratr0TimerHandle timer_handle3 = ratr0_timers_create(3, 0, NULL);
+    Ratr0TimerHandle timer_handle4 = ratr0_timers_create(3, 0, NULL);
+    Ratr0TimerHandle timer_handle5 = ratr0_timers_create(3, 0, NULL);
+    chibi_assert(timer_handle3 != timer_handle4);
+    chibi_assert(timer_handle5 != timer_handle3 && timer_handle5 != timer_handle4);
+    chibi_assert(ratr0_timers_create(3, 0, NULL) == -1);
+}
+
 
 /*
  * SUITE DEFINITION
@@ -220,6 +240,7 @@ chibi_suite *CoreSuite(void)
     chibi_suite_add_test(suite, TestUpdate2TimersTimeout);
     chibi_suite_add_test(suite, TestCreateTooManyTimers);
     chibi_suite_add_test(suite, TestCreateAndFreeTimers);
+    chibi_suite_add_test(suite, TestFreeTimerTwice);
     return suite;
 }
 
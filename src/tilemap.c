@@ -0,0 +1,180 @@
+/** @file tilemap.c */
+#include <ratr0/debug_utils.h>
+#include <ratr0/display.h>
+#include <ratr0/resources.h>
+#include <ratr0/blitter.h>
+#include <ratr0/tilemap.h>
+
+#define PRINT_DEBUG(...) PRINT_DEBUG_TAG("TILEMAP", __VA_ARGS__)
+
+#define TILE_SIZE  (16)
+#define TILE_SHIFT (4)
+
+/*
+ * The view covers view_cols columns starting at the column before the one
+ * under the view's x position, which is the extra word of the early fetch,
+ * and view_rows rows. Map column c is drawn to ring column c mod ring_cols
+ * and, if that's smaller than view_cols - 1, also at the same position
+ * behind the ring, so the fetched columns are always next to each other in
+ * memory.
+ * The ring has one column and one row more than the view, the edge that is
+ * drawn in a frame is never on screen.
+ */
+
+/* Division and remainder that round towards minus infinity */
+static INT32 _floor_div(INT32 a, INT32 b)
+{
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+static INT32 _floor_mod(INT32 a, INT32 b)
+{
+    INT32 r = a % b;
+    return r < 0 ? r + b : r;
+}
+
+static INT32 _first_col(struct Ratr0TileMap *map)
+{
+    return _floor_div(map->x + TILE_SIZE - 1, TILE_SIZE) - 1;
+}
+
+static INT32 _first_row(struct Ratr0TileMap *map)
+{
+    return _floor_div(map->y, TILE_SIZE);
+}
+
+BOOL ratr0_tilemap_init(struct Ratr0TileMap *map,
+                        struct Ratr0TileSheet *tilesheet,
+                        UINT8 *tiles, UINT16 width, UINT16 height,
+                        UINT16 playfield_num)
+{
+    struct Ratr0DisplayBuffer *buffer = ratr0_display_get_buffer(playfield_num, 0);
+    UINT16 vp_width, vp_height;
+    if (!buffer) {
+        PRINT_DEBUG("ERROR: playfield %d does not exist", (int) playfield_num);
+        return FALSE;
+    }
+    if (tilesheet->header.tile_width != TILE_SIZE ||
+        tilesheet->header.tile_height != TILE_SIZE) {
+        PRINT_DEBUG("ERROR: tiles need to be 16x16");
+        return FALSE;
+    }
+    ratr0_display_get_viewport(&vp_width, &vp_height);
+    struct Ratr0Surface *surface = &buffer->surface;
+    if (surface->width < RATR0_TILEMAP_BUFFER_WIDTH(vp_width) ||
+        surface->height < RATR0_TILEMAP_BUFFER_HEIGHT(vp_height) ||
+        (surface->height & (TILE_SIZE - 1)) != 0) {
+        PRINT_DEBUG("ERROR: playfield buffers of %dx%d are too small for the tile map",
+                    (int) surface->width, (int) surface->height);
+        return FALSE;
+    }
+    map->tilesheet = tilesheet;
+    map->tiles = tiles;
+    map->width = width;
+    map->height = height;
+    map->playfield_num = playfield_num;
+    ratr0_resources_init_surface_from_tilesheet(&map->tiles_surface, tilesheet);
+
+    map->view_cols = (vp_width >> TILE_SHIFT) + 1;
+    map->view_rows = ((vp_height + TILE_SIZE - 1) >> TILE_SHIFT) + 1;
+    map->ring_cols = (surface->width >> TILE_SHIFT) - map->view_cols + 1;
+    map->ring_rows = surface->height >> TILE_SHIFT;
+    map->x = map->y = 0;
+    return TRUE;
+}
+
+/*
+ * Draws map tile (col, row) to its place in the ring of every buffer of the
+ * playfield.
+ */
+static void _draw_tile(struct Ratr0TileMap *map, INT32 col, INT32 row)
+{
+    struct Ratr0BlitDescriptor desc;
+    struct Ratr0DisplayBuffer *buffer;
+    UINT16 tiles_per_row = map->tiles_surface.width >> TILE_SHIFT;
+    UINT8 tile = map->tiles[_floor_mod(row, map->height) * map->width +
+                            _floor_mod(col, map->width)];
+    UINT16 srcx = (tile % tiles_per_row) << TILE_SHIFT;
+    UINT16 srcy = (tile / tiles_per_row) << TILE_SHIFT;
+    UINT16 ring_col = _floor_mod(col, map->ring_cols);
+    UINT16 dsty = _floor_mod(row, map->ring_rows) << TILE_SHIFT;
+
+    for (int i = 0; (buffer = ratr0_display_get_buffer(map->playfield_num, i)) != NULL; i++) {
+        ratr0_blit_prepare_rect_simple(&desc, &buffer->surface, &map->tiles_surface,
+                                       ring_col << TILE_SHIFT, dsty, srcx, srcy,
+                                       TILE_SIZE, TILE_SIZE);
+        ratr0_blit_enqueue(&desc);
+        if (ring_col < map->view_cols - 1) {
+            ratr0_blit_prepare_rect_simple(&desc, &buffer->surface, &map->tiles_surface,
+                                           (ring_col + map->ring_cols) << TILE_SHIFT, dsty,
+                                           srcx, srcy, TILE_SIZE, TILE_SIZE);
+            ratr0_blit_enqueue(&desc);
+        }
+    }
+}
+
+/* Draws the tiles of columns [col0, col1) in rows [row0, row1) */
+static void _draw_tiles(struct Ratr0TileMap *map, INT32 col0, INT32 col1,
+                        INT32 row0, INT32 row1)
+{
+    for (INT32 col = col0; col < col1; col++) {
+        for (INT32 row = row0; row < row1; row++) {
+            _draw_tile(map, col, row);
+        }
+    }
+}
+
+/* Moves the view in the playfield buffers to the view position */
+static void _update_display(struct Ratr0TileMap *map)
+{
+    // the ring column of the first fetched column starts a copy of the
+    // view, which is offset by the full rings before it
+    INT32 ring_start = _floor_div(_first_col(map), map->ring_cols) * map->ring_cols;
+    UINT16 x = map->x - ring_start * TILE_SIZE;
+    UINT16 y = _floor_mod(map->y, map->ring_rows << TILE_SHIFT);
+    ratr0_display_scroll_playfield(map->playfield_num, x, y);
+}
+
+void ratr0_tilemap_set_position(struct Ratr0TileMap *map, UINT16 x, UINT16 y)
+{
+    map->x = x;
+    map->y = y;
+    INT32 col = _first_col(map), row = _first_row(map);
+    _draw_tiles(map, col, col + map->view_cols, row, row + map->view_rows);
+    _update_display(map);
+}
+
+void ratr0_tilemap_scroll(struct Ratr0TileMap *map, INT16 dx, INT16 dy)
+{
+    INT32 old_col = _first_col(map), old_row = _first_row(map);
+    map->x += dx;
+    map->y += dy;
+    INT32 col = _first_col(map), row = _first_row(map);
+    INT32 dcol = col - old_col, drow = row - old_row;
+
+    if (dcol <= -map->view_cols || dcol >= map->view_cols ||
+        drow <= -map->view_rows || drow >= map->view_rows) {
+        _draw_tiles(map, col, col + map->view_cols, row, row + map->view_rows);
+    } else {
+        // 1. the new columns in all rows of the view
+        INT32 new_col0 = dcol > 0 ? old_col + map->view_cols : col;
+        INT32 new_col1 = dcol > 0 ? col + map->view_cols : old_col;
+        _draw_tiles(map, new_col0, new_col1, row, row + map->view_rows);
+
+        // 2. the new rows in the remaining columns
+        if (drow != 0) {
+            INT32 new_row0 = drow > 0 ? old_row + map->view_rows : row;
+            INT32 new_row1 = drow > 0 ? row + map->view_rows : old_row;
+            INT32 col0 = dcol > 0 ? col : new_col1;
+            INT32 col1 = dcol > 0 ? new_col0 : col + map->view_cols;
+            _draw_tiles(map, col0, col1, new_row0, new_row1);
+        }
+    }
+    _update_display(map);
+}
+
+void ratr0_tilemap_get_position(struct Ratr0TileMap *map, UINT16 *x, UINT16 *y)
+{
+    *x = _floor_mod(map->x, map->width << TILE_SHIFT);
+    *y = _floor_mod(map->y, map->height << TILE_SHIFT);
+}
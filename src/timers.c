@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <ratr0/debug_utils.h>
 #include <ratr0/memory.h>
+#include <ratr0/datastructs/pool.h>
 #include <ratr0/timers.h>
 
 #define PRINT_DEBUG(...) PRINT_DEBUG_TAG("TIMERS", __VA_ARGS__)
@@ -11,17 +12,13 @@ static struct Ratr0TimerSystem timer_system;
 static Ratr0Engine *engine;
 
 /* Timer pool.
- * We manage timers in a double linked list, so insertion and removal
- * are constant time operations.
+ * Timers are allocated from an object pool, a timer handle is the timer's
+ * index in the pool. We keep the used timers in a double linked list, so
+ * insertion and removal are constant time operations.
  */
-static Ratr0MemHandle h_timers;
+static struct Ratr0Pool timer_pool;
 static struct Ratr0Timer *timers;
 
-/* Timer pool management variables */
-static UINT16 max_timers;
-static UINT16 num_used_timers = 0;
-static INT16 first_free_timer = 0;
-
 // We insert timers at the front, and iterate from the first
 // timer, to keep things simple
 static INT16 first_used_timer = -1;
@@ -45,17 +42,16 @@ void ratr0_timers_update(struct Ratr0Timer *timer)
 Ratr0TimerHandle ratr0_timers_create(INT32 start_value, BOOL oneshot,
                                        void (*timeout_fun)(void))
 {
+    struct Ratr0Timer *timer = ratr0_pool_alloc(&timer_pool);
     /* can't create more */
-    if (num_used_timers == max_timers) {
+    if (!timer) {
 #ifndef TEST
-        PRINT_DEBUG("maximum number of timers (%d) exceeded !", (int) max_timers);
+        PRINT_DEBUG("maximum number of timers (%d) exceeded !", (int) timer_pool.capacity);
 #endif
         return -1;
     }
-    int next_free_timer = timers[first_free_timer].next;  // next in chain
-    int timer_idx = first_free_timer;
+    int timer_idx = ratr0_pool_index(&timer_pool, timer);
 
-    struct Ratr0Timer *timer = &timers[timer_idx];
     timer->start_value = start_value;
     timer->current_value = start_value;
     timer->oneshot = oneshot;
@@ -72,10 +68,6 @@ Ratr0TimerHandle ratr0_timers_create(INT32 start_value, BOOL oneshot,
         timers[timer_idx].prev = -1; // make sure it's initialized correctly
         first_used_timer = timer_idx;
     }
-
-    // This was a fresh timer, so just increment the free index
-    if (next_free_timer == -1) first_free_timer++;
-    num_used_timers++;
     return timer_idx;
 }
 
@@ -94,16 +86,9 @@ struct Ratr0TimerSystem *ratr0_timers_startup(Ratr0Engine *eng, UINT16 pool_size
     timer_system.shutdown = &ratr0_timers_shutdown;
 
     // Initialize the timer pool
-    max_timers = pool_size;
-    h_timers = ratr0_memory_allocate_block(RATR0_MEM_DEFAULT,
-                                           sizeof(struct Ratr0Timer) * pool_size);
-    timers = ratr0_memory_block_address(h_timers);
-    for (int i = 0; i < pool_size; i++) {
-        timers[i].running = FALSE;
-        timers[i].next = timers[i].prev = -1;
-    }
-    num_used_timers = 0;
-    first_free_timer = 0;
+    ratr0_pool_init(&timer_pool, sizeof(struct Ratr0Timer), pool_size,
+                    RATR0_MEM_DEFAULT | RATR0_MEMTAG_TIMERS);
+    timers = (struct Ratr0Timer *) timer_pool.elements;
     first_used_timer = -1;
 
 #ifndef TEST
@@ -117,9 +102,20 @@ struct Ratr0Timer *ratr0_timers_get(Ratr0TimerHandle handle)
     return &timers[handle];
 }
 
+/*
+ * A timer is in use if it is linked into the chain. Freed timers are
+ * unlinked with prev = -1, or poisoned, so they can't be freed twice.
+ */
+static BOOL _is_used(Ratr0TimerHandle handle)
+{
+    INT16 prev = timers[handle].prev;
+    if (handle == first_used_timer) return TRUE;
+    return prev >= 0 && prev < timer_pool.next_unused && timers[prev].next == handle;
+}
+
 void ratr0_timers_free(Ratr0TimerHandle handle)
 {
-    if (handle == -1 || handle >= max_timers) {
+    if (handle < 0 || handle >= timer_pool.next_unused || !_is_used(handle)) {
         PRINT_DEBUG("ERROR: trying to free invalid timer handle");
         return;
     }
@@ -128,25 +124,19 @@ void ratr0_timers_free(Ratr0TimerHandle handle)
     if (handle == first_used_timer) {
         first_used_timer = timers[handle].next;
     }
-    // put this timer at the start of the free chain
-    timers[first_free_timer].prev = handle;
-
     // unlink this timer from the chain
     if (timers[handle].prev != -1) {
         timers[timers[handle].prev].next = timers[handle].next;
     }
-
-    // now continue appending the rest of the current free timer chain
-    // to this new free timer and make it the first in the free chain
-    timers[handle].next = first_free_timer;
-    first_free_timer = handle;
-
-    // of course the number of used timers is now less
-    num_used_timers--;
+    if (timers[handle].next != -1) {
+        timers[timers[handle].next].prev = timers[handle].prev;
+    }
+    timers[handle].prev = timers[handle].next = -1;
+    ratr0_pool_free(&timer_pool, &timers[handle]);
 }
 
 void ratr0_timers_shutdown(void)
 {
-    ratr0_memory_free_block(h_timers);
+    ratr0_pool_destroy(&timer_pool);
     PRINT_DEBUG("Shutdown finished.");
 }